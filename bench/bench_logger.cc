@@ -0,0 +1,410 @@
+// gfc-logger-bench: cost of a log statement, per formatter pattern, per
+// appender and for a statement filtered out by level.
+//
+//     gfc-logger-bench [--threads N] [--calls N] [--only TEXT]
+//
+// Every scenario runs at 1, 2, 4, ... up to N threads (default: the number
+// of CPUs, at most 8), each thread making --calls calls (default 200000),
+// in two passes:
+//   - latency: every call timed on its own with steady_clock; p50, p99,
+//     p99.9 and max over all threads' calls, which include the cost of
+//     one clock read. Heap allocations per call are counted in this pass.
+//   - throughput: the same calls untimed; calls/s and bytes/s of output
+//     over the wall time, the final flush() of the appenders included.
+// --only runs the scenarios whose name contains TEXT.
+#include "../gfc-logger-system/async_appender.hh"
+#include "../gfc-logger-system/binary_log.hh"
+#include "../gfc-logger-system/flight_recorder.hh"
+#include "../gfc-logger-system/json_formatter.hh"
+#include "../gfc-logger-system/rolling_file_appender.hh"
+#include "../gfc-logger-system/segment_log.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+/* ------------ allocation counting ------------ */
+
+static thread_local bool     t_counting = false;
+static thread_local uint64_t t_allocations = 0;
+
+// counted new must pair with free(); GCC cannot tell once it inlines delete
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void* operator new(size_t size) {
+    if(t_counting) {
+        ++t_allocations;
+    }
+    if(void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+/* ------------ sinks ------------ */
+
+// Formats into a reused per-thread buffer and discards it: the cost of
+// Logger::log() and the formatter without any I/O.
+class NullAppender : public gfc::LogAppender {
+public:
+    void log(const gfc::LogEvent::ptr& event) override {
+        thread_local std::string buf;
+        buf.clear();
+        m_formatter->format(buf, *event);
+        count_events(1);
+        count_write(buf.size(), 0);
+    }
+    void log_formatted(gfc::FormattedEvent& formatted) override {
+        std::string_view text = formatted.format(m_formatter);
+        count_events(1);
+        count_write(text.size(), 0);
+    }
+};
+
+static const char* kPattern = "%d{%Y-%m-%d %H:%M:%S.%us} [%p] [%c] [%t] [%f:%l] %m%n";
+
+// Directory for files that should not touch a disk.
+static std::string tmpfs_dir() {
+    return access("/dev/shm", W_OK) == 0 ? "/dev/shm" : "/tmp";
+}
+
+static std::string temp_path(const char* name) {
+    return tmpfs_dir() + "/gfc-bench-" + std::to_string(getpid()) + "-" + name;
+}
+
+// Removes path and everything next to it named path.<suffix> (archives,
+// .prev files).
+static void remove_files(const std::string& path) {
+    std::filesystem::path p(path);
+    std::string prefix = p.filename().string();
+    std::error_code ec;
+    for(const auto& entry : std::filesystem::directory_iterator(p.parent_path(), ec)) {
+        std::string name = entry.path().filename().string();
+        if(name == prefix || name.rfind(prefix + ".", 0) == 0) {
+            std::filesystem::remove(entry.path(), ec);
+        }
+    }
+}
+
+static uint64_t file_size(const std::string& path) {
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(path, ec);
+    return ec ? 0 : size;
+}
+
+/* ------------ scenarios ------------ */
+
+// What one run logs to. The appenders are flushed after the run and their
+// written bytes summed, unless bytes is set.
+struct Setup {
+    gfc::Logger::ptr                    logger;
+    std::vector<gfc::LogAppender::ptr>  appenders;
+    std::function<uint64_t()>           bytes;
+    std::function<void()>               teardown;
+};
+
+typedef void (*CallFn)(const gfc::Logger::ptr& logger, uint64_t i);
+
+struct Scenario {
+    std::string                 name;
+    std::function<Setup()>      setup;
+    CallFn                      call;
+};
+
+static void call_text(const gfc::Logger::ptr& logger, uint64_t i) {
+    GFC_LOG_INFO(logger) << "request " << i << " served in " << 0.25 * (i & 1023) << " ms";
+}
+
+static void call_fields(const gfc::Logger::ptr& logger, uint64_t i) {
+    GFC_LOG_INFO(logger).kv("user", "user-42").kv("id", i).kv("ms", 0.25 * (i & 1023)).kv("ok", (i & 1) != 0)
+        << "request served";
+}
+
+// what a JSON line took before structured fields: built by hand, unescaped
+static void call_json_by_hand(const gfc::Logger::ptr& logger, uint64_t i) {
+    GFC_LOG_INFO(logger) << "{\"user\":\"user-42\",\"id\":" << i << ",\"ms\":" << 0.25 * (i & 1023)
+                         << ",\"ok\":" << ((i & 1) ? "true" : "false") << ",\"msg\":\"request served\"}";
+}
+
+static void call_filtered(const gfc::Logger::ptr& logger, uint64_t i) {
+    GFC_LOG_DEBUG(logger) << "request " << i << " served in " << 0.25 * (i & 1023) << " ms";
+}
+
+static void call_binary(const gfc::Logger::ptr& logger, uint64_t i) {
+    GFC_BINLOG_INFO(logger, "request {} served in {} ms", i, 0.25 * (i & 1023));
+}
+
+static Setup with_appender(gfc::LogAppender::ptr appender, const std::string& pattern = kPattern) {
+    Setup setup;
+    setup.logger = std::make_shared<gfc::Logger>("bench");
+    setup.logger->add_appender(appender);
+    appender->set_formatter(std::make_shared<gfc::LogFormatter>(pattern));
+    setup.appenders.push_back(appender);
+    return setup;
+}
+
+static Scenario formatter_scenario(const std::string& pattern, CallFn call = call_text) {
+    return {"format " + pattern, [pattern]() { return with_appender(std::make_shared<NullAppender>(), pattern); },
+            call};
+}
+
+static Scenario file_scenario(const std::string& name, const std::string& path, bool buffered) {
+    return {name, [path, buffered]() {
+        auto appender = std::make_shared<gfc::FileLogAppender>(path);
+        if(!buffered) {
+            appender->set_flush_interval(std::chrono::milliseconds(0));
+        }
+        Setup setup = with_appender(appender);
+        setup.teardown = [path]() {
+            if(path != "/dev/null") {
+                remove_files(path);
+            }
+        };
+        return setup;
+    }, call_text};
+}
+
+static std::vector<Scenario> make_scenarios() {
+    std::vector<Scenario> scenarios;
+
+    // formatters, through a sink that does no I/O
+    scenarios.push_back(formatter_scenario("%m%n"));
+    scenarios.push_back(formatter_scenario("%p %c %m%n"));
+    scenarios.push_back(formatter_scenario("%d [%p] [%c] [%t] [%f:%l] %m%n"));
+    scenarios.push_back(formatter_scenario(kPattern));
+    scenarios.push_back(formatter_scenario("%d{%Y-%m-%dT%H:%M:%S.%ns%z} %p %c %t %r %f:%l%T%m%n"));
+    scenarios.push_back(formatter_scenario("%p %m%K%n", call_fields));
+    scenarios.push_back({"format json, built with <<", []() {
+        return with_appender(std::make_shared<NullAppender>(), "%d{%Y-%m-%dT%H:%M:%S.%ms%z} %p %c %t %f:%l %m%n");
+    }, call_json_by_hand});
+    scenarios.push_back({"format JsonLogFormatter, kv fields", []() {
+        auto appender = std::make_shared<NullAppender>();
+        Setup setup = with_appender(appender);
+        appender->set_formatter(std::make_shared<gfc::JsonLogFormatter>());
+        return setup;
+    }, call_fields});
+
+    // a statement below the logger's level
+    scenarios.push_back({"filtered out by level", []() {
+        Setup setup = with_appender(std::make_shared<NullAppender>());
+        setup.logger->set_level(gfc::LogLevel::INFO);
+        return setup;
+    }, call_filtered});
+
+    // appenders
+    scenarios.push_back(file_scenario("file /dev/null", "/dev/null", true));
+    scenarios.push_back(file_scenario("file tmpfs", temp_path("file.log"), true));
+    scenarios.push_back(file_scenario("file tmpfs, unbuffered", temp_path("unbuffered.log"), false));
+    scenarios.push_back({"rolling file tmpfs, 16MB", []() {
+        std::string path = temp_path("rolling.log");
+        auto appender = std::make_shared<gfc::RollingFileLogAppender>(path, 16 << 20);
+        appender->set_compress(false);
+        appender->set_max_archives(2);
+        Setup setup = with_appender(appender);
+        setup.teardown = [path, appender]() {
+            appender->wait_for_archiving();
+            remove_files(path);
+        };
+        return setup;
+    }, call_text});
+    scenarios.push_back({"async -> file /dev/null", []() {
+        auto file = std::make_shared<gfc::FileLogAppender>("/dev/null");
+        Setup setup = with_appender(std::make_shared<gfc::AsyncLogAppender>(file));
+        setup.appenders.push_back(file);
+        setup.bytes = [file]() { return file->get_stats().bytes; };
+        return setup;
+    }, call_text});
+    scenarios.push_back({"flight recorder tmpfs", []() {
+        std::string path = temp_path("flight");
+        Setup setup = with_appender(std::make_shared<gfc::FlightRecorder>(path));
+        setup.teardown = [path]() { remove_files(path); };
+        return setup;
+    }, call_text});
+    scenarios.push_back({"segment tmpfs", []() {
+        std::string path = temp_path("segment.gseg");
+        auto appender = std::make_shared<gfc::SegmentLogAppender>(path);
+        Setup setup = with_appender(appender);
+        setup.teardown = [path, appender]() {
+            appender->close();
+            remove_files(path);
+        };
+        return setup;
+    }, call_text});
+    scenarios.push_back({"binary logger tmpfs", []() {
+        std::string path = temp_path("binary.blog");
+        Setup setup;
+        setup.logger = std::make_shared<gfc::Logger>("bench");
+        gfc::BinaryLogger::get_instance().open(path);
+        setup.bytes = [path]() {
+            gfc::BinaryLogger::get_instance().flush();
+            return file_size(path);
+        };
+        setup.teardown = [path]() {
+            gfc::BinaryLogger::get_instance().close();
+            remove_files(path);
+        };
+        return setup;
+    }, call_binary});
+    return scenarios;
+}
+
+/* ------------ runner ------------ */
+
+struct Result {
+    uint64_t    p50_ns, p99_ns, p999_ns, max_ns;
+    double      calls_per_sec;
+    double      allocs_per_call;
+    double      bytes_per_sec;
+};
+
+// Runs body(thread index) on threads threads released together; returns
+// the wall time until the last one finished.
+static double run_threads(int threads, const std::function<void(int)>& body) {
+    std::atomic<int> ready{0};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> workers;
+    for(int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            ready.fetch_add(1);
+            while(!go.load(std::memory_order_acquire)) {
+            }
+            body(t);
+        });
+    }
+    while(ready.load() != threads) {
+    }
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for(auto& worker : workers) {
+        worker.join();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static uint64_t written_bytes(const Setup& setup) {
+    for(const auto& appender : setup.appenders) {
+        appender->flush();
+    }
+    if(setup.bytes) {
+        return setup.bytes();
+    }
+    uint64_t bytes = 0;
+    for(const auto& appender : setup.appenders) {
+        bytes += appender->get_stats().bytes;
+    }
+    return bytes;
+}
+
+static Result run(const Scenario& scenario, int threads, uint64_t calls) {
+    Result result;
+    Setup setup = scenario.setup();
+    const gfc::Logger::ptr& logger = setup.logger;
+
+    // warm up the pools, per-thread buffers and call sites
+    run_threads(threads, [&](int) {
+        for(uint64_t i = 0; i < calls / 10 + 1; ++i) {
+            scenario.call(logger, i);
+        }
+    });
+
+    // latency
+    std::vector<std::vector<uint64_t>> samples(threads, std::vector<uint64_t>(calls));
+    std::vector<uint64_t> allocations(threads);
+    run_threads(threads, [&](int t) {
+        uint64_t* out = samples[t].data();
+        t_allocations = 0;
+        t_counting = true;
+        for(uint64_t i = 0; i < calls; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            scenario.call(logger, i);
+            out[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        }
+        t_counting = false;
+        allocations[t] = t_allocations;
+    });
+    std::vector<uint64_t> all;
+    all.reserve(threads * calls);
+    uint64_t total_allocations = 0;
+    for(int t = 0; t < threads; ++t) {
+        all.insert(all.end(), samples[t].begin(), samples[t].end());
+        total_allocations += allocations[t];
+    }
+    samples.clear();
+    std::sort(all.begin(), all.end());
+    auto percentile = [&](double p) { return all[std::min<size_t>(all.size() - 1, all.size() * p)]; };
+    result.p50_ns = percentile(0.50);
+    result.p99_ns = percentile(0.99);
+    result.p999_ns = percentile(0.999);
+    result.max_ns = all.back();
+    result.allocs_per_call = static_cast<double>(total_allocations) / all.size();
+
+    // throughput
+    uint64_t bytes_before = written_bytes(setup);
+    double seconds = run_threads(threads, [&](int) {
+        for(uint64_t i = 0; i < calls; ++i) {
+            scenario.call(logger, i);
+        }
+    });
+    auto flush_start = std::chrono::steady_clock::now();
+    uint64_t bytes = written_bytes(setup) - bytes_before;
+    seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - flush_start).count();
+    result.calls_per_sec = threads * calls / seconds;
+    result.bytes_per_sec = bytes / seconds;
+
+    if(setup.teardown) {
+        setup.teardown();
+    }
+    return result;
+}
+
+int main(int argc, char** argv) {
+    int max_threads = std::clamp<int>(std::thread::hardware_concurrency(), 1, 8);
+    uint64_t calls = 200000;
+    std::string only;
+    for(int i = 1; i < argc; ++i) {
+        if(!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            max_threads = std::max(1, atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--calls") && i + 1 < argc) {
+            calls = std::max(1LL, atoll(argv[++i]));
+        } else if(!strcmp(argv[i], "--only") && i + 1 < argc) {
+            only = argv[++i];
+        } else {
+            std::fprintf(stderr, "usage: %s [--threads N] [--calls N] [--only TEXT]\n", argv[0]);
+            return 2;
+        }
+    }
+    std::vector<int> thread_counts;
+    for(int n = 1; n < max_threads; n *= 2) {
+        thread_counts.push_back(n);
+    }
+    thread_counts.push_back(max_threads);
+
+    std::printf("%-60s %3s %7s %7s %7s %8s %9s %7s %8s\n", "scenario", "thr", "p50ns", "p99ns", "p99.9ns",
+                "maxns", "Mcalls/s", "alloc/c", "MB/s");
+    for(const Scenario& scenario : make_scenarios()) {
+        if(!only.empty() && scenario.name.find(only) == std::string::npos) {
+            continue;
+        }
+        for(int threads : thread_counts) {
+            Result r = run(scenario, threads, calls);
+            std::printf("%-60s %3d %7llu %7llu %7llu %8llu %9.2f %7.2f %8.1f\n", scenario.name.c_str(), threads,
+                        (unsigned long long)r.p50_ns, (unsigned long long)r.p99_ns, (unsigned long long)r.p999_ns,
+                        (unsigned long long)r.max_ns, r.calls_per_sec / 1e6, r.allocs_per_call, r.bytes_per_sec / 1e6);
+            std::fflush(stdout);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,412 @@
+#include "async_appender.hh"
+
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+
+namespace gfc {
+
+namespace {
+
+// Spill records only ever live inside this process, so the call site and
+// the (interned) logger name are kept as pointers.
+struct SpillRecordHeader {
+    uint32_t    size;           // whole record including this header
+    uint32_t    thread_id;
+    uint32_t    coroutine_id;
+    uint32_t    elapse;
+    int64_t     time_ns;
+    uintptr_t   site;           // static or interned LogSite
+    uintptr_t   logger_name;    // interned, lives as long as the process
+    uint32_t    content_len;
+    uint32_t    field_count;    // LogFields after the content
+    uint32_t    field_text_len; // then their text
+};
+
+void encode_spill_record(std::string& out, const LogEvent::ptr& event) {
+    const std::string& content = event->get_content();
+    std::span<const LogField> fields = event->get_fields();
+    const std::string& field_text = event->get_field_text();
+    SpillRecordHeader header;
+    header.size             = sizeof(header) + content.size() + fields.size_bytes() + field_text.size();
+    header.thread_id        = event->get_thread_id();
+    header.coroutine_id     = event->get_coroutine_id();
+    header.elapse           = event->get_elapse();
+    header.time_ns          = event->get_time_ns();
+    header.site             = reinterpret_cast<uintptr_t>(&event->get_site());
+    header.logger_name      = reinterpret_cast<uintptr_t>(&event->get_logger_name());
+    header.content_len      = content.size();
+    header.field_count      = fields.size();
+    header.field_text_len   = field_text.size();
+    out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.append(content);
+    out.append(reinterpret_cast<const char*>(fields.data()), fields.size_bytes());
+    out.append(field_text);
+}
+
+// Returns the record size, or 0 if [data, data + len) holds no complete record.
+size_t decode_spill_record(const char* data, size_t len, LogEvent::ptr& event) {
+    SpillRecordHeader header;
+    if(len < sizeof(header)) {
+        return 0;
+    }
+    memcpy(&header, data, sizeof(header));
+    if(len < header.size) {
+        return 0;
+    }
+    const char* p = data + sizeof(header);
+    event = LogEvent::create(
+        *reinterpret_cast<const LogSite*>(header.site),
+        header.thread_id, header.coroutine_id, header.elapse,
+        std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::nanoseconds(header.time_ns))),
+        *reinterpret_cast<const std::string*>(header.logger_name));
+    event->set_content(std::string_view(p, header.content_len));
+    p += header.content_len;
+    if(header.field_count > 0) {
+        // the record is not necessarily aligned for LogField
+        std::vector<LogField> fields(header.field_count);
+        memcpy(fields.data(), p, header.field_count * sizeof(LogField));
+        p += header.field_count * sizeof(LogField);
+        event->set_fields(fields, std::string_view(p, header.field_text_len));
+    }
+    return header.size;
+}
+
+bool write_all(int fd, const char* data, size_t len, uint64_t offset) {
+    while(len > 0) {
+        ssize_t n = pwrite(fd, data, len, offset);
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        len -= n;
+        offset += n;
+    }
+    return true;
+}
+
+} // namespace
+
+AsyncLogAppender::AsyncLogAppender(LogAppender::ptr appender, size_t capacity, OverflowPolicy policy)
+    : m_appender(appender), m_queue(capacity), m_policy(policy) {
+    m_formatter = m_appender->get_formatter();
+    m_level.store(m_appender->get_level(), std::memory_order_relaxed);
+    m_thread = std::thread(&AsyncLogAppender::run, this);
+}
+
+AsyncLogAppender::~AsyncLogAppender() {
+    stop();
+    if(m_spill_fd >= 0) {
+        close(m_spill_fd);
+    }
+}
+
+void AsyncLogAppender::set_formatter(LogFormatter::ptr formatter) {
+    LogAppender::set_formatter(formatter);
+    m_appender->set_formatter(formatter);
+}
+
+void AsyncLogAppender::set_level(LogLevel level) {
+    LogAppender::set_level(level);
+    m_appender->set_level(level);
+}
+
+AppenderStats AsyncLogAppender::get_stats() const {
+    AppenderStats stats = LogAppender::get_stats();
+    stats.dropped = get_dropped_count();
+    uint64_t replayed = get_replayed_count();
+    uint64_t spilled = get_spilled_count();
+    stats.queue_depth = m_queue.size_approx() + (spilled > replayed ? spilled - replayed : 0);
+    return stats;
+}
+
+void AsyncLogAppender::log(const LogEvent::ptr& event) {
+    count_events(1);
+    if(m_stop.load(std::memory_order_acquire)) {
+        // the writer is going away: let it drain, then fall back to the
+        // caller's thread
+        m_joined.wait(false, std::memory_order_acquire);
+        m_appender->log(event);
+        return;
+    }
+    if(m_spilling.load(std::memory_order_acquire) && spill(event)) {
+        wake(false);
+        drain_if_stopped();
+        return;
+    }
+    LogEvent::ptr queued = event;
+    if(m_queue.try_push(std::move(queued))) {
+        wake(false);
+        drain_if_stopped();
+        return;
+    }
+
+    // queue full
+    bool accepted = false;
+    switch(m_policy) {
+        case OverflowPolicy::BLOCK:
+            accepted = push_blocking(queued, std::chrono::milliseconds(
+                m_block_timeout_ms.load(std::memory_order_relaxed)));
+            break;
+        case OverflowPolicy::DROP_NEWEST:
+            break;
+        case OverflowPolicy::DROP_BELOW_LEVEL:
+            if(event->get_level() >= m_drop_level.load(std::memory_order_relaxed) ||
+               event->get_level() >= LogLevel::ERROR) {
+                accepted = push_blocking(queued, std::chrono::milliseconds(0));
+            }
+            break;
+        case OverflowPolicy::SPILL:
+            accepted = spill(event);
+            break;
+    }
+    if(!accepted) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    wake(true);
+    if(accepted) {
+        drain_if_stopped();
+    }
+}
+
+bool AsyncLogAppender::push_blocking(LogEvent::ptr& event, std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    for(int spins = 0; !m_queue.try_push(std::move(event)); ++spins) {
+        // make sure the writer is running and wait for a free cell
+        wake(true);
+        if(spins < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        if(timeout.count() > 0 && std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool AsyncLogAppender::spill(const LogEvent::ptr& event) {
+    thread_local std::string record;
+    record.clear();
+    encode_spill_record(record, event);
+
+    std::lock_guard<std::mutex> lock(m_spill_mutex);
+    if(m_spill_fd < 0) {
+        std::string path = m_spill_dir + "/gfc-log-spill-XXXXXX";
+        m_spill_fd = mkstemp(&path[0]);
+        if(m_spill_fd < 0) {
+            std::cout << "[ERROR] AsyncLogAppender::spill() cannot create spill file in " << m_spill_dir << std::endl;
+            return false;
+        }
+        unlink(path.c_str());   // gone as soon as we close it or crash
+    }
+    if(!write_all(m_spill_fd, record.data(), record.size(), m_spill_write)) {
+        return false;
+    }
+    m_spill_write += record.size();
+    m_spilling.store(true, std::memory_order_seq_cst);
+    m_spilled.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+// Writer thread: replays one chunk of the spill file, and turns spilling off
+// once the file has been consumed completely.
+void AsyncLogAppender::replay_spill() {
+    uint64_t end;
+    {
+        std::lock_guard<std::mutex> lock(m_spill_mutex);
+        end = m_spill_write;
+        if(m_spill_read == end) {
+            m_spill_read = m_spill_write = 0;
+            if(ftruncate(m_spill_fd, 0) != 0) {
+                // keep appending past the old data, it is never read again
+                m_spill_read = m_spill_write = lseek(m_spill_fd, 0, SEEK_END);
+            }
+            m_spilling.store(false, std::memory_order_release);
+            return;
+        }
+    }
+
+    const size_t kChunk = 64 * 1024;
+    size_t want = std::min<uint64_t>(end - m_spill_read, kChunk);
+    SpillRecordHeader header;
+    if(pread(m_spill_fd, &header, sizeof(header), m_spill_read) == sizeof(header) && header.size > want) {
+        want = header.size;     // single record larger than a chunk
+    }
+    m_spill_buf.resize(want);
+    ssize_t n = pread(m_spill_fd, &m_spill_buf[0], want, m_spill_read);
+    if(n <= 0) {
+        std::cout << "[ERROR] AsyncLogAppender::replay_spill() read failed, dropping spilled events" << std::endl;
+        std::lock_guard<std::mutex> lock(m_spill_mutex);
+        m_spill_read = m_spill_write;
+        return;
+    }
+
+    size_t offset = 0;
+    LogEvent::ptr event;
+    while(size_t used = decode_spill_record(m_spill_buf.data() + offset, n - offset, event)) {
+        m_batch.push_back(std::move(event));
+        offset += used;
+    }
+    if(offset == 0) {
+        // nothing decodes from here on, so m_spill_read would never move
+        std::cout << "[ERROR] AsyncLogAppender::replay_spill() corrupt spill record, dropping spilled events" << std::endl;
+        std::lock_guard<std::mutex> lock(m_spill_mutex);
+        m_spill_read = m_spill_write;
+        return;
+    }
+    m_appender->log_batch(m_batch);
+    m_replayed.fetch_add(m_batch.size(), std::memory_order_relaxed);
+    m_batch.clear();
+    m_spill_read += offset;
+}
+
+void AsyncLogAppender::flush() {
+    count_flush();
+    if(m_stop.load(std::memory_order_acquire)) {
+        m_joined.wait(false, std::memory_order_acquire);
+        m_appender->flush();
+        return;
+    }
+    // only what was spilled before the call; producers may keep spilling
+    uint64_t spilled = m_spilled.load(std::memory_order_acquire);
+    while(m_replayed.load(std::memory_order_acquire) < spilled && m_spilling.load(std::memory_order_acquire)) {
+        wake(true);
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    size_t target = m_queue.push_count();
+    size_t request = m_flush_request.load(std::memory_order_relaxed);
+    while(request < target &&
+          !m_flush_request.compare_exchange_weak(request, target, std::memory_order_release)) {}
+    wake(true);
+
+    size_t done = m_flushed.load(std::memory_order_acquire);
+    while(done < target) {
+        m_flushed.wait(done, std::memory_order_acquire);
+        done = m_flushed.load(std::memory_order_acquire);
+    }
+}
+
+void AsyncLogAppender::stop() {
+    std::unique_lock<std::mutex> lock(m_stop_mutex);
+    if(!m_thread.joinable()) {
+        return;
+    }
+    m_stop.store(true, std::memory_order_release);
+    wake(true);
+    m_thread.join();
+    m_joined.store(true, std::memory_order_seq_cst);
+    m_joined.notify_all();
+    lock.unlock();
+    // a producer that saw m_stop unset may have queued or spilled after the
+    // writer's last look
+    drain_stopped();
+}
+
+void AsyncLogAppender::drain_if_stopped() {
+    // The caller's push (a seq_cst CAS on the tail) or spill (a seq_cst
+    // store to m_spilling) comes before this seq_cst load, and stop()
+    // stores m_joined before it looks at both: either stop() drains the
+    // event, or we do.
+    if(m_joined.load(std::memory_order_seq_cst)) {
+        drain_stopped();
+    }
+}
+
+void AsyncLogAppender::drain_stopped() {
+    std::lock_guard<std::mutex> lock(m_stop_mutex);
+    LogEvent::ptr event;
+    for(;;) {
+        // a reserved cell may not be filled in yet
+        while(m_queue.size_approx() > 0) {
+            if(m_queue.try_pop(event)) {
+                m_appender->log(event);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        if(!m_spilling.load(std::memory_order_seq_cst)) {
+            break;
+        }
+        replay_spill();
+    }
+}
+
+void AsyncLogAppender::wake(bool force) {
+    // Our push or spill and this load are seq_cst, as are run()'s store to
+    // m_sleeping and its checks after it: either we see the writer parked,
+    // or it sees the event before parking. No fence, so ThreadSanitizer
+    // can follow it.
+    if(force || m_sleeping.load(std::memory_order_seq_cst)) {
+        m_wakeups.fetch_add(1, std::memory_order_release);
+        m_wakeups.notify_one();
+    }
+}
+
+void AsyncLogAppender::serve_flush() {
+    size_t popped = m_queue.pop_count();
+    if(m_flush_request.load(std::memory_order_acquire) > m_flushed.load(std::memory_order_relaxed) &&
+       m_flush_request.load(std::memory_order_acquire) <= popped) {
+        m_appender->flush();
+        m_flushed.store(popped, std::memory_order_release);
+        m_flushed.notify_all();
+    }
+}
+
+void AsyncLogAppender::run() {
+    LogEvent::ptr event;
+    for(;;) {
+        while(m_queue.try_pop(event)) {
+            // hand over whatever has piled up in one go
+            m_batch.push_back(std::move(event));
+            while(m_batch.size() < kMaxBatch && m_queue.try_pop(event)) {
+                m_batch.push_back(std::move(event));
+            }
+            m_appender->log_batch(m_batch);
+            m_batch.clear();
+            // under sustained load the queue may never run empty, so serve
+            // pending flush() callers as soon as their events are written
+            serve_flush();
+        }
+
+        if(m_spilling.load(std::memory_order_acquire)) {
+            replay_spill();
+            // nor may the spill file
+            serve_flush();
+            continue;
+        }
+
+        // queue is empty: flush only for a pending flush() and leave the
+        // timing of writes to the wrapped appender, e.g. FileLogAppender's
+        // flush interval
+        size_t popped = m_queue.pop_count();
+        if(m_flush_request.load(std::memory_order_acquire) > m_flushed.load(std::memory_order_relaxed)) {
+            m_appender->flush();
+            m_flushed.store(popped, std::memory_order_release);
+            m_flushed.notify_all();
+        }
+
+        if(m_stop.load(std::memory_order_acquire) && m_queue.size_approx() == 0 &&
+           !m_spilling.load(std::memory_order_acquire)) {
+            m_appender->flush();
+            break;
+        }
+
+        uint32_t ticket = m_wakeups.load(std::memory_order_acquire);
+        m_sleeping.store(true, std::memory_order_seq_cst);
+        if(m_queue.size_approx() == 0 && !m_stop.load(std::memory_order_acquire) &&
+           !m_spilling.load(std::memory_order_seq_cst) &&
+           m_flush_request.load(std::memory_order_acquire) <= m_flushed.load(std::memory_order_relaxed)) {
+            m_wakeups.wait(ticket, std::memory_order_acquire);
+        }
+        m_sleeping.store(false, std::memory_order_relaxed);
+    }
+}
+
+} // namespace gfc
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "logger.hh"
+#include "mpsc_queue.hh"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gfc {
+
+// What AsyncLogAppender::log() does when the queue is full.
+enum class OverflowPolicy {
+    BLOCK,              // wait for a free slot, give up (and drop) after the block timeout
+    DROP_NEWEST,        // drop the incoming event
+    DROP_BELOW_LEVEL,   // drop incoming events below the drop level, block for the rest
+    SPILL               // append overflow to a temporary file, replayed when the writer catches up
+};
+
+/* ------------ AsyncLogAppender ------------ */
+
+// Decorator that takes the wrapped appender off the caller's thread:
+// log() only pushes the event into a bounded lock-free queue, and a dedicated
+// writer thread hands whatever has queued up to the wrapped appender's
+// log_batch(). The queue is drained on stop() and on destruction, so
+// nothing accepted by log() is lost on a clean shutdown.
+// A full queue is handled according to the OverflowPolicy; every event the
+// policy gives up on is counted in get_dropped_count().
+class AsyncLogAppender : public LogAppender {
+public:
+    typedef std::shared_ptr<AsyncLogAppender> ptr;
+
+public:
+    AsyncLogAppender(LogAppender::ptr appender, size_t capacity = 8192,
+                     OverflowPolicy policy = OverflowPolicy::BLOCK);
+    ~AsyncLogAppender();
+
+    virtual void log(const LogEvent::ptr& event) override;
+    // Blocks until every event queued before the call has been written and
+    // the wrapped appender has been flushed.
+    virtual void flush() override;
+    virtual void set_formatter(LogFormatter::ptr formatter) override;
+    // Also sets the wrapped appender's level, so events are filtered before
+    // they are queued.
+    virtual void set_level(LogLevel level) override;
+    // events, flushes, dropped and queue depth (queued plus spilled) of the
+    // wrapper; the wrapped appender reports its writes itself
+    virtual AppenderStats get_stats() const override;
+
+    void                stop();
+    LogAppender::ptr    get_appender() const { return m_appender; }
+    size_t              get_queue_size() const { return m_queue.size_approx(); }
+
+    OverflowPolicy      get_overflow_policy() const { return m_policy; }
+    // 0 blocks forever (BLOCK policy only)
+    void                set_block_timeout(std::chrono::milliseconds timeout) {
+        m_block_timeout_ms.store(timeout.count(), std::memory_order_relaxed);
+    }
+    // DROP_BELOW_LEVEL: events below this level may be dropped; ERROR and
+    // FATAL are never dropped whatever the setting.
+    void                set_drop_level(LogLevel level) { m_drop_level.store(level, std::memory_order_relaxed); }
+    // SPILL: directory for the (already unlinked) overflow file, default /tmp
+    void                set_spill_dir(const std::string& dir) {
+        std::lock_guard<std::mutex> lock(m_spill_mutex);
+        m_spill_dir = dir;
+    }
+
+    uint64_t            get_dropped_count()  const { return m_dropped.load(std::memory_order_relaxed); }
+    uint64_t            get_spilled_count()  const { return m_spilled.load(std::memory_order_relaxed); }
+    uint64_t            get_replayed_count() const { return m_replayed.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr size_t kMaxBatch = 256;   // events per log_batch() call on the wrapped appender
+
+    void run();
+    // writer thread: flushes the wrapped appender once a flush() caller's events are written
+    void serve_flush();
+    void wake(bool force);
+    bool push_blocking(LogEvent::ptr& event, std::chrono::milliseconds timeout);
+    bool spill(const LogEvent::ptr& event);
+    void replay_spill();
+    // After stop(): writes what raced past it into the queue or the spill
+    // file, on the caller's thread.
+    void drain_if_stopped();
+    void drain_stopped();
+
+private:
+    LogAppender::ptr            m_appender;             // wrapped sink, only touched by the writer thread until stop()
+    MPSCQueue<LogEvent::ptr>    m_queue;                // pending events
+    std::thread                 m_thread;               // writer thread
+    std::atomic<bool>           m_stop{false};
+    std::atomic<bool>           m_joined{false};        // the writer has exited and been joined
+    std::mutex                  m_stop_mutex;           // serialises stop() and drain_stopped()
+    std::atomic<bool>           m_sleeping{false};      // writer is (about to be) parked
+    std::atomic<uint32_t>       m_wakeups{0};           // futex word the writer parks on
+    std::atomic<size_t>         m_flush_request{0};     // push count some flush() caller waits for
+    std::atomic<size_t>         m_flushed{0};           // pop count at the last wrapped flush
+
+    OverflowPolicy              m_policy;
+    std::atomic<int64_t>        m_block_timeout_ms{0};
+    std::atomic<LogLevel>       m_drop_level{LogLevel::WARN};
+    std::atomic<uint64_t>       m_dropped{0};
+    std::atomic<uint64_t>       m_spilled{0};
+    std::atomic<uint64_t>       m_replayed{0};
+
+    // SPILL state: while m_spilling is set every producer appends to the
+    // spill file so that per-thread order is kept until it is replayed.
+    std::atomic<bool>           m_spilling{false};
+    std::mutex                  m_spill_mutex;
+    std::string                 m_spill_dir = "/tmp";
+    int                         m_spill_fd = -1;
+    uint64_t                    m_spill_write = 0;      // guarded by m_spill_mutex
+    uint64_t                    m_spill_read = 0;       // writer thread, m_stop_mutex once joined
+    std::string                 m_spill_buf;            // as m_spill_read
+    std::vector<LogEvent::ptr>  m_batch;                // as m_spill_read
+};
+
+} // namespace gfc
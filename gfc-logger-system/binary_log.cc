@@ -0,0 +1,504 @@
+#include "binary_log.hh"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace gfc {
+
+namespace {
+
+// File layout: a 16 byte header, then entries of
+//     u8 tag, u32 body length, body
+// Dictionary entries always precede the first event that refers to them.
+const char      kMagic[8] = {'G', 'F', 'C', 'B', 'L', 'O', 'G', '\0'};
+const uint32_t  kVersion = 1;
+
+enum class EntryTag : uint8_t {
+    SITE    = 1,    // u32 id, u8 level, i32 line, str file, str function, str format, u8 count, u8 types[count]
+    LOGGER  = 2,    // u32 id, str name
+    EVENT   = 3     // u32 site id, u32 logger id, i64 time_ns, u32 thread id, arguments
+};
+
+template<typename T>
+void put(std::string& out, T v) {
+    out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+void put_string(std::string& out, std::string_view s) {
+    put<uint32_t>(out, s.size());
+    out.append(s.data(), s.size());
+}
+
+// Appends the entry header; the body length is patched by end_entry().
+size_t begin_entry(std::string& out, EntryTag tag) {
+    put(out, tag);
+    put<uint32_t>(out, 0);
+    return out.size();
+}
+
+void end_entry(std::string& out, size_t body) {
+    uint32_t len = out.size() - body;
+    memcpy(&out[body - sizeof(len)], &len, sizeof(len));
+}
+
+// Bounds-checked reads from an entry body.
+struct Cursor {
+    const char* p;
+    const char* end;
+    bool        ok = true;
+
+    template<typename T>
+    T get() {
+        T v{};
+        if(end - p < static_cast<ptrdiff_t>(sizeof(T))) {
+            ok = false;
+            return v;
+        }
+        memcpy(&v, p, sizeof(T));
+        p += sizeof(T);
+        return v;
+    }
+    std::string_view get_bytes(size_t len) {
+        if(static_cast<size_t>(end - p) < len) {
+            ok = false;
+            return std::string_view();
+        }
+        std::string_view s(p, len);
+        p += len;
+        return s;
+    }
+    std::string_view get_string() { return get_bytes(get<uint32_t>()); }
+};
+
+} // namespace
+
+/* ------------ BinaryLogger ------------ */
+
+struct BinaryLogger::Site {
+    const LogSite*              site;       // static in the call site
+    std::string_view            format;     // points at the call site's literal
+    std::vector<BinaryArgType>  types;
+};
+
+// Single-producer single-consumer byte ring owned by one logging thread.
+// Records are contiguous; a record that does not fit before the end of the
+// ring starts over at offset 0, leaving a size-0 marker (or fewer than four
+// bytes) behind.
+struct BinaryLogger::ThreadBuffer {
+    explicit ThreadBuffer(size_t size) : data(new char[size]), capacity(size) {}
+
+    std::unique_ptr<char[]>     data;
+    size_t                      capacity;               // power of 2
+    alignas(64) std::atomic<size_t> head{0};            // bytes committed, producer only
+    alignas(64) std::atomic<size_t> tail{0};            // bytes consumed, writer only
+    std::atomic<bool>           retired{false};         // owning thread has exited
+};
+
+BinaryLogger& BinaryLogger::get_instance() {
+    static BinaryLogger instance;
+    return instance;
+}
+
+BinaryLogger::~BinaryLogger() {
+    close();
+    for(ThreadBuffer* buffer : m_buffers) {
+        delete buffer;
+    }
+}
+
+bool BinaryLogger::open(const std::string& path, size_t thread_buffer_size) {
+    if(is_open()) {
+        std::cout << "[ERROR] BinaryLogger::open() already writing, close() first" << std::endl;
+        return false;
+    }
+    m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(m_fd < 0) {
+        std::cout << "[ERROR] BinaryLogger::open() cannot open " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    size_t size = 4096;
+    while(size < thread_buffer_size) {
+        size <<= 1;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_buffer_size = size;
+        // leftovers of a previous file belong to that file
+        for(ThreadBuffer* buffer : m_buffers) {
+            buffer->tail.store(buffer->head.load(std::memory_order_acquire), std::memory_order_release);
+        }
+    }
+    m_sites_written = 0;
+    m_logger_ids.clear();
+    m_out.assign(kMagic, sizeof(kMagic));
+    put(m_out, kVersion);
+    put<uint32_t>(m_out, 0);
+
+    m_stop.store(false, std::memory_order_relaxed);
+    m_thread = std::thread(&BinaryLogger::run, this);
+    m_open.store(true, std::memory_order_release);
+    return true;
+}
+
+void BinaryLogger::close() {
+    if(!m_thread.joinable()) {
+        return;
+    }
+    m_open.store(false, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop.store(true, std::memory_order_release);
+    }
+    m_wake_cv.notify_one();
+    m_thread.join();
+    ::close(m_fd);
+    m_fd = -1;
+}
+
+void BinaryLogger::flush() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if(!m_thread.joinable()) {
+        return;
+    }
+    uint64_t ticket = ++m_flush_request;
+    m_wake_cv.notify_one();
+    m_flushed_cv.wait(lock, [&]() { return m_flush_done >= ticket; });
+}
+
+uint32_t BinaryLogger::register_site(std::atomic<uint32_t>& site_id_slot, const LogSite& site,
+                                     std::string_view fmt, const BinaryArgType* types, size_t count) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint32_t id = site_id_slot.load(std::memory_order_relaxed);
+    if(id != 0) {
+        return id;  // another thread got here first
+    }
+    m_sites.push_back(Site{&site, fmt, std::vector<BinaryArgType>(types, types + count)});
+    id = m_sites.size();
+    site_id_slot.store(id, std::memory_order_release);
+    return id;
+}
+
+BinaryLogger::ThreadBuffer* BinaryLogger::local_buffer() {
+    struct LocalBuffer {
+        ThreadBuffer* buffer = nullptr;
+        ~LocalBuffer() {
+            if(buffer) {
+                buffer->retired.store(true, std::memory_order_release);
+            }
+        }
+    };
+    thread_local LocalBuffer local;
+    if(!local.buffer) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        local.buffer = new ThreadBuffer(m_buffer_size);
+        m_buffers.push_back(local.buffer);
+    }
+    return local.buffer;
+}
+
+void BinaryLogger::commit(const char* data, size_t len) {
+    ThreadBuffer* buffer = local_buffer();
+    if(len > buffer->capacity / 2) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    size_t mask = buffer->capacity - 1;
+    size_t head = buffer->head.load(std::memory_order_relaxed);
+    size_t pos = head & mask;
+    size_t skip = pos + len > buffer->capacity ? buffer->capacity - pos : 0;
+
+    // wait for the writer to make room
+    while(head + skip + len - buffer->tail.load(std::memory_order_acquire) > buffer->capacity) {
+        if(!is_open()) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        std::this_thread::yield();
+    }
+    if(skip >= sizeof(uint32_t)) {
+        uint32_t wrap = 0;
+        memcpy(buffer->data.get() + pos, &wrap, sizeof(wrap));
+    }
+    memcpy(buffer->data.get() + ((head + skip) & mask), data, len);
+    buffer->head.store(head + skip + len, std::memory_order_release);
+}
+
+// Writer thread: moves the committed records of one buffer to m_out,
+// preceded by any dictionary entries they need. Returns false if the buffer
+// was empty.
+bool BinaryLogger::drain(ThreadBuffer& buffer) {
+    size_t head = buffer.head.load(std::memory_order_acquire);
+    size_t tail = buffer.tail.load(std::memory_order_relaxed);
+    if(tail == head) {
+        return false;
+    }
+    size_t mask = buffer.capacity - 1;
+    while(tail != head) {
+        size_t pos = tail & mask;
+        size_t room = buffer.capacity - pos;
+        uint32_t size = 0;
+        if(room >= sizeof(size)) {
+            memcpy(&size, buffer.data.get() + pos, sizeof(size));
+        }
+        if(size == 0) {
+            tail += room;
+            continue;
+        }
+        RecordHeader header;
+        memcpy(&header, buffer.data.get() + pos, sizeof(header));
+
+        if(header.site_id > m_sites_written) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for(; m_sites_written < m_sites.size(); ++m_sites_written) {
+                const Site& site = m_sites[m_sites_written];
+                size_t body = begin_entry(m_out, EntryTag::SITE);
+                put<uint32_t>(m_out, m_sites_written + 1);
+                put<uint8_t>(m_out, static_cast<uint8_t>(site.site->level));
+                put<int32_t>(m_out, site.site->line);
+                put_string(m_out, site.site->file);
+                put_string(m_out, site.site->function);
+                put_string(m_out, site.format);
+                put<uint8_t>(m_out, site.types.size());
+                m_out.append(reinterpret_cast<const char*>(site.types.data()), site.types.size());
+                end_entry(m_out, body);
+            }
+        }
+        auto it = m_logger_ids.find(header.logger_name);
+        if(it == m_logger_ids.end()) {
+            it = m_logger_ids.emplace(header.logger_name, m_logger_ids.size() + 1).first;
+            size_t body = begin_entry(m_out, EntryTag::LOGGER);
+            put<uint32_t>(m_out, it->second);
+            put_string(m_out, *header.logger_name);
+            end_entry(m_out, body);
+        }
+
+        size_t body = begin_entry(m_out, EntryTag::EVENT);
+        put<uint32_t>(m_out, header.site_id);
+        put<uint32_t>(m_out, it->second);
+        put<int64_t>(m_out, LogClock::to_ns(header.time_ticks));
+        put<uint32_t>(m_out, header.thread_id);
+        m_out.append(buffer.data.get() + pos + sizeof(header), size - sizeof(header));
+        end_entry(m_out, body);
+        tail += size;
+    }
+    buffer.tail.store(tail, std::memory_order_release);
+    return true;
+}
+
+void BinaryLogger::write_out() {
+    const char* data = m_out.data();
+    size_t len = m_out.size();
+    while(len > 0) {
+        ssize_t n = ::write(m_fd, data, len);
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            std::cout << "[ERROR] BinaryLogger::write_out() write failed: " << strerror(errno) << std::endl;
+            break;
+        }
+        data += n;
+        len -= n;
+    }
+    m_out.clear();
+}
+
+void BinaryLogger::run() {
+    std::vector<ThreadBuffer*> buffers;
+    for(;;) {
+        uint64_t request;
+        bool stop;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            request = m_flush_request;
+            stop = m_stop.load(std::memory_order_relaxed);
+            buffers = m_buffers;
+        }
+        bool busy = false;
+        for(ThreadBuffer* buffer : buffers) {
+            busy |= drain(*buffer);
+        }
+        write_out();
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if(request > m_flush_done) {
+                m_flush_done = request;
+                m_flushed_cv.notify_all();
+            }
+            // buffers of exited threads go away once they are empty
+            for(auto it = m_buffers.begin(); it != m_buffers.end();) {
+                ThreadBuffer* buffer = *it;
+                if(buffer->retired.load(std::memory_order_acquire) &&
+                   buffer->head.load(std::memory_order_acquire) == buffer->tail.load(std::memory_order_relaxed)) {
+                    delete buffer;
+                    it = m_buffers.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            if(stop && !busy) {
+                break;
+            }
+            if(!busy) {
+                // records are polled: producers never have to wake the writer
+                m_wake_cv.wait_for(lock, std::chrono::milliseconds(1), [&]() {
+                    return m_flush_request > m_flush_done || m_stop.load(std::memory_order_relaxed);
+                });
+            }
+        }
+    }
+}
+
+/* ------------ BinaryLogReader ------------ */
+
+bool BinaryLogReader::open(const std::string& path) {
+    m_in.open(path, std::ios::binary);
+    if(!m_in) {
+        std::cout << "[ERROR] BinaryLogReader::open() cannot open " << path << std::endl;
+        return false;
+    }
+    m_in.seekg(0, std::ios::end);
+    m_size = m_in.tellg();
+    m_in.seekg(0);
+    char header[16];
+    if(!m_in.read(header, sizeof(header)) || memcmp(header, kMagic, sizeof(kMagic)) != 0) {
+        std::cout << "[ERROR] BinaryLogReader::open() " << path << " is not a binary log" << std::endl;
+        return false;
+    }
+    uint32_t version;
+    memcpy(&version, header + sizeof(kMagic), sizeof(version));
+    if(version != kVersion) {
+        std::cout << "[ERROR] BinaryLogReader::open() unsupported version " << version << std::endl;
+        return false;
+    }
+    m_pos = sizeof(header);
+    return true;
+}
+
+bool BinaryLogReader::next(LogEvent::ptr& event) {
+    for(;;) {
+        char entry[5];
+        if(!m_in.read(entry, sizeof(entry))) {
+            // a clean end of file, or a record cut short by a crash
+            m_corrupt = m_in.gcount() != 0;
+            return false;
+        }
+        EntryTag tag = static_cast<EntryTag>(entry[0]);
+        uint32_t len;
+        memcpy(&len, entry + 1, sizeof(len));
+        m_pos += sizeof(entry);
+        // a garbage length must not size the buffer past what the file holds
+        if(len > m_size - m_pos) {
+            m_corrupt = true;
+            return false;
+        }
+        m_pos += len;
+        m_body.resize(len);
+        if(!m_in.read(&m_body[0], len)) {
+            m_corrupt = true;
+            return false;
+        }
+
+        Cursor in{m_body.data(), m_body.data() + m_body.size()};
+        if(tag == EntryTag::SITE) {
+            uint32_t id = in.get<uint32_t>();
+            auto site = std::make_unique<Site>();
+            LogLevel level          = static_cast<LogLevel>(in.get<uint8_t>());
+            int32_t line            = in.get<int32_t>();
+            const char* file        = intern_site_string(in.get_string());
+            const char* function    = intern_site_string(in.get_string());
+            site->site      = &intern_log_site(file, line, function, level);
+            site->format    = in.get_string();
+            std::string_view types = in.get_bytes(in.get<uint8_t>());
+            for(char t : types) {
+                site->types.push_back(static_cast<BinaryArgType>(t));
+            }
+            // ids are handed out in order, so one can only reuse a slot or add the next
+            if(!in.ok || id == 0 || id > m_sites.size() + 1) {
+                m_corrupt = true;
+                return false;
+            }
+            if(m_sites.size() < id) {
+                m_sites.resize(id);
+            }
+            m_sites[id - 1] = std::move(site);
+        } else if(tag == EntryTag::LOGGER) {
+            uint32_t id = in.get<uint32_t>();
+            std::string_view name = in.get_string();
+            if(!in.ok || id == 0 || id > m_logger_names.size() + 1) {
+                m_corrupt = true;
+                return false;
+            }
+            if(m_logger_names.size() < id) {
+                m_logger_names.resize(id, nullptr);
+            }
+            m_logger_names[id - 1] = &intern_logger_name(std::string(name));
+        } else if(tag == EntryTag::EVENT) {
+            uint32_t site_id    = in.get<uint32_t>();
+            uint32_t logger_id  = in.get<uint32_t>();
+            int64_t  time_ns    = in.get<int64_t>();
+            uint32_t thread_id  = in.get<uint32_t>();
+            if(!in.ok || site_id == 0 || site_id > m_sites.size() || !m_sites[site_id - 1] ||
+               logger_id == 0 || logger_id > m_logger_names.size() || !m_logger_names[logger_id - 1]) {
+                m_corrupt = true;
+                return false;
+            }
+            const Site& site = *m_sites[site_id - 1];
+            event = LogEvent::create(*site.site, thread_id, 0, 0,
+                std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                    std::chrono::nanoseconds(time_ns))),
+                *m_logger_names[logger_id - 1]);
+            std::string& content = event->get_content_buffer();
+            content.clear();
+            if(!render(site, in.p, in.end - in.p, content)) {
+                m_corrupt = true;
+                return false;
+            }
+            return true;
+        }
+        // unknown entries are skipped
+    }
+}
+
+// Expands the {} fields of the site's format with the encoded arguments.
+bool BinaryLogReader::render(const Site& site, const char* data, size_t len, std::string& out) {
+    Cursor in{data, data + len};
+    LogStream stream(out);
+    const std::string& fmt = site.format;
+    size_t arg = 0;
+    for(size_t i = 0; i < fmt.size(); ++i) {
+        char c = fmt[i];
+        if((c == '{' || c == '}') && i + 1 < fmt.size() && fmt[i + 1] == c) {
+            out.push_back(c);
+            ++i;
+            continue;
+        }
+        if(c != '{' || i + 1 >= fmt.size() || fmt[i + 1] != '}') {
+            out.push_back(c);
+            continue;
+        }
+        ++i;
+        if(arg >= site.types.size()) {
+            return false;
+        }
+        switch(site.types[arg++]) {
+            case BinaryArgType::INT64:      stream << in.get<int64_t>(); break;
+            case BinaryArgType::UINT64:     stream << in.get<uint64_t>(); break;
+            case BinaryArgType::FLOAT:      stream << in.get<float>(); break;
+            case BinaryArgType::DOUBLE:     stream << in.get<double>(); break;
+            case BinaryArgType::BOOL:       stream << (in.get<uint8_t>() != 0); break;
+            case BinaryArgType::CHAR:       stream << in.get<char>(); break;
+            case BinaryArgType::STRING:     stream << in.get_string(); break;
+            case BinaryArgType::POINTER:
+                stream << reinterpret_cast<const void*>(static_cast<uintptr_t>(in.get<uint64_t>()));
+                break;
+            default:
+                return false;
+        }
+    }
+    return in.ok && arg == site.types.size();
+}
+
+} // namespace gfc
@@ -0,0 +1,246 @@
+#pragma once
+
+#include "logger.hh"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace gfc {
+
+// Deferred binary logging. Each call site registers its format string,
+// file, line, level and argument types once; afterwards a log call only
+// copies the site id, a timestamp and the raw argument bytes into a
+// per-thread buffer. A background thread writes the records to a compact
+// binary file, which gfc-logdecode (or BinaryLogReader) turns back into
+// text with a LogFormatter pattern.
+//
+//     gfc::BinaryLogger::get_instance().open("app.blog");
+//     GFC_BINLOG_INFO(logger, "user={} latency={}us", id, us);
+#define GFC_BINLOG_LEVEL(logger, level, fmt, ...) \
+    if constexpr (!gfc::is_level_active(level)) ; \
+    else if (static constexpr gfc::LogSite gfc_log_site_{__FILE__, __LINE__, __func__, level}; false) ; \
+    else if (static std::atomic<uint32_t> gfc_binlog_site_id_{0}; false) ; \
+    else if (auto&& gfc_logger_ = (logger); level < gfc_logger_->get_level()) ; \
+    else gfc::BinaryLogger::get_instance().log(gfc_binlog_site_id_, gfc_log_site_, gfc_logger_->get_name(), \
+                                               fmt __VA_OPT__(,) __VA_ARGS__)
+
+#define GFC_BINLOG_DEBUG(logger, fmt, ...)  GFC_BINLOG_LEVEL(logger, gfc::LogLevel::DEBUG, fmt __VA_OPT__(,) __VA_ARGS__)
+#define GFC_BINLOG_INFO(logger, fmt, ...)   GFC_BINLOG_LEVEL(logger, gfc::LogLevel::INFO,  fmt __VA_OPT__(,) __VA_ARGS__)
+#define GFC_BINLOG_WARN(logger, fmt, ...)   GFC_BINLOG_LEVEL(logger, gfc::LogLevel::WARN,  fmt __VA_OPT__(,) __VA_ARGS__)
+#define GFC_BINLOG_ERROR(logger, fmt, ...)  GFC_BINLOG_LEVEL(logger, gfc::LogLevel::ERROR, fmt __VA_OPT__(,) __VA_ARGS__)
+#define GFC_BINLOG_FATAL(logger, fmt, ...)  GFC_BINLOG_LEVEL(logger, gfc::LogLevel::FATAL, fmt __VA_OPT__(,) __VA_ARGS__)
+
+enum class BinaryArgType : uint8_t {
+    INT64   = 1,
+    UINT64  = 2,
+    FLOAT   = 3,
+    DOUBLE  = 4,
+    BOOL    = 5,
+    CHAR    = 6,
+    STRING  = 7,    // u32 length + bytes; also used for types rendered with operator<<
+    POINTER = 8
+};
+
+// How one argument type is stored in a record.
+template<typename T, typename = void>
+struct BinaryArg {
+    static constexpr BinaryArgType type = BinaryArgType::STRING;
+    static void encode(std::string& out, const T& v) {
+        thread_local std::string text;
+        text.clear();
+        LogStream(text) << v;
+        uint32_t len = text.size();
+        out.append(reinterpret_cast<const char*>(&len), sizeof(len));
+        out.append(text);
+    }
+};
+
+template<typename T>
+struct BinaryArg<T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool> &&
+                                     !std::is_same_v<T, char> && !std::is_same_v<T, signed char> &&
+                                     !std::is_same_v<T, unsigned char>>> {
+    static constexpr BinaryArgType type = std::is_signed_v<T> ? BinaryArgType::INT64 : BinaryArgType::UINT64;
+    static void encode(std::string& out, T v) {
+        std::conditional_t<std::is_signed_v<T>, int64_t, uint64_t> wide = v;
+        out.append(reinterpret_cast<const char*>(&wide), sizeof(wide));
+    }
+};
+
+template<typename T>
+struct BinaryArg<T, std::enable_if_t<std::is_same_v<T, char> || std::is_same_v<T, signed char> ||
+                                     std::is_same_v<T, unsigned char>>> {
+    static constexpr BinaryArgType type = BinaryArgType::CHAR;
+    static void encode(std::string& out, T v) { out.push_back(static_cast<char>(v)); }
+};
+
+template<>
+struct BinaryArg<bool> {
+    static constexpr BinaryArgType type = BinaryArgType::BOOL;
+    static void encode(std::string& out, bool v) { out.push_back(v ? 1 : 0); }
+};
+
+template<>
+struct BinaryArg<float> {
+    static constexpr BinaryArgType type = BinaryArgType::FLOAT;
+    static void encode(std::string& out, float v) { out.append(reinterpret_cast<const char*>(&v), sizeof(v)); }
+};
+
+template<typename T>
+struct BinaryArg<T, std::enable_if_t<std::is_same_v<T, double> || std::is_same_v<T, long double>>> {
+    static constexpr BinaryArgType type = BinaryArgType::DOUBLE;
+    static void encode(std::string& out, T v) {
+        double d = v;
+        out.append(reinterpret_cast<const char*>(&d), sizeof(d));
+    }
+};
+
+struct BinaryStringArg {
+    static constexpr BinaryArgType type = BinaryArgType::STRING;
+    static void encode(std::string& out, std::string_view v) {
+        uint32_t len = v.size();
+        out.append(reinterpret_cast<const char*>(&len), sizeof(len));
+        out.append(v.data(), v.size());
+    }
+};
+template<> struct BinaryArg<const char*>        : BinaryStringArg {};
+template<> struct BinaryArg<char*>              : BinaryStringArg {};
+template<> struct BinaryArg<std::string>        : BinaryStringArg {};
+template<> struct BinaryArg<std::string_view>   : BinaryStringArg {};
+
+template<typename T>
+struct BinaryArg<T*, std::enable_if_t<!std::is_same_v<std::remove_cv_t<T>, char>>> {
+    static constexpr BinaryArgType type = BinaryArgType::POINTER;
+    static void encode(std::string& out, const T* v) {
+        uint64_t p = reinterpret_cast<uintptr_t>(v);
+        out.append(reinterpret_cast<const char*>(&p), sizeof(p));
+    }
+};
+
+/* ------------ BinaryLogger ------------ */
+
+class BinaryLogger {
+public:
+    // Header of a record while it sits in a per-thread buffer.
+    struct RecordHeader {
+        uint32_t            size;           // whole record, 0 marks a wrap to the buffer start
+        uint32_t            site_id;
+        int64_t             time_ticks;     // LogClock, converted by the writer thread
+        uint32_t            thread_id;
+        uint32_t            reserved;
+        const std::string*  logger_name;    // interned
+    };
+
+public:
+    static BinaryLogger& get_instance();
+
+    // Starts writing to path (truncated). thread_buffer_size is the size of
+    // each logging thread's staging buffer.
+    bool open(const std::string& path, size_t thread_buffer_size = 1 << 20);
+    // Writes out everything still buffered and stops the writer thread.
+    void close();
+    // Blocks until every record logged before the call has been written.
+    void flush();
+    bool is_open() const { return m_open.load(std::memory_order_acquire); }
+
+    uint64_t get_dropped_count() const { return m_dropped.load(std::memory_order_relaxed); }
+
+    template<typename... Args>
+    void log(std::atomic<uint32_t>& site_id_slot, const LogSite& site, const std::string& logger_name,
+             FormatString<std::type_identity_t<Args>...> fmt, const Args&... args) {
+        if(!is_open()) {
+            return;
+        }
+        uint32_t site_id = site_id_slot.load(std::memory_order_acquire);
+        if(site_id == 0) {
+            static constexpr BinaryArgType types[sizeof...(Args) + 1] = {BinaryArg<std::decay_t<Args>>::type...};
+            site_id = register_site(site_id_slot, site, fmt.get(), types, sizeof...(Args));
+        }
+
+        thread_local std::string record;
+        record.resize(sizeof(RecordHeader));
+        (BinaryArg<std::decay_t<Args>>::encode(record, args), ...);
+        RecordHeader header;
+        header.size         = record.size();
+        header.site_id      = site_id;
+        header.time_ticks   = LogClock::now();
+        header.thread_id    = current_thread_id();
+        header.reserved     = 0;
+        header.logger_name  = &logger_name;
+        memcpy(&record[0], &header, sizeof(header));
+        commit(record.data(), record.size());
+    }
+
+private:
+    BinaryLogger() = default;
+    ~BinaryLogger();
+
+    struct Site;
+    struct ThreadBuffer;
+
+    uint32_t        register_site(std::atomic<uint32_t>& site_id_slot, const LogSite& site,
+                                  std::string_view fmt, const BinaryArgType* types, size_t count);
+    void            commit(const char* data, size_t len);
+    ThreadBuffer*   local_buffer();
+    void            run();
+    bool            drain(ThreadBuffer& buffer);
+    void            write_out();
+
+private:
+    std::atomic<bool>           m_open{false};
+    int                         m_fd = -1;
+    size_t                      m_buffer_size = 1 << 20;
+    std::thread                 m_thread;
+    std::atomic<bool>           m_stop{false};
+    std::atomic<uint64_t>       m_dropped{0};
+
+    std::mutex                  m_mutex;                // guards sites, buffers and flush state
+    std::condition_variable     m_wake_cv;              // flush() or close() waiting for the writer
+    std::condition_variable     m_flushed_cv;
+    std::vector<Site>           m_sites;                // index = site id - 1
+    std::vector<ThreadBuffer*>  m_buffers;
+    uint64_t                    m_flush_request = 0;
+    uint64_t                    m_flush_done = 0;
+
+    // writer thread only
+    size_t                      m_sites_written = 0;
+    std::unordered_map<const std::string*, uint32_t> m_logger_ids;
+    std::string                 m_out;
+};
+
+/* ------------ BinaryLogReader ------------ */
+
+// Reads a file written by BinaryLogger back as LogEvents, rendering each
+// record's format string with its arguments as the event content.
+class BinaryLogReader {
+public:
+    bool open(const std::string& path);
+    // Returns false at the end of the file or on a corrupt record.
+    bool next(LogEvent::ptr& event);
+    bool is_corrupt() const { return m_corrupt; }
+
+private:
+    struct Site {
+        const LogSite*              site;       // interned
+        std::string                 format;
+        std::vector<BinaryArgType>  types;
+    };
+    bool render(const Site& site, const char* data, size_t len, std::string& out);
+
+private:
+    std::ifstream                   m_in;
+    uint64_t                        m_size = 0;         // bytes in the file
+    uint64_t                        m_pos = 0;          // offset of the next entry
+    bool                            m_corrupt = false;
+    std::vector<std::unique_ptr<Site>> m_sites;         // index = site id - 1, stable addresses
+    std::vector<const std::string*> m_logger_names;     // index = logger id - 1, interned
+    std::string                     m_body;
+};
+
+} // namespace gfc
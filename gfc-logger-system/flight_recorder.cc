@@ -0,0 +1,381 @@
+#include "flight_recorder.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace gfc {
+
+// Layout of the file: this header, padded to a page, then the slots.
+struct FlightRecorder::FileHeader {
+    char                    magic[8];
+    uint32_t                version;
+    uint32_t                slot_size;
+    uint64_t                slot_count;
+    std::atomic<uint64_t>   next;           // number of events recorded so far
+};
+
+// Event n lives in slot n % slot_count while its seq is 2n + 2; seq is
+// 2n + 1 while its writer owns the slot. The text follows the header.
+struct FlightRecorder::Slot {
+    std::atomic<uint64_t>   seq;
+    std::atomic<uint32_t>   len;
+    uint32_t                reserved;
+
+    char*       text()          { return reinterpret_cast<char*>(this + 1); }
+    const char* text() const    { return reinterpret_cast<const char*>(this + 1); }
+};
+
+namespace {
+
+const char   kMagic[8] = {'G', 'F', 'C', 'F', 'L', 'T', 'R', '1'};
+const size_t kHeaderSize = 4096;
+const size_t kMaxSlotSize = 4096;
+
+bool write_all(int fd, const char* data, size_t len) {
+    while(len > 0) {
+        ssize_t n = write(fd, data, len);
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// async-signal-safe decimal rendering
+size_t format_uint(char* buf, uint64_t value) {
+    char tmp[20];
+    size_t n = 0;
+    do {
+        tmp[n++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while(value != 0);
+    for(size_t i = 0; i < n; ++i) {
+        buf[i] = tmp[n - 1 - i];
+    }
+    return n;
+}
+
+// Slot text is copied a word at a time with atomics: dump() may read a slot
+// while a writer refills it, and throws the copy away then. Release stores
+// and acquire loads (plain moves on x86) stand in for fences, which
+// ThreadSanitizer does not model: a reader that sees a word of the new text
+// also sees the odd seq the writer claimed the slot with.
+// Slot text is 8-byte aligned and a multiple of 8 bytes long.
+void store_text(char* dst, const char* src, size_t len) {
+    for(size_t i = 0; i < len; i += 8) {
+        uint64_t word = 0;
+        memcpy(&word, src + i, std::min<size_t>(8, len - i));
+        __atomic_store_n(reinterpret_cast<uint64_t*>(dst + i), word, __ATOMIC_RELEASE);
+    }
+}
+
+void load_text(char* dst, const char* src, size_t len) {
+    for(size_t i = 0; i < len; i += 8) {
+        uint64_t word = __atomic_load_n(reinterpret_cast<const uint64_t*>(src + i), __ATOMIC_ACQUIRE);
+        memcpy(dst + i, &word, std::min<size_t>(8, len - i));
+    }
+}
+
+const int kCrashSignals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+struct sigaction s_old_actions[NSIG];
+std::atomic<bool> s_crashing{false};
+std::atomic<bool> s_handlers_installed{false};
+
+// The crash handler runs on this, so a SIGSEGV from a stack overflow still
+// gets its dump. A thread that already has one (e.g. from a sanitizer)
+// keeps it.
+const size_t kSignalStackSize = 64 * 1024;
+
+class SignalStack {
+public:
+    SignalStack() {
+        stack_t current;
+        if(sigaltstack(nullptr, &current) != 0 || !(current.ss_flags & SS_DISABLE)) {
+            return;
+        }
+        void* base = mmap(nullptr, kSignalStackSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(base == MAP_FAILED) {
+            return;
+        }
+        stack_t stack;
+        stack.ss_sp = base;
+        stack.ss_size = kSignalStackSize;
+        stack.ss_flags = 0;
+        if(sigaltstack(&stack, nullptr) != 0) {
+            munmap(base, kSignalStackSize);
+            return;
+        }
+        m_base = base;
+    }
+    ~SignalStack() {
+        if(m_base) {
+            stack_t stack;
+            memset(&stack, 0, sizeof(stack));
+            stack.ss_flags = SS_DISABLE;
+            sigaltstack(&stack, nullptr);
+            munmap(m_base, kSignalStackSize);
+        }
+    }
+private:
+    void* m_base = nullptr;
+};
+
+void ensure_signal_stack() {
+    thread_local SignalStack stack;
+}
+
+} // namespace
+
+std::atomic<FlightRecorder*> FlightRecorder::s_installed{nullptr};
+
+FlightRecorder::FlightRecorder(const std::string& filename, size_t slots, size_t slot_size)
+    : m_filename(filename) {
+    m_slot_count = 1;
+    while(m_slot_count < slots) {
+        m_slot_count <<= 1;
+    }
+    // keep the slot headers 8-byte aligned
+    m_slot_size = (std::clamp(slot_size, sizeof(Slot) + 8, kMaxSlotSize) + 7) & ~size_t(7);
+    set_formatter(std::make_shared<LogFormatter>("%d{%Y-%m-%d %H:%M:%S.%us} [%p] [%c] [%t] [%f:%l] %m%n"));
+
+    struct stat st;
+    if(stat(filename.c_str(), &st) == 0 && st.st_size > 0) {
+        rename(filename.c_str(), (filename + ".prev").c_str());
+    }
+    m_map_size = kHeaderSize + m_slot_count * m_slot_size;
+    m_fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    void* map = MAP_FAILED;
+    if(m_fd >= 0 && ftruncate(m_fd, m_map_size) == 0) {
+        map = mmap(nullptr, m_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    }
+    if(map == MAP_FAILED) {
+        std::cout << "[ERROR] FlightRecorder::FlightRecorder() cannot map " << filename
+                  << ": " << strerror(errno) << std::endl;
+        return;
+    }
+    // the file is new and zero-filled: every slot reads as empty
+    m_header = static_cast<FileHeader*>(map);
+    memcpy(m_header->magic, kMagic, sizeof(kMagic));
+    m_header->version = 1;
+    m_header->slot_size = static_cast<uint32_t>(m_slot_size);
+    m_header->slot_count = m_slot_count;
+    m_slots = static_cast<char*>(map) + kHeaderSize;
+}
+
+FlightRecorder::~FlightRecorder() {
+    if(m_header) {
+        munmap(m_header, m_map_size);
+    }
+    if(m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+void FlightRecorder::log(const LogEvent::ptr& event) {
+    record(*event);
+}
+
+void FlightRecorder::record(const LogEvent& event) {
+    if(!m_header) {
+        return;
+    }
+    if(s_handlers_installed.load(std::memory_order_relaxed)) {
+        ensure_signal_stack();
+    }
+    thread_local std::string text;
+    text.clear();
+    m_record_formatter.load(std::memory_order_acquire)->format(text, event);
+
+    uint64_t n = m_header->next.fetch_add(1, std::memory_order_relaxed);
+    Slot* slot = reinterpret_cast<Slot*>(m_slots + (n & (m_slot_count - 1)) * m_slot_size);
+    // Once the ring has wrapped, events n and n + slot_count share a slot.
+    // Take it over from an earlier event that is done with it; wait for one
+    // still writing; give up if a later event has it, as that one replaces
+    // this in the ring anyway.
+    uint64_t seq = slot->seq.load(std::memory_order_relaxed);
+    for(;;) {
+        if(seq > 2 * n) {
+            count_events(1);
+            return;
+        }
+        if(seq & 1) {
+            sched_yield();
+            seq = slot->seq.load(std::memory_order_relaxed);
+            continue;
+        }
+        if(slot->seq.compare_exchange_weak(seq, 2 * n + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+            break;
+        }
+    }
+    size_t len = std::min(text.size(), m_slot_size - sizeof(Slot));
+    store_text(slot->text(), text.data(), len);
+    slot->len.store(static_cast<uint32_t>(len), std::memory_order_release);
+    uint64_t owned = 2 * n + 1;
+    slot->seq.compare_exchange_strong(owned, 2 * n + 2, std::memory_order_release, std::memory_order_relaxed);
+    count_events(1);
+    count_write(len, 0);
+
+    if(event.get_level() == LogLevel::FATAL) {
+        int fd = m_dump_fd.load(std::memory_order_relaxed);
+        if(fd >= 0) {
+            dump(fd, m_dump_max.load(std::memory_order_relaxed));
+        }
+    }
+}
+
+void FlightRecorder::set_level(LogLevel level) {
+    LogAppender::set_level(level);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(get_installed() == this) {
+        record_level_flag().store(static_cast<int>(level), std::memory_order_relaxed);
+    }
+}
+
+void FlightRecorder::set_formatter(LogFormatter::ptr formatter) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_formatter = formatter;
+    // record() uses the formatter without the lock, so none is ever freed
+    m_formatters.push_back(formatter);
+    m_record_formatter.store(formatter.get(), std::memory_order_release);
+}
+
+void FlightRecorder::set_dump_target(int fd, size_t max_events) {
+    m_dump_max.store(max_events, std::memory_order_relaxed);
+    m_dump_fd.store(fd, std::memory_order_relaxed);
+}
+
+uint64_t FlightRecorder::get_record_count() const {
+    return m_header ? m_header->next.load(std::memory_order_relaxed) : 0;
+}
+
+size_t FlightRecorder::dump(int fd, size_t max_events) const {
+    if(!m_header) {
+        return 0;
+    }
+    return dump_ring(m_header, m_slots, fd, max_events);
+}
+
+size_t FlightRecorder::dump_ring(const FileHeader* header, const char* slots, int fd, size_t max_events) {
+    uint64_t count = header->slot_count;
+    size_t slot_size = header->slot_size;
+    uint64_t next = header->next.load(std::memory_order_acquire);
+    uint64_t first = next > count ? next - count : 0;
+    if(max_events != 0 && next - first > max_events) {
+        first = next - max_events;
+    }
+
+    char line[96] = "--- flight recorder: events ";
+    size_t len = strlen(line);
+    len += format_uint(line + len, first);
+    line[len++] = '-';
+    len += format_uint(line + len, next);
+    memcpy(line + len, " ---\n", 5);
+    write_all(fd, line, len + 5);
+
+    // copy each slot out and check it was not rewritten meanwhile
+    char text[kMaxSlotSize];
+    size_t written = 0;
+    for(uint64_t n = first; n < next; ++n) {
+        const Slot* slot = reinterpret_cast<const Slot*>(slots + (n & (count - 1)) * slot_size);
+        if(slot->seq.load(std::memory_order_acquire) != 2 * n + 2) {
+            continue;
+        }
+        size_t text_len = std::min<size_t>(slot->len.load(std::memory_order_acquire), slot_size - sizeof(Slot));
+        load_text(text, slot->text(), text_len);
+        if(slot->seq.load(std::memory_order_relaxed) != 2 * n + 2) {
+            continue;
+        }
+        if(text_len == 0 || text[text_len - 1] != '\n') {
+            text[text_len++] = '\n';    // cut off, or a pattern without %n
+        }
+        write_all(fd, text, text_len);
+        ++written;
+    }
+    return written;
+}
+
+void FlightRecorder::install(ptr recorder) {
+    // leaked: logging threads and signal handlers may use a recorder after
+    // it was replaced
+    static std::mutex* mutex = new std::mutex;
+    static std::vector<ptr>* installed = new std::vector<ptr>;
+    std::lock_guard<std::mutex> lock(*mutex);
+    if(recorder) {
+        installed->push_back(recorder);
+    }
+    s_installed.store(recorder.get(), std::memory_order_release);
+    record_level_flag().store(recorder ? static_cast<int>(recorder->get_level()) : INT_MAX,
+                              std::memory_order_relaxed);
+}
+
+void FlightRecorder::on_crash_signal(int sig) {
+    if(!s_crashing.exchange(true)) {
+        FlightRecorder* recorder = get_installed();
+        int fd = recorder ? recorder->m_dump_fd.load(std::memory_order_relaxed) : -1;
+        if(fd >= 0) {
+            char line[48] = "--- flight recorder: signal ";
+            size_t len = strlen(line);
+            len += format_uint(line + len, static_cast<uint64_t>(sig));
+            memcpy(line + len, " ---\n", 5);
+            write_all(fd, line, len + 5);
+            recorder->dump(fd, recorder->m_dump_max.load(std::memory_order_relaxed));
+        }
+    }
+    sigaction(sig, &s_old_actions[sig], nullptr);
+    raise(sig);
+}
+
+void FlightRecorder::install_signal_handlers() {
+    static std::once_flag once;
+    std::call_once(once, []() {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = &FlightRecorder::on_crash_signal;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_ONSTACK;
+        ensure_signal_stack();
+        for(int sig : kCrashSignals) {
+            sigaction(sig, &action, &s_old_actions[sig]);
+        }
+        s_handlers_installed.store(true, std::memory_order_relaxed);
+    });
+}
+
+size_t FlightRecorder::dump_file(const std::string& filename, int fd, size_t max_events) {
+    int file = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if(file < 0) {
+        return 0;
+    }
+    struct stat st;
+    size_t written = 0;
+    if(fstat(file, &st) == 0 && static_cast<size_t>(st.st_size) >= kHeaderSize) {
+        void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, file, 0);
+        if(map != MAP_FAILED) {
+            const FileHeader* header = static_cast<const FileHeader*>(map);
+            uint64_t count = header->slot_count;
+            if(memcmp(header->magic, kMagic, sizeof(kMagic)) == 0 && header->version == 1 &&
+               count != 0 && (count & (count - 1)) == 0 && header->slot_size <= kMaxSlotSize &&
+               header->slot_size > sizeof(Slot) &&
+               kHeaderSize + count * header->slot_size <= static_cast<size_t>(st.st_size)) {
+                written = dump_ring(header, static_cast<const char*>(map) + kHeaderSize, fd, max_events);
+            }
+            munmap(map, st.st_size);
+        }
+    }
+    close(file);
+    return written;
+}
+
+} // namespace gfc
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "logger.hh"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+
+namespace gfc {
+
+/* ------------ FlightRecorder ------------ */
+
+// Keeps the most recent events, formatted, in a fixed-size ring of slots
+// inside an mmap'd file, so the last moments before a crash survive in
+// memory and on disk without writing DEBUG output anywhere all the time.
+//
+//     auto recorder = std::make_shared<gfc::FlightRecorder>("/var/tmp/app.flight");
+//     gfc::FlightRecorder::install(recorder);     // every logger, from DEBUG up
+//     gfc::FlightRecorder::install_signal_handlers();
+//
+// Once installed, a recorder gets every event at or above its own level
+// from every logger, including events the logger's level filters out: the
+// GFC_LOG_* macros let such statements through as long as the recorder
+// wants them, and Logger::log() hands them to the recorder only. It can
+// also be added to loggers like any appender instead, but not both.
+//
+// Writers claim a slot with one fetch_add and fill it under a per-slot
+// sequence number, so recording takes no lock; a writer overtaken by one
+// a whole ring later drops its event. A message longer than a
+// slot is cut off. dump() only reads the ring and calls write(2), so it can
+// run in a signal handler; it skips slots that are being written. It runs
+// on FATAL events and, with install_signal_handlers(), on SIGSEGV, SIGBUS,
+// SIGFPE, SIGILL and SIGABRT.
+//
+// A file left over from an earlier run is kept as <filename>.prev;
+// dump_file() reads it.
+class FlightRecorder : public LogAppender {
+public:
+    typedef std::shared_ptr<FlightRecorder> ptr;
+
+public:
+    // slots is rounded up to a power of two; slot_size (at most 4096)
+    // includes a 16-byte header
+    FlightRecorder(const std::string& filename, size_t slots = 4096, size_t slot_size = 256);
+    ~FlightRecorder();
+
+    virtual void log(const LogEvent::ptr& event) override;
+    virtual void set_level(LogLevel level) override;
+    virtual void set_formatter(LogFormatter::ptr formatter) override;
+    void        record(const LogEvent& event);
+
+    // Writes the last max_events events still in the ring (all of them for
+    // 0) to fd, oldest first. Returns the number written. Async-signal-safe.
+    size_t      dump(int fd, size_t max_events = 0) const;
+    // Where FATAL events and crash signals dump to, and how many events;
+    // fd -1 turns dumping on FATAL off. Default: all of them to stderr.
+    void        set_dump_target(int fd, size_t max_events = 0);
+
+    bool                is_open()           const { return m_header != nullptr; }
+    const std::string&  get_filename()      const { return m_filename; }
+    size_t              get_slot_count()    const { return m_slot_count; }
+    uint64_t            get_record_count()  const;
+
+    // Makes recorder the process-wide recorder; null uninstalls. An
+    // installed recorder is kept alive for the rest of the process, since
+    // logging threads and signal handlers may still be using it.
+    static void             install(ptr recorder);
+    static FlightRecorder*  get_installed() { return s_installed.load(std::memory_order_acquire); }
+    // Dumps the installed recorder on a crash signal, then lets the
+    // previous disposition of the signal take over. The handler runs on an
+    // alternate signal stack, set up for the calling thread and for each
+    // thread when it first records, so a stack overflow is dumped too.
+    static void             install_signal_handlers();
+    // Dumps a recorder file, e.g. one a crashed process left behind.
+    static size_t           dump_file(const std::string& filename, int fd, size_t max_events = 0);
+
+private:
+    struct FileHeader;
+    struct Slot;
+
+    static size_t dump_ring(const FileHeader* header, const char* slots, int fd, size_t max_events);
+    static void on_crash_signal(int sig);
+
+private:
+    std::string                 m_filename;
+    int                         m_fd = -1;
+    size_t                      m_slot_count;
+    size_t                      m_slot_size;
+    size_t                      m_map_size = 0;
+    FileHeader*                 m_header = nullptr;     // start of the mapping, null if it failed
+    char*                       m_slots = nullptr;
+    std::atomic<LogFormatter*>  m_record_formatter{nullptr};
+    std::vector<LogFormatter::ptr> m_formatters;        // every formatter set so far, guarded by m_mutex
+    std::atomic<int>            m_dump_fd{STDERR_FILENO};
+    std::atomic<size_t>         m_dump_max{0};
+
+    static std::atomic<FlightRecorder*> s_installed;
+};
+
+} // namespace gfc
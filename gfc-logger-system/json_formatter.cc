@@ -0,0 +1,164 @@
+#include "json_formatter.hh"
+
+#include <charconv>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace gfc {
+
+namespace {
+
+// Bytes that cannot appear unescaped inside a JSON string.
+inline bool needs_escape(unsigned char c) {
+    return c < 0x20 || c == '"' || c == '\\';
+}
+
+// Offset of the first byte in [p, end) that needs escaping, or end - p.
+size_t find_escape(const char* p, const char* end) {
+    const char* s = p;
+#if defined(__AVX2__)
+    const __m256i quote32 = _mm256_set1_epi8('"');
+    const __m256i backslash32 = _mm256_set1_epi8('\\');
+    const __m256i control32 = _mm256_set1_epi8(0x1f);
+    for(; end - s >= 32; s += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s));
+        // v <= 0x1f (unsigned) exactly when min(v, 0x1f) == v
+        __m256i hit = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, quote32), _mm256_cmpeq_epi8(v, backslash32)),
+            _mm256_cmpeq_epi8(_mm256_min_epu8(v, control32), v));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hit));
+        if(mask != 0) {
+            return s - p + __builtin_ctz(mask);
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    for(; end - s >= 16; s += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+        __m128i hit = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+            _mm_cmpeq_epi8(_mm_min_epu8(v, control), v));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(hit));
+        if(mask != 0) {
+            return s - p + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for(; s < end; ++s) {
+        if(needs_escape(static_cast<unsigned char>(*s))) {
+            break;
+        }
+    }
+    return s - p;
+}
+
+void append_quoted(std::string& out, std::string_view text) {
+    out.push_back('"');
+    JsonLogFormatter::append_escaped(out, text);
+    out.push_back('"');
+}
+
+template<typename Number>
+void append_number(std::string& out, Number value) {
+    char buf[32];
+    auto res = std::to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, res.ptr - buf);
+}
+
+} // namespace
+
+JsonLogFormatter::JsonLogFormatter(const std::string& time_format)
+    : LogFormatter("%d{" + time_format + "}") {
+}
+
+void JsonLogFormatter::append_escaped(std::string& out, std::string_view text) {
+    static const char kHex[] = "0123456789abcdef";
+    const char* p = text.data();
+    const char* end = p + text.size();
+    while(p < end) {
+        size_t run = find_escape(p, end);
+        out.append(p, run);
+        p += run;
+        if(p == end) {
+            break;
+        }
+        unsigned char c = static_cast<unsigned char>(*p++);
+        switch(c) {
+            case '"':   out.append("\\\"", 2); break;
+            case '\\':  out.append("\\\\", 2); break;
+            case '\n':  out.append("\\n", 2); break;
+            case '\r':  out.append("\\r", 2); break;
+            case '\t':  out.append("\\t", 2); break;
+            case '\b':  out.append("\\b", 2); break;
+            case '\f':  out.append("\\f", 2); break;
+            default: {
+                char esc[6] = {'\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 0xf]};
+                out.append(esc, sizeof(esc));
+                break;
+            }
+        }
+    }
+}
+
+void JsonLogFormatter::format_ops(std::string& out, const LogEvent& event) const {
+    out.append("{\"time\":\"");
+    // the compiled %d{...}; its text only needs escaping if the format put
+    // quotes or control characters in it
+    size_t time_begin = out.size();
+    LogFormatter::format_ops(out, event);
+    if(find_escape(out.data() + time_begin, out.data() + out.size()) != out.size() - time_begin) {
+        std::string time = out.substr(time_begin);
+        out.resize(time_begin);
+        append_escaped(out, time);
+    }
+    out.append("\",\"level\":\"");
+    out.append(to_string(event.get_level()));
+    out.append("\",\"logger\":");
+    append_quoted(out, event.get_logger_name());
+    out.append(",\"thread\":");
+    append_number(out, event.get_thread_id());
+    out.append(",\"file\":");
+    append_quoted(out, event.get_file_name());
+    out.append(",\"line\":");
+    append_number(out, event.get_line_num());
+    out.append(",\"msg\":");
+    append_quoted(out, event.get_content());
+
+    for(const LogField& field : event.get_fields()) {
+        out.push_back(',');
+        append_quoted(out, event.get_field_key(field));
+        out.push_back(':');
+        switch(field.type) {
+            case LogField::Type::INT:
+                append_number(out, field.i);
+                break;
+            case LogField::Type::UINT:
+                append_number(out, field.u);
+                break;
+            case LogField::Type::DOUBLE:
+                if(std::isfinite(field.d)) {
+                    append_number(out, field.d);
+                } else {
+                    out.append("null");
+                }
+                break;
+            case LogField::Type::BOOL:
+                out.append(field.b ? "true" : "false");
+                break;
+            case LogField::Type::STRING:
+                append_quoted(out, event.get_field_string(field));
+                break;
+        }
+    }
+    out.append("}\n");
+}
+
+} // namespace gfc
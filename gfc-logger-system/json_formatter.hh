@@ -0,0 +1,38 @@
+#pragma once
+
+#include "logger.hh"
+
+namespace gfc {
+
+/* ------------ JsonLogFormatter ------------ */
+
+// Renders each event as one JSON object per line:
+//
+//   {"time":"2024-05-01T12:00:00.123+0800","level":"INFO","logger":"db",
+//    "thread":1234,"file":"db.cc","line":42,"msg":"done","user":7,"ms":1.5}
+//
+// followed by the event's kv() fields in the order they were added, with
+// their own types: integers and doubles as numbers (std::to_chars, shortest
+// round trip; NaN and infinities as null), bools as true/false, strings as
+// strings. Field keys are not checked against the fixed members.
+//
+// Strings are escaped in runs: SSE2 (or AVX2, when the build enables it)
+// finds the next byte that needs escaping 16 (32) bytes at a time and
+// everything before it is appended in one go. Bytes from 0x80 up are
+// copied as they are, so valid UTF-8 stays valid.
+class JsonLogFormatter : public LogFormatter {
+public:
+    typedef std::shared_ptr<JsonLogFormatter> ptr;
+public:
+    // time_format is a %d{...} format, sub-second fields included
+    JsonLogFormatter(const std::string& time_format = "%Y-%m-%dT%H:%M:%S.%ms%z");
+
+    // Appends text with '"', '\\' and control characters escaped, without
+    // the surrounding quotes.
+    static void append_escaped(std::string& out, std::string_view text);
+
+protected:
+    virtual void format_ops(std::string& out, const LogEvent& event) const override;
+};
+
+} // namespace gfc
@@ -0,0 +1,205 @@
+#include "log_clock.hh"
+
+#include <cmath>
+#include <mutex>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+namespace gfc {
+
+uint32_t lookup_thread_id() {
+    static std::once_flag once;
+    std::call_once(once, []() {
+        // the child of a fork is a new thread with the forking thread's cache
+        pthread_atfork(nullptr, nullptr, []() { t_thread_id = 0; });
+    });
+    t_thread_id = static_cast<uint32_t>(syscall(SYS_gettid));
+    return t_thread_id;
+}
+
+namespace {
+
+const int64_t kCheckIntervalNs = 1000000000;    // how often to_ns() compares with CLOCK_REALTIME
+const int64_t kStepNs = 1000000;                // differences beyond this are not slewed
+const int64_t kCalibrationNs = 1000000;
+
+int64_t clock_ns(clockid_t clock) {
+    timespec ts;
+    clock_gettime(clock, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+bool invariant_tsc() {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned eax, ebx, ecx, edx;
+    return __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1u << 8));
+#else
+    return false;
+#endif
+}
+
+// ns = base_ns + (ticks - base_ticks) * ns_per_tick. Written by one thread
+// at a time (s_calibrating), read under the sequence number s_seq. The
+// fields are stored with release and loaded with acquire rather than
+// ordered by fences, which ThreadSanitizer does not model: a reader that
+// sees any new field also sees the odd s_seq stored before it.
+struct Params {
+    int64_t base_ticks;
+    int64_t base_ns;
+    double  ns_per_tick;
+};
+
+std::atomic<uint64_t>   s_seq{0};
+std::atomic<int64_t>    s_base_ticks{0};
+std::atomic<int64_t>    s_base_ns{0};
+std::atomic<double>     s_ns_per_tick{1.0};
+std::atomic<int64_t>    s_next_check{0};        // ticks after which to_ns() calibrates again
+std::atomic<bool>       s_calibrating{false};
+std::atomic<int64_t>    s_start_ticks{0};
+
+// s_calibrating held for these
+double                  s_rate = 1.0;           // measured ns per tick
+int64_t                 s_rate_ticks = 0;       // where the measurement started
+int64_t                 s_rate_ns = 0;
+
+Params load_params() {
+    for(;;) {
+        uint64_t seq = s_seq.load(std::memory_order_acquire);
+        if(seq & 1) {
+            continue;
+        }
+        Params params{s_base_ticks.load(std::memory_order_acquire), s_base_ns.load(std::memory_order_acquire),
+                      s_ns_per_tick.load(std::memory_order_acquire)};
+        if(s_seq.load(std::memory_order_relaxed) == seq) {
+            return params;
+        }
+    }
+}
+
+void store_params(const Params& params) {
+    uint64_t seq = s_seq.load(std::memory_order_relaxed);
+    s_seq.store(seq + 1, std::memory_order_relaxed);
+    s_base_ticks.store(params.base_ticks, std::memory_order_release);
+    s_base_ns.store(params.base_ns, std::memory_order_release);
+    s_ns_per_tick.store(params.ns_per_tick, std::memory_order_release);
+    s_seq.store(seq + 2, std::memory_order_release);
+    s_next_check.store(params.base_ticks + static_cast<int64_t>(kCheckIntervalNs / params.ns_per_tick),
+                       std::memory_order_relaxed);
+}
+
+int64_t read_ticks(LogClock::Source source) {
+#if defined(__x86_64__) || defined(__i386__)
+    if(source == LogClock::Source::TSC) {
+        return static_cast<int64_t>(__rdtsc());
+    }
+#endif
+    return clock_ns(CLOCK_MONOTONIC);
+}
+
+// A tick reading and a clock reading taken as close together as a few
+// tries allow.
+void sample(LogClock::Source source, clockid_t clock, int64_t& ticks, int64_t& ns) {
+    int64_t best = INT64_MAX;
+    for(int i = 0; i < 5; ++i) {
+        int64_t before = read_ticks(source);
+        int64_t now = clock_ns(clock);
+        int64_t after = read_ticks(source);
+        if(after - before < best) {
+            best = after - before;
+            ticks = before + (after - before) / 2;
+            ns = now;
+        }
+    }
+}
+
+void calibrate(int64_t ticks_hint) {
+    if(s_calibrating.exchange(true, std::memory_order_acquire)) {
+        return;
+    }
+    if(ticks_hint >= s_next_check.load(std::memory_order_relaxed)) {
+        LogClock::Source source = LogClock::get_source();
+        int64_t ticks, ns;
+        sample(source, CLOCK_REALTIME, ticks, ns);
+        Params params = load_params();
+        int64_t predicted = params.base_ns + std::llround((ticks - params.base_ticks) * params.ns_per_tick);
+        int64_t error = ns - predicted;
+        if(std::llabs(error) > kStepNs) {
+            // the wall clock was set: jump, and measure the rate afresh
+            s_rate_ticks = ticks;
+            s_rate_ns = ns;
+            store_params({ticks, ns, s_rate});
+        } else {
+            if(source == LogClock::Source::TSC && ticks > s_rate_ticks) {
+                s_rate = static_cast<double>(ns - s_rate_ns) / (ticks - s_rate_ticks);
+            }
+            // carry on from the predicted time and catch up over the next interval
+            store_params({ticks, predicted, s_rate * (1.0 + static_cast<double>(error) / kCheckIntervalNs)});
+        }
+    }
+    s_calibrating.store(false, std::memory_order_release);
+}
+
+// The TSC and CLOCK_MONOTONIC at load: elapsed_ms() counts from here, and
+// the first now() measures the TSC rate from here, so it seldom has to wait.
+struct LoadMark {
+    int64_t tsc = 0;
+    int64_t monotonic_ns = 0;
+};
+
+LoadMark mark_load() {
+    LoadMark mark;
+    sample(LogClock::Source::TSC, CLOCK_MONOTONIC, mark.tsc, mark.monotonic_ns);
+    return mark;
+}
+
+const LoadMark s_load_mark = mark_load();
+
+} // namespace
+
+std::atomic<LogClock::Source> LogClock::s_source{Source::NONE};
+
+int64_t LogClock::start_now() {
+    static std::once_flag once;
+    std::call_once(once, []() {
+        s_calibrating.store(true, std::memory_order_relaxed);
+        Source source = invariant_tsc() ? Source::TSC : Source::MONOTONIC;
+        // called from another library's static initialisation, before ours
+        LoadMark load = s_load_mark.monotonic_ns ? s_load_mark : mark_load();
+        if(source == Source::TSC) {
+            int64_t tsc = 0, monotonic = 0;
+            do {
+                sample(source, CLOCK_MONOTONIC, tsc, monotonic);
+            } while(monotonic - load.monotonic_ns < kCalibrationNs || tsc <= load.tsc);
+            s_rate = static_cast<double>(monotonic - load.monotonic_ns) / (tsc - load.tsc);
+        }
+        int64_t ticks, ns;
+        sample(source, CLOCK_REALTIME, ticks, ns);
+        s_rate_ticks = ticks;
+        s_rate_ns = ns;
+        s_start_ticks.store(source == Source::TSC ? load.tsc : load.monotonic_ns, std::memory_order_relaxed);
+        store_params({ticks, ns, s_rate});
+        s_calibrating.store(false, std::memory_order_release);
+        s_source.store(source, std::memory_order_release);
+    });
+    return now();
+}
+
+int64_t LogClock::to_ns(int64_t ticks) {
+    if(ticks >= s_next_check.load(std::memory_order_relaxed)) {
+        calibrate(ticks);
+    }
+    Params params = load_params();
+    return params.base_ns + std::llround((ticks - params.base_ticks) * params.ns_per_tick);
+}
+
+uint32_t LogClock::elapsed_ms(int64_t ticks) {
+    double ms = (ticks - s_start_ticks.load(std::memory_order_relaxed)) *
+                s_ns_per_tick.load(std::memory_order_relaxed) / 1000000;
+    return ms > 0 ? static_cast<uint32_t>(ms) : 0;
+}
+
+} // namespace gfc
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace gfc {
+
+// Kernel id (gettid) of the calling thread, looked up once per thread and
+// again in the child after a fork.
+inline thread_local uint32_t t_thread_id = 0;
+uint32_t lookup_thread_id();
+inline uint32_t current_thread_id() {
+    return t_thread_id ? t_thread_id : lookup_thread_id();
+}
+
+/* ------------ LogClock ------------ */
+
+// Time stamps for log events. now() only reads a tick counter: the TSC
+// (one rdtsc) where the CPU keeps it invariant, CLOCK_MONOTONIC
+// otherwise. to_ns() turns ticks into UTC nanoseconds; it runs where the
+// time is needed, when the event is formatted, which for AsyncLogAppender
+// and BinaryLogger is their background thread.
+//
+// Loading the library only notes the TSC and CLOCK_MONOTONIC. The first
+// now() measures the TSC rate from there, against CLOCK_MONOTONIC, waiting
+// only if less than 1 ms has passed since. About once a second, to_ns() compares with
+// CLOCK_REALTIME again: it refines the rate and absorbs the difference over
+// the next second, so converted times stay monotonic, and follows a
+// difference of more than 1 ms (the clock was set) at once.
+class LogClock {
+public:
+    enum class Source { NONE, TSC, MONOTONIC };
+
+    // Ticks; only meaningful to to_ns() and elapsed_ms() of this process.
+    static int64_t  now() {
+        Source source = s_source.load(std::memory_order_relaxed);
+#if defined(__x86_64__) || defined(__i386__)
+        if(source == Source::TSC) {
+            return static_cast<int64_t>(__rdtsc());
+        }
+#endif
+        if(source == Source::MONOTONIC) {
+            return monotonic_ns();
+        }
+        return start_now();
+    }
+    // UTC nanoseconds since the epoch
+    static int64_t  to_ns(int64_t ticks);
+    // milliseconds from the clock's start (library load) to ticks
+    static uint32_t elapsed_ms(int64_t ticks);
+    static Source   get_source() { return s_source.load(std::memory_order_acquire); }
+
+private:
+    static int64_t monotonic_ns() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+    // calibrates on the first call
+    static int64_t start_now();
+
+private:
+    static std::atomic<Source> s_source;
+};
+
+} // namespace gfc
@@ -0,0 +1,544 @@
+#include "log_config.hh"
+#include "async_appender.hh"
+#include "json_formatter.hh"
+#include "network_appender.hh"
+#include "rolling_file_appender.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <set>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace gfc {
+
+namespace {
+
+const char* kDefaultPattern = "%d{%Y-%m-%d %H:%M:%S} [%p] [%c] [%t] [%f:%l] %m%n";
+
+std::string_view trim(std::string_view s) {
+    size_t begin = s.find_first_not_of(" \t\r");
+    if(begin == std::string_view::npos) {
+        return {};
+    }
+    size_t end = s.find_last_not_of(" \t\r");
+    return s.substr(begin, end - begin + 1);
+}
+
+bool parse_level(std::string_view text, LogLevel& level) {
+    for(LogLevel l : {LogLevel::DEBUG, LogLevel::INFO, LogLevel::WARN, LogLevel::ERROR, LogLevel::FATAL}) {
+        if(text == to_string(l)) {
+            level = l;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parse_bool(std::string_view text, bool& value) {
+    if(text == "true" || text == "yes" || text == "on" || text == "1") {
+        value = true;
+    } else if(text == "false" || text == "no" || text == "off" || text == "0") {
+        value = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// a number followed by one of the units; the first unit is the default
+bool parse_scaled(std::string_view text, std::initializer_list<std::pair<std::string_view, uint64_t>> units,
+                  uint64_t& value) {
+    uint64_t number = 0;
+    auto res = std::from_chars(text.data(), text.data() + text.size(), number);
+    if(res.ec != std::errc() || res.ptr == text.data()) {
+        return false;
+    }
+    std::string_view unit = trim(std::string_view(res.ptr, text.data() + text.size() - res.ptr));
+    for(auto& [name, scale] : units) {
+        if(unit.empty() || unit == name) {
+            value = number * scale;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parse_size(std::string_view text, uint64_t& bytes) {
+    return parse_scaled(text, {{"", 1}, {"K", 1ULL << 10}, {"M", 1ULL << 20}, {"G", 1ULL << 30}}, bytes);
+}
+
+bool parse_duration_ns(std::string_view text, uint64_t& ns) {
+    return parse_scaled(text, {{"s", 1000000000ULL}, {"ms", 1000000ULL}, {"m", 60000000000ULL},
+                               {"h", 3600000000000ULL}}, ns);
+}
+
+std::vector<std::string> split_list(std::string_view text) {
+    std::vector<std::string> items;
+    while(!text.empty()) {
+        size_t comma = text.find(',');
+        std::string_view item = trim(text.substr(0, comma));
+        if(!item.empty() && std::find(items.begin(), items.end(), item) == items.end()) {
+            items.emplace_back(item);
+        }
+        text = comma == std::string_view::npos ? std::string_view() : text.substr(comma + 1);
+    }
+    return items;
+}
+
+const std::set<std::string> kAppenderKeys = {"type", "path", "level", "pattern", "format", "max_size",
+                                             "interval", "max_archives", "async", "queue_size",
+                                             "transport", "address"};
+
+// Checks one appender section; returns the error, or "" if it is valid.
+std::string check_appender(const LogConfig::Appender& spec) {
+    auto get = [&](const char* key) -> const std::string* {
+        auto it = spec.settings.find(key);
+        return it == spec.settings.end() ? nullptr : &it->second;
+    };
+    const std::string* type = get("type");
+    if(!type) {
+        return "appender " + spec.name + " has no type";
+    }
+    if(*type != "stdout" && *type != "file" && *type != "rolling" && *type != "network") {
+        return "appender " + spec.name + ": unknown type " + *type;
+    }
+    if((*type == "file" || *type == "rolling") && !get("path")) {
+        return "appender " + spec.name + " has no path";
+    }
+    if(*type == "network" && !get("address")) {
+        return "appender " + spec.name + " has no address";
+    }
+    if(const std::string* v = get("transport"); v && *v != "udp" && *v != "tcp" && *v != "unix") {
+        return "appender " + spec.name + ": unknown transport " + *v;
+    }
+    LogLevel level;
+    uint64_t number;
+    bool flag;
+    if(const std::string* v = get("level"); v && !parse_level(*v, level)) {
+        return "appender " + spec.name + ": bad level " + *v;
+    }
+    if(const std::string* v = get("format"); v && *v != "pattern" && *v != "json") {
+        return "appender " + spec.name + ": unknown format " + *v;
+    }
+    if(const std::string* v = get("pattern"); v && LogFormatter(*v).is_error()) {
+        return "appender " + spec.name + ": bad pattern " + *v;
+    }
+    if(const std::string* v = get("max_size"); v && !parse_size(*v, number)) {
+        return "appender " + spec.name + ": bad max_size " + *v;
+    }
+    if(const std::string* v = get("interval"); v && *v != "none" && *v != "hourly" && *v != "daily") {
+        return "appender " + spec.name + ": bad interval " + *v;
+    }
+    for(const char* key : {"max_archives", "queue_size"}) {
+        if(const std::string* v = get(key); v && !parse_scaled(*v, {{"", 1}}, number)) {
+            return "appender " + spec.name + ": bad " + key + " " + *v;
+        }
+    }
+    if(const std::string* v = get("async"); v && !parse_bool(*v, flag)) {
+        return "appender " + spec.name + ": bad async " + *v;
+    }
+    return "";
+}
+
+} // namespace
+
+/* ------------ LogConfig ------------ */
+
+LogConfig::ptr LogConfig::parse(std::string_view text, int64_t mtime_ns, std::string& error) {
+    auto config = std::make_shared<LogConfig>();
+    Appender* appender = nullptr;
+    Logger* logger = nullptr;
+    std::set<std::string> appender_names, logger_names;
+    std::vector<int> logger_lines;
+    auto fail = [&](int line, const std::string& message) {
+        error = "line " + std::to_string(line) + ": " + message;
+        return nullptr;
+    };
+
+    int line_num = 0;
+    while(!text.empty()) {
+        size_t eol = text.find('\n');
+        std::string_view line = trim(text.substr(0, eol));
+        text = eol == std::string_view::npos ? std::string_view() : text.substr(eol + 1);
+        ++line_num;
+        if(line.empty() || line[0] == '#' || line[0] == ';') {
+            continue;
+        }
+        if(line[0] == '[') {
+            if(line.back() != ']') {
+                return fail(line_num, "unterminated section header");
+            }
+            std::string_view header = trim(line.substr(1, line.size() - 2));
+            size_t space = header.find_first_of(" \t");
+            std::string_view kind = header.substr(0, space);
+            std::string name(trim(space == std::string_view::npos ? std::string_view() : header.substr(space)));
+            if(name.empty()) {
+                return fail(line_num, "section without a name");
+            }
+            appender = nullptr;
+            logger = nullptr;
+            if(kind == "appender") {
+                if(!appender_names.insert(name).second) {
+                    return fail(line_num, "appender " + name + " defined twice");
+                }
+                config->m_appenders.push_back({name, {}, line_num});
+                appender = &config->m_appenders.back();
+            } else if(kind == "logger") {
+                if(!logger_names.insert(name).second) {
+                    return fail(line_num, "logger " + name + " defined twice");
+                }
+                config->m_loggers.emplace_back();
+                config->m_loggers.back().name = name;
+                logger_lines.push_back(line_num);
+                logger = &config->m_loggers.back();
+            } else {
+                return fail(line_num, "unknown section " + std::string(kind));
+            }
+            continue;
+        }
+        size_t eq = line.find('=');
+        if(eq == std::string_view::npos) {
+            return fail(line_num, "expected key = value");
+        }
+        std::string key(trim(line.substr(0, eq)));
+        std::string_view value = trim(line.substr(eq + 1));
+        if(appender) {
+            if(!kAppenderKeys.count(key)) {
+                return fail(line_num, "unknown appender key " + key);
+            }
+            appender->settings[key] = std::string(value);
+        } else if(logger) {
+            if(key == "level") {
+                if(!parse_level(value, logger->level)) {
+                    return fail(line_num, "bad level " + std::string(value));
+                }
+            } else if(key == "level_for") {
+                uint64_t ns;
+                if(!parse_duration_ns(value, ns) || ns == 0) {
+                    return fail(line_num, "bad level_for " + std::string(value));
+                }
+                logger->level_until_ns = mtime_ns + static_cast<int64_t>(ns);
+            } else if(key == "additive") {
+                if(!parse_bool(value, logger->additive)) {
+                    return fail(line_num, "bad additive " + std::string(value));
+                }
+            } else if(key == "appenders") {
+                logger->appenders = split_list(value);
+            } else {
+                return fail(line_num, "unknown logger key " + key);
+            }
+        } else {
+            return fail(line_num, "key outside a section");
+        }
+    }
+
+    for(const Appender& spec : config->m_appenders) {
+        std::string message = check_appender(spec);
+        if(!message.empty()) {
+            return fail(spec.line, message);
+        }
+    }
+    for(size_t i = 0; i < config->m_loggers.size(); ++i) {
+        const Logger& spec = config->m_loggers[i];
+        if(spec.level_until_ns != 0 && spec.level == LogLevel::UNKNOW) {
+            return fail(logger_lines[i], "logger " + spec.name + ": level_for without a level");
+        }
+        for(const std::string& name : spec.appenders) {
+            if(!appender_names.count(name)) {
+                return fail(logger_lines[i], "logger " + spec.name + ": unknown appender " + name);
+            }
+        }
+    }
+    return config;
+}
+
+LogConfig::ptr LogConfig::load(const std::string& path, std::string& error) {
+    std::ifstream in(path, std::ios::binary);
+    struct stat st;
+    if(!in || stat(path.c_str(), &st) != 0) {
+        error = "cannot read " + path;
+        return nullptr;
+    }
+    std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    int64_t mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    LogConfig::ptr config = parse(text, mtime_ns, error);
+    if(!config) {
+        error = path + ": " + error;
+    }
+    return config;
+}
+
+std::vector<LoggerConfig> LogConfig::resolve(const std::map<std::string, LogAppender::ptr>& appenders,
+                                             int64_t now_ns, int64_t& next_change_ns) const {
+    std::vector<LoggerConfig> configs;
+    next_change_ns = 0;
+    std::map<std::string, LogLevel> levels;
+    for(const Appender& spec : m_appenders) {
+        LogLevel level = LogLevel::DEBUG;
+        if(auto it = spec.settings.find("level"); it != spec.settings.end()) {
+            parse_level(it->second, level);
+        }
+        levels[spec.name] = level;
+    }
+    for(const Logger& spec : m_loggers) {
+        LoggerConfig config;
+        config.name = spec.name;
+        config.level = spec.level;
+        if(spec.level_until_ns != 0) {
+            if(now_ns >= spec.level_until_ns) {
+                config.level = LogLevel::UNKNOW;
+            } else if(next_change_ns == 0 || spec.level_until_ns < next_change_ns) {
+                next_change_ns = spec.level_until_ns;
+            }
+        }
+        config.additive = spec.additive;
+        for(const std::string& name : spec.appenders) {
+            config.appenders.push_back(appenders.at(name));
+            config.appender_levels.push_back(levels.at(name));
+        }
+        configs.push_back(std::move(config));
+    }
+    return configs;
+}
+
+LogAppender::ptr LogConfig::make_appender(const Appender& spec) {
+    auto get = [&](const char* key, const char* fallback) -> std::string {
+        auto it = spec.settings.find(key);
+        return it == spec.settings.end() ? fallback : it->second;
+    };
+    std::string type = get("type", "");
+    LogAppender::ptr appender;
+    if(type == "stdout") {
+        appender = std::make_shared<StdoutLogAppender>();
+    } else if(type == "file") {
+        appender = std::make_shared<FileLogAppender>(get("path", ""));
+    } else if(type == "network") {
+        std::string transport = get("transport", "udp");
+        appender = std::make_shared<NetworkLogAppender>(
+            transport == "tcp" ? NetworkTransport::TCP :
+            transport == "unix" ? NetworkTransport::UNIX : NetworkTransport::UDP, get("address", ""));
+    } else {
+        uint64_t max_size = 0;
+        parse_size(get("max_size", "0"), max_size);
+        std::string interval = get("interval", "none");
+        auto rolling = std::make_shared<RollingFileLogAppender>(
+            get("path", ""), max_size,
+            interval == "hourly" ? RollingInterval::HOURLY :
+            interval == "daily" ? RollingInterval::DAILY : RollingInterval::NONE);
+        uint64_t archives = 7;
+        parse_scaled(get("max_archives", "7"), {{"", 1}}, archives);
+        rolling->set_max_archives(archives);
+        appender = rolling;
+    }
+    bool async = false;
+    parse_bool(get("async", "false"), async);
+    if(async) {
+        uint64_t queue_size = 8192;
+        parse_scaled(get("queue_size", "8192"), {{"", 1}}, queue_size);
+        appender = std::make_shared<AsyncLogAppender>(appender, queue_size);
+    }
+    if(get("format", "pattern") == "json") {
+        appender->set_formatter(std::make_shared<JsonLogFormatter>());
+    } else {
+        // the syslog header already has the time, level and logger
+        appender->set_formatter(std::make_shared<LogFormatter>(
+            get("pattern", type == "network" ? "%m" : kDefaultPattern)));
+    }
+    return appender;
+}
+
+/* ------------ ConfigWatcher ------------ */
+
+// Applies config files and keeps them applied: reloads the watched file
+// when inotify reports it written or replaced, and applies the config again
+// when a level_for runs out. Everything runs under m_mutex, and the
+// background thread only starts once something needs it.
+class ConfigWatcher {
+public:
+    static ConfigWatcher& get_instance() {
+        // leaked, like the other background threads
+        static ConfigWatcher* instance = new ConfigWatcher();
+        return *instance;
+    }
+
+    bool load(const std::string& path) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return load_file(path);
+    }
+
+    bool watch(const std::string& path) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_watch >= 0) {
+            inotify_rm_watch(m_inotify, m_watch);
+            m_watch = -1;
+        }
+        m_path.clear();
+        if(path.empty()) {
+            return true;
+        }
+        if(!start()) {
+            return false;
+        }
+        // watch the directory: editors and deploy tools replace the file.
+        // Not IN_CREATE: the new file is still empty when that arrives.
+        size_t slash = path.rfind('/');
+        std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+        m_watch = inotify_add_watch(m_inotify, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if(m_watch < 0) {
+            std::cout << "[ERROR] LoggerManager::watch_config() cannot watch " << dir
+                      << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        m_path = path;
+        m_name = slash == std::string::npos ? path : path.substr(slash + 1);
+        bool loaded = load_file(path);
+        wake();
+        return loaded;
+    }
+
+private:
+    static int64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    // m_mutex held for the rest
+    bool load_file(const std::string& path) {
+        std::string error;
+        LogConfig::ptr config = LogConfig::load(path, error);
+        if(!config) {
+            std::cout << "[ERROR] LoggerManager::load_config() " << error << std::endl;
+            return false;
+        }
+        m_config = config;
+        apply(now_ns());
+        return true;
+    }
+
+    // Builds what the appender sections describe, reusing the appenders of
+    // the last config whose settings did not change, and hands it all to
+    // LoggerManager::configure() in one go.
+    void apply(int64_t now) {
+        std::map<std::string, LogAppender::ptr> by_name;
+        std::map<std::string, LogAppender::ptr> built;
+        for(const LogConfig::Appender& spec : m_config->get_appenders()) {
+            std::string key = spec.name;
+            for(auto& [name, value] : spec.settings) {
+                if(name != "level") {
+                    key += '\n' + name + '=' + value;
+                }
+            }
+            auto it = m_built.find(key);
+            // a kept appender still serves the current config: its new
+            // level goes in with the new snapshots, see resolve()
+            LogAppender::ptr appender = it != m_built.end() ? it->second : LogConfig::make_appender(spec);
+            by_name[spec.name] = appender;
+            built[key] = appender;
+        }
+
+        int64_t next_change = 0;
+        std::vector<LoggerConfig> configs = m_config->resolve(by_name, now, next_change);
+        std::set<std::string> configured;
+        for(const LoggerConfig& config : configs) {
+            configured.insert(config.name);
+        }
+        std::vector<std::string> reset;
+        for(const std::string& name : m_configured) {
+            if(!configured.count(name)) {
+                reset.push_back(name);
+            }
+        }
+        LoggerManager::get_instance().configure(configs, reset);
+        // appenders no longer used are released here, off the log path
+        m_built.swap(built);
+        m_configured.swap(configured);
+        m_next_change_ns = next_change;
+        if(next_change != 0 && start()) {
+            wake();
+        }
+    }
+
+    bool start() {
+        if(m_started) {
+            return true;
+        }
+        m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if(m_inotify < 0 || pipe2(m_wake, O_NONBLOCK | O_CLOEXEC) != 0) {
+            std::cout << "[ERROR] ConfigWatcher::start() " << strerror(errno) << std::endl;
+            return false;
+        }
+        m_started = true;
+        std::thread(&ConfigWatcher::run, this).detach();
+        return true;
+    }
+
+    void wake() {
+        char c = 0;
+        [[maybe_unused]] ssize_t n = write(m_wake[1], &c, 1);
+    }
+
+    void run() {
+        alignas(struct inotify_event) char buf[4096];
+        for(;;) {
+            int timeout = -1;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if(m_next_change_ns != 0) {
+                    int64_t ms = (m_next_change_ns - now_ns() + 999999) / 1000000;
+                    timeout = static_cast<int>(std::clamp<int64_t>(ms, 0, 60000));
+                }
+            }
+            pollfd fds[2] = {{m_inotify, POLLIN, 0}, {m_wake[0], POLLIN, 0}};
+            poll(fds, 2, timeout);
+            while(read(m_wake[0], buf, sizeof(buf)) > 0) {
+            }
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            bool changed = false;
+            ssize_t len;
+            while((len = read(m_inotify, buf, sizeof(buf))) > 0) {
+                for(char* p = buf; p < buf + len; ) {
+                    auto* event = reinterpret_cast<struct inotify_event*>(p);
+                    if(event->wd == m_watch && event->len > 0 && m_name == event->name) {
+                        changed = true;
+                    }
+                    p += sizeof(struct inotify_event) + event->len;
+                }
+            }
+            if(changed && !m_path.empty()) {
+                load_file(m_path);
+            } else if(m_next_change_ns != 0 && now_ns() >= m_next_change_ns) {
+                apply(now_ns());
+            }
+        }
+    }
+
+private:
+    std::mutex                  m_mutex;
+    LogConfig::ptr              m_config;           // last config loaded
+    std::map<std::string, LogAppender::ptr> m_built;    // its appenders, by settings
+    std::set<std::string>       m_configured;       // loggers it configured
+    int64_t                     m_next_change_ns = 0;   // next level_for to run out, 0 for none
+    bool                        m_started = false;
+    int                         m_inotify = -1;
+    int                         m_wake[2] = {-1, -1};
+    int                         m_watch = -1;
+    std::string                 m_path;             // watched file, "" for none
+    std::string                 m_name;             // its name within the directory
+};
+
+bool LoggerManager::load_config(const std::string& path) {
+    return ConfigWatcher::get_instance().load(path);
+}
+
+bool LoggerManager::watch_config(const std::string& path) {
+    return ConfigWatcher::get_instance().watch(path);
+}
+
+} // namespace gfc
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "logger.hh"
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace gfc {
+
+/* ------------ LogConfig ------------ */
+
+// Loggers and appenders described in an INI-style file, applied by
+// LoggerManager::load_config() and watch_config():
+//
+//     [appender console]
+//     type = stdout
+//     level = WARN
+//
+//     [appender app]
+//     type = rolling
+//     path = /var/log/app.log
+//     pattern = %d{%Y-%m-%d %H:%M:%S.%ms} [%p] [%c] [%t] %m%n
+//     max_size = 64M
+//     interval = daily
+//     async = true
+//
+//     [logger root]
+//     level = INFO
+//     appenders = console, app
+//
+//     # DEBUG for five minutes after this file was saved, then INFO again
+//     [logger db.pool]
+//     level = DEBUG
+//     level_for = 5m
+//
+// Appender keys:
+//   type            stdout, file, rolling or network (required)
+//   path            file and rolling (required)
+//   address         network: host:port, or a path for unix (required)
+//   transport       network: udp (the default), tcp or unix
+//   level           DEBUG, INFO, WARN, ERROR or FATAL
+//   pattern         LogFormatter pattern (network: %m by default), or
+//   format          pattern (the default) or json
+//   max_size        rolling: bytes, with K, M or G
+//   interval        rolling: none, hourly or daily
+//   max_archives    rolling
+//   async           true to put it behind an AsyncLogAppender
+//   queue_size      async
+// Logger keys:
+//   level           inherited when left out
+//   level_for       how long level holds, from the file's modification
+//                   time; ms, s, m or h (seconds by default)
+//   additive        false stops events from going up to the parent's appenders
+//   appenders       comma-separated appender names
+//
+// Lines starting with # or ; are comments. A logger in the file gets
+// exactly the appenders listed; a logger left out of a new version of the
+// file goes back to inheriting its level, with no appenders. Loggers the
+// file never named are not touched. An appender whose settings stay the
+// same across reloads (level aside) is kept, open files and queues with it.
+class LogConfig {
+public:
+    typedef std::shared_ptr<const LogConfig> ptr;
+
+    struct Appender {
+        std::string                         name;
+        std::map<std::string, std::string>  settings;
+        int                                 line = 0;
+    };
+    struct Logger {
+        std::string                 name;
+        LogLevel                    level = LogLevel::UNKNOW;
+        int64_t                     level_until_ns = 0;     // 0: for good
+        bool                        additive = true;
+        std::vector<std::string>    appenders;
+    };
+
+public:
+    // mtime_ns is when the text was written; level_for counts from it.
+    // Returns null and sets error ("line 12: ...") if the text is not valid.
+    static ptr  parse(std::string_view text, int64_t mtime_ns, std::string& error);
+    static ptr  load(const std::string& path, std::string& error);
+
+    // The LoggerConfig of every logger at time now_ns, with the appenders
+    // given by name at the levels their sections set; sets next_change_ns
+    // to the next level_for expiry after now_ns, or 0.
+    std::vector<LoggerConfig> resolve(const std::map<std::string, LogAppender::ptr>& appenders,
+                                      int64_t now_ns, int64_t& next_change_ns) const;
+
+    const std::vector<Appender>&    get_appenders() const { return m_appenders; }
+    const std::vector<Logger>&      get_loggers()   const { return m_loggers; }
+
+    // Builds the appender a section describes; the settings were checked by parse().
+    static LogAppender::ptr make_appender(const Appender& spec);
+
+private:
+    std::vector<Appender>   m_appenders;
+    std::vector<Logger>     m_loggers;
+};
+
+} // namespace gfc
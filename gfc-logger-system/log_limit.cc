@@ -0,0 +1,240 @@
+#include "log_limit.hh"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <thread>
+
+namespace gfc {
+
+namespace {
+
+std::atomic<LogLimiter*> g_limiters{nullptr};
+
+int64_t steady_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Background thread behind set_suppression_report(), started on first use.
+class SuppressionReporter {
+public:
+    static SuppressionReporter& get_instance() {
+        // leaked: limiters are statics that may fire during static destruction
+        static SuppressionReporter* instance = new SuppressionReporter();
+        return *instance;
+    }
+
+    void set(const Logger::ptr& logger, std::chrono::milliseconds interval) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_logger = interval.count() > 0 ? logger : nullptr;
+        m_interval = interval;
+        if(m_logger && !m_started) {
+            m_started = true;
+            std::thread(&SuppressionReporter::run, this).detach();
+        }
+        m_cond.notify_one();
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for(;;) {
+            if(!m_logger) {
+                m_cond.wait(lock);
+                continue;
+            }
+            auto interval = m_interval;
+            if(m_cond.wait_for(lock, interval) == std::cv_status::timeout && m_logger) {
+                Logger::ptr logger = m_logger;
+                lock.unlock();
+                report_suppressed(logger);
+                lock.lock();
+            }
+        }
+    }
+
+private:
+    std::mutex                  m_mutex;
+    std::condition_variable     m_cond;
+    Logger::ptr                 m_logger;
+    std::chrono::milliseconds   m_interval{0};
+    bool                        m_started = false;
+};
+
+// Background thread that logs the "repeated" lines of dedup runs that went
+// quiet, started with the first logger that turns dedup on.
+class RepeatReporter {
+public:
+    static RepeatReporter& get_instance() {
+        // leaked: loggers may be destroyed during static destruction
+        static RepeatReporter* instance = new RepeatReporter();
+        return *instance;
+    }
+
+    void add(Logger* logger) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_loggers.push_back(logger);
+        if(!m_started) {
+            m_started = true;
+            std::thread(&RepeatReporter::run, this).detach();
+            std::atexit([]() { get_instance().report_all(); });
+        }
+        m_cond.notify_one();
+    }
+
+    void remove(Logger* logger) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_loggers.erase(std::remove(m_loggers.begin(), m_loggers.end(), logger), m_loggers.end());
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        int64_t next = 0;
+        for(;;) {
+            if(m_loggers.empty()) {
+                m_cond.wait(lock, [this]() { return !m_loggers.empty(); });
+            } else {
+                // at least 10 ms apart, for intervals of 0, and at most a
+                // minute, for intervals changed meanwhile
+                int64_t wait_ns = std::clamp<int64_t>(next - steady_now_ns(), 10000000, 60000000000);
+                m_cond.wait_for(lock, std::chrono::nanoseconds(wait_ns));
+            }
+            int64_t now = steady_now_ns();
+            next = INT64_MAX;
+            for(Logger* logger : m_loggers) {
+                next = std::min(next, logger->report_repeats(now, false));
+            }
+        }
+    }
+
+    void report_all() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(Logger* logger : m_loggers) {
+            logger->report_repeats(steady_now_ns(), true);
+        }
+    }
+
+private:
+    std::mutex                  m_mutex;
+    std::condition_variable     m_cond;
+    std::vector<Logger*>        m_loggers;
+    bool                        m_started = false;
+};
+
+} // namespace
+
+/* ------------ LogLimiter ------------ */
+
+LogLimiter* LogLimiter::get_first() {
+    return g_limiters.load(std::memory_order_acquire);
+}
+
+void LogLimiter::enlist() {
+    bool registered = false;
+    if(!m_registered.compare_exchange_strong(registered, true, std::memory_order_relaxed)) {
+        return;     // another thread got there first
+    }
+    m_next = g_limiters.load(std::memory_order_relaxed);
+    while(!g_limiters.compare_exchange_weak(m_next, this, std::memory_order_release, std::memory_order_relaxed)) {}
+}
+
+RateLimiter::RateLimiter(const LogSite& site, double per_sec) : LogLimiter(site) {
+    if(per_sec <= 0) {
+        m_interval_ns = INT64_MAX / 4;  // nothing gets through
+        m_burst_ns = 0;
+        return;
+    }
+    m_interval_ns = std::max<int64_t>(1, static_cast<int64_t>(1e9 / per_sec));
+    m_burst_ns = m_interval_ns * std::max<int64_t>(1, static_cast<int64_t>(per_sec));
+}
+
+void report_suppressed(const Logger::ptr& logger) {
+    for(LogLimiter* limiter = LogLimiter::get_first(); limiter; limiter = limiter->get_next()) {
+        const LogSite& site = limiter->get_site();
+        // log() would drop the report along with the count
+        if(site.level < logger->get_level()) {
+            continue;
+        }
+        uint64_t count = limiter->take_suppressed();
+        if(count == 0) {
+            continue;
+        }
+        auto event = LogEvent::create(site, logger->get_name());
+        event->set_content("suppressed " + std::to_string(count) + " messages");
+        logger->log(site.level, event);
+    }
+}
+
+void set_suppression_report(const Logger::ptr& logger, std::chrono::milliseconds interval) {
+    SuppressionReporter::get_instance().set(logger, interval);
+}
+
+/* ------------ DedupFilter ------------ */
+
+DedupFilter::DedupFilter(std::chrono::milliseconds report_interval)
+    : m_interval_ns(std::chrono::duration_cast<std::chrono::nanoseconds>(report_interval).count()) {
+}
+
+void DedupFilter::set_enabled(bool enabled, std::chrono::milliseconds report_interval) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_enabled = enabled;
+    m_interval_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(report_interval).count();
+    if(!enabled) {
+        m_site = nullptr;
+        m_repeats = 0;
+    }
+}
+
+bool DedupFilter::admit(const LogEvent& event, LogEvent::ptr& report) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(!m_enabled) {
+        return true;
+    }
+    int64_t now = steady_now_ns();
+    if(m_site && event.get_level() == m_site->level && event.get_content() == m_content) {
+        ++m_repeats;
+        if(now - m_reported_ns >= m_interval_ns) {
+            report = make_report(now);
+        }
+        return false;
+    }
+    if(m_repeats > 0) {
+        report = make_report(now);
+    }
+    m_site = &event.get_site();
+    m_logger_name = &event.get_logger_name();
+    m_content.assign(event.get_content());
+    m_reported_ns = now;
+    return true;
+}
+
+LogEvent::ptr DedupFilter::take_report(int64_t now_ns, bool force, int64_t& next_ns) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    LogEvent::ptr report;
+    if(m_enabled && m_repeats > 0 && (force || now_ns - m_reported_ns >= m_interval_ns)) {
+        report = make_report(now_ns);
+    }
+    // a run starting now is due one interval after the message it repeats
+    next_ns = m_repeats > 0 ? m_reported_ns + m_interval_ns : now_ns + m_interval_ns;
+    return report;
+}
+
+void DedupFilter::watch(Logger* logger) {
+    RepeatReporter::get_instance().add(logger);
+}
+
+void DedupFilter::unwatch(Logger* logger) {
+    RepeatReporter::get_instance().remove(logger);
+}
+
+LogEvent::ptr DedupFilter::make_report(int64_t now_ns) {
+    auto report = LogEvent::create(*m_site, *m_logger_name);
+    report->set_content("last message repeated " + std::to_string(m_repeats) + " times");
+    m_repeats = 0;
+    m_reported_ns = now_ns;
+    return report;
+}
+
+} // namespace gfc
@@ -0,0 +1,202 @@
+#pragma once
+
+#include "logger.hh"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace gfc {
+
+// Call-site limits for statements that may fire in a tight loop, e.g. an
+// error logged on every request while a dependency is down:
+//
+//     GFC_LOG_ERROR_EVERY_N(logger, 1000) << "connect failed: " << err;
+//     GFC_LOG_WARN_RATE(logger, 5) << "queue full";     // at most ~5 per second
+//     GFC_LOG_INFO_FIRST_N(logger, 3) << "deprecated option " << name;
+//
+// Each statement keeps its limiter in a function-local static next to its
+// LogSite, so the check is an atomic add (or a clock read and a CAS for
+// RATE) with no lookup. Statements below the logger's level do not count,
+// unless an installed FlightRecorder lets them through.
+// What a limiter holds back is counted and can be reported with
+// report_suppressed() or set_suppression_report().
+#define GFC_LOG_LIMITED(logger, level, limiter, arg) \
+    if constexpr (!gfc::is_level_active(level)) ; \
+    else if (static constexpr gfc::LogSite gfc_log_site_{__FILE__, __LINE__, __func__, level}; false) ; \
+    else if (auto&& gfc_logger_ = (logger); !gfc_logger_->is_enabled(level)) ; \
+    else if (static gfc::limiter gfc_log_limiter_(gfc_log_site_, arg); !gfc_log_limiter_.allow()) ; \
+    else gfc::LogEventWrap(gfc_logger_, gfc::LogEvent::create(gfc_log_site_, gfc_logger_->get_name())).get_ss()
+
+// the 1st, n+1st, 2n+1st, ... time
+#define GFC_LOG_EVERY_N(logger, level, n)       GFC_LOG_LIMITED(logger, level, EveryNLimiter, n)
+// the first n times only
+#define GFC_LOG_FIRST_N(logger, level, n)       GFC_LOG_LIMITED(logger, level, FirstNLimiter, n)
+// at most per_sec times a second on average, in bursts of up to per_sec
+#define GFC_LOG_RATE(logger, level, per_sec)    GFC_LOG_LIMITED(logger, level, RateLimiter, per_sec)
+
+#define GFC_LOG_DEBUG_EVERY_N(logger, n)    GFC_LOG_EVERY_N(logger, gfc::LogLevel::DEBUG, n)
+#define GFC_LOG_INFO_EVERY_N(logger, n)     GFC_LOG_EVERY_N(logger, gfc::LogLevel::INFO, n)
+#define GFC_LOG_WARN_EVERY_N(logger, n)     GFC_LOG_EVERY_N(logger, gfc::LogLevel::WARN, n)
+#define GFC_LOG_ERROR_EVERY_N(logger, n)    GFC_LOG_EVERY_N(logger, gfc::LogLevel::ERROR, n)
+#define GFC_LOG_FATAL_EVERY_N(logger, n)    GFC_LOG_EVERY_N(logger, gfc::LogLevel::FATAL, n)
+
+#define GFC_LOG_DEBUG_FIRST_N(logger, n)    GFC_LOG_FIRST_N(logger, gfc::LogLevel::DEBUG, n)
+#define GFC_LOG_INFO_FIRST_N(logger, n)     GFC_LOG_FIRST_N(logger, gfc::LogLevel::INFO, n)
+#define GFC_LOG_WARN_FIRST_N(logger, n)     GFC_LOG_FIRST_N(logger, gfc::LogLevel::WARN, n)
+#define GFC_LOG_ERROR_FIRST_N(logger, n)    GFC_LOG_FIRST_N(logger, gfc::LogLevel::ERROR, n)
+#define GFC_LOG_FATAL_FIRST_N(logger, n)    GFC_LOG_FIRST_N(logger, gfc::LogLevel::FATAL, n)
+
+#define GFC_LOG_DEBUG_RATE(logger, per_sec) GFC_LOG_RATE(logger, gfc::LogLevel::DEBUG, per_sec)
+#define GFC_LOG_INFO_RATE(logger, per_sec)  GFC_LOG_RATE(logger, gfc::LogLevel::INFO, per_sec)
+#define GFC_LOG_WARN_RATE(logger, per_sec)  GFC_LOG_RATE(logger, gfc::LogLevel::WARN, per_sec)
+#define GFC_LOG_ERROR_RATE(logger, per_sec) GFC_LOG_RATE(logger, gfc::LogLevel::ERROR, per_sec)
+#define GFC_LOG_FATAL_RATE(logger, per_sec) GFC_LOG_RATE(logger, gfc::LogLevel::FATAL, per_sec)
+
+/* ------------ LogLimiter ------------ */
+
+// Counts the statements a limiter held back. A limiter joins the process-wide
+// list that report_suppressed() walks the first time it suppresses anything;
+// limiters are function-local statics and never leave it.
+class LogLimiter {
+public:
+    explicit LogLimiter(const LogSite& site) : m_site(site) {}
+    LogLimiter(const LogLimiter&) = delete;
+    LogLimiter& operator=(const LogLimiter&) = delete;
+
+    const LogSite&  get_site() const { return m_site; }
+    // suppressed since the last report
+    uint64_t        get_suppressed() const { return m_suppressed.load(std::memory_order_relaxed); }
+    uint64_t        take_suppressed() { return m_suppressed.exchange(0, std::memory_order_relaxed); }
+
+    static LogLimiter* get_first();     // head of the list of limiters that suppressed something
+    LogLimiter*     get_next() const { return m_next; }
+
+protected:
+    void suppress() {
+        m_suppressed.fetch_add(1, std::memory_order_relaxed);
+        if(!m_registered.load(std::memory_order_relaxed)) {
+            enlist();
+        }
+    }
+
+private:
+    void enlist();
+
+private:
+    const LogSite&          m_site;
+    std::atomic<uint64_t>   m_suppressed{0};
+    std::atomic<bool>       m_registered{false};
+    LogLimiter*             m_next = nullptr;   // fixed once enlisted
+};
+
+class EveryNLimiter : public LogLimiter {
+public:
+    EveryNLimiter(const LogSite& site, uint64_t n) : LogLimiter(site), m_n(n ? n : 1) {}
+    bool allow() {
+        if(m_count.fetch_add(1, std::memory_order_relaxed) % m_n == 0) {
+            return true;
+        }
+        suppress();
+        return false;
+    }
+private:
+    const uint64_t          m_n;
+    std::atomic<uint64_t>   m_count{0};
+};
+
+class FirstNLimiter : public LogLimiter {
+public:
+    FirstNLimiter(const LogSite& site, uint64_t n) : LogLimiter(site), m_n(n) {}
+    bool allow() {
+        // a plain load once the quota is used up, so a storm does not keep
+        // bumping a shared counter
+        if(m_count.load(std::memory_order_relaxed) < m_n &&
+           m_count.fetch_add(1, std::memory_order_relaxed) < m_n) {
+            return true;
+        }
+        suppress();
+        return false;
+    }
+private:
+    const uint64_t          m_n;
+    std::atomic<uint64_t>   m_count{0};
+};
+
+// Generic cell rate algorithm: m_tat is the time the next event is due if
+// events arrived at exactly the allowed rate. An event is let through if
+// that is no more than a burst's worth of intervals ahead of now.
+class RateLimiter : public LogLimiter {
+public:
+    RateLimiter(const LogSite& site, double per_sec);
+    bool allow() {
+        int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t tat = m_tat.load(std::memory_order_relaxed);
+        for(;;) {
+            int64_t next = (tat > now ? tat : now) + m_interval_ns;
+            if(next - now > m_burst_ns) {
+                suppress();
+                return false;
+            }
+            if(m_tat.compare_exchange_weak(tat, next, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+    }
+private:
+    int64_t                 m_interval_ns;  // between events at the allowed rate
+    int64_t                 m_burst_ns;     // how far ahead m_tat may run
+    std::atomic<int64_t>    m_tat{0};
+};
+
+// Logs one line per call site that has held back statements since the last
+// report: "suppressed N messages", at that site's level, to logger. A site
+// whose level logger does not log keeps its count for a later report.
+void report_suppressed(const Logger::ptr& logger);
+// Runs report_suppressed(logger) every interval on a background thread;
+// an interval of 0 stops it.
+void set_suppression_report(const Logger::ptr& logger, std::chrono::milliseconds interval);
+
+/* ------------ DedupFilter ------------ */
+
+// Logger::set_dedup(): collapses a run of identical messages (same level,
+// same text, from any call site) into the first one and a "last message
+// repeated N times" line. That line is logged when a different message
+// arrives, and at most every report interval while the run goes on. A run
+// that ends in silence is reported by a background thread once the
+// interval is up, and at exit.
+class DedupFilter {
+public:
+    explicit DedupFilter(std::chrono::milliseconds report_interval);
+
+    // false if event repeats the previous message. report is set to a
+    // "repeated" event to log first, if one is due.
+    bool    admit(const LogEvent& event, LogEvent::ptr& report);
+    void    set_enabled(bool enabled, std::chrono::milliseconds report_interval);
+    // The pending "repeated" event, if it is due at now_ns or force is set.
+    // Sets next_ns to when to ask again.
+    LogEvent::ptr take_report(int64_t now_ns, bool force, int64_t& next_ns);
+
+    // Has the background thread call logger->report_repeats() when due;
+    // once unwatch() returns it no longer touches logger.
+    static void watch(Logger* logger);
+    static void unwatch(Logger* logger);
+
+private:
+    LogEvent::ptr make_report(int64_t now_ns);
+
+private:
+    std::mutex          m_mutex;
+    bool                m_enabled = true;
+    int64_t             m_interval_ns;
+    const LogSite*      m_site = nullptr;       // of the previous message
+    const std::string*  m_logger_name = nullptr;
+    std::string         m_content;
+    uint64_t            m_repeats = 0;          // since the last report
+    int64_t             m_reported_ns = 0;      // time of the previous message or report
+};
+
+} // namespace gfc
@@ -1,13 +1,265 @@
 #include "logger.hh"
+#include "rcu.hh"
+#include "log_limit.hh"
+#include "flight_recorder.hh"
 
+#include <algorithm>
 #include <cassert>
+#include <charconv>
+#include <cstddef>
+#include <ctime>
 #include <unordered_map>
 #include <functional>
+#include <atomic>
+#include <mutex>
+#include <unordered_set>
+#include <map>
+#include <tuple>
+#include <thread>
+#include <condition_variable>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 namespace gfc {
 
 /* ------------ LogEvent ------------ */
 
+const std::string& intern_logger_name(const std::string& name) {
+    // deliberately leaked: events queued for async appenders may still
+    // point into it while static destructors run
+    static std::mutex* mutex = new std::mutex;
+    static std::unordered_set<std::string>* names = new std::unordered_set<std::string>;
+    std::lock_guard<std::mutex> lock(*mutex);
+    return *names->insert(name).first;
+}
+
+const LogSite& intern_log_site(const char* file, int32_t line, const char* function, LogLevel level) {
+    typedef std::tuple<const char*, int32_t, const char*, LogLevel> Key;
+    // leaked for the same reason as the logger names
+    static std::mutex* mutex = new std::mutex;
+    static std::map<Key, LogSite>* sites = new std::map<Key, LogSite>;
+    std::lock_guard<std::mutex> lock(*mutex);
+    return sites->try_emplace(Key(file, line, function, level), LogSite{file, line, function, level}).first->second;
+}
+
+// Decoded events point at their file and function names like events logged
+// in-process point at __FILE__ and __func__, so the names read back must
+// live as long.
+const char* intern_site_string(std::string_view s) {
+    static std::mutex* mutex = new std::mutex;
+    static std::unordered_set<std::string>* strings = new std::unordered_set<std::string>;
+    std::lock_guard<std::mutex> lock(*mutex);
+    return strings->emplace(s).first->c_str();
+}
+
+// Per-thread cache of LogEvent objects and of the memory for their
+// shared_ptr control blocks. Objects released on the owning thread go back
+// on its private free lists; objects released elsewhere (e.g. by an async
+// writer) are pushed onto a lock-free return stack that the owner takes
+// over in one exchange when its private list runs dry. Pools are never
+// freed: the pool of an exited thread is handed to the next new thread.
+class EventPool {
+public:
+    static const size_t kBlockSize = 64;                // control block memory
+    static const size_t kMaxRetainedContent = 4096;     // larger buffers are released
+
+    static EventPool* local();
+    // shared_ptr deleter of pooled events
+    static void recycle(LogEvent* event) { event->m_pool->release_event(event); }
+
+    LogEvent* acquire_event() {
+        if(!m_events) {
+            m_events = m_remote_events.exchange(nullptr, std::memory_order_acquire);
+        }
+        if(!m_events) {
+            LogEvent* event = new LogEvent();
+            event->m_pool = this;
+            return event;
+        }
+        LogEvent* event = m_events;
+        m_events = event->m_pool_next;
+        return event;
+    }
+
+    void release_event(LogEvent* event) {
+        if(event->m_content.capacity() > kMaxRetainedContent) {
+            std::string().swap(event->m_content);
+        }
+        if(event->m_field_text.capacity() > kMaxRetainedContent) {
+            std::string().swap(event->m_field_text);
+        }
+        if(t_pool == this) {
+            event->m_pool_next = m_events;
+            m_events = event;
+            return;
+        }
+        event->m_pool_next = m_remote_events.load(std::memory_order_relaxed);
+        while(!m_remote_events.compare_exchange_weak(event->m_pool_next, event,
+                std::memory_order_release, std::memory_order_relaxed)) {}
+    }
+
+    void* acquire_block() {
+        if(!m_blocks) {
+            m_blocks = m_remote_blocks.exchange(nullptr, std::memory_order_acquire);
+        }
+        if(!m_blocks) {
+            return ::operator new(kBlockSize);
+        }
+        Block* block = m_blocks;
+        m_blocks = block->next;
+        return block;
+    }
+
+    void release_block(void* memory) {
+        Block* block = static_cast<Block*>(memory);
+        if(t_pool == this) {
+            block->next = m_blocks;
+            m_blocks = block;
+            return;
+        }
+        block->next = m_remote_blocks.load(std::memory_order_relaxed);
+        while(!m_remote_blocks.compare_exchange_weak(block->next, block,
+                std::memory_order_release, std::memory_order_relaxed)) {}
+    }
+
+private:
+    struct Block {
+        Block* next;
+    };
+    // hands the pool over to a later thread when this one exits
+    struct ThreadGuard {
+        ~ThreadGuard();
+    };
+
+    static thread_local EventPool*  t_pool;     // trivially destructible, usable during thread exit
+    // pools of exited threads, leaked on purpose so late releases stay valid
+    static std::mutex               s_orphans_mutex;
+    static std::vector<EventPool*>* s_orphans;
+
+    LogEvent*                       m_events = nullptr;     // owner thread only
+    Block*                          m_blocks = nullptr;     // owner thread only
+    alignas(64) std::atomic<LogEvent*>  m_remote_events{nullptr};
+    alignas(64) std::atomic<Block*>     m_remote_blocks{nullptr};
+};
+
+thread_local EventPool* EventPool::t_pool = nullptr;
+std::mutex              EventPool::s_orphans_mutex;
+std::vector<EventPool*>*EventPool::s_orphans = new std::vector<EventPool*>;
+
+EventPool* EventPool::local() {
+    if(t_pool) {
+        return t_pool;
+    }
+    thread_local ThreadGuard guard;
+    {
+        std::lock_guard<std::mutex> lock(s_orphans_mutex);
+        if(!s_orphans->empty()) {
+            t_pool = s_orphans->back();
+            s_orphans->pop_back();
+        }
+    }
+    if(!t_pool) {
+        t_pool = new EventPool();
+    }
+    return t_pool;
+}
+
+EventPool::ThreadGuard::~ThreadGuard() {
+    EventPool* pool = t_pool;
+    t_pool = nullptr;
+    if(pool) {
+        std::lock_guard<std::mutex> lock(s_orphans_mutex);
+        s_orphans->push_back(pool);
+    }
+}
+
+namespace {
+
+// Routes the shared_ptr control block of pooled events through EventPool.
+template<typename T>
+struct PoolAllocator {
+    typedef T value_type;
+
+    explicit PoolAllocator(EventPool* pool) : m_pool(pool) {}
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U>& other) : m_pool(other.m_pool) {}
+
+    T* allocate(size_t n) {
+        if(n * sizeof(T) <= EventPool::kBlockSize && alignof(T) <= alignof(std::max_align_t)) {
+            return static_cast<T*>(m_pool->acquire_block());
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+    void deallocate(T* p, size_t n) {
+        if(n * sizeof(T) <= EventPool::kBlockSize && alignof(T) <= alignof(std::max_align_t)) {
+            m_pool->release_block(p);
+        } else {
+            ::operator delete(p);
+        }
+    }
+    template<typename U>
+    bool operator==(const PoolAllocator<U>& other) const { return m_pool == other.m_pool; }
+    template<typename U>
+    bool operator!=(const PoolAllocator<U>& other) const { return m_pool != other.m_pool; }
+
+    EventPool* m_pool;
+};
+
+} // namespace
+
+LogEvent::ptr LogEvent::create(const LogSite& site, const std::string& logger_name) {
+    EventPool* pool = EventPool::local();
+    LogEvent* event = pool->acquire_event();
+    event->m_level          = site.level;
+    event->m_site           = &site;
+    event->m_thread_id      = current_thread_id();
+    event->m_coroutine_id   = 0;
+    event->m_elapse         = 0;
+    event->m_time           = LogClock::now();
+    event->m_clock_time     = true;
+    event->m_logger_name    = &logger_name;
+    event->m_content.clear();
+    event->m_fields.clear();
+    event->m_field_text.clear();
+    return LogEvent::ptr(event, &EventPool::recycle, PoolAllocator<LogEvent>(pool));
+}
+
+LogEvent::ptr LogEvent::create( const LogSite& site,
+                                uint32_t thread_id, uint32_t coroutine_id, 
+                                uint32_t elapse, std::chrono::system_clock::time_point time, 
+                                const std::string& logger_name) {
+    EventPool* pool = EventPool::local();
+    LogEvent* event = pool->acquire_event();
+    event->m_level          = site.level;
+    event->m_site           = &site;
+    event->m_thread_id      = thread_id;
+    event->m_coroutine_id   = coroutine_id;
+    event->m_elapse         = elapse;
+    event->m_time           = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    event->m_clock_time     = false;
+    event->m_logger_name    = &logger_name;
+    event->m_content.clear();
+    event->m_fields.clear();
+    event->m_field_text.clear();
+    return LogEvent::ptr(event, &EventPool::recycle, PoolAllocator<LogEvent>(pool));
+}
+
+LogEvent::ptr LogEvent::create( LogLevel level, 
+                                const char* file_name, int32_t line_num, 
+                                uint32_t thread_id, uint32_t coroutine_id, 
+                                uint32_t elapse, std::chrono::system_clock::time_point time, 
+                                const std::string& logger_name) {
+    return create(intern_log_site(file_name, line_num, "", level), thread_id, coroutine_id, elapse, time, logger_name);
+}
+
+LogEvent::LogEvent() : m_level(LogLevel::UNKNOW), m_site(&intern_log_site("", 0, "", LogLevel::UNKNOW)),
+                       m_logger_name(&intern_logger_name("")) {}
+
 LogEvent::LogEvent( LogLevel level, 
                     const char* file_name, int32_t line_num, 
                     uint32_t thread_id, uint32_t coroutine_id, 
@@ -15,14 +267,34 @@ LogEvent::LogEvent( LogLevel level,
                     const std::string& logger_name,
                     const std::string& content) 
                     : 
-                    m_level(level), m_file_name(file_name), m_line_num(line_num),
+                    m_level(level), m_site(&intern_log_site(file_name, line_num, "", level)),
                     m_thread_id(thread_id), m_coroutine_id(coroutine_id),
-                    m_elapse(elapse), m_time(time), 
-                    m_logger_name(logger_name), m_content(content) {}
+                    m_elapse(elapse), m_time(static_cast<int64_t>(time) * 1000000000), 
+                    m_logger_name(&intern_logger_name(logger_name)), m_content(content) {}
 
-std::string LogEvent::get_level_str() const {
+LogEvent::LogEvent( LogLevel level, 
+                    const char* file_name, int32_t line_num, 
+                    uint32_t thread_id, uint32_t coroutine_id, 
+                    uint32_t elapse, std::chrono::system_clock::time_point time, 
+                    const std::string& logger_name,
+                    const std::string& content) 
+                    : 
+                    m_level(level), m_site(&intern_log_site(file_name, line_num, "", level)),
+                    m_thread_id(thread_id), m_coroutine_id(coroutine_id),
+                    m_elapse(elapse), 
+                    m_time(std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count()), 
+                    m_logger_name(&intern_logger_name(logger_name)), m_content(content) {}
+
+time_t LogEvent::get_time() const {
+    // floor, so that times before the epoch stay in the right second
+    int64_t time_ns = get_time_ns();
+    int64_t sec = time_ns / 1000000000;
+    return static_cast<time_t>(time_ns % 1000000000 < 0 ? sec - 1 : sec);
+}
+
+const char* to_string(LogLevel level) {
     #define LOG_LEVEL_NAME_CASE(r) case LogLevel::r: return #r
-    switch (m_level) {
+    switch (level) {
         LOG_LEVEL_NAME_CASE(UNKNOW);
         LOG_LEVEL_NAME_CASE(DEBUG);
         LOG_LEVEL_NAME_CASE(INFO);
@@ -34,133 +306,258 @@ std::string LogEvent::get_level_str() const {
     #undef LOG_LEVEL_NAME_CASE
 }
 
+std::string LogEvent::get_level_str() const {
+    return to_string(m_level);
+}
 
-/* ------------ FormatItem ------------ */
+namespace {
 
-class StringFormatItem :    public LogFormatter::FormatItem {
-public:
-    StringFormatItem(const std::string& str) : m_string(str) {}
-    void format(std::ostream& os, LogEvent::ptr event) override {
-        os << m_string;
-    }
-private:
-    std::string m_string;
-};
+LogField& append_field(std::vector<LogField>& fields, std::string& text, LogField::Type type, std::string_view key) {
+    LogField& field = fields.emplace_back();
+    field.type = type;
+    field.key_len = static_cast<uint32_t>(key.size());
+    field.text_offset = static_cast<uint32_t>(text.size());
+    text.append(key.data(), key.size());
+    return field;
+}
 
-class MessageFormatItem :   public LogFormatter::FormatItem {
-public:
-    void format(std::ostream& os, LogEvent::ptr event) override {
-        os << event->get_content();
-    }
-};
+} // namespace
 
-class LevelFormatItem :     public LogFormatter::FormatItem {
-public:
-    void format(std::ostream& os, LogEvent::ptr event) override {
-        os << event->get_level_str();
-    }
-};
+void LogEvent::add_field(std::string_view key, int64_t value) {
+    append_field(m_fields, m_field_text, LogField::Type::INT, key).i = value;
+}
 
-class ElapseFormatItem :    public LogFormatter::FormatItem {
-public:
-    void format(std::ostream& os, LogEvent::ptr event) override {
-        os << event->get_elapse();
-    }
-};
+void LogEvent::add_field(std::string_view key, uint64_t value) {
+    append_field(m_fields, m_field_text, LogField::Type::UINT, key).u = value;
+}
 
-class LoggerNameFormatItem: public LogFormatter::FormatItem {
-public:
-    void format(std::ostream& os, LogEvent::ptr event) override {
-        os << event->get_logger_name();
-    }
-};
+void LogEvent::add_field(std::string_view key, double value) {
+    append_field(m_fields, m_field_text, LogField::Type::DOUBLE, key).d = value;
+}
 
-class ThreadIdFormatItem :  public LogFormatter::FormatItem {
-public:
-    void format(std::ostream& os, LogEvent::ptr event) override {
-        os << event->get_thread_id();
-    }
-};
+void LogEvent::add_field(std::string_view key, bool value) {
+    append_field(m_fields, m_field_text, LogField::Type::BOOL, key).b = value;
+}
 
-class CoroutineIdFormatItem:public LogFormatter::FormatItem {
-public:
-    void format(std::ostream& os, LogEvent::ptr event) override {
-        os << event->get_coroutine_id();
+void LogEvent::add_field(std::string_view key, std::string_view value) {
+    append_field(m_fields, m_field_text, LogField::Type::STRING, key).str_len = static_cast<uint32_t>(value.size());
+    m_field_text.append(value.data(), value.size());
+}
+
+void LogEvent::set_fields(std::span<const LogField> fields, std::string_view text) {
+    m_fields.assign(fields.begin(), fields.end());
+    m_field_text.assign(text.data(), text.size());
+}
+
+
+/* ------------ LogFormatter ------------ */
+
+LogFormatter::LogFormatter(const std::string& pattern) : m_pattern(pattern) {
+    init();
+}
+
+std::string LogFormatter::format(const LogEvent::ptr& event) {
+    std::string out;
+    format(out, *event);
+    return out;
+}
+
+namespace {
+
+template<typename Int>
+inline void append_int(std::string& out, Int value) {
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, res.ptr - buf);
+}
+
+// %K: the fields as key=value, separated by spaces
+void append_fields(std::string& out, const LogEvent& event) {
+    bool first = true;
+    for(const LogField& field : event.get_fields()) {
+        if(!first) {
+            out.push_back(' ');
+        }
+        first = false;
+        out.append(event.get_field_key(field));
+        out.push_back('=');
+        switch(field.type) {
+            case LogField::Type::INT:
+                append_int(out, field.i);
+                break;
+            case LogField::Type::UINT:
+                append_int(out, field.u);
+                break;
+            case LogField::Type::DOUBLE: {
+                char buf[32];
+                auto res = std::to_chars(buf, buf + sizeof(buf), field.d);
+                out.append(buf, res.ptr - buf);
+                break;
+            }
+            case LogField::Type::BOOL:
+                out.append(field.b ? "true" : "false");
+                break;
+            case LogField::Type::STRING:
+                out.append(event.get_field_string(field));
+                break;
+        }
     }
+}
+
+} // namespace
+
+namespace {
+
+// Per-thread cache of rendered date text for the current second, so that
+// localtime_r()/strftime() run at most once per second per date item.
+struct DateCacheEntry {
+    static const size_t kMaxParts = 5;
+    uint64_t    key = 0;                    // formatter id and date index, 0 = empty
+    int64_t     sec = 0;
+    uint16_t    ends[kMaxParts] = {};       // end offset of each rendered part in text
+    char        text[256];
 };
 
-class NewLineFormatItem :   public LogFormatter::FormatItem {
-public:
-    void format(std::ostream& os, LogEvent::ptr event) override {
-        os << std::endl;
+const size_t kDateCacheSize = 8;
+thread_local DateCacheEntry t_date_cache[kDateCacheSize];
+
+std::atomic<uint64_t> s_formatter_ids{0};
+
+void append_subsecond(std::string& out, int64_t nsec, uint8_t digits) {
+    static const int64_t kDivisor[] = {1, 100000000, 10000000, 1000000, 100000, 10000, 1000, 100, 10, 1};
+    char buf[9];
+    int64_t value = nsec / kDivisor[digits];
+    for(int i = digits - 1; i >= 0; --i) {
+        buf[i] = static_cast<char>('0' + value % 10);
+        value /= 10;
     }
-};
+    out.append(buf, digits);
+}
 
-class DateTimeFormatItem :  public LogFormatter::FormatItem {
-public:
-    DateTimeFormatItem(const std::string& format = "%Y-%m-%d %H:%M:%S") : m_format(format) {
-        if(m_format.empty()) {
-            m_format = "%Y-%m-%d %H:%M:%S";
-        }
+} // namespace
+
+void LogFormatter::format_date(std::string& out, uint32_t index, int64_t time_ns) const {
+    const DateFormat& date = m_dates[index];
+    int64_t sec = time_ns / 1000000000;
+    int64_t nsec = time_ns % 1000000000;
+    if(nsec < 0) {
+        sec -= 1;
+        nsec += 1000000000;
     }
-    void format(std::ostream& os, LogEvent::ptr event) override {
+
+    uint64_t key = (m_id << 8) | index;
+    DateCacheEntry& entry = t_date_cache[(m_id * 31 + index) % kDateCacheSize];
+    if(entry.key != key || entry.sec != sec) {
         struct tm tm;
-        time_t time = event->get_time();
+        time_t time = static_cast<time_t>(sec);
         localtime_r(&time, &tm);
-        char buf[64];
-        strftime(buf, sizeof(buf), m_format.c_str(), &tm);
-        os << buf;
-    }
-private:
-    std::string m_format;
-};
-
-class FileNameFormatItem :  public LogFormatter::FormatItem {
-public:
-    void format(std::ostream& os, LogEvent::ptr event) override {
-        os << event->get_file_name();
+        size_t len = 0;
+        for(size_t i = 0; i < date.parts.size(); ++i) {
+            len += strftime(entry.text + len, sizeof(entry.text) - len, date.parts[i].c_str(), &tm);
+            entry.ends[i] = static_cast<uint16_t>(len);
+        }
+        entry.key = key;
+        entry.sec = sec;
     }
-};
 
-class LineFormatItem :      public LogFormatter::FormatItem {
-public:
-    void format(std::ostream& os, LogEvent::ptr event) override {
-        os << event->get_line_num();
+    size_t begin = 0;
+    for(size_t i = 0; i < date.parts.size(); ++i) {
+        out.append(entry.text + begin, entry.ends[i] - begin);
+        begin = entry.ends[i];
+        if(i < date.digits.size()) {
+            append_subsecond(out, nsec, date.digits[i]);
+        }
     }
-};
+}
 
-class TabFormatItem :       public LogFormatter::FormatItem {
-public:
-    void format(std::ostream& os, LogEvent::ptr event) override {
-        os << "\t";
+void LogFormatter::format(std::string& out, const LogEvent& event) const {
+    size_t size = out.size();
+    if(stats_timing()) {
+        int64_t start = stats_now_ns();
+        format_ops(out, event);
+        m_format_time.record(stats_now_ns() - start);
+    } else {
+        format_ops(out, event);
     }
-};
-
-/* ------------ LogFormatter ------------ */
+    m_counters.add(0);
+    m_counters.add(1, out.size() - size);
+}
 
-LogFormatter::LogFormatter(const std::string& pattern) : m_pattern(pattern) {
-    init();
+FormatterStats LogFormatter::get_stats() const {
+    FormatterStats stats;
+    stats.events = m_counters.get(0);
+    stats.bytes = m_counters.get(1);
+    stats.format_time = m_format_time.snapshot();
+    return stats;
 }
 
-std::string LogFormatter::format(LogEvent::ptr event) {
-    std::stringstream ss;
-    for(auto& item : m_items) {
-        item->format(ss, event);
+void LogFormatter::format_ops(std::string& out, const LogEvent& event) const {
+    const char* literals = m_literals.data();
+    for(const Op& op : m_ops) {
+        switch(op.code) {
+            case OpCode::LITERAL:
+                out.append(literals + op.offset, op.len);
+                break;
+            case OpCode::MESSAGE:
+                out.append(event.get_content());
+                break;
+            case OpCode::LEVEL:
+                out.append(to_string(event.get_level()));
+                break;
+            case OpCode::ELAPSE:
+                append_int(out, event.get_elapse());
+                break;
+            case OpCode::LOGGER_NAME:
+                out.append(event.get_logger_name());
+                break;
+            case OpCode::THREAD_ID:
+                append_int(out, event.get_thread_id());
+                break;
+            case OpCode::COROUTINE_ID:
+                append_int(out, event.get_coroutine_id());
+                break;
+            case OpCode::NEWLINE:
+                out.push_back('\n');
+                break;
+            case OpCode::DATETIME:
+                format_date(out, op.offset, event.get_time_ns());
+                break;
+            case OpCode::FILE_NAME:
+                out.append(event.get_file_name());
+                break;
+            case OpCode::FUNCTION_NAME:
+                out.append(event.get_function_name());
+                break;
+            case OpCode::LINE:
+                append_int(out, event.get_line_num());
+                break;
+            case OpCode::TAB:
+                out.push_back('\t');
+                break;
+            case OpCode::FIELDS:
+                append_fields(out, event);
+                break;
+        }
     }
-    return ss.str();
 }
 
 void LogFormatter::init() {
 
     // 按顺序存储解析到的pattern项
     // 每个pattern包括一个整数类型和一个字符串，类型为0表示该pattern是常规字符串，为1表示该pattern需要转义
-    // 日期格式单独用下面的dataformat存储
+    // 日期格式单独用下面的dateformats存储，每个%d按出现顺序对应一项
     std::vector<std::pair<bool, std::string>> patterns;
     std::string tmp;            // 临时存储常规字符串
-    std::string dateformat;     // 日期格式字符串，默认把位于%d后面的大括号对里的全部字符都当作格式字符，不校验格式是否合法
+    std::vector<std::string> dateformats; // 日期格式字符串，默认把位于%d后面的大括号对里的全部字符都当作格式字符，不校验格式是否合法
     bool error = false;         // 是否解析出错
     bool parsing_string = true; // 是否正在解析常规字符，初始时为true
 
+    m_error = false;
+    m_ops.clear();
+    m_literals.clear();
+    m_dates.clear();
+    m_id = ++s_formatter_ids;
+
     size_t i = 0;
     while(i < m_pattern.size()) {
         std::string c = std::string(1, m_pattern[i]);
@@ -195,15 +592,16 @@ void LogFormatter::init() {
                     continue;
                 }
                 else {
-                    if(i < m_pattern.size() && m_pattern[i] != '{') {
+                    dateformats.emplace_back();
+                    if(i >= m_pattern.size() || m_pattern[i] != '{') {
                         continue;
                     }
                     i++;
                     while( i < m_pattern.size() && m_pattern[i] != '}') {
-                        dateformat.push_back(m_pattern[i]);
+                        dateformats.back().push_back(m_pattern[i]);
                         i++;
                     }
-                    if(m_pattern[i] != '}') {
+                    if(i >= m_pattern.size()) {
                         // %d后面的大括号没有闭合，直接报错
                         std::cout << "[ERROR] LogFormatter::init() " << "pattern: [" << m_pattern << "] '{' not closed" << std::endl;
                         error = true;
@@ -235,56 +633,114 @@ void LogFormatter::init() {
         %c - class name
         %t - thread id
         %n - new line
-        %d - time yyyy-mm-dd HH:MM:SS [ISO 8601]
+        %d - time yyyy-mm-dd HH:MM:SS [ISO 8601], %d{...} takes a strftime format
+             plus %ms / %us / %ns for milli- / micro- / nanoseconds
         %f - file name
         %l - line number
+        %M - function name
         extends:
         %T - tab
+        %K - key/value fields as key=value, space separated
+        %% - literal '%'
     */
 
-    auto createFormatItem = [](const std::string& str) -> FormatItem::ptr {
+    auto opcodeOf = [](const std::string& str, OpCode& code) -> bool {
 
-        #define CREATE_FORMAT_ITEM(format, FormatItemClass) \
+        #define FORMAT_ITEM_OPCODE(format, op) \
             if (str == format) { \
-                return std::make_shared<FormatItemClass>(); \
+                code = OpCode::op; \
+                return true; \
             }
 
-        CREATE_FORMAT_ITEM("m", MessageFormatItem)
-        CREATE_FORMAT_ITEM("p", LevelFormatItem)
-        CREATE_FORMAT_ITEM("r", ElapseFormatItem)
-        CREATE_FORMAT_ITEM("c", LoggerNameFormatItem)
-        CREATE_FORMAT_ITEM("t", ThreadIdFormatItem)
-        CREATE_FORMAT_ITEM("n", NewLineFormatItem)
-        CREATE_FORMAT_ITEM("f", FileNameFormatItem)
-        CREATE_FORMAT_ITEM("l", LineFormatItem) 
-        CREATE_FORMAT_ITEM("T", TabFormatItem)
+        FORMAT_ITEM_OPCODE("m", MESSAGE)
+        FORMAT_ITEM_OPCODE("p", LEVEL)
+        FORMAT_ITEM_OPCODE("r", ELAPSE)
+        FORMAT_ITEM_OPCODE("c", LOGGER_NAME)
+        FORMAT_ITEM_OPCODE("t", THREAD_ID)
+        FORMAT_ITEM_OPCODE("n", NEWLINE)
+        FORMAT_ITEM_OPCODE("f", FILE_NAME)
+        FORMAT_ITEM_OPCODE("l", LINE)
+        FORMAT_ITEM_OPCODE("M", FUNCTION_NAME)
+        FORMAT_ITEM_OPCODE("T", TAB)
+        FORMAT_ITEM_OPCODE("K", FIELDS)
 
-        return nullptr;
+        return false;
 
-        #undef CREATE_FORMAT_ITEM
+        #undef FORMAT_ITEM_OPCODE
 
     };
 
+    // 相邻的常规字符串合并成一个LITERAL
+    auto appendLiteral = [this](const std::string& str) {
+        if(!m_ops.empty() && m_ops.back().code == OpCode::LITERAL &&
+           m_ops.back().offset + m_ops.back().len == m_literals.size()) {
+            m_ops.back().len += str.size();
+        } else {
+            m_ops.push_back(Op{OpCode::LITERAL, static_cast<uint32_t>(m_literals.size()), static_cast<uint32_t>(str.size())});
+        }
+        m_literals += str;
+    };
+
+    // %d{...}中的%ms/%us/%ns是秒以下的字段，把日期格式在这些字段处切开，
+    // 切开的每一段仍交给strftime处理
+    auto compileDate = [this](const std::string& dateformat) -> bool {
+        DateFormat date;
+        date.parts.emplace_back();
+        for(size_t j = 0; j < dateformat.size(); ++j) {
+            if(dateformat[j] == '%' && dateformat.compare(j + 1, 2, "ms") == 0) {
+                date.digits.push_back(3);
+            } else if(dateformat[j] == '%' && dateformat.compare(j + 1, 2, "us") == 0) {
+                date.digits.push_back(6);
+            } else if(dateformat[j] == '%' && dateformat.compare(j + 1, 2, "ns") == 0) {
+                date.digits.push_back(9);
+            } else {
+                date.parts.back().push_back(dateformat[j]);
+                if(dateformat[j] == '%' && j + 1 < dateformat.size()) {
+                    date.parts.back().push_back(dateformat[++j]);  // keep %% and %x pairs intact
+                }
+                continue;
+            }
+            date.parts.emplace_back();
+            j += 2;
+        }
+        if(date.parts.size() > DateCacheEntry::kMaxParts) {
+            return false;
+        }
+        m_ops.push_back(Op{OpCode::DATETIME, static_cast<uint32_t>(m_dates.size())});
+        m_dates.push_back(std::move(date));
+        return true;
+    };
+
+    size_t date_index = 0;
     for(auto &[is_pattern, fmt_str] : patterns) {
         // common string
         if(is_pattern == false) {
-            m_items.push_back(std::make_shared<StringFormatItem>(fmt_str));
+            appendLiteral(fmt_str);
         } 
         // pattern string
         else {
+            OpCode code;
             if( fmt_str =="d") {
-                m_items.push_back(std::make_shared<DateTimeFormatItem>(dateformat));
-            } else {
-                auto item = createFormatItem(fmt_str);
-                if(item) {
-                    m_items.push_back(item);
-                } else {
-                    std::cout <<"[ERROR] LogFormatter::init() " 
-                                "pattern: [" << m_pattern << "] " << 
-                                "unknown format item: " << fmt_str << std::endl;
+                std::string dateformat = dateformats[date_index++];
+                if(dateformat.empty()) {
+                    dateformat = "%Y-%m-%d %H:%M:%S";
+                }
+                if(!compileDate(dateformat)) {
+                    std::cout << "[ERROR] LogFormatter::init() " << "pattern: [" << m_pattern << "] "
+                                 "too many sub-second fields in %d{" << dateformat << "}" << std::endl;
                     error = true;
                     break;
                 }
+            } else if(fmt_str == "%") {
+                appendLiteral(fmt_str);
+            } else if(opcodeOf(fmt_str, code)) {
+                m_ops.push_back(Op{code});
+            } else {
+                std::cout <<"[ERROR] LogFormatter::init() " 
+                            "pattern: [" << m_pattern << "] " << 
+                            "unknown format item: " << fmt_str << std::endl;
+                error = true;
+                break;
             }
         }
     } // end for loop
@@ -297,67 +753,575 @@ void LogFormatter::init() {
 }
 
 
+/* ------------ FormattedEvent ------------ */
+
+namespace {
+
+struct FormattedText {
+    LogFormatter::ptr   formatter;      // held so its address cannot be reused meanwhile
+    std::string         text;
+};
+
+// Stack of buffers shared by the FormattedEvents of a thread; nested log
+// calls (an appender that logs) take the buffers above their caller's.
+// unique_ptr keeps handed-out text in place when the vector grows.
+thread_local std::vector<std::unique_ptr<FormattedText>> t_formatted;
+thread_local size_t t_formatted_top = 0;
+
+} // namespace
+
+FormattedEvent::FormattedEvent(const LogEvent::ptr& event)
+    : m_event(event), m_base(t_formatted_top) {
+}
+
+FormattedEvent::~FormattedEvent() {
+    for(size_t i = m_base; i < t_formatted_top; ++i) {
+        t_formatted[i]->formatter.reset();
+    }
+    t_formatted_top = m_base;
+}
+
+std::string_view FormattedEvent::format(const LogFormatter::ptr& formatter) {
+    for(size_t i = m_base; i < t_formatted_top; ++i) {
+        if(t_formatted[i]->formatter == formatter) {
+            return t_formatted[i]->text;
+        }
+    }
+    if(t_formatted_top == t_formatted.size()) {
+        t_formatted.push_back(std::make_unique<FormattedText>());
+    }
+    FormattedText& slot = *t_formatted[t_formatted_top++];
+    slot.formatter = formatter;
+    slot.text.clear();
+    formatter->format(slot.text, *m_event);
+    return slot.text;
+}
+
+size_t FormattedEvent::get_format_count() const {
+    return t_formatted_top - m_base;
+}
+
 /* ------------ LogAppender ------------ */
 
-void StdoutLogAppender::log(LogEvent::ptr event) {
-    std::cout << m_formatter->format(event);
+AppenderStats LogAppender::get_stats() const {
+    AppenderStats stats;
+    auto counters = m_counters.snapshot();
+    stats.events = counters[STAT_EVENTS];
+    stats.bytes = counters[STAT_BYTES];
+    stats.writes = counters[STAT_WRITES];
+    stats.flushes = counters[STAT_FLUSHES];
+    stats.write_time = m_write_time.snapshot();
+    return stats;
+}
+
+void StdoutLogAppender::log(const LogEvent::ptr& event) {
+    thread_local std::string buf;
+    buf.clear();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_formatter->format(buf, *event);
+    count_events(1);
+    write_out(buf.data(), buf.size());
+}
+
+void StdoutLogAppender::log_batch(std::span<const LogEvent::ptr> events) {
+    thread_local std::string buf;
+    buf.clear();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(const LogEvent::ptr& event : events) {
+        m_formatter->format(buf, *event);
+    }
+    count_events(events.size());
+    write_out(buf.data(), buf.size());
+}
+
+void StdoutLogAppender::log_formatted(FormattedEvent& formatted) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::string_view text = formatted.format(m_formatter);
+    count_events(1);
+    write_out(text.data(), text.size());
+}
+
+void StdoutLogAppender::flush() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::cout.flush();
+    count_flush();
 }
 
-FileLogAppender::FileLogAppender(const std::string& filename) : m_filename(filename) {
-    m_filestream.open(filename);
+void StdoutLogAppender::write_out(const char* data, size_t len) {
+    int64_t start = write_start();
+    std::cout.write(data, len);
+    count_write(len, start);
+}
+
+// Background thread behind the flush and sync intervals of file appenders.
+// It starts with the first file appender and idles while there is none.
+class FileFlusher {
+public:
+    static FileFlusher& get_instance() {
+        // leaked: appenders may outlive static destructors
+        static FileFlusher* instance = new FileFlusher();
+        return *instance;
+    }
+
+    void add(FileLogAppender* appender) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_appenders.push_back(appender);
+        if(!m_started) {
+            m_started = true;
+            std::thread(&FileFlusher::run, this).detach();
+        }
+        m_cond.notify_one();
+    }
+
+    // Once this returns the flusher no longer touches appender.
+    void remove(FileLogAppender* appender) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_appenders.erase(std::remove(m_appenders.begin(), m_appenders.end(), appender), m_appenders.end());
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for(;;) {
+            if(m_appenders.empty()) {
+                m_cond.wait(lock, [this]() { return !m_appenders.empty(); });
+            } else {
+                m_cond.wait_for(lock, std::chrono::milliseconds(50));
+            }
+            int64_t now = stats_now_ns();
+            for(FileLogAppender* appender : m_appenders) {
+                appender->flush_if_due(now);
+            }
+        }
+    }
+
+private:
+    std::mutex                      m_mutex;
+    std::condition_variable         m_cond;
+    std::vector<FileLogAppender*>   m_appenders;
+    bool                            m_started = false;
+};
+
+FileLogAppender::FileLogAppender(const std::string& filename, size_t buffer_size) 
+    : m_filename(filename), m_buffer_size(buffer_size) {
+    m_buffer.reserve(buffer_size);
+    open_file();
+    FileFlusher::get_instance().add(this);
+}
+
+FileLogAppender::~FileLogAppender() {
+    FileFlusher::get_instance().remove(this);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    write_buffer();
+    if(m_durability != FileDurability::NONE && m_unsynced) {
+        sync_file();
+    }
+    if(m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+bool FileLogAppender::open_file() {
+    m_fd = open(m_filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(m_fd < 0) {
+        std::cout << "[ERROR] FileLogAppender::open_file() cannot open " << m_filename 
+                  << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat st;
+    m_file_size = fstat(m_fd, &st) == 0 ? st.st_size : 0;
+    return true;
+}
+
+bool FileLogAppender::write_buffer() {
+    if(m_buffer.empty() && m_chunks.empty()) {
+        return true;
+    }
+    std::vector<struct iovec>& iov = m_iov;
+    iov.clear();
+    for(std::string& chunk : m_chunks) {
+        iov.push_back({chunk.data(), chunk.size()});
+    }
+    if(!m_buffer.empty()) {
+        iov.push_back({m_buffer.data(), m_buffer.size()});
+    }
+    size_t first = 0;
+    uint64_t written = 0;
+    int64_t start = write_start();
+    bool ok = m_fd >= 0;
+    while(ok && first < iov.size()) {
+        ssize_t n = writev(m_fd, &iov[first], std::min<size_t>(iov.size() - first, IOV_MAX));
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            std::cout << "[ERROR] FileLogAppender::write_buffer() write to " << m_filename 
+                      << " failed: " << strerror(errno) << std::endl;
+            ok = false;
+            break;
+        }
+        m_file_size += n;
+        written += n;
+        // skip what was written, possibly ending inside an iovec
+        while(first < iov.size() && static_cast<size_t>(n) >= iov[first].iov_len) {
+            n -= iov[first].iov_len;
+            ++first;
+        }
+        if(first < iov.size()) {
+            iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + n;
+            iov[first].iov_len -= n;
+        }
+    }
+    count_write(written, start);
+    m_unsynced = true;
+    m_buffer.clear();
+    for(std::string& chunk : m_chunks) {
+        chunk.clear();
+        m_spare_chunks.push_back(std::move(chunk));
+    }
+    m_chunks.clear();
+    m_chunked = 0;
+    return ok;
+}
+
+void FileLogAppender::sync_file() {
+    if(m_fd >= 0) {
+        fdatasync(m_fd);
+    }
+    m_syncs.fetch_add(1, std::memory_order_relaxed);
+    m_unsynced = false;
+    m_synced_at_ns = stats_now_ns();
 }
 
 bool FileLogAppender::reopen() {
-    if(m_filestream) {
-        m_filestream.close();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    write_buffer();
+    if(m_fd >= 0) {
+        close(m_fd);
     }
-    m_filestream.open(m_filename);
-    return static_cast<bool>(m_filestream);
+    return open_file();
 }
 
-void FileLogAppender::log(LogEvent::ptr event) {
-    m_filestream << m_formatter->format(event);
+void FileLogAppender::log(const LogEvent::ptr& event) {
+    log_batch(std::span<const LogEvent::ptr>(&event, 1));
+}
+
+void FileLogAppender::log_batch(std::span<const LogEvent::ptr> events) {
+    if(events.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // deadlines run from when the lines arrived, not from their time stamps
+    if(get_buffered_size() == 0) {
+        m_buffered_since_ns = stats_now_ns();
+    }
+    LogLevel max_level = LogLevel::DEBUG;
+    for(const LogEvent::ptr& event : events) {
+        on_event(*event);
+        if(m_buffer.size() >= m_buffer_size) {
+            // keep the full buffer for the writev and carry on in a new chunk
+            m_chunked += m_buffer.size();
+            m_chunks.push_back(std::move(m_buffer));
+            if(m_spare_chunks.empty()) {
+                m_buffer = std::string();
+                m_buffer.reserve(m_buffer_size);
+            } else {
+                m_buffer = std::move(m_spare_chunks.back());
+                m_spare_chunks.pop_back();
+            }
+        }
+        m_formatter->format(m_buffer, *event);
+        max_level = std::max(max_level, event->get_level());
+    }
+    count_events(events.size());
+
+    write_if_due(max_level);
+}
+
+void FileLogAppender::log_formatted(FormattedEvent& formatted) {
+    const LogEvent& event = *formatted.get_event();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    on_event(event);
+    if(get_buffered_size() == 0) {
+        m_buffered_since_ns = stats_now_ns();
+    }
+    m_buffer.append(formatted.format(m_formatter));
+    count_events(1);
+    write_if_due(event.get_level());
+}
+
+void FileLogAppender::write_if_due(LogLevel max_level) {
+    if(get_buffered_size() >= m_buffer_size || max_level >= LogLevel::ERROR || m_flush_interval_ns == 0) {
+        write_buffer();
+        if(max_level == LogLevel::FATAL && m_durability == FileDurability::SYNC_ON_FATAL) {
+            sync_file();
+        } else if(m_durability == FileDurability::SYNC_INTERVAL && 
+                  stats_now_ns() - m_synced_at_ns >= m_sync_interval_ns) {
+            sync_file();
+        }
+    }
+}
+
+void FileLogAppender::flush() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    write_buffer();
+    count_flush();
+}
+
+void FileLogAppender::flush_if_due(int64_t now_ns) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(!m_buffer.empty() && now_ns - m_buffered_since_ns >= m_flush_interval_ns) {
+        write_buffer();
+    }
+    if(m_durability == FileDurability::SYNC_INTERVAL && m_unsynced && 
+       now_ns - m_synced_at_ns >= m_sync_interval_ns) {
+        sync_file();
+    }
+}
+
+void FileLogAppender::set_flush_interval(std::chrono::milliseconds interval) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_flush_interval_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count();
+}
+
+void FileLogAppender::set_durability(FileDurability durability, std::chrono::milliseconds sync_interval) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_durability = durability;
+    m_sync_interval_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(sync_interval).count();
 }
 
 /* ------------ Logger ------------ */
 
-Logger::Logger(const std::string& name) : m_name(name), m_level(LogLevel::DEBUG) {
+namespace {
+
+// Guards the shape of the logger tree (parents, children) and serializes
+// recomputing effective levels. Taken after LoggerManager::m_mutex.
+std::mutex& tree_mutex() {
+    static std::mutex* mutex = new std::mutex();
+    return *mutex;
+}
+
+} // namespace
+
+Logger::Logger(const std::string& name) 
+    : m_name(&intern_logger_name(name)), m_level(LogLevel::DEBUG), m_effective_level(LogLevel::DEBUG),
+      m_targets(new Targets{LogLevel::DEBUG, {}}) {
     m_formatter = std::make_shared<LogFormatter>("%d{%Y-%m-%d %H:%M:%S} [%p] [%c] [%t] [%f:%l] %m%n");
 }
 
-void Logger::log(LogLevel level, LogEvent::ptr event) {
-    if(level >= m_level) {
-        for(auto& appender : m_appenders) {
-            appender->log(event);
+Logger::~Logger() {
+    if(DedupFilter* dedup = m_dedup.load(std::memory_order_relaxed)) {
+        DedupFilter::unwatch(this);
+        report_repeats(0, true);
+        delete dedup;
+    }
+    delete m_targets.load(std::memory_order_relaxed);
+}
+
+void Logger::log(LogLevel level, const LogEvent::ptr& event) {
+    size_t index = static_cast<size_t>(level) % 6;
+    if(static_cast<int>(level) >= record_level_flag().load(std::memory_order_relaxed)) {
+        if(FlightRecorder* recorder = FlightRecorder::get_installed()) {
+            recorder->record(*event);
+        }
+    }
+    if(level < get_level()) {
+        m_counters.add(6 + index);
+        return;
+    }
+    RcuReadGuard guard;
+    const Targets* targets = rcu_dereference(m_targets);
+    // the level of the same snapshot as the appenders, in case a change
+    // came in since get_level()
+    if(level < targets->level) {
+        m_counters.add(6 + index);
+        return;
+    }
+    if(DedupFilter* dedup = m_dedup.load(std::memory_order_acquire)) {
+        LogEvent::ptr report;
+        bool admitted = dedup->admit(*event, report);
+        if(report) {
+            dispatch(*targets, report->get_level(), report);
+        }
+        if(!admitted) {
+            m_counters.add(6 + index);
+            return;
         }
     }
+    m_counters.add(index);
+    dispatch(*targets, level, event);
 }
-void Logger::debug(LogEvent::ptr event) {
+
+LoggerStats Logger::get_stats() const {
+    LoggerStats stats;
+    auto counters = m_counters.snapshot();
+    for(size_t i = 0; i < 6; ++i) {
+        stats.emitted[i] = counters[i];
+        stats.filtered[i] = counters[6 + i];
+    }
+    return stats;
+}
+
+void Logger::dispatch(const Targets& targets, LogLevel level, const LogEvent::ptr& event) {
+    FormattedEvent formatted(event);
+    for(const Target& target : targets.appenders) {
+        if(level >= (target.level != LogLevel::UNKNOW ? target.level : target.appender->get_level())) {
+            target.appender->log_formatted(formatted);
+        }
+    }
+}
+void Logger::debug(const LogEvent::ptr& event) {
     log(LogLevel::DEBUG, event);
 }
-void Logger::info(LogEvent::ptr event) {
+void Logger::info(const LogEvent::ptr& event) {
     log(LogLevel::INFO, event);
 }
-void Logger::warn(LogEvent::ptr event) {
+void Logger::warn(const LogEvent::ptr& event) {
     log(LogLevel::WARN, event);
 }
-void Logger::error(LogEvent::ptr event) {
+void Logger::error(const LogEvent::ptr& event) {
     log(LogLevel::ERROR, event);
 }
-void Logger::fatal(LogEvent::ptr event) {
+void Logger::fatal(const LogEvent::ptr& event) {
     log(LogLevel::FATAL, event);
 }
 
+void Logger::update_targets(std::vector<const Targets*>& retired) {
+    Targets* targets = new Targets{get_level(), m_appenders};
+    Logger* parent = m_parent.load(std::memory_order_relaxed);
+    if(parent && is_additive()) {
+        const Targets* inherited = parent->m_targets.load(std::memory_order_relaxed);
+        targets->appenders.insert(targets->appenders.end(), inherited->appenders.begin(),
+                                  inherited->appenders.end());
+    }
+    retired.push_back(rcu_assign<const Targets>(m_targets, targets));
+    for(Logger* child : m_children) {
+        child->update_targets(retired);
+    }
+}
+
+void Logger::free_retired(std::vector<const Targets*>& retired) {
+    if(retired.empty()) {
+        return;
+    }
+    // wait for log() calls that may still iterate the old lists
+    rcu_synchronize();
+    for(const Targets* targets : retired) {
+        delete targets;
+    }
+    retired.clear();
+}
+
 void Logger::add_appender(LogAppender::ptr appender) {
-    appender->set_formatter(m_formatter);
-    m_appenders.push_back(appender); 
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        appender->set_formatter(m_formatter);
+    }
+    std::vector<const Targets*> retired;
+    {
+        std::lock_guard<std::mutex> lock(tree_mutex());
+        m_appenders.push_back({appender, LogLevel::UNKNOW});
+        update_targets(retired);
+    }
+    free_retired(retired);
 }
 void Logger::del_appender(LogAppender::ptr appender) {
-    for(auto it = m_appenders.begin(); it != m_appenders.end(); ++it) {
-        if(*it == appender) {
-            m_appenders.erase(it);
-            break;
+    std::vector<const Targets*> retired;
+    {
+        std::lock_guard<std::mutex> lock(tree_mutex());
+        auto it = std::find_if(m_appenders.begin(), m_appenders.end(),
+                               [&](const Target& target) { return target.appender == appender; });
+        if(it == m_appenders.end()) {
+            return;
         }
+        m_appenders.erase(it);
+        update_targets(retired);
+    }
+    free_retired(retired);
+}
+
+std::vector<LogAppender::ptr> Logger::get_appenders() const {
+    std::lock_guard<std::mutex> lock(tree_mutex());
+    std::vector<LogAppender::ptr> appenders;
+    for(const Target& target : m_appenders) {
+        appenders.push_back(target.appender);
+    }
+    return appenders;
+}
+
+void Logger::set_additive(bool additive) {
+    std::vector<const Targets*> retired;
+    {
+        std::lock_guard<std::mutex> lock(tree_mutex());
+        m_additive.store(additive, std::memory_order_relaxed);
+        update_targets(retired);
+    }
+    free_retired(retired);
+}
+
+void Logger::set_formatter(LogFormatter::ptr formatter) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_formatter = formatter;
+}
+
+void Logger::set_dedup(bool enable, std::chrono::milliseconds report_interval) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(DedupFilter* dedup = m_dedup.load(std::memory_order_relaxed)) {
+        dedup->set_enabled(enable, report_interval);
+    } else if(enable) {
+        m_dedup.store(new DedupFilter(report_interval), std::memory_order_release);
+        DedupFilter::watch(this);
+    }
+}
+
+int64_t Logger::report_repeats(int64_t now_ns, bool force) {
+    DedupFilter* dedup = m_dedup.load(std::memory_order_acquire);
+    if(!dedup) {
+        return INT64_MAX;
+    }
+    int64_t next_ns;
+    LogEvent::ptr report = dedup->take_report(now_ns, force, next_ns);
+    if(report) {
+        RcuReadGuard guard;
+        dispatch(*rcu_dereference(m_targets), report->get_level(), report);
+    }
+    return next_ns;
+}
+
+void Logger::set_level(LogLevel level) {
+    std::vector<const Targets*> retired;
+    {
+        std::lock_guard<std::mutex> lock(tree_mutex());
+        m_level.store(level, std::memory_order_relaxed);
+        update_effective_level();
+        update_targets(retired);
+    }
+    free_retired(retired);
+}
+
+void Logger::set_parent(Logger* parent, std::vector<const Targets*>& retired) {
+    Logger* old = m_parent.load(std::memory_order_relaxed);
+    if(old) {
+        auto& siblings = old->m_children;
+        siblings.erase(std::remove(siblings.begin(), siblings.end(), this), siblings.end());
+    }
+    if(parent) {
+        parent->m_children.push_back(this);
+    }
+    m_parent.store(parent, std::memory_order_release);
+    update_effective_level();
+    update_targets(retired);
+}
+
+void Logger::update_effective_level() {
+    LogLevel level = m_level.load(std::memory_order_relaxed);
+    if(level == LogLevel::UNKNOW) {
+        Logger* parent = m_parent.load(std::memory_order_relaxed);
+        level = parent ? parent->get_level() : LogLevel::DEBUG;
+    }
+    m_effective_level.store(level, std::memory_order_relaxed);
+    for(Logger* child : m_children) {
+        child->update_effective_level();
     }
 }
 
@@ -375,18 +1339,219 @@ LoggerManager& LoggerManager::get_instance() {
     return instance;
 }
 
+Logger::ptr LoggerManager::get_logger(const std::string& name) {
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        auto it = m_loggers.find(name);
+        if(it != m_loggers.end()) {
+            return it->second;
+        }
+    }
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    return get_or_create(name);
+}
+
+std::vector<Logger::ptr> LoggerManager::get_loggers() const {
+    std::vector<Logger::ptr> loggers;
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        loggers.reserve(m_loggers.size());
+        for(auto& i : m_loggers) {
+            loggers.push_back(i.second);
+        }
+    }
+    std::sort(loggers.begin(), loggers.end(), [](const Logger::ptr& a, const Logger::ptr& b) {
+        return a->get_name() < b->get_name();
+    });
+    return loggers;
+}
+
+Logger::ptr LoggerManager::find_logger(const std::string& name) const {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    auto it = m_loggers.find(name);
+    return it == m_loggers.end() ? nullptr : it->second;
+}
+
+Logger::ptr LoggerManager::get_or_create(const std::string& name) {
+    auto it = m_loggers.find(name);
+    if(it != m_loggers.end()) {
+        return it->second;
+    }
+    Logger::ptr parent = parent_of(name);
+    Logger::ptr logger = std::make_shared<Logger>(name);
+    std::vector<const Logger::Targets*> retired;
+    {
+        std::lock_guard<std::mutex> lock(tree_mutex());
+        logger->m_level.store(LogLevel::UNKNOW, std::memory_order_relaxed);
+        logger->set_parent(parent.get(), retired);
+    }
+    Logger::free_retired(retired);
+    m_loggers[name] = logger;
+    return logger;
+}
+
+Logger::ptr LoggerManager::parent_of(const std::string& name) {
+    size_t dot = name.rfind('.');
+    if(dot == std::string::npos || dot == 0) {
+        return m_root_logger;
+    }
+    return get_or_create(name.substr(0, dot));
+}
+
 void LoggerManager::add_logger(const std::string& name, Logger::ptr logger) {
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    if(name == m_root_logger->get_name()) {
+        std::cout << "[ERROR] LoggerManager::add_logger() the root logger cannot be replaced" << std::endl;
+        return;
+    }
+    auto it = m_loggers.find(name);
+    Logger::ptr old = it == m_loggers.end() ? nullptr : it->second;
+    if(old == logger) {
+        return;
+    }
+    Logger::ptr parent = parent_of(name);
+    std::vector<const Logger::Targets*> retired;
+    {
+        std::lock_guard<std::mutex> tree_lock(tree_mutex());
+        if(old) {
+            for(Logger* child : std::vector<Logger*>(old->m_children)) {
+                child->set_parent(logger.get(), retired);
+            }
+            old->set_parent(nullptr, retired);
+        }
+        logger->set_parent(parent.get(), retired);
+    }
+    Logger::free_retired(retired);
+    if(old) {
+        m_retired.push_back(old);
+    }
     m_loggers[name] = logger;
 }
 
+void LoggerManager::configure(const std::vector<LoggerConfig>& configs, const std::vector<std::string>& reset) {
+    std::vector<const Logger::Targets*> retired;
+    {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        std::vector<std::pair<Logger::ptr, const LoggerConfig*>> loggers;
+        for(const std::string& name : reset) {
+            auto it = m_loggers.find(name);
+            if(it != m_loggers.end()) {
+                loggers.emplace_back(it->second, nullptr);
+            }
+        }
+        for(const LoggerConfig& config : configs) {
+            loggers.emplace_back(get_or_create(config.name), &config);
+        }
+        std::lock_guard<std::mutex> tree_lock(tree_mutex());
+        for(auto& [logger, config] : loggers) {
+            LogLevel level = config ? config->level : LogLevel::UNKNOW;
+            if(level == LogLevel::UNKNOW && logger == m_root_logger) {
+                level = LogLevel::DEBUG;    // nothing to inherit from
+            }
+            logger->m_level.store(level, std::memory_order_relaxed);
+            logger->m_additive.store(config ? config->additive : true, std::memory_order_relaxed);
+            logger->m_appenders.clear();
+            for(size_t i = 0; config && i < config->appenders.size(); ++i) {
+                LogLevel appender_level = i < config->appender_levels.size() ? config->appender_levels[i]
+                                                                             : LogLevel::UNKNOW;
+                logger->m_appenders.push_back({config->appenders[i], appender_level});
+            }
+        }
+        // the effective levels change first, but log() checks each event
+        // again against the level in the snapshot it sends it with
+        m_root_logger->update_effective_level();
+        m_root_logger->update_targets(retired);
+        for(auto& [logger, config] : loggers) {
+            for(const Logger::Target& target : logger->m_appenders) {
+                if(target.level != LogLevel::UNKNOW) {
+                    target.appender->set_level(target.level);
+                }
+            }
+        }
+    }
+    Logger::free_retired(retired);
+}
+
+/* ------------ LogStream ------------ */
+
+LogStream& LogStream::operator<<(const void* v) {
+    if(v == nullptr) {
+        m_buf->push_back('0');  // what std::ostream prints for a null pointer
+        return *this;
+    }
+    char tmp[2 + 2 * sizeof(void*)] = {'0', 'x'};
+    auto res = std::to_chars(tmp + 2, tmp + sizeof(tmp), reinterpret_cast<uintptr_t>(v), 16);
+    m_buf->append(tmp, res.ptr - tmp);
+    return *this;
+}
+
+LogStream& LogStream::operator<<(std::ostream& (*manip)(std::ostream&)) {
+    if(manip == static_cast<std::ostream& (*)(std::ostream&)>(std::endl)) {
+        m_buf->push_back('\n');
+    }
+    return *this;
+}
+
+std::ostringstream& LogStream::fallback_stream() {
+    thread_local std::ostringstream os;
+    return os;
+}
+
+namespace {
+
+// manipulators such as std::hex land in the fallback stream too; do not let
+// them leak into the next value
+void reset_fallback(std::ostringstream& os) {
+    os.str("");
+    os.clear();
+    os.flags(std::ios_base::skipws | std::ios_base::dec);
+    os.precision(6);
+    os.fill(' ');
+}
+
+} // namespace
+
+void LogStream::append_fallback(std::ostringstream& os) {
+    auto view = os.view();
+    m_buf->append(view.data(), view.size());
+    reset_fallback(os);
+}
+
+void LogStream::add_fallback_field(std::string_view key, std::ostringstream& os) {
+    m_event->add_field(key, os.view());
+    reset_fallback(os);
+}
+
+void LogStream::append_format_text(std::string_view& rest) {
+    size_t i = 0;
+    while(i < rest.size()) {
+        size_t special = rest.find_first_of("{}", i);
+        if(special == std::string_view::npos) {
+            break;
+        }
+        m_buf->append(rest.data() + i, special - i);
+        // the format string was validated at compile time: '{' is followed
+        // by '{' or '}', and '}' by '}'
+        if(rest[special] == '{' && rest[special + 1] == '}') {
+            rest.remove_prefix(special + 2);
+            return;
+        }
+        m_buf->push_back(rest[special]);
+        i = special + 2;
+    }
+    i = std::min(i, rest.size());
+    m_buf->append(rest.data() + i, rest.size() - i);
+    rest.remove_prefix(rest.size());
+}
 
 /* ------------ LogEventWrap ------------ */
 
-LogEventWrap::LogEventWrap(Logger::ptr logger, LogEvent::ptr event) : m_logger(logger), m_event(event) {
+LogEventWrap::LogEventWrap(const Logger::ptr& logger, LogEvent::ptr event)
+    : m_logger(logger.get()), m_event(std::move(event)), m_stream(*m_event) {
+    m_stream.buffer().clear();
 }
 LogEventWrap::~LogEventWrap() {
-    if(m_logger != nullptr && m_event != nullptr) {
-        m_event->set_content(m_ss.str());
+    if(m_logger != nullptr) {
         m_logger->log(m_event->get_level(), m_event);
     }
 }
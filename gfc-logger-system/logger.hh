@@ -7,16 +7,49 @@
 #include <list>
 #include <vector>
 #include <cinttypes>
+#include <cstdint>
 #include <unordered_map>
 #include <memory>
+#include <chrono>
+#include <string_view>
+#include <charconv>
+#include <cstddef>
+#include <type_traits>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <climits>
+#include <sys/uio.h>
+
+#include "stats.hh"
+#include "log_clock.hh"
 
 namespace gfc {
 
+// Statements below GFC_LOG_ACTIVE_LEVEL are compiled out, arguments and
+// all: build with -DGFC_LOG_ACTIVE_LEVEL=2 to drop DEBUG, 3 to also drop
+// INFO, and so on. 0 (the default) keeps every level.
+#ifndef GFC_LOG_ACTIVE_LEVEL
+#define GFC_LOG_ACTIVE_LEVEL 0
+#endif
+
+// level must be a constant expression: it is part of the call site's static
+// LogSite. The logger expression is evaluated once, and the if/else chain
+// keeps the macro safe inside an unbraced if.
 #define GFC_LOG_LEVEL(logger, level) \
-    if (level >= logger->get_level()) \
-    gfc::LogEventWrap(logger, std::make_shared<gfc::LogEvent>( \
-        level, __FILE__, __LINE__, 0, 0, 0, time(nullptr), logger->get_name(), "" \
-    )).get_ss()
+    if constexpr (!gfc::is_level_active(level)) ; \
+    else if (static constexpr gfc::LogSite gfc_log_site_{__FILE__, __LINE__, __func__, level}; false) ; \
+    else if (auto&& gfc_logger_ = (logger); !gfc_logger_->is_enabled(level)) ; \
+    else gfc::LogEventWrap(gfc_logger_, gfc::LogEvent::create(gfc_log_site_, gfc_logger_->get_name())).get_ss()
+
+// The logger called name (a string literal), looked up once per call site
+// and then reused:  GFC_LOG_INFO(GFC_LOGGER("db.pool")) << ...
+#define GFC_LOGGER(name) \
+    ([]() -> const gfc::Logger::ptr& { \
+        static const gfc::Logger::ptr gfc_logger_ = gfc::LoggerManager::get_instance().get_logger(name); \
+        return gfc_logger_; \
+    }())
 
 #define GFC_LOG_DEBUG(logger)   GFC_LOG_LEVEL(logger, gfc::LogLevel::DEBUG)
 #define GFC_LOG_INFO(logger)    GFC_LOG_LEVEL(logger, gfc::LogLevel::INFO)
@@ -24,6 +57,18 @@ namespace gfc {
 #define GFC_LOG_ERROR(logger)   GFC_LOG_LEVEL(logger, gfc::LogLevel::ERROR)
 #define GFC_LOG_FATAL(logger)   GFC_LOG_LEVEL(logger, gfc::LogLevel::FATAL)
 
+// fmt-style variants: GFC_LOG_INFOF(logger, "user={} latency={}us", id, us)
+// The format string is checked against the argument count at compile time;
+// arguments are only evaluated when the level is enabled.
+#define GFC_LOG_LEVELF(logger, level, fmt, ...) \
+    GFC_LOG_LEVEL(logger, level).format(fmt __VA_OPT__(,) __VA_ARGS__)
+
+#define GFC_LOG_DEBUGF(logger, fmt, ...)    GFC_LOG_LEVELF(logger, gfc::LogLevel::DEBUG, fmt __VA_OPT__(,) __VA_ARGS__)
+#define GFC_LOG_INFOF(logger, fmt, ...)     GFC_LOG_LEVELF(logger, gfc::LogLevel::INFO,  fmt __VA_OPT__(,) __VA_ARGS__)
+#define GFC_LOG_WARNF(logger, fmt, ...)     GFC_LOG_LEVELF(logger, gfc::LogLevel::WARN,  fmt __VA_OPT__(,) __VA_ARGS__)
+#define GFC_LOG_ERRORF(logger, fmt, ...)    GFC_LOG_LEVELF(logger, gfc::LogLevel::ERROR, fmt __VA_OPT__(,) __VA_ARGS__)
+#define GFC_LOG_FATALF(logger, fmt, ...)    GFC_LOG_LEVELF(logger, gfc::LogLevel::FATAL, fmt __VA_OPT__(,) __VA_ARGS__)
+
 enum class LogLevel {
     UNKNOW  = 0,
     DEBUG   = 1,
@@ -33,10 +78,74 @@ enum class LogLevel {
     FATAL   = 5
 };
 
+const char* to_string(LogLevel level);
+
+constexpr bool is_level_active(LogLevel level) {
+    return static_cast<int>(level) >= GFC_LOG_ACTIVE_LEVEL;
+}
+
+// Static description of a log statement. GFC_LOG_* keeps one per call site
+// and its events point to it instead of carrying their own copy.
+struct LogSite {
+    const char* file;
+    int32_t     line;
+    const char* function;
+    LogLevel    level;
+};
+
+// Returns a LogSite that lives as long as the process, for events that do
+// not come from a GFC_LOG_* call site. The strings are not copied.
+const LogSite& intern_log_site(const char* file, int32_t line, const char* function, LogLevel level);
+// Returns a process-wide copy of s, for the file and function names of
+// sites read back from a log file.
+const char* intern_site_string(std::string_view s);
+
+// Returns the process-wide copy of name. Interned names are never freed, so
+// events can keep a pointer to them instead of a copy.
+const std::string& intern_logger_name(const std::string& name);
+
+class EventPool;
+
+// A key/value pair attached to an event with LogStream::kv(). Values keep
+// their type; the key, and the text of a STRING value right after it, live
+// in the event's field text.
+struct LogField {
+    enum class Type : uint8_t { INT, UINT, DOUBLE, BOOL, STRING };
+
+    Type        type;
+    uint32_t    key_len;
+    uint32_t    text_offset;    // of the key in LogEvent::get_field_text()
+    union {
+        int64_t     i;
+        uint64_t    u;
+        double      d;
+        bool        b;
+        uint32_t    str_len;    // STRING: length of the text after the key
+    };
+};
+
 class LogEvent {
 public:
     typedef std::shared_ptr<LogEvent> ptr;
 public:
+    // Takes an event from the calling thread's pool. The event returns to
+    // the pool when the last reference goes away, keeping its content
+    // buffer, so steady-state logging does not touch the heap.
+    // logger_name must be interned (Logger::get_name() is), and site must
+    // outlive the event.
+    // This one stamps the event with the calling thread's id and the
+    // LogClock time, which is only converted to wall time when read.
+    static ptr create(const LogSite& site, const std::string& logger_name);
+    static ptr create(  const LogSite& site,
+                        uint32_t thread_id, uint32_t coroutine_id, 
+                        uint32_t elapse, std::chrono::system_clock::time_point time, 
+                        const std::string& logger_name);
+    static ptr create(  LogLevel level, 
+                        const char* file_name, int32_t line_num, 
+                        uint32_t thread_id, uint32_t coroutine_id, 
+                        uint32_t elapse, std::chrono::system_clock::time_point time, 
+                        const std::string& logger_name);
+
     LogEvent();
     LogEvent(   LogLevel level, 
                 const char* file_name, int32_t line_num, 
@@ -44,58 +153,170 @@ public:
                 uint32_t elapse, time_t time, 
                 const std::string& logger_name,
                 const std::string& content);
+    LogEvent(   LogLevel level, 
+                const char* file_name, int32_t line_num, 
+                uint32_t thread_id, uint32_t coroutine_id, 
+                uint32_t elapse, std::chrono::system_clock::time_point time, 
+                const std::string& logger_name,
+                const std::string& content);
     
-    const char* get_file_name()     const { return m_file_name; }
-    int32_t     get_line_num()      const { return m_line_num; }
+    const LogSite& get_site()       const { return *m_site; }
+    const char* get_file_name()     const { return m_site->file; }
+    int32_t     get_line_num()      const { return m_site->line; }
+    const char* get_function_name() const { return m_site->function; }
     uint32_t    get_thread_id()     const { return m_thread_id; }
     uint32_t    get_coroutine_id()  const { return m_coroutine_id; }
-    uint32_t    get_elapse()        const { return m_elapse; }
-    time_t      get_time()          const { return m_time; }
+    uint32_t    get_elapse()        const { return m_clock_time ? LogClock::elapsed_ms(m_time) : m_elapse; }
+    time_t      get_time()          const;  // seconds since the epoch
+    int64_t     get_time_ns()       const { return m_clock_time ? LogClock::to_ns(m_time) : m_time; }
     LogLevel    get_level()         const { return m_level; }
-    std::string get_logger_name()   const { return m_logger_name; }
-    std::string get_content()       const { return m_content; }
+    const std::string& get_logger_name() const { return *m_logger_name; }
+    const std::string& get_content()     const { return m_content; }
     std::string get_level_str() const;
 
-    void        set_content(const std::string& content) { m_content = content; }
+    void        set_content(std::string_view content) { m_content.assign(content.data(), content.size()); }
+    std::string& get_content_buffer() { return m_content; }    // for writing the content in place
+
+    std::span<const LogField> get_fields()  const { return m_fields; }
+    const std::string& get_field_text()     const { return m_field_text; }
+    std::string_view get_field_key(const LogField& field) const {
+        return std::string_view(m_field_text.data() + field.text_offset, field.key_len);
+    }
+    std::string_view get_field_string(const LogField& field) const {
+        return std::string_view(m_field_text.data() + field.text_offset + field.key_len, field.str_len);
+    }
+    void        add_field(std::string_view key, int64_t value);
+    void        add_field(std::string_view key, uint64_t value);
+    void        add_field(std::string_view key, double value);
+    void        add_field(std::string_view key, bool value);
+    void        add_field(std::string_view key, std::string_view value);
+    // replaces all fields, e.g. with those of another event
+    void        set_fields(std::span<const LogField> fields, std::string_view text);
 private:
+    friend class EventPool;
+
     LogLevel    m_level;                // log level
-    const char* m_file_name = nullptr;  // file name
-    int32_t     m_line_num = 0;         // line number
+    const LogSite* m_site;              // file, line and function
     uint32_t    m_thread_id = 0;        // thread id
     uint32_t    m_coroutine_id = 0;     // coroutine id
-    uint32_t    m_elapse = 0;           // elipse time
-    time_t      m_time;                 // UTC time
-    std::string m_logger_name;          // logger name
+    uint32_t    m_elapse = 0;           // ms since the program started, unless m_clock_time
+    int64_t     m_time = 0;             // UTC time, nanoseconds since the epoch, or LogClock ticks
+    bool        m_clock_time = false;   // m_time is in LogClock ticks
+    const std::string* m_logger_name;   // logger name, interned
     std::string m_content;              // log content
-
+    std::vector<LogField> m_fields;     // key/value fields, in the order added
+    std::string m_field_text;           // keys and string values of m_fields
+    EventPool*  m_pool = nullptr;       // owning pool, null if not pooled
+    LogEvent*   m_pool_next = nullptr;  // free list link while pooled
 };
 
+// Lowest level the installed FlightRecorder keeps, INT_MAX while there is
+// none. Statements at or above it are logged even when their logger's level
+// would filter them, so that the recorder gets to see them.
+inline std::atomic<int>& record_level_flag() {
+    static std::atomic<int> level{INT_MAX};
+    return level;
+}
+
 /* ------------ LogFormatter ------------ */
 
+// init() compiles the pattern into a flat program of opcodes; format() runs
+// it with a switch loop, appending to a caller-provided buffer. Formatting
+// into a reused buffer does not allocate.
 class LogFormatter {
 public:
     typedef std::shared_ptr<LogFormatter> ptr;
 public:
     LogFormatter(const std::string& pattern = "%d{%Y-%m-%d %H:%M:%S} [%p] [%c] [%t] [%f:%l] %m%n"); 
-    std::string format(LogEvent::ptr event);
+    virtual ~LogFormatter() {}
+    std::string format(const LogEvent::ptr& event);
+    void        format(std::string& out, const LogEvent& event) const;    // appends to out
     void        init();
-public:
-    class FormatItem {
-    public:
-        typedef std::shared_ptr<FormatItem> ptr;
-    public:
-        virtual ~FormatItem() {}
-        virtual void format(std::ostream& os, LogEvent::ptr event) = 0;
+
+    const std::string&  get_pattern()   const { return m_pattern; }
+    bool                is_error()      const { return m_error; }
+    FormatterStats      get_stats()     const;
+
+protected:
+    // Renders event; format() wraps it with the stats. Subclasses that
+    // produce a different layout override it.
+    virtual void format_ops(std::string& out, const LogEvent& event) const;
+
+private:
+    enum class OpCode : uint8_t {
+        LITERAL,        // m_literals[offset, offset + len)
+        MESSAGE,
+        LEVEL,
+        ELAPSE,
+        LOGGER_NAME,
+        THREAD_ID,
+        COROUTINE_ID,
+        NEWLINE,
+        DATETIME,       // m_dates[offset]
+        FILE_NAME,
+        FUNCTION_NAME,
+        LINE,
+        TAB,
+        FIELDS
     };
+    struct Op {
+        OpCode      code;
+        uint32_t    offset = 0;
+        uint32_t    len = 0;
+    };
+    // A %d{...} format split around its sub-second fields (%ms, %us, %ns):
+    // parts[0] digits[0] parts[1] ... digits[n-1] parts[n]
+    struct DateFormat {
+        std::vector<std::string>    parts;      // strftime formats
+        std::vector<uint8_t>        digits;     // 3, 6 or 9
+    };
+
+    void format_date(std::string& out, uint32_t index, int64_t time_ns) const;
+
+private:
+    std::string     m_pattern;      // log pattern
+    bool            m_error = false;// parse error
+    std::vector<Op> m_ops;          // compiled pattern
+    std::string     m_literals;     // literal text referenced by m_ops
+    std::vector<DateFormat> m_dates;// date formats referenced by m_ops
+    uint64_t        m_id = 0;       // identifies this compiled program in per-thread date caches
+    mutable ShardedCounters<2> m_counters;      // events, bytes
+    mutable LatencyHistogram m_format_time;
+};
+
+/* ------------ FormattedEvent ------------ */
+
+// An event on its way through Logger::log(), rendered at most once per
+// distinct formatter, so appenders that share a formatter share the text.
+// The text lives in per-thread buffers that keep their capacity; it is only
+// valid until the FormattedEvent goes away.
+class FormattedEvent {
+public:
+    explicit FormattedEvent(const LogEvent::ptr& event);
+    ~FormattedEvent();
+    FormattedEvent(const FormattedEvent&) = delete;
+    FormattedEvent& operator=(const FormattedEvent&) = delete;
+
+    const LogEvent::ptr&    get_event() const { return m_event; }
+    // The event as formatter renders it, formatting it on the first request.
+    std::string_view        format(const LogFormatter::ptr& formatter);
+    // number of distinct formatters used so far
+    size_t                  get_format_count() const;
 
 private:
-    std::string m_pattern;                  // log pattern
-    bool m_error = false;                   // parse error
-    std::vector<FormatItem::ptr> m_items;   // format items, store the parsed pattern
+    const LogEvent::ptr&    m_event;
+    size_t                  m_base;     // first per-thread buffer of this event
 };
 
 /* ------------ LogAppender ------------ */
 
+// log() may be called from several threads at once; appenders that keep
+// state serialize on m_mutex, which also guards m_formatter.
+//
+// Each appender has its own minimum level on top of the logger's, so one
+// logger can send DEBUG to a local file and only WARN and up to a costlier
+// sink. Wrap a slow sink in an AsyncLogAppender to give it its own queue and
+// thread; the others then no longer wait for it.
 class LogAppender {
 public:
     typedef std::shared_ptr<LogAppender> ptr;
@@ -103,12 +324,58 @@ public:
 public:
     virtual ~LogAppender() {}
     
-    virtual void        log(LogEvent::ptr event) = 0;
-    LogFormatter::ptr   get_formatter() const { return m_formatter; }
-    void                set_formatter(LogFormatter::ptr formatter) { m_formatter = formatter; }
+    virtual void        log(const LogEvent::ptr& event) = 0;
+    // Delivers several events in order. Sinks that can take a whole batch
+    // under one lock and in one syscall override this; the default just
+    // calls log() for each event.
+    virtual void        log_batch(std::span<const LogEvent::ptr> events) {
+        for(const LogEvent::ptr& event : events) {
+            log(event);
+        }
+    }
+    // Called by Logger::log(). Appenders that write the formatted text take
+    // it from formatted.format(m_formatter) instead of formatting it
+    // themselves; the default just calls log().
+    virtual void        log_formatted(FormattedEvent& formatted) {
+        log(formatted.get_event());
+    }
+    virtual void        flush() {}      // push buffered output down to the sink
+
+    LogLevel            get_level() const { return m_level.load(std::memory_order_relaxed); }
+    virtual void        set_level(LogLevel level) { m_level.store(level, std::memory_order_relaxed); }
+    virtual AppenderStats get_stats() const;
+    LogFormatter::ptr   get_formatter() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_formatter;
+    }
+    virtual void        set_formatter(LogFormatter::ptr formatter) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_formatter = formatter;
+    }
 
 protected:
+    // for subclasses to keep get_stats() up to date
+    void        count_events(uint64_t n)    { m_counters.add(STAT_EVENTS, n); }
+    void        count_flush()               { m_counters.add(STAT_FLUSHES); }
+    // start = write_start(); <write to the sink>; count_write(bytes, start);
+    static int64_t write_start()            { return stats_timing() ? stats_now_ns() : 0; }
+    void        count_write(uint64_t bytes, int64_t start_ns) {
+        m_counters.add(STAT_WRITES);
+        m_counters.add(STAT_BYTES, bytes);
+        if(start_ns != 0) {
+            m_write_time.record(stats_now_ns() - start_ns);
+        }
+    }
+
+protected:
+    mutable std::mutex  m_mutex;
     LogFormatter::ptr   m_formatter;
+    std::atomic<LogLevel> m_level{LogLevel::DEBUG};     // events below it are not passed in
+
+private:
+    enum { STAT_EVENTS, STAT_BYTES, STAT_WRITES, STAT_FLUSHES, STAT_COUNT };
+    ShardedCounters<STAT_COUNT> m_counters;
+    LatencyHistogram    m_write_time;
 };
 
 class StdoutLogAppender : public LogAppender {
@@ -116,89 +383,449 @@ public:
     typedef std::shared_ptr<StdoutLogAppender> ptr;
 
 public:
-    virtual void log(LogEvent::ptr event) override;
+    virtual void log(const LogEvent::ptr& event) override;
+    virtual void log_batch(std::span<const LogEvent::ptr> events) override;
+    virtual void log_formatted(FormattedEvent& formatted) override;
+    virtual void flush() override;
 
 private:
+    void write_out(const char* data, size_t len);   // m_mutex held
+};
 
+// When FileLogAppender forces its data to disk with fdatasync().
+enum class FileDurability {
+    NONE,           // leave it to the kernel
+    SYNC_INTERVAL,  // at most every sync interval, while there is unsynced data
+    SYNC_ON_FATAL   // after every FATAL event
 };
 
+class FileFlusher;
+
+// Appends formatted lines to an owned buffer and hands it to write(2) on an
+// O_APPEND descriptor once it fills up, when an ERROR or FATAL event comes
+// in, on flush(), or once its oldest line has waited for the flush interval
+// (checked every 50 ms by a background thread shared by all file appenders).
 class FileLogAppender : public LogAppender {
 public:
     typedef std::shared_ptr<FileLogAppender> ptr;
 
 public:
-    FileLogAppender(const std::string& filename);
-    virtual void log(LogEvent::ptr event) override;
+    FileLogAppender(const std::string& filename, size_t buffer_size = 64 * 1024);
+    ~FileLogAppender();
+    virtual void log(const LogEvent::ptr& event) override;
+    virtual void log_batch(std::span<const LogEvent::ptr> events) override;
+    virtual void log_formatted(FormattedEvent& formatted) override;
+    virtual void flush() override;
+    // Writes out the buffer and opens the file again (in append mode), e.g.
+    // after it was moved away by an external tool.
     bool reopen();
 
+    // 0 writes every line as it comes in
+    void set_flush_interval(std::chrono::milliseconds interval);
+    void set_durability(FileDurability durability,
+                        std::chrono::milliseconds sync_interval = std::chrono::milliseconds(1000));
+
+    const std::string&  get_filename() const { return m_filename; }
+    uint64_t            get_write_count() const { return get_stats().writes; }
+    uint64_t            get_sync_count()  const { return m_syncs.load(std::memory_order_relaxed); }
+
+protected:
+    // Called with m_mutex held before event is added to the buffer.
+    virtual void on_event(const LogEvent&) {}
+
+    // m_mutex held for all of these
+    bool open_file();
+    bool write_buffer();
+    void sync_file();
+    size_t get_buffered_size() const { return m_chunked + m_buffer.size(); }
+
 private:
+    friend class FileFlusher;
+    // called by the flusher thread, now_ns from stats_now_ns()
+    void flush_if_due(int64_t now_ns);
+    // m_mutex held: writes the buffer out if the events just added call for it
+    void write_if_due(LogLevel max_level);
+
+protected:
     std::string     m_filename;
-    std::ofstream   m_filestream;
+    int             m_fd = -1;
+    uint64_t        m_file_size = 0;            // bytes in the file, including those written by others
+    std::string     m_buffer;
+    size_t          m_buffer_size;
+    // A batch larger than the buffer is formatted into a run of full
+    // chunks that write_buffer() submits with m_buffer in one writev(2).
+    std::vector<std::string> m_chunks;
+    std::vector<std::string> m_spare_chunks;
+    size_t          m_chunked = 0;              // bytes in m_chunks
+    std::vector<struct iovec> m_iov;            // write_buffer()'s, kept for its capacity
+    int64_t         m_buffered_since_ns = 0;    // steady time the oldest buffered line arrived
+    int64_t         m_flush_interval_ns = 1000000000;
+    FileDurability  m_durability = FileDurability::NONE;
+    int64_t         m_sync_interval_ns = 1000000000;
+    int64_t         m_synced_at_ns = 0;         // steady time of the last fdatasync
+    bool            m_unsynced = false;         // written since the last fdatasync
+    std::atomic<uint64_t> m_syncs{0};           // fdatasync(2) calls
 };
 
 
 /* ------------ Logger ------------ */
 
+class DedupFilter;
+
+// The log path takes no locks: the level is an atomic, and the appenders are
+// an immutable snapshot read inside an RCU read section. The snapshot also
+// holds the level, which log() checks again there, so an event judged by a
+// new level never reaches the old appenders or the other way round. Configuration
+// changes serialize on the tree lock, publish new snapshots and free the old
+// ones once no thread can still be iterating them. Each event is formatted
+// once per distinct formatter among the appenders (see FormattedEvent).
+//
+// Loggers handed out by LoggerManager form a tree by dotted name: "db.pool"
+// is the parent of "db.pool.conn", and "root" is the parent of every name
+// without a dot. A logger without a level of its own inherits its parent's;
+// the result is cached in m_effective_level and recomputed for the whole
+// subtree whenever a level on the way up changes, so get_level() stays a
+// single load. Events also go to the appenders of all ancestors, up to the
+// first logger that is not additive; the snapshot already holds that whole
+// chain, so one event sees one version of it, however many loggers a
+// change (such as a config reload, see log_config.hh) touched.
+//
+// An installed FlightRecorder (flight_recorder.hh) sees every event at or
+// above its own level before the logger's level is applied.
 class Logger {
 public:
     typedef std::shared_ptr<Logger> ptr;
     
 public:
     Logger(const std::string& name = "root");
+    ~Logger();
 
-    void log(LogLevel level, LogEvent::ptr event);
+    void log(LogLevel level, const LogEvent::ptr& event);
 
-    void debug  (LogEvent::ptr event);
-    void info   (LogEvent::ptr event);
-    void warn   (LogEvent::ptr event);
-    void error  (LogEvent::ptr event);
-    void fatal  (LogEvent::ptr event);
+    void debug  (const LogEvent::ptr& event);
+    void info   (const LogEvent::ptr& event);
+    void warn   (const LogEvent::ptr& event);
+    void error  (const LogEvent::ptr& event);
+    void fatal  (const LogEvent::ptr& event);
 
     void add_appender(LogAppender::ptr appender);
     void del_appender(LogAppender::ptr appender);
+    std::vector<LogAppender::ptr> get_appenders() const;
+
+    const std::string&  get_name()  const           { return *m_name; }
+    // effective level: the logger's own, or else the nearest ancestor's
+    LogLevel            get_level() const           { return m_effective_level.load(std::memory_order_relaxed); }
+    // whether a statement at level is logged: it passes the level, or the
+    // installed flight recorder wants it
+    bool                is_enabled(LogLevel level) const {
+        return level >= get_level() ||
+               static_cast<int>(level) >= record_level_flag().load(std::memory_order_relaxed);
+    }
+    void                set_level(LogLevel level);
+    // LogLevel::UNKNOW while the level is inherited
+    LogLevel            get_own_level() const       { return m_level.load(std::memory_order_relaxed); }
+    // inherit the level from the parent again
+    void                reset_level()               { set_level(LogLevel::UNKNOW); }
+    void                set_formatter(LogFormatter::ptr formatter);
+
+    Logger*             get_parent() const          { return m_parent.load(std::memory_order_acquire); }
+    bool                is_additive() const         { return m_additive.load(std::memory_order_relaxed); }
+    LoggerStats         get_stats() const;
+    // false stops events from reaching the ancestors' appenders
+    void                set_additive(bool additive);
+    // Collapses runs of identical messages into one line plus "last message
+    // repeated N times" (see DedupFilter in log_limit.hh).
+    void                set_dedup(bool enable,
+                                  std::chrono::milliseconds report_interval = std::chrono::seconds(30));
+    // Logs the dedup filter's pending "repeated" line if it is due at
+    // now_ns (steady clock) or force is set; returns when to call again.
+    // Called by the dedup filter's background thread.
+    int64_t             report_repeats(int64_t now_ns, bool force);
 
-    const std::string&  get_name()  const           { return m_name; }
-    LogLevel            get_level() const           { return m_level; }
-    void                set_level(LogLevel level)   { m_level = level; }
-    void                set_formatter(LogFormatter::ptr formatter) { m_formatter = formatter; }
+private:
+    friend class LoggerManager;
+    // An appender and the level configure() gave it here; UNKNOW defers to
+    // the appender's own level.
+    struct Target {
+        LogAppender::ptr    appender;
+        LogLevel            level;
+    };
+    typedef std::vector<Target> TargetList;
+    // What log() reads in one RCU read section.
+    struct Targets {
+        LogLevel            level;          // effective level
+        TargetList          appenders;
+    };
+
+    void dispatch(const Targets& targets, LogLevel level, const LogEvent::ptr& event);
+    // tree lock held for these
+    void set_parent(Logger* parent, std::vector<const Targets*>& retired);
+    void update_effective_level();
+    // Rebuilds the snapshots of this logger and its subtree from their
+    // appenders and effective levels; the replaced ones go to retired, to
+    // be freed by free_retired().
+    void update_targets(std::vector<const Targets*>& retired);
+    // outside the tree lock: waits until no log() call can still see them
+    static void free_retired(std::vector<const Targets*>& retired);
 
 private:
-    std::string                 m_name;         // logger name
-    LogLevel                    m_level;        // logger level
-    std::list<LogAppender::ptr> m_appenders;    // appenders
-    LogFormatter::ptr           m_formatter;    // formatter
+    const std::string*          m_name;         // logger name, interned
+    std::atomic<LogLevel>       m_level;        // own level, UNKNOW to inherit
+    std::atomic<LogLevel>       m_effective_level;  // m_level or the inherited level
+    std::atomic<Logger*>        m_parent{nullptr};  // set by LoggerManager
+    std::atomic<bool>           m_additive{true};
+    std::atomic<DedupFilter*>   m_dedup{nullptr};   // created by the first set_dedup(true), then kept
+    ShardedCounters<12>         m_counters;     // emitted, then filtered, by level
+    std::vector<Logger*>        m_children;     // guarded by the tree lock
+    TargetList                  m_appenders;    // own appenders, guarded by the tree lock
+    // own appenders, then the ancestors' as far as events go up; read under RCU
+    std::atomic<const Targets*> m_targets;
+    mutable std::mutex          m_mutex;        // guards m_formatter and m_dedup changes
+    LogFormatter::ptr           m_formatter;
 };
 
 /* ------------ LoggerManager ------------ */
 
+// One logger's part of a configuration, see LoggerManager::configure().
+struct LoggerConfig {
+    std::string                     name;
+    LogLevel                        level = LogLevel::UNKNOW;   // UNKNOW inherits
+    bool                            additive = true;
+    std::vector<LogAppender::ptr>   appenders;
+    // the level of each appender on this logger, in the same order; missing
+    // or UNKNOW leaves the appender's own level in charge
+    std::vector<LogLevel>           appender_levels;
+};
+
 // Use Singleton pattern
+//
+// Owns the logger tree. Loggers that enter the tree are never destroyed
+// (one replaced by add_logger() is kept aside), so the parent pointers
+// followed on the log path always stay valid.
 class LoggerManager {
 public:
     typedef std::shared_ptr<LoggerManager> ptr;
 public:
     static LoggerManager&   get_instance();
-    Logger::ptr             get_logger(const std::string& name) { return m_loggers[name];}
+    // Creates the logger, and any missing ancestors, on first use. Each call
+    // hashes the name; call sites should keep the result (see GFC_LOGGER).
+    Logger::ptr             get_logger(const std::string& name);
+    // null if no logger of that name exists yet
+    Logger::ptr             find_logger(const std::string& name) const;
     Logger::ptr             get_root_logger()                   { return m_root_logger;  }
+    // every logger in the tree, sorted by name
+    std::vector<Logger::ptr> get_loggers() const;
+    // Puts logger into the tree under name. A logger already there, e.g. one
+    // created by get_logger(), hands its children over to the new one; handles
+    // to it that callers kept keep pointing to the old logger.
     void                    add_logger(const std::string& name, Logger::ptr logger);
+
+    // Gives every logger in configs its level, additivity and appenders,
+    // replacing those it had, and sends the loggers in reset back to an
+    // inherited level, no appenders and additive. The loggers' snapshots,
+    // levels and appender levels included, are all rebuilt before any is
+    // published, so each event sees either the old or the new configuration
+    // of its whole chain. Appenders given a level are then set to it too.
+    void                    configure(const std::vector<LoggerConfig>& configs,
+                                      const std::vector<std::string>& reset = {});
+    // Applies a config file (see LogConfig in log_config.hh); false, and
+    // the current configuration kept, if it cannot be read or parsed.
+    bool                    load_config(const std::string& path);
+    // load_config(path), then again whenever the file changes; "" stops
+    // watching. Reloads run on a background thread.
+    bool                    watch_config(const std::string& path);
 private:
     LoggerManager();
+    // m_mutex held exclusively
+    Logger::ptr             get_or_create(const std::string& name);
+    Logger::ptr             parent_of(const std::string& name);
 private:
     Logger::ptr m_root_logger;
+    mutable std::shared_mutex m_mutex;      // guards m_loggers and m_retired
     std::unordered_map<std::string, Logger::ptr> m_loggers;
+    std::vector<Logger::ptr> m_retired;     // replaced by add_logger(), may still be referenced
+};
+
+/* ------------ FormatString ------------ */
+
+// Never defined: reaching it while checking a format string at compile
+// time turns the message into a compiler error.
+void format_string_error(const char* message);
+
+// Counts the {} fields of a format string, accepting {{ and }} escapes.
+// Only plain {} fields are supported (no indices or format specs).
+consteval size_t count_format_fields(std::string_view fmt) {
+    size_t fields = 0;
+    for(size_t i = 0; i < fmt.size(); ++i) {
+        if(fmt[i] == '{') {
+            if(i + 1 < fmt.size() && fmt[i + 1] == '{') {
+                ++i;
+            } else if(i + 1 < fmt.size() && fmt[i + 1] == '}') {
+                ++i;
+                ++fields;
+            } else {
+                format_string_error("only {} fields are supported; use {{ for a literal '{'");
+            }
+        } else if(fmt[i] == '}') {
+            if(i + 1 < fmt.size() && fmt[i + 1] == '}') {
+                ++i;
+            } else {
+                format_string_error("unmatched '}' in format string; use }} for a literal '}'");
+            }
+        }
+    }
+    return fields;
+}
+
+// A format string literal whose {} fields are checked against Args when
+// the call site is compiled. It only refers to the literal, so it stays a
+// static constant of the call site.
+template<typename... Args>
+class FormatString {
+public:
+    template<size_t N>
+    consteval FormatString(const char (&str)[N]) : m_str(str, N - 1) {
+        if(count_format_fields(m_str) != sizeof...(Args)) {
+            format_string_error("number of {} fields does not match the number of arguments");
+        }
+    }
+    std::string_view get() const { return m_str; }
+private:
+    std::string_view m_str;
+};
+
+/* ------------ LogStream ------------ */
+
+// The stream behind GFC_LOG_* << ...: a small ostream replacement that
+// appends straight into the event's (pooled, reused) content buffer.
+// Built-in types are rendered with std::to_chars and produce the same text
+// as std::ostream with default flags; any other type with an
+// operator<<(std::ostream&, const T&) goes through a thread-local
+// std::ostringstream. Stream state manipulators (std::hex, std::setw, ...)
+// are accepted but have no effect.
+//
+// kv(key, value) attaches a typed field to the event instead of adding
+// text: integers, floating point values and bools are stored as they are,
+// strings are copied, and other types are rendered with operator<< once.
+// A stream over a plain buffer has no event and appends " key=value".
+class LogStream {
+public:
+    explicit LogStream(std::string& buf) : m_buf(&buf) {}
+    explicit LogStream(LogEvent& event) : m_buf(&event.get_content_buffer()), m_event(&event) {}
+
+    LogStream& operator<<(bool v)                   { m_buf->push_back(v ? '1' : '0'); return *this; }
+    LogStream& operator<<(char v)                   { m_buf->push_back(v); return *this; }
+    LogStream& operator<<(signed char v)            { m_buf->push_back(static_cast<char>(v)); return *this; }
+    LogStream& operator<<(unsigned char v)          { m_buf->push_back(static_cast<char>(v)); return *this; }
+    LogStream& operator<<(short v)                  { return append_integer(v); }
+    LogStream& operator<<(unsigned short v)         { return append_integer(v); }
+    LogStream& operator<<(int v)                    { return append_integer(v); }
+    LogStream& operator<<(unsigned int v)           { return append_integer(v); }
+    LogStream& operator<<(long v)                   { return append_integer(v); }
+    LogStream& operator<<(unsigned long v)          { return append_integer(v); }
+    LogStream& operator<<(long long v)              { return append_integer(v); }
+    LogStream& operator<<(unsigned long long v)     { return append_integer(v); }
+    LogStream& operator<<(float v)                  { return append_floating(v); }
+    LogStream& operator<<(double v)                 { return append_floating(v); }
+    LogStream& operator<<(long double v)            { return append_floating(v); }
+    LogStream& operator<<(const char* v)            { m_buf->append(v); return *this; }
+    LogStream& operator<<(char* v)                  { m_buf->append(v); return *this; }
+    LogStream& operator<<(const std::string& v)     { m_buf->append(v); return *this; }
+    LogStream& operator<<(std::string_view v)       { m_buf->append(v.data(), v.size()); return *this; }
+    LogStream& operator<<(std::nullptr_t)           { m_buf->append("nullptr"); return *this; }
+    LogStream& operator<<(const void* v);
+    // std::endl and friends: only the line break is kept, there is nothing to flush
+    LogStream& operator<<(std::ostream& (*manip)(std::ostream&));
+
+    template<typename T>
+    LogStream& operator<<(const T& v) {
+        std::ostringstream& os = fallback_stream();
+        os << v;
+        append_fallback(os);
+        return *this;
+    }
+
+    // Renders fmt with each {} replaced by the next argument, as operator<< would.
+    template<typename... Args>
+    LogStream& format(FormatString<std::type_identity_t<Args>...> fmt, const Args&... args) {
+        std::string_view rest = fmt.get();
+        ((append_format_text(rest), *this << args), ...);
+        append_format_text(rest);
+        return *this;
+    }
+
+    template<typename T>
+    LogStream& kv(std::string_view key, const T& value) {
+        if(m_event == nullptr) {
+            m_buf->push_back(' ');
+            m_buf->append(key.data(), key.size());
+            m_buf->push_back('=');
+            return *this << value;
+        }
+        if constexpr (std::is_same_v<T, bool>) {
+            m_event->add_field(key, value);
+        } else if constexpr (std::is_same_v<T, char>) {
+            m_event->add_field(key, std::string_view(&value, 1));
+        } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+            m_event->add_field(key, static_cast<int64_t>(value));
+        } else if constexpr (std::is_integral_v<T>) {
+            m_event->add_field(key, static_cast<uint64_t>(value));
+        } else if constexpr (std::is_floating_point_v<T>) {
+            m_event->add_field(key, static_cast<double>(value));
+        } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+            m_event->add_field(key, std::string_view(value));
+        } else {
+            std::ostringstream& os = fallback_stream();
+            os << value;
+            add_fallback_field(key, os);
+        }
+        return *this;
+    }
+
+    LogStream& write(const char* data, size_t len)  { m_buf->append(data, len); return *this; }
+    std::string& buffer() { return *m_buf; }
+
+private:
+    template<typename Int>
+    LogStream& append_integer(Int v) {
+        char tmp[24];
+        auto res = std::to_chars(tmp, tmp + sizeof(tmp), v);
+        m_buf->append(tmp, res.ptr - tmp);
+        return *this;
+    }
+    template<typename Float>
+    LogStream& append_floating(Float v) {
+        char tmp[64];
+        auto res = std::to_chars(tmp, tmp + sizeof(tmp), v, std::chars_format::general, 6);
+        m_buf->append(tmp, res.ptr - tmp);
+        return *this;
+    }
+    static std::ostringstream& fallback_stream();
+    void append_fallback(std::ostringstream& os);
+    void add_fallback_field(std::string_view key, std::ostringstream& os);
+    // Appends the literal text of rest up to its next {} field (unescaping
+    // {{ and }}) and consumes the field.
+    void append_format_text(std::string_view& rest);
+
+private:
+    std::string* m_buf;
+    LogEvent*    m_event = nullptr;     // receives kv() fields
 };
 
 /* ------------ LogEventWrap ------------ */
 
+// Lives for one log statement. It only borrows the logger, which the
+// statement's own expression keeps alive until the wrap is destroyed.
 class LogEventWrap {
 public:
     LogEventWrap() = delete;
-    LogEventWrap(Logger::ptr logger, LogEvent::ptr event);
+    LogEventWrap(const Logger::ptr& logger, LogEvent::ptr event);
     ~LogEventWrap();
-    std::stringstream& get_ss() { return m_ss; }
+    LogStream& get_ss() { return m_stream; }
 private:
-    Logger::ptr         m_logger;
+    Logger*             m_logger;
     LogEvent::ptr       m_event;
-    std::stringstream   m_ss;
+    LogStream           m_stream;
 };
 
 } // namespace gfc
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace gfc {
+
+/* ------------ MPSCQueue ------------ */
+
+// Bounded lock-free multi-producer / single-consumer ring (D. Vyukov's
+// sequence-numbered cell scheme). Producers reserve a cell with one CAS on
+// the tail; the single consumer never contends with them. The CAS and
+// size_approx()'s load of the tail are seq_cst (free on x86, where a CAS is
+// a full barrier), so a caller can order a push against its own seq_cst
+// flags without a fence.
+template<typename T>
+class MPSCQueue {
+public:
+    explicit MPSCQueue(size_t capacity) {
+        size_t cap = 2;
+        while(cap < capacity) {
+            cap <<= 1;
+        }
+        m_mask  = cap - 1;
+        m_cells = std::unique_ptr<Cell[]>(new Cell[cap]);
+        for(size_t i = 0; i < cap; ++i) {
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+    ~MPSCQueue() {
+        T item;
+        while(try_pop(item)) {}
+    }
+    MPSCQueue(const MPSCQueue&) = delete;
+    MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+    // Returns false without blocking when the queue is full.
+    bool try_push(T&& item) {
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        for(;;) {
+            Cell& cell = m_cells[pos & m_mask];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if(diff == 0) {
+                if(m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_seq_cst,
+                                                std::memory_order_relaxed)) {
+                    new (&cell.storage) T(std::move(item));
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if(diff < 0) {
+                return false;
+            } else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer side only.
+    bool try_pop(T& item) {
+        size_t pos = m_head.load(std::memory_order_relaxed);
+        Cell& cell = m_cells[pos & m_mask];
+        size_t seq = cell.seq.load(std::memory_order_acquire);
+        if(static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1) < 0) {
+            return false;
+        }
+        T* slot = std::launder(reinterpret_cast<T*>(&cell.storage));
+        item = std::move(*slot);
+        slot->~T();
+        cell.seq.store(pos + m_mask + 1, std::memory_order_release);
+        m_head.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    size_t capacity()   const { return m_mask + 1; }
+    // Total pushes reserved / pops completed so far, callable from any thread.
+    size_t push_count() const { return m_tail.load(std::memory_order_acquire); }
+    size_t pop_count()  const { return m_head.load(std::memory_order_acquire); }
+    size_t size_approx() const {
+        size_t tail = m_tail.load(std::memory_order_seq_cst);
+        size_t head = m_head.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    alignas(64) std::atomic<size_t> m_tail{0};          // next cell to reserve (producers)
+    alignas(64) std::atomic<size_t> m_head{0};          // next cell to consume (consumer)
+    size_t                          m_mask = 0;
+    std::unique_ptr<Cell[]>         m_cells;
+};
+
+} // namespace gfc
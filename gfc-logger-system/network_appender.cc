@@ -0,0 +1,494 @@
+#include "network_appender.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <ctime>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace gfc {
+
+namespace {
+
+const int kConnectTimeoutMs = 1000;
+const int kWritableWaitMs = 100;    // how long one send waits for room in the socket buffer
+const size_t kMaxDatagrams = 64;    // per sendmmsg(2)
+
+int syslog_severity(LogLevel level) {
+    switch(level) {
+        case LogLevel::DEBUG:   return 7;
+        case LogLevel::INFO:    return 6;
+        case LogLevel::WARN:    return 4;
+        case LogLevel::ERROR:   return 3;
+        case LogLevel::FATAL:   return 2;
+        default:                return 5;   // notice
+    }
+}
+
+void append_number(std::string& out, uint64_t value) {
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, res.ptr);
+}
+
+// RFC 5424 header fields are printable US-ASCII without spaces.
+std::string header_field(std::string_view value, size_t max_len) {
+    std::string field(value.substr(0, max_len));
+    for(char& c : field) {
+        if(c <= ' ' || c > '~') {
+            c = '_';
+        }
+    }
+    return field.empty() ? "-" : field;
+}
+
+// 2026-10-16T22:52:56.123456Z
+void append_timestamp(std::string& out, int64_t time_ns) {
+    thread_local time_t t_second = -1;
+    thread_local char t_prefix[24];
+    time_t second = static_cast<time_t>(time_ns / 1000000000);
+    int64_t micros = (time_ns % 1000000000) / 1000;
+    if(micros < 0) {
+        second -= 1;
+        micros += 1000000;
+    }
+    if(second != t_second) {
+        struct tm tm;
+        gmtime_r(&second, &tm);
+        strftime(t_prefix, sizeof(t_prefix), "%Y-%m-%dT%H:%M:%S", &tm);
+        t_second = second;
+    }
+    char frac[9] = {'.', '0', '0', '0', '0', '0', '0', 'Z', ' '};
+    for(int i = 6; i > 0 && micros > 0; --i, micros /= 10) {
+        frac[i] = static_cast<char>('0' + micros % 10);
+    }
+    out.append(t_prefix);
+    out.append(frac, sizeof(frac));
+}
+
+} // namespace
+
+NetworkLogAppender::NetworkLogAppender(NetworkTransport transport, const std::string& address)
+    : m_transport(transport), m_address(address), m_pid(static_cast<uint32_t>(getpid())) {
+    char host[256] = {0};
+    gethostname(host, sizeof(host) - 1);
+    m_hostname = header_field(host, 255);
+    m_app_name = header_field(program_invocation_short_name, 48);
+    m_thread = std::thread(&NetworkLogAppender::run, this);
+}
+
+NetworkLogAppender::~NetworkLogAppender() {
+    stop();
+}
+
+void NetworkLogAppender::set_app_name(const std::string& name) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_app_name = header_field(name, 48);
+}
+
+void NetworkLogAppender::set_facility(int facility) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_facility = std::clamp(facility, 0, 23);
+}
+
+void NetworkLogAppender::set_batch_size(size_t bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_batch_size = bytes;
+}
+
+void NetworkLogAppender::set_flush_interval(std::chrono::milliseconds interval) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_flush_interval = interval;
+}
+
+void NetworkLogAppender::set_max_buffer(size_t bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_max_buffer = bytes;
+}
+
+void NetworkLogAppender::set_max_message(size_t bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_max_message = bytes;
+}
+
+void NetworkLogAppender::set_flush_timeout(std::chrono::milliseconds timeout) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_flush_timeout = timeout;
+}
+
+void NetworkLogAppender::set_reconnect_backoff(std::chrono::milliseconds min, std::chrono::milliseconds max) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_min_backoff = min;
+    m_max_backoff = std::max(min, max);
+}
+
+AppenderStats NetworkLogAppender::get_stats() const {
+    AppenderStats stats = LogAppender::get_stats();
+    stats.dropped = get_dropped_count();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    stats.queue_depth = m_pending_lengths.size() + m_inflight_count;
+    return stats;
+}
+
+void NetworkLogAppender::log(const LogEvent::ptr& event) {
+    FormattedEvent formatted(event);
+    log_formatted(formatted);
+}
+
+void NetworkLogAppender::log_formatted(FormattedEvent& formatted) {
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        count_events(1);
+        wake = append_message(*formatted.get_event(), formatted.format(m_formatter));
+    }
+    if(wake) {
+        m_cond.notify_one();
+    }
+}
+
+bool NetworkLogAppender::append_message(const LogEvent& event, std::string_view text) {
+    while(!text.empty() && (text.back() == '\n' || text.back() == '\r')) {
+        text.remove_suffix(1);
+    }
+    thread_local std::string header;
+    header.clear();
+    header += '<';
+    append_number(header, m_facility * 8 + syslog_severity(event.get_level()));
+    header += ">1 ";
+    append_timestamp(header, event.get_time_ns());
+    header += m_hostname;
+    header += ' ';
+    header += m_app_name;
+    header += ' ';
+    append_number(header, m_pid);
+    header += ' ';
+    const std::string& name = event.get_logger_name();
+    bool name_ok = !name.empty() && name.size() <= 32 &&
+                   std::all_of(name.begin(), name.end(), [](char c) { return c > ' ' && c <= '~'; });
+    header += name_ok ? std::string_view(name) : std::string_view("-");
+    header += " - ";
+
+    if(header.size() + text.size() > m_max_message) {
+        text = text.substr(0, m_max_message > header.size() ? m_max_message - header.size() : 0);
+    }
+    size_t size = header.size() + text.size();
+    char prefix[24];
+    size_t prefix_len = 0;
+    if(m_transport != NetworkTransport::UDP) {
+        auto res = std::to_chars(prefix, prefix + sizeof(prefix) - 1, size);
+        *res.ptr++ = ' ';
+        prefix_len = res.ptr - prefix;
+    }
+    size_t framed = prefix_len + size;
+    if(m_stop || m_pending.size() + m_inflight_bytes + framed > m_max_buffer) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    m_pending.append(prefix, prefix_len);
+    m_pending.append(header);
+    m_pending.append(text);
+    m_pending_lengths.push_back(static_cast<uint32_t>(framed));
+    ++m_accepted;
+
+    if(event.get_level() >= LogLevel::ERROR) {
+        // send it now, without waiting for it
+        m_flush_request = m_accepted;
+        return true;
+    }
+    // wake the sender once, when the batch fills up
+    return m_pending.size() >= m_batch_size && m_pending.size() - framed < m_batch_size;
+}
+
+void NetworkLogAppender::flush() {
+    count_flush();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    uint64_t target = m_accepted;
+    if(m_done >= target || m_stop) {
+        return;
+    }
+    m_flush_request = std::max(m_flush_request, target);
+    m_cond.notify_one();
+    m_done_cond.wait_for(lock, m_flush_timeout, [&]() { return m_done >= target || m_down || m_stop; });
+}
+
+void NetworkLogAppender::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(!m_stop) {
+            m_stop = true;
+            m_stop_deadline = std::chrono::steady_clock::now() + m_flush_timeout;
+        }
+    }
+    m_cond.notify_one();
+    m_done_cond.notify_all();
+    if(m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void NetworkLogAppender::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for(;;) {
+        auto now = std::chrono::steady_clock::now();
+        if(m_stop && now >= m_stop_deadline) {
+            uint64_t lost = (m_lengths.size() - m_next) + m_pending_lengths.size();
+            if(lost > 0) {
+                std::cout << "[ERROR] NetworkLogAppender::run() " << m_address << " unreachable, dropping "
+                          << lost << " messages" << std::endl;
+                m_dropped.fetch_add(lost, std::memory_order_relaxed);
+            }
+            m_taken += m_pending_lengths.size();
+            m_done = m_taken;
+            m_pending.clear();
+            m_pending_lengths.clear();
+            m_inflight_bytes = m_inflight_count = 0;
+            m_done_cond.notify_all();
+            break;
+        }
+
+        if(m_next == m_lengths.size()) {
+            // the batch is out, take the next one
+            m_batch.clear();
+            m_lengths.clear();
+            m_next = m_next_offset = m_partial = 0;
+            if(!m_stop) {
+                m_cond.wait_for(lock, m_flush_interval, [this]() {
+                    return m_stop || m_pending.size() >= m_batch_size || m_flush_request > m_taken;
+                });
+            }
+            if(m_pending.empty()) {
+                if(m_stop) {
+                    break;
+                }
+                continue;
+            }
+            m_batch.swap(m_pending);
+            m_lengths.swap(m_pending_lengths);
+            m_taken += m_lengths.size();
+            m_inflight_bytes = m_batch.size();
+            m_inflight_count = m_lengths.size();
+        }
+        if(m_fd < 0 && std::chrono::steady_clock::now() < m_retry_at) {
+            // the collector is down, wait for the next attempt
+            m_cond.wait_until(lock, m_stop ? std::min(m_retry_at, m_stop_deadline) : m_retry_at);
+            continue;
+        }
+
+        lock.unlock();
+        size_t sent_before = m_next;
+        send_batch();
+        lock.lock();
+
+        m_done += m_next - sent_before;
+        m_inflight_bytes = m_batch.size() - m_next_offset;
+        m_inflight_count = m_lengths.size() - m_next;
+        if(m_fd < 0) {
+            if(!m_down) {
+                std::cout << "[ERROR] NetworkLogAppender::run() cannot send to " << m_address << ": "
+                          << strerror(m_error) << ", retrying" << std::endl;
+            }
+            m_backoff = m_backoff.count() == 0 ? m_min_backoff : std::min(m_backoff * 2, m_max_backoff);
+            m_retry_at = std::chrono::steady_clock::now() + m_backoff;
+            m_down = true;
+        } else {
+            m_backoff = std::chrono::milliseconds(0);
+            m_down = false;
+        }
+        m_done_cond.notify_all();
+    }
+    lock.unlock();
+    close_socket();
+}
+
+void NetworkLogAppender::send_batch() {
+    if(m_fd >= 0 && m_transport != NetworkTransport::UDP && peer_closed()) {
+        close_socket();     // the collector went away while we were idle
+    }
+    if(m_fd < 0) {
+        if(!connect_socket()) {
+            return;
+        }
+        if(m_ever_connected) {
+            m_reconnects.fetch_add(1, std::memory_order_relaxed);
+        }
+        m_ever_connected = true;
+        m_connected.store(true, std::memory_order_relaxed);
+    }
+    bool ok = m_transport == NetworkTransport::UDP ? send_datagrams() : send_stream();
+    if(!ok) {
+        m_error = errno;
+        close_socket();
+    }
+}
+
+bool NetworkLogAppender::connect_socket() {
+    if(m_transport == NetworkTransport::UNIX) {
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if(m_address.size() >= sizeof(addr.sun_path)) {
+            m_error = ENAMETOOLONG;
+            return false;
+        }
+        memcpy(addr.sun_path, m_address.data(), m_address.size());
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+            m_fd = fd;
+            return true;
+        }
+        m_error = errno;
+        if(fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+
+    // host:port or [v6 host]:port
+    size_t colon = m_address.rfind(':');
+    if(colon == std::string::npos) {
+        m_error = EINVAL;
+        return false;
+    }
+    std::string host = m_address.substr(0, colon);
+    std::string port = m_address.substr(colon + 1);
+    if(host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+        host = host.substr(1, host.size() - 2);
+    }
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = m_transport == NetworkTransport::UDP ? SOCK_DGRAM : SOCK_STREAM;
+    addrinfo* result = nullptr;
+    if(int rt = getaddrinfo(host.c_str(), port.c_str(), &hints, &result); rt != 0) {
+        m_error = rt == EAI_SYSTEM ? errno : EHOSTUNREACH;
+        return false;
+    }
+    for(addrinfo* ai = result; ai && m_fd < 0; ai = ai->ai_next) {
+        int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+        if(fd < 0) {
+            m_error = errno;
+            continue;
+        }
+        int rt = connect(fd, ai->ai_addr, ai->ai_addrlen);
+        if(rt != 0 && errno == EINPROGRESS) {
+            pollfd pfd = {fd, POLLOUT, 0};
+            int err = ETIMEDOUT;
+            socklen_t len = sizeof(err);
+            if(poll(&pfd, 1, kConnectTimeoutMs) > 0) {
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            }
+            rt = err == 0 ? 0 : -1;
+            errno = err;
+        }
+        if(rt != 0) {
+            m_error = errno;
+            close(fd);
+            continue;
+        }
+        if(m_transport == NetworkTransport::TCP) {
+            // batches are already as large as they get
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        m_fd = fd;
+    }
+    freeaddrinfo(result);
+    return m_fd >= 0;
+}
+
+void NetworkLogAppender::close_socket() {
+    if(m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+    m_partial = 0;      // a message cut short is sent again in full
+    m_connected.store(false, std::memory_order_relaxed);
+}
+
+bool NetworkLogAppender::peer_closed() {
+    char c;
+    ssize_t n = recv(m_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR);
+}
+
+bool NetworkLogAppender::wait_writable() {
+    pollfd pfd = {m_fd, POLLOUT, 0};
+    return poll(&pfd, 1, kWritableWaitMs) > 0;
+}
+
+bool NetworkLogAppender::send_datagrams() {
+    mmsghdr msgs[kMaxDatagrams];
+    iovec iov[kMaxDatagrams];
+    while(m_next < m_lengths.size()) {
+        size_t count = std::min(kMaxDatagrams, m_lengths.size() - m_next);
+        size_t offset = m_next_offset;
+        for(size_t i = 0; i < count; ++i) {
+            iov[i].iov_base = &m_batch[offset];
+            iov[i].iov_len = m_lengths[m_next + i];
+            memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            offset += iov[i].iov_len;
+        }
+        int64_t start = write_start();
+        int sent = sendmmsg(m_fd, msgs, count, MSG_NOSIGNAL);
+        if(sent < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                if(!wait_writable()) {
+                    return true;    // still full, try again later
+                }
+                continue;
+            }
+            return false;
+        }
+        size_t bytes = 0;
+        for(int i = 0; i < sent; ++i) {
+            bytes += m_lengths[m_next];
+            m_next_offset += m_lengths[m_next];
+            ++m_next;
+        }
+        count_write(bytes, start);
+    }
+    return true;
+}
+
+bool NetworkLogAppender::send_stream() {
+    while(m_next < m_lengths.size()) {
+        size_t from = m_next_offset + m_partial;
+        int64_t start = write_start();
+        ssize_t n = send(m_fd, m_batch.data() + from, m_batch.size() - from, MSG_NOSIGNAL);
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                if(!wait_writable()) {
+                    return true;
+                }
+                continue;
+            }
+            return false;
+        }
+        count_write(n, start);
+        m_partial += n;
+        while(m_next < m_lengths.size() && m_partial >= m_lengths[m_next]) {
+            m_partial -= m_lengths[m_next];
+            m_next_offset += m_lengths[m_next];
+            ++m_next;
+        }
+    }
+    return true;
+}
+
+} // namespace gfc
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "logger.hh"
+
+#include <chrono>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+namespace gfc {
+
+enum class NetworkTransport {
+    UDP,    // one RFC 5424 message per datagram, several datagrams per sendmmsg(2)
+    TCP,    // RFC 6587 octet counting: "<length> <message>", batched into one send(2)
+    UNIX    // stream socket at a path, framed like TCP
+};
+
+/* ------------ NetworkLogAppender ------------ */
+
+// Ships events to a log collector as RFC 5424 syslog messages:
+//
+//     <134>1 2026-10-16T22:52:56.123456Z host app 4242 db.pool - connection lost
+//
+// The logger name is the MSGID, the formatter's output (without the line
+// break) the MSG. log() only appends the message to a buffer; a sender
+// thread hands the buffer to the socket once it holds the batch size, an
+// ERROR or FATAL event comes in, flush() is called, or its oldest message has
+// waited for the flush interval.
+//
+// The socket is non-blocking and connected by the sender thread, so a slow
+// or absent collector never holds up a logging thread. While the collector
+// is unreachable the sender retries with exponential backoff and messages
+// wait in the buffer; once it holds max_buffer bytes new messages are
+// dropped and counted. Messages the kernel has accepted are gone: those in
+// flight when a TCP connection breaks, or sent over UDP before the collector
+// reported itself missing, are lost.
+class NetworkLogAppender : public LogAppender {
+public:
+    typedef std::shared_ptr<NetworkLogAppender> ptr;
+
+public:
+    // address is "host:port" ("[::1]:514" for IPv6) for UDP and TCP, a path for UNIX
+    NetworkLogAppender(NetworkTransport transport, const std::string& address);
+    ~NetworkLogAppender();
+
+    virtual void log(const LogEvent::ptr& event) override;
+    virtual void log_formatted(FormattedEvent& formatted) override;
+    // Waits, at most for the flush timeout, until everything logged before
+    // the call has been sent; returns at once while the collector is down.
+    virtual void flush() override;
+    // also dropped, and queue depth (messages waiting to be sent)
+    virtual AppenderStats get_stats() const override;
+
+    // Sends what is left, giving up after the flush timeout, and closes the socket.
+    void    stop();
+
+    void    set_app_name(const std::string& name);      // default: the program name
+    void    set_facility(int facility);                 // 0 to 23, default 1 (user)
+    void    set_batch_size(size_t bytes);               // default 16K
+    void    set_flush_interval(std::chrono::milliseconds interval);    // default 100 ms
+    void    set_max_buffer(size_t bytes);               // default 4M
+    void    set_max_message(size_t bytes);              // longer messages are cut, default 8K
+    void    set_flush_timeout(std::chrono::milliseconds timeout);      // default 1 s
+    void    set_reconnect_backoff(std::chrono::milliseconds min, std::chrono::milliseconds max);
+
+    NetworkTransport    get_transport() const { return m_transport; }
+    const std::string&  get_address()   const { return m_address; }
+    bool                is_connected()  const { return m_connected.load(std::memory_order_relaxed); }
+    uint64_t            get_dropped_count()   const { return m_dropped.load(std::memory_order_relaxed); }
+    uint64_t            get_reconnect_count() const { return m_reconnects.load(std::memory_order_relaxed); }
+
+private:
+    // m_mutex held; returns whether the sender should be woken
+    bool    append_message(const LogEvent& event, std::string_view text);
+    void    run();
+    // sender thread only, without m_mutex; on failure the socket is closed
+    void    send_batch();
+    bool    connect_socket();
+    void    close_socket();
+    bool    peer_closed();
+    bool    send_datagrams();
+    bool    send_stream();
+    bool    wait_writable();
+
+private:
+    NetworkTransport    m_transport;
+    std::string         m_address;
+    std::string         m_hostname;
+    uint32_t            m_pid;
+
+    // guarded by m_mutex
+    std::string             m_app_name;
+    int                     m_facility = 1;
+    std::string             m_pending;          // framed messages waiting for the sender
+    std::vector<uint32_t>   m_pending_lengths;  // their sizes
+    size_t                  m_inflight_bytes = 0;   // taken by the sender, not yet sent
+    size_t                  m_inflight_count = 0;
+    uint64_t                m_accepted = 0;     // messages appended to m_pending
+    uint64_t                m_taken = 0;        // messages moved to the sender's batch
+    uint64_t                m_done = 0;         // messages sent or given up on
+    uint64_t                m_flush_request = 0;
+    bool                    m_stop = false;
+    std::chrono::steady_clock::time_point m_stop_deadline;  // when stop() gives up sending
+    bool                    m_down = false;     // the last connection attempt failed
+    size_t                  m_batch_size = 16 * 1024;
+    size_t                  m_max_buffer = 4 * 1024 * 1024;
+    size_t                  m_max_message = 8 * 1024;
+    std::chrono::milliseconds m_flush_interval{100};
+    std::chrono::milliseconds m_flush_timeout{1000};
+    std::chrono::milliseconds m_min_backoff{100};
+    std::chrono::milliseconds m_max_backoff{10000};
+    std::condition_variable m_cond;             // wakes the sender
+    std::condition_variable m_done_cond;        // wakes flush()
+
+    // sender thread only
+    int                     m_fd = -1;
+    std::string             m_batch;
+    std::vector<uint32_t>   m_lengths;
+    size_t                  m_next = 0;         // first message of m_batch not completely sent
+    size_t                  m_next_offset = 0;  // where it starts
+    size_t                  m_partial = 0;      // stream: bytes of it already sent
+    std::chrono::milliseconds m_backoff{0};
+    std::chrono::steady_clock::time_point m_retry_at;
+    bool                    m_ever_connected = false;
+    int                     m_error = 0;        // errno of the last failure
+
+    std::atomic<bool>       m_connected{false};
+    std::atomic<uint64_t>   m_dropped{0};
+    std::atomic<uint64_t>   m_reconnects{0};
+    std::thread             m_thread;
+};
+
+} // namespace gfc
@@ -0,0 +1,85 @@
+#include "rcu.hh"
+
+#include <thread>
+
+namespace gfc {
+
+namespace {
+
+// One per thread that has ever entered a read section. Records are reused
+// by later threads and never freed, so the list can be walked without locks.
+struct ReaderRecord {
+    alignas(64) std::atomic<uint64_t> epoch{0};     // epoch the read section started in, 0 outside
+    uint32_t                nesting = 0;            // owner thread only
+    std::atomic<bool>       in_use{true};
+    ReaderRecord*           next = nullptr;         // fixed once the record is published
+};
+
+std::atomic<uint64_t>       g_epoch{1};
+std::atomic<ReaderRecord*>  g_records{nullptr};
+
+// trivially destructible, so it stays usable while thread_locals are destroyed
+thread_local ReaderRecord*  t_record = nullptr;
+
+struct RecordGuard {
+    ~RecordGuard() {
+        if(t_record) {
+            t_record->in_use.store(false, std::memory_order_release);
+            t_record = nullptr;
+        }
+    }
+};
+
+ReaderRecord* local_record() {
+    if(t_record) {
+        return t_record;
+    }
+    thread_local RecordGuard guard;
+    for(ReaderRecord* r = g_records.load(std::memory_order_acquire); r; r = r->next) {
+        bool used = false;
+        if(!r->in_use.load(std::memory_order_relaxed) &&
+           r->in_use.compare_exchange_strong(used, true, std::memory_order_acquire)) {
+            t_record = r;
+            return r;
+        }
+    }
+    ReaderRecord* r = new ReaderRecord();
+    r->next = g_records.load(std::memory_order_relaxed);
+    while(!g_records.compare_exchange_weak(r->next, r, std::memory_order_seq_cst, std::memory_order_relaxed)) {}
+    t_record = r;
+    return r;
+}
+
+} // namespace
+
+void rcu_read_lock() {
+    ReaderRecord* r = local_record();
+    if(r->nesting++ == 0) {
+        // seq_cst, like rcu_dereference() and the scan in rcu_synchronize():
+        // either the writer sees this section, or the section sees the
+        // writer's new version
+        r->epoch.store(g_epoch.load(std::memory_order_acquire), std::memory_order_seq_cst);
+    }
+}
+
+void rcu_read_unlock() {
+    ReaderRecord* r = t_record;
+    if(--r->nesting == 0) {
+        r->epoch.store(0, std::memory_order_release);
+    }
+}
+
+void rcu_synchronize() {
+    uint64_t target = g_epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+    for(ReaderRecord* r = g_records.load(std::memory_order_seq_cst); r; r = r->next) {
+        for(;;) {
+            uint64_t epoch = r->epoch.load(std::memory_order_seq_cst);
+            if(epoch == 0 || epoch >= target) {
+                break;
+            }
+            std::this_thread::yield();
+        }
+    }
+}
+
+} // namespace gfc
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace gfc {
+
+// Minimal read-copy-update for configuration that is read on every log call
+// and changed rarely (a logger's appender list, ...).
+//
+// Readers bracket their access with an RcuReadGuard, which costs one
+// sequentially consistent store to a per-thread record; no shared cache
+// line is written. Inside, they load the current version with
+// rcu_dereference(). A writer publishes a new version with rcu_assign() and
+// then calls rcu_synchronize(), which waits until every read section that
+// might still see the old version has ended. After that the old version
+// can be freed.
+//
+// Read sections nest. rcu_synchronize() must not be called inside one.
+void rcu_read_lock();
+void rcu_read_unlock();
+void rcu_synchronize();
+
+template<typename T>
+T* rcu_dereference(const std::atomic<T*>& p) {
+    return p.load(std::memory_order_seq_cst);
+}
+
+// Returns the previous version.
+template<typename T>
+T* rcu_assign(std::atomic<T*>& p, T* value) {
+    return p.exchange(value, std::memory_order_seq_cst);
+}
+
+class RcuReadGuard {
+public:
+    RcuReadGuard()  { rcu_read_lock(); }
+    ~RcuReadGuard() { rcu_read_unlock(); }
+    RcuReadGuard(const RcuReadGuard&) = delete;
+    RcuReadGuard& operator=(const RcuReadGuard&) = delete;
+};
+
+} // namespace gfc
@@ -0,0 +1,276 @@
+#include "rolling_file_appender.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <tuple>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef GFC_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace gfc {
+
+namespace {
+
+int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::string format_segment_time(int64_t time_ns) {
+    time_t sec = static_cast<time_t>(time_ns / 1000000000);
+    struct tm tm;
+    localtime_r(&sec, &tm);
+    char buf[32];
+    size_t len = strftime(buf, sizeof(buf), "%Y%m%d-%H%M%S", &tm);
+    return std::string(buf, len);
+}
+
+bool file_exists(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+bool ends_with(const std::string& s, const char* suffix) {
+    size_t len = strlen(suffix);
+    return s.size() >= len && s.compare(s.size() - len, len, suffix) == 0;
+}
+
+} // namespace
+
+RollingFileLogAppender::RollingFileLogAppender(const std::string& filename, uint64_t max_size,
+                                               RollingInterval interval)
+    : FileLogAppender(filename), m_max_size(max_size), m_interval(interval) {
+#ifdef GFC_HAVE_ZLIB
+    m_compress = true;
+#else
+    m_compress = false;
+#endif
+    m_segment_start_ns = now_ns();
+    m_next_rollover_ns = next_boundary(m_segment_start_ns);
+    m_thread = std::thread(&RollingFileLogAppender::run, this);
+}
+
+RollingFileLogAppender::~RollingFileLogAppender() {
+    {
+        std::lock_guard<std::mutex> lock(m_archive_mutex);
+        m_stop = true;
+    }
+    m_archive_cond.notify_one();
+    m_thread.join();
+}
+
+void RollingFileLogAppender::set_max_archives(size_t count) {
+    std::lock_guard<std::mutex> lock(m_archive_mutex);
+    m_max_archives = count;
+}
+
+void RollingFileLogAppender::set_compress(bool compress) {
+#ifndef GFC_HAVE_ZLIB
+    if(compress) {
+        std::cout << "[ERROR] RollingFileLogAppender::set_compress() built without zlib" << std::endl;
+        return;
+    }
+#endif
+    std::lock_guard<std::mutex> lock(m_archive_mutex);
+    m_compress = compress;
+}
+
+void RollingFileLogAppender::wait_for_archiving() {
+    std::unique_lock<std::mutex> lock(m_archive_mutex);
+    m_archived_cond.wait(lock, [this]() { return m_pending.empty() && !m_busy; });
+}
+
+void RollingFileLogAppender::on_event(const LogEvent& event) {
+    int64_t time_ns = event.get_time_ns();
+    uint64_t size = m_file_size + get_buffered_size();
+    if(time_ns >= m_next_rollover_ns || (m_max_size > 0 && size > 0 && size >= m_max_size)) {
+        rotate(time_ns);
+    }
+}
+
+// m_mutex held
+void RollingFileLogAppender::rotate(int64_t now_ns) {
+    write_buffer();
+    int64_t segment_start_ns = m_segment_start_ns;
+    m_segment_start_ns = now_ns;
+    m_next_rollover_ns = next_boundary(now_ns);
+    if(m_file_size == 0) {
+        return;     // nothing worth archiving
+    }
+    if(m_durability != FileDurability::NONE && m_unsynced) {
+        sync_file();
+    }
+
+    // names are never reused, even once pruning has removed an archive
+    std::string base = m_filename + "." + format_segment_time(segment_start_ns);
+    int seq = base == m_last_archive_base ? m_last_archive_seq + 1 : 0;
+    std::string archive;
+    for(;; ++seq) {
+        archive = seq == 0 ? base : base + "-" + std::to_string(seq);
+        if(!file_exists(archive) && !file_exists(archive + ".gz")) {
+            break;
+        }
+    }
+    m_last_archive_base = base;
+    m_last_archive_seq = seq;
+    if(rename(m_filename.c_str(), archive.c_str()) != 0) {
+        std::cout << "[ERROR] RollingFileLogAppender::rotate() cannot rename " << m_filename
+                  << ": " << strerror(errno) << std::endl;
+        return;     // keep appending to the current file
+    }
+    close(m_fd);
+    open_file();
+    m_rotations.fetch_add(1, std::memory_order_relaxed);
+
+    {
+        std::lock_guard<std::mutex> lock(m_archive_mutex);
+        m_pending.push_back(archive);
+    }
+    m_archive_cond.notify_one();
+}
+
+int64_t RollingFileLogAppender::next_boundary(int64_t time_ns) const {
+    if(m_interval == RollingInterval::NONE) {
+        return INT64_MAX;
+    }
+    time_t sec = static_cast<time_t>(time_ns / 1000000000);
+    struct tm tm;
+    localtime_r(&sec, &tm);
+    tm.tm_sec = 0;
+    tm.tm_min = 0;
+    if(m_interval == RollingInterval::DAILY) {
+        tm.tm_hour = 0;
+        tm.tm_mday += 1;
+    } else {
+        tm.tm_hour += 1;
+    }
+    tm.tm_isdst = -1;   // mktime normalizes the overflow and works out DST
+    return static_cast<int64_t>(mktime(&tm)) * 1000000000;
+}
+
+void RollingFileLogAppender::run() {
+    std::unique_lock<std::mutex> lock(m_archive_mutex);
+    for(;;) {
+        m_archive_cond.wait(lock, [this]() { return m_stop || !m_pending.empty(); });
+        if(m_pending.empty()) {
+            break;  // stopping, and everything is archived
+        }
+        std::string path = m_pending.front();
+        m_pending.pop_front();
+        m_busy = true;
+        bool compress = m_compress;
+        lock.unlock();
+
+        if(compress) {
+            compress_archive(path);
+        }
+        prune_archives();
+
+        lock.lock();
+        m_busy = false;
+        m_archived_cond.notify_all();
+    }
+}
+
+// Replaces path by path.gz. The data goes to a .tmp file first, so a crash
+// never leaves a truncated archive under the final name.
+void RollingFileLogAppender::compress_archive(const std::string& path) {
+#ifdef GFC_HAVE_ZLIB
+    int in = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(in < 0) {
+        std::cout << "[ERROR] RollingFileLogAppender::compress_archive() cannot open " << path << std::endl;
+        return;
+    }
+    std::string tmp = path + ".gz.tmp";
+    gzFile out = gzopen(tmp.c_str(), "wb6");
+    if(out == nullptr) {
+        std::cout << "[ERROR] RollingFileLogAppender::compress_archive() cannot create " << tmp << std::endl;
+        close(in);
+        return;
+    }
+    std::vector<char> buf(64 * 1024);
+    bool ok = true;
+    for(;;) {
+        ssize_t n = read(in, buf.data(), buf.size());
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n <= 0) {
+            ok = n == 0;
+            break;
+        }
+        if(gzwrite(out, buf.data(), n) != n) {
+            ok = false;
+            break;
+        }
+    }
+    ok = gzclose(out) == Z_OK && ok;
+    close(in);
+    if(!ok || rename(tmp.c_str(), (path + ".gz").c_str()) != 0) {
+        std::cout << "[ERROR] RollingFileLogAppender::compress_archive() failed for " << path << std::endl;
+        unlink(tmp.c_str());
+        return;
+    }
+    unlink(path.c_str());
+#else
+    (void)path;
+#endif
+}
+
+void RollingFileLogAppender::prune_archives() {
+    size_t keep;
+    {
+        std::lock_guard<std::mutex> lock(m_archive_mutex);
+        keep = m_max_archives;
+    }
+    if(keep == 0) {
+        return;
+    }
+
+    size_t slash = m_filename.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : m_filename.substr(0, slash);
+    std::string prefix = (slash == std::string::npos ? m_filename : m_filename.substr(slash + 1)) + ".";
+    DIR* d = opendir(dir.c_str());
+    if(d == nullptr) {
+        return;
+    }
+    // (segment time, -N suffix, file name)
+    std::vector<std::tuple<std::string, long, std::string>> archives;
+    while(struct dirent* entry = readdir(d)) {
+        std::string name = entry->d_name;
+        if(name.compare(0, prefix.size(), prefix) != 0 || name.size() <= prefix.size() ||
+           !isdigit(static_cast<unsigned char>(name[prefix.size()])) || ends_with(name, ".tmp")) {
+            continue;
+        }
+        std::string stamp = name.substr(prefix.size());
+        if(ends_with(stamp, ".gz")) {
+            stamp.resize(stamp.size() - 3);
+        }
+        long n = 0;
+        size_t dash = stamp.find('-', 9);   // after the date's own '-'
+        if(dash != std::string::npos) {
+            n = strtol(stamp.c_str() + dash + 1, nullptr, 10);
+            stamp.resize(dash);
+        }
+        archives.emplace_back(stamp, n, name);
+    }
+    closedir(d);
+
+    if(archives.size() <= keep) {
+        return;
+    }
+    std::sort(archives.begin(), archives.end());
+    for(size_t i = 0; i + keep < archives.size(); ++i) {
+        unlink((dir + "/" + std::get<2>(archives[i])).c_str());
+    }
+}
+
+} // namespace gfc
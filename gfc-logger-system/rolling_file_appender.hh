@@ -0,0 +1,77 @@
+#pragma once
+
+#include "logger.hh"
+
+#include <condition_variable>
+#include <deque>
+#include <thread>
+
+namespace gfc {
+
+enum class RollingInterval {
+    NONE,       // size-based rotation only
+    HOURLY,     // at the start of every hour, local time
+    DAILY       // at local midnight
+};
+
+/* ------------ RollingFileLogAppender ------------ */
+
+// FileLogAppender that moves its file aside once it reaches max_size bytes
+// and/or when the interval boundary is crossed, then carries on with a new
+// file. Archives are named <filename>.<YYYYmmdd-HHMMSS> after the time their
+// segment was started (with -1, -2, ... appended if that name is taken).
+//
+// Rotation itself is a write, a rename and an open under the appender lock.
+// Compressing the archive (gzip, when built with zlib) and deleting archives
+// beyond the retention count happen on a background thread.
+class RollingFileLogAppender : public FileLogAppender {
+public:
+    typedef std::shared_ptr<RollingFileLogAppender> ptr;
+
+public:
+    // max_size 0 disables size-based rotation
+    RollingFileLogAppender(const std::string& filename, uint64_t max_size,
+                           RollingInterval interval = RollingInterval::NONE);
+    ~RollingFileLogAppender();
+
+    // number of archives to keep, 0 keeps all (default 7)
+    void    set_max_archives(size_t count);
+    // gzip archives in the background (default on if built with zlib)
+    void    set_compress(bool compress);
+    // Blocks until the background thread has caught up with all rotations.
+    void    wait_for_archiving();
+
+    uint64_t get_rotation_count() const { return m_rotations.load(std::memory_order_relaxed); }
+
+protected:
+    virtual void on_event(const LogEvent& event) override;
+
+private:
+    void    rotate(int64_t now_ns);
+    int64_t next_boundary(int64_t time_ns) const;
+    void    run();
+    void    compress_archive(const std::string& path);
+    void    prune_archives();
+
+private:
+    uint64_t                m_max_size;
+    RollingInterval         m_interval;
+    int64_t                 m_segment_start_ns;     // when the current file was started
+    int64_t                 m_next_rollover_ns;     // INT64_MAX without an interval
+    std::atomic<uint64_t>   m_rotations{0};
+    std::string             m_last_archive_base;    // name of the last archive without its -N suffix
+    int                     m_last_archive_seq = 0;
+
+    // background archiving, guarded by m_archive_mutex
+    std::mutex              m_archive_mutex;
+    std::condition_variable m_archive_cond;
+    std::condition_variable m_archived_cond;
+    std::deque<std::string> m_pending;              // archives waiting for compression
+    bool                    m_busy = false;
+    bool                    m_stop = false;
+    size_t                  m_max_archives = 7;
+    bool                    m_compress;
+    std::thread             m_thread;
+};
+
+} // namespace gfc
@@ -0,0 +1,744 @@
+#include "segment_log.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef GFC_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace gfc {
+
+namespace {
+
+// File layout:
+//     16 byte header: magic, u32 version, u32 reserved
+//     blocks: BlockHeader, then stored_size bytes of payload
+//     on close: zero padding to 8 bytes, SegmentBlockIndex[count], Trailer
+// Dictionary payload entries:
+//     u8 SITE, u32 id, u8 level, i32 line, str file, str function
+//     u8 LOGGER, u32 id, str name
+// Data payload records:
+//     i64 time_ns, u32 elapse, u32 thread id, u32 coroutine id, u32 site id,
+//     u32 logger id, str content, u32 field count, fields
+// Fields: u8 type, str key, then i64, u64, f64, u8 or str by type.
+// Integers are little-endian; str is a u32 length and the bytes.
+const char      kMagic[8] = {'G', 'F', 'C', 'S', 'E', 'G', '\0', '\0'};
+const uint32_t  kVersion = 1;
+const uint32_t  kBlockMagic = 0x4b4c4247;   // "GBLK"
+const uint32_t  kIndexMagic = 0x58444947;   // "GIDX"
+const size_t    kHeaderSize = 16;
+const size_t    kMaxSealed = 4;             // sealed blocks queued before logging waits
+const int       kCompressionLevel = 6;
+
+enum DictTag : uint8_t { SITE = 1, LOGGER = 2 };
+
+struct BlockHeader {
+    uint32_t            magic;
+    uint32_t            checksum;   // of the stored payload
+    SegmentBlockIndex   index;
+};
+
+struct Trailer {
+    uint64_t    index_offset;
+    uint32_t    count;
+    uint32_t    magic;
+};
+
+// FNV-1a
+uint32_t checksum(const char* data, size_t len) {
+    uint32_t hash = 2166136261u;
+    for(size_t i = 0; i < len; ++i) {
+        hash = (hash ^ static_cast<uint8_t>(data[i])) * 16777619u;
+    }
+    return hash;
+}
+
+template<typename T>
+void put(std::string& out, T v) {
+    out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+void put_string(std::string& out, std::string_view s) {
+    put<uint32_t>(out, s.size());
+    out.append(s.data(), s.size());
+}
+
+// Bounds-checked reads from a payload.
+struct Cursor {
+    const char* p;
+    const char* end;
+    bool        ok = true;
+
+    template<typename T>
+    T get() {
+        T v{};
+        if(end - p < static_cast<ptrdiff_t>(sizeof(T))) {
+            ok = false;
+            return v;
+        }
+        memcpy(&v, p, sizeof(T));
+        p += sizeof(T);
+        return v;
+    }
+    std::string_view get_string() {
+        uint32_t len = get<uint32_t>();
+        if(static_cast<size_t>(end - p) < len) {
+            ok = false;
+            return std::string_view();
+        }
+        std::string_view s(p, len);
+        p += len;
+        return s;
+    }
+};
+
+} // namespace
+
+/* ------------ SegmentLogAppender ------------ */
+
+SegmentLogAppender::SegmentLogAppender(const std::string& path, size_t block_size)
+    : m_path(path), m_block_size(block_size) {
+    m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(m_fd < 0) {
+        std::cout << "[ERROR] SegmentLogAppender::SegmentLogAppender() cannot open " << path << ": "
+                  << strerror(errno) << std::endl;
+    } else {
+        char header[kHeaderSize] = {0};
+        memcpy(header, kMagic, sizeof(kMagic));
+        memcpy(header + sizeof(kMagic), &kVersion, sizeof(kVersion));
+        write_all(header, sizeof(header));
+        m_offset = sizeof(header);
+    }
+    m_data.reserve(block_size + 4096);
+    m_thread = std::thread(&SegmentLogAppender::run, this);
+}
+
+SegmentLogAppender::~SegmentLogAppender() {
+    close();
+}
+
+void SegmentLogAppender::set_flush_interval(std::chrono::milliseconds interval) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_flush_interval = interval;
+    }
+    m_cond.notify_one();
+}
+
+void SegmentLogAppender::log(const LogEvent::ptr& event) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if(m_stop) {
+        return;
+    }
+    count_events(1);
+    encode(*event);
+    if(m_data.size() >= m_block_size || event->get_level() == LogLevel::FATAL) {
+        wait_for_room(lock);
+        seal_block();
+    }
+}
+
+void SegmentLogAppender::log_batch(std::span<const LogEvent::ptr> events) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if(m_stop) {
+        return;
+    }
+    count_events(events.size());
+    for(const LogEvent::ptr& event : events) {
+        encode(*event);
+        if(m_data.size() >= m_block_size || event->get_level() == LogLevel::FATAL) {
+            wait_for_room(lock);
+            seal_block();
+        }
+    }
+}
+
+void SegmentLogAppender::encode(const LogEvent& event) {
+    const LogSite* site = &event.get_site();
+    auto site_it = m_site_ids.find(site);
+    if(site_it == m_site_ids.end()) {
+        site_it = m_site_ids.emplace(site, m_site_ids.size() + 1).first;
+        put<uint8_t>(m_dict, SITE);
+        put<uint32_t>(m_dict, site_it->second);
+        put<uint8_t>(m_dict, static_cast<uint8_t>(site->level));
+        put<int32_t>(m_dict, site->line);
+        put_string(m_dict, site->file ? site->file : "");
+        put_string(m_dict, site->function ? site->function : "");
+    }
+    const std::string* logger = &event.get_logger_name();
+    auto logger_it = m_logger_ids.find(logger);
+    if(logger_it == m_logger_ids.end()) {
+        logger_it = m_logger_ids.emplace(logger, m_logger_ids.size() + 1).first;
+        put<uint8_t>(m_dict, LOGGER);
+        put<uint32_t>(m_dict, logger_it->second);
+        put_string(m_dict, *logger);
+    }
+
+    if(m_data.empty()) {
+        m_opened_at = std::chrono::steady_clock::now();
+        memset(&m_index, 0, sizeof(m_index));
+        m_index.kind = SegmentBlockIndex::DATA;
+        m_index.min_time_ns = INT64_MAX;
+        m_index.max_time_ns = INT64_MIN;
+    }
+    int64_t time_ns = event.get_time_ns();
+    put<int64_t>(m_data, time_ns);
+    put<uint32_t>(m_data, event.get_elapse());
+    put<uint32_t>(m_data, event.get_thread_id());
+    put<uint32_t>(m_data, event.get_coroutine_id());
+    put<uint32_t>(m_data, site_it->second);
+    put<uint32_t>(m_data, logger_it->second);
+    put_string(m_data, event.get_content());
+    std::span<const LogField> fields = event.get_fields();
+    put<uint32_t>(m_data, fields.size());
+    for(const LogField& field : fields) {
+        put<uint8_t>(m_data, static_cast<uint8_t>(field.type));
+        put_string(m_data, event.get_field_key(field));
+        switch(field.type) {
+            case LogField::Type::INT:       put<int64_t>(m_data, field.i); break;
+            case LogField::Type::UINT:      put<uint64_t>(m_data, field.u); break;
+            case LogField::Type::DOUBLE:    put<double>(m_data, field.d); break;
+            case LogField::Type::BOOL:      put<uint8_t>(m_data, field.b ? 1 : 0); break;
+            case LogField::Type::STRING:    put_string(m_data, event.get_field_string(field)); break;
+        }
+    }
+
+    ++m_index.event_count;
+    m_index.min_time_ns = std::min(m_index.min_time_ns, time_ns);
+    m_index.max_time_ns = std::max(m_index.max_time_ns, time_ns);
+    m_index.level_mask |= 1 << static_cast<int>(event.get_level());
+    uint32_t id = logger_it->second;
+    m_index.logger_mask[id / 64 % 2] |= 1ULL << id % 64;
+}
+
+void SegmentLogAppender::wait_for_room(std::unique_lock<std::mutex>& lock) {
+    m_written_cond.wait(lock, [this]() { return m_sealed.size() < kMaxSealed; });
+}
+
+void SegmentLogAppender::seal_block() {
+    if(m_data.empty()) {
+        return;
+    }
+    SealedBlock& block = m_sealed.emplace_back();
+    block.dict.swap(m_dict);
+    block.data.swap(m_data);
+    block.index = m_index;
+    if(!m_spare.empty()) {
+        m_data.swap(m_spare.back());
+        m_spare.pop_back();
+    } else {
+        m_data.reserve(m_block_size + 4096);
+    }
+    ++m_sealed_count;
+    m_cond.notify_one();
+}
+
+void SegmentLogAppender::flush() {
+    count_flush();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    seal_block();
+    uint64_t target = m_sealed_count;
+    m_written_cond.wait(lock, [&]() { return m_written_count >= target; });
+}
+
+void SegmentLogAppender::close() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_stop) {
+            return;
+        }
+        seal_block();
+        m_stop = true;
+    }
+    m_cond.notify_one();
+    m_thread.join();
+}
+
+void SegmentLogAppender::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for(;;) {
+        if(m_sealed.empty()) {
+            if(m_stop) {
+                break;
+            }
+            m_cond.wait_for(lock, m_flush_interval, [this]() { return m_stop || !m_sealed.empty(); });
+            if(m_sealed.empty() && !m_data.empty() &&
+               std::chrono::steady_clock::now() - m_opened_at >= m_flush_interval) {
+                seal_block();
+            }
+            continue;
+        }
+        SealedBlock block = std::move(m_sealed.front());
+        m_sealed.pop_front();
+        lock.unlock();
+        write_block(block);
+        lock.lock();
+        block.data.clear();
+        m_spare.push_back(std::move(block.data));
+        ++m_written_count;
+        m_written_cond.notify_all();
+    }
+    lock.unlock();
+    write_index();
+    if(m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+void SegmentLogAppender::write_block(SealedBlock& block) {
+    if(!block.dict.empty()) {
+        SegmentBlockIndex dict;
+        memset(&dict, 0, sizeof(dict));
+        dict.kind = SegmentBlockIndex::DICT;
+        write_entry(dict, block.dict);
+    }
+    write_entry(block.index, block.data);
+    m_blocks.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SegmentLogAppender::write_entry(SegmentBlockIndex index, const std::string& raw) {
+    const std::string* stored = &raw;
+    index.codec = SegmentBlockIndex::NONE;
+#ifdef GFC_HAVE_ZLIB
+    if(index.kind == SegmentBlockIndex::DATA) {
+        uLongf len = compressBound(raw.size());
+        m_compressed.resize(len);
+        if(compress2(reinterpret_cast<Bytef*>(&m_compressed[0]), &len, reinterpret_cast<const Bytef*>(raw.data()),
+                     raw.size(), kCompressionLevel) == Z_OK && len < raw.size()) {
+            m_compressed.resize(len);
+            stored = &m_compressed;
+            index.codec = SegmentBlockIndex::ZLIB;
+        }
+    }
+#endif
+    index.offset = m_offset;
+    index.raw_size = raw.size();
+    index.stored_size = stored->size();
+    BlockHeader header{kBlockMagic, checksum(stored->data(), stored->size()), index};
+    int64_t start = write_start();
+    if(write_all(reinterpret_cast<const char*>(&header), sizeof(header)) &&
+       write_all(stored->data(), stored->size())) {
+        count_write(sizeof(header) + stored->size(), start);
+        m_offset += sizeof(header) + stored->size();
+        m_entries.push_back(index);
+    }
+}
+
+bool SegmentLogAppender::write_all(const char* data, size_t len) {
+    if(m_fd < 0) {
+        return false;
+    }
+    while(len > 0) {
+        ssize_t n = ::write(m_fd, data, len);
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            std::cout << "[ERROR] SegmentLogAppender::write_all() write to " << m_path << " failed: "
+                      << strerror(errno) << std::endl;
+            // a partial block would hide every block after it
+            ::close(m_fd);
+            m_fd = -1;
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+void SegmentLogAppender::write_index() {
+    std::string out(m_offset % 8 ? 8 - m_offset % 8 : 0, '\0');
+    Trailer trailer{m_offset + out.size(), static_cast<uint32_t>(m_entries.size()), kIndexMagic};
+    out.append(reinterpret_cast<const char*>(m_entries.data()), m_entries.size() * sizeof(SegmentBlockIndex));
+    put(out, trailer);
+    write_all(out.data(), out.size());
+}
+
+/* ------------ SegmentReader ------------ */
+
+struct SegmentReader::Filter {
+    int64_t             from_ns;
+    int64_t             to_ns;
+    LogLevel            min_level;
+    uint8_t             level_mask;
+    bool                all_loggers;
+    std::vector<bool>   logger_ok;      // index = logger id
+    uint64_t            logger_mask[2];
+};
+
+SegmentReader::~SegmentReader() {
+    if(m_map) {
+        munmap(const_cast<char*>(m_map), m_size);
+    }
+}
+
+bool SegmentReader::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        std::cout << "[ERROR] SegmentReader::open() cannot open " << path << std::endl;
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < kHeaderSize) {
+        std::cout << "[ERROR] SegmentReader::open() " << path << " is not a log segment" << std::endl;
+        ::close(fd);
+        return false;
+    }
+    m_size = st.st_size;
+    void* map = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(map == MAP_FAILED) {
+        std::cout << "[ERROR] SegmentReader::open() cannot map " << path << std::endl;
+        m_size = 0;
+        return false;
+    }
+    m_map = static_cast<const char*>(map);
+    uint32_t version;
+    memcpy(&version, m_map + sizeof(kMagic), sizeof(version));
+    if(memcmp(m_map, kMagic, sizeof(kMagic)) != 0 || version != kVersion) {
+        std::cout << "[ERROR] SegmentReader::open() " << path << " is not a version " << kVersion
+                  << " log segment" << std::endl;
+        return false;
+    }
+
+    const SegmentBlockIndex* entries = nullptr;
+    size_t count = 0;
+    Trailer trailer;
+    if(m_size >= kHeaderSize + sizeof(trailer)) {
+        memcpy(&trailer, m_map + m_size - sizeof(trailer), sizeof(trailer));
+        // the trailer is untrusted: compare by subtraction, sums may overflow
+        size_t index_end = m_size - sizeof(trailer);
+        if(trailer.magic == kIndexMagic && trailer.index_offset % 8 == 0 && trailer.index_offset >= kHeaderSize &&
+           trailer.index_offset <= index_end &&
+           index_end - trailer.index_offset == trailer.count * sizeof(SegmentBlockIndex)) {
+            entries = reinterpret_cast<const SegmentBlockIndex*>(m_map + trailer.index_offset);
+            count = trailer.count;
+            m_has_index = true;
+        }
+    }
+    if(!m_has_index) {
+        // still being written or cut short: walk the block headers
+        size_t pos = kHeaderSize;
+        BlockHeader header;
+        while(m_size - pos >= sizeof(header)) {
+            memcpy(&header, m_map + pos, sizeof(header));
+            if(header.magic != kBlockMagic || header.index.offset != pos) {
+                m_corrupt = true;
+                break;
+            }
+            if(m_size - pos - sizeof(header) < header.index.stored_size) {
+                break;
+            }
+            m_scanned.push_back(header.index);
+            pos += sizeof(header) + header.index.stored_size;
+        }
+        // a block still being written, or cut short
+        m_truncated = !m_corrupt && pos != m_size;
+        entries = m_scanned.data();
+        count = m_scanned.size();
+    }
+
+    for(size_t i = 0; i < count; ++i) {
+        const SegmentBlockIndex& index = entries[i];
+        if(index.kind == SegmentBlockIndex::DICT) {
+            if(!load_dict(index)) {
+                m_corrupt = true;
+                break;
+            }
+        } else if(index.kind == SegmentBlockIndex::DATA) {
+            m_blocks.push_back(&index);
+        }
+    }
+    return true;
+}
+
+bool SegmentReader::inflate(const SegmentBlockIndex& index, std::string& raw) const {
+    if(index.offset > m_size || m_size - index.offset < sizeof(BlockHeader) ||
+       m_size - index.offset - sizeof(BlockHeader) < index.stored_size) {
+        return false;
+    }
+    BlockHeader header;
+    memcpy(&header, m_map + index.offset, sizeof(header));
+    const char* stored = m_map + index.offset + sizeof(header);
+    if(header.magic != kBlockMagic || header.checksum != checksum(stored, index.stored_size)) {
+        return false;
+    }
+    if(index.codec == SegmentBlockIndex::NONE) {
+        raw.assign(stored, index.stored_size);
+        return raw.size() == index.raw_size;
+    }
+#ifdef GFC_HAVE_ZLIB
+    if(index.codec == SegmentBlockIndex::ZLIB) {
+        raw.resize(index.raw_size);
+        uLongf len = raw.size();
+        return uncompress(reinterpret_cast<Bytef*>(&raw[0]), &len, reinterpret_cast<const Bytef*>(stored),
+                          index.stored_size) == Z_OK && len == index.raw_size;
+    }
+#endif
+    std::cout << "[ERROR] SegmentReader::inflate() unsupported codec " << static_cast<int>(index.codec) << std::endl;
+    return false;
+}
+
+bool SegmentReader::load_dict(const SegmentBlockIndex& index) {
+    std::string raw;
+    if(!inflate(index, raw)) {
+        return false;
+    }
+    Cursor in{raw.data(), raw.data() + raw.size()};
+    while(in.ok && in.p < in.end) {
+        uint8_t tag = in.get<uint8_t>();
+        uint32_t id = in.get<uint32_t>();
+        // ids are handed out in order, so one can only reuse a slot or add the next
+        if(tag == SITE) {
+            if(id == 0 || id > m_sites.size() + 1) {
+                return false;
+            }
+            LogLevel level          = static_cast<LogLevel>(in.get<uint8_t>());
+            int32_t line            = in.get<int32_t>();
+            const char* file        = intern_site_string(in.get_string());
+            const char* function    = intern_site_string(in.get_string());
+            if(m_sites.size() < id) {
+                m_sites.resize(id, nullptr);
+            }
+            m_sites[id - 1] = &intern_log_site(file, line, function, level);
+        } else if(tag == LOGGER) {
+            if(id == 0 || id > m_loggers.size() + 1) {
+                return false;
+            }
+            std::string_view name = in.get_string();
+            if(m_loggers.size() < id) {
+                m_loggers.resize(id, nullptr);
+            }
+            m_loggers[id - 1] = &intern_logger_name(std::string(name));
+        } else {
+            return false;
+        }
+    }
+    return in.ok;
+}
+
+SegmentReader::Filter SegmentReader::make_filter(const SegmentQuery& query) const {
+    Filter filter;
+    filter.from_ns = query.from_ns;
+    filter.to_ns = query.to_ns;
+    filter.min_level = query.min_level;
+    filter.level_mask = 0;
+    for(int level = static_cast<int>(query.min_level); level <= static_cast<int>(LogLevel::FATAL); ++level) {
+        filter.level_mask |= 1 << level;
+    }
+    filter.all_loggers = query.loggers.empty();
+    filter.logger_ok.assign(m_loggers.size() + 1, filter.all_loggers);
+    filter.logger_mask[0] = filter.logger_mask[1] = 0;
+    for(size_t i = 0; i < m_loggers.size() && !filter.all_loggers; ++i) {
+        if(!m_loggers[i]) {
+            continue;
+        }
+        const std::string& name = *m_loggers[i];
+        for(const std::string& want : query.loggers) {
+            if(name.compare(0, want.size(), want) == 0 && (name.size() == want.size() || name[want.size()] == '.')) {
+                uint32_t id = i + 1;
+                filter.logger_ok[id] = true;
+                filter.logger_mask[id / 64 % 2] |= 1ULL << id % 64;
+                break;
+            }
+        }
+    }
+    return filter;
+}
+
+bool SegmentReader::matches(const SegmentBlockIndex& index, const Filter& filter) const {
+    return index.max_time_ns >= filter.from_ns && index.min_time_ns < filter.to_ns &&
+           (index.level_mask & filter.level_mask) &&
+           (filter.all_loggers || (index.logger_mask[0] & filter.logger_mask[0]) ||
+                                  (index.logger_mask[1] & filter.logger_mask[1]));
+}
+
+std::vector<size_t> SegmentReader::select(const SegmentQuery& query) const {
+    Filter filter = make_filter(query);
+    std::vector<size_t> selected;
+    for(size_t i = 0; i < m_blocks.size(); ++i) {
+        if(matches(*m_blocks[i], filter)) {
+            selected.push_back(i);
+        }
+    }
+    return selected;
+}
+
+bool SegmentReader::decode(const SegmentBlockIndex& index, const Filter& filter, std::string& raw,
+                           std::vector<LogEvent::ptr>& events) const {
+    if(!inflate(index, raw)) {
+        return false;
+    }
+    Cursor in{raw.data(), raw.data() + raw.size()};
+    while(in.ok && in.p < in.end) {
+        int64_t  time_ns        = in.get<int64_t>();
+        uint32_t elapse         = in.get<uint32_t>();
+        uint32_t thread_id      = in.get<uint32_t>();
+        uint32_t coroutine_id   = in.get<uint32_t>();
+        uint32_t site_id        = in.get<uint32_t>();
+        uint32_t logger_id      = in.get<uint32_t>();
+        std::string_view content = in.get_string();
+        uint32_t field_count    = in.get<uint32_t>();
+        if(!in.ok || site_id == 0 || site_id > m_sites.size() || !m_sites[site_id - 1] ||
+           logger_id == 0 || logger_id > m_loggers.size() || !m_loggers[logger_id - 1]) {
+            return false;
+        }
+        const LogSite& site = *m_sites[site_id - 1];
+        bool wanted = time_ns >= filter.from_ns && time_ns < filter.to_ns && site.level >= filter.min_level &&
+                      filter.logger_ok[logger_id];
+        LogEvent::ptr event;
+        if(wanted) {
+            event = LogEvent::create(site, thread_id, coroutine_id, elapse,
+                std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                    std::chrono::nanoseconds(time_ns))),
+                *m_loggers[logger_id - 1]);
+            event->set_content(content);
+        }
+        for(uint32_t i = 0; i < field_count && in.ok; ++i) {
+            LogField::Type type = static_cast<LogField::Type>(in.get<uint8_t>());
+            std::string_view key = in.get_string();
+            switch(type) {
+                case LogField::Type::INT: {
+                    int64_t v = in.get<int64_t>();
+                    if(event) event->add_field(key, v);
+                    break;
+                }
+                case LogField::Type::UINT: {
+                    uint64_t v = in.get<uint64_t>();
+                    if(event) event->add_field(key, v);
+                    break;
+                }
+                case LogField::Type::DOUBLE: {
+                    double v = in.get<double>();
+                    if(event) event->add_field(key, v);
+                    break;
+                }
+                case LogField::Type::BOOL: {
+                    bool v = in.get<uint8_t>() != 0;
+                    if(event) event->add_field(key, v);
+                    break;
+                }
+                case LogField::Type::STRING: {
+                    std::string_view v = in.get_string();
+                    if(event) event->add_field(key, v);
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        if(event && in.ok) {
+            events.push_back(std::move(event));
+        }
+    }
+    return in.ok;
+}
+
+bool SegmentReader::read_block(size_t block, const SegmentQuery& query, std::vector<LogEvent::ptr>& events) const {
+    std::string raw;
+    return block < m_blocks.size() && decode(*m_blocks[block], make_filter(query), raw, events);
+}
+
+bool SegmentReader::read(const SegmentQuery& query, std::vector<LogEvent::ptr>& events) const {
+    Filter filter = make_filter(query);
+    std::string raw;
+    bool ok = true;
+    for(const SegmentBlockIndex* index : m_blocks) {
+        if(matches(*index, filter)) {
+            ok = decode(*index, filter, raw, events) && ok;
+        }
+    }
+    return ok;
+}
+
+bool SegmentReader::render(const SegmentQuery& query, const LogFormatter& formatter, unsigned threads,
+                           std::ostream& out) const {
+    Filter filter = make_filter(query);
+    std::vector<size_t> selected = select(query);
+    bool ok = true;
+    if(threads <= 1 || selected.size() <= 1) {
+        std::string raw;
+        std::string text;
+        std::vector<LogEvent::ptr> events;
+        for(size_t block : selected) {
+            ok = decode(*m_blocks[block], filter, raw, events) && ok;
+            for(const LogEvent::ptr& event : events) {
+                formatter.format(text, *event);
+            }
+            events.clear();
+            out.write(text.data(), text.size());
+            text.clear();
+        }
+        return ok;
+    }
+
+    // Workers take blocks in file order and leave the text in its slot; this
+    // thread writes the slots out in order.
+    struct Slot {
+        std::string text;
+        bool        done = false;
+        bool        ok = true;
+    };
+    std::vector<Slot> slots(selected.size());
+    std::mutex mutex;
+    std::condition_variable cond;
+    size_t next = 0;            // next slot to decode
+    size_t written = 0;         // slots written to out
+    // decoded text waiting for its turn stays within a few blocks per thread
+    const size_t window = threads * 2;
+
+    auto work = [&]() {
+        std::string raw;
+        std::vector<LogEvent::ptr> events;
+        std::unique_lock<std::mutex> lock(mutex);
+        for(;;) {
+            cond.wait(lock, [&]() { return next >= slots.size() || next < written + window; });
+            if(next >= slots.size()) {
+                break;
+            }
+            size_t i = next++;
+            lock.unlock();
+            std::string text;
+            bool block_ok = decode(*m_blocks[selected[i]], filter, raw, events);
+            for(const LogEvent::ptr& event : events) {
+                formatter.format(text, *event);
+            }
+            // events go back to this thread's pool
+            events.clear();
+            lock.lock();
+            slots[i].text = std::move(text);
+            slots[i].ok = block_ok;
+            slots[i].done = true;
+            cond.notify_all();
+        }
+    };
+    std::vector<std::thread> workers;
+    for(size_t t = 0; t < std::min<size_t>(threads, slots.size()); ++t) {
+        workers.emplace_back(work);
+    }
+    for(size_t i = 0; i < slots.size(); ++i) {
+        std::string text;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [&]() { return slots[i].done; });
+            text.swap(slots[i].text);
+            ok = slots[i].ok && ok;
+            ++written;
+            cond.notify_all();
+        }
+        out.write(text.data(), text.size());
+    }
+    for(auto& worker : workers) {
+        worker.join();
+    }
+    return ok;
+}
+
+} // namespace gfc
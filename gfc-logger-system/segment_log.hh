@@ -0,0 +1,188 @@
+#pragma once
+
+#include "logger.hh"
+
+#include <condition_variable>
+#include <deque>
+#include <ostream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace gfc {
+
+// Index entry of one block of a segment file. Each block is preceded by a
+// copy of its entry, and a complete segment ends with all of them, so a
+// reader finds the blocks for a time range, level or logger without
+// touching the others.
+struct SegmentBlockIndex {
+    enum Kind : uint8_t { DATA = 1, DICT = 2 };
+    enum Codec : uint8_t { NONE = 0, ZLIB = 1 };
+
+    uint64_t    offset;             // of the block header in the file
+    uint32_t    stored_size;        // payload bytes in the file
+    uint32_t    raw_size;           // payload bytes once decompressed
+    int64_t     min_time_ns;
+    int64_t     max_time_ns;
+    uint32_t    event_count;
+    uint8_t     kind;
+    uint8_t     codec;
+    uint8_t     level_mask;         // bit 1 << level for each level present
+    uint8_t     reserved;
+    uint64_t    logger_mask[2];     // bit (logger id % 128) for each logger present
+
+    bool has_logger(uint32_t id) const { return logger_mask[id / 64 % 2] & (1ULL << id % 64); }
+};
+
+/* ------------ SegmentLogAppender ------------ */
+
+// Writes events to a segment file: the events are stored, not formatted,
+// in blocks of about block_size bytes that are compressed (with zlib, when
+// built with it) independently of each other, each with an index entry.
+// gfc-logcat (or SegmentReader) reads a time range back without
+// decompressing the rest of the file and renders it with any LogFormatter
+// pattern.
+//
+// log() encodes the event into the open block under the appender lock. A
+// full block, or one that has been open for the flush interval, is sealed
+// and handed to a background thread that compresses and writes it; logging
+// waits only if four sealed blocks are already queued. A FATAL event seals
+// the block at once. Logger names and call sites go into uncompressed
+// dictionary blocks written before the first block that uses them.
+//
+// The path is truncated. The index is written on close(); a segment cut
+// short by a crash is still readable up to its last complete block.
+class SegmentLogAppender : public LogAppender {
+public:
+    typedef std::shared_ptr<SegmentLogAppender> ptr;
+
+public:
+    SegmentLogAppender(const std::string& path, size_t block_size = 256 * 1024);
+    ~SegmentLogAppender();
+
+    virtual void log(const LogEvent::ptr& event) override;
+    virtual void log_batch(std::span<const LogEvent::ptr> events) override;
+    // Seals the open block and waits until every block is written.
+    virtual void flush() override;
+
+    // Writes the index and closes the file; later events are ignored.
+    void    close();
+    void    set_flush_interval(std::chrono::milliseconds interval);    // default 1 s
+
+    const std::string&  get_path() const { return m_path; }
+    uint64_t            get_block_count() const { return m_blocks.load(std::memory_order_relaxed); }
+
+private:
+    struct SealedBlock {
+        std::string dict;
+        std::string data;
+        SegmentBlockIndex index;
+    };
+
+    // m_mutex held for these
+    void    encode(const LogEvent& event);
+    void    seal_block();
+    void    wait_for_room(std::unique_lock<std::mutex>& lock);
+
+    void    run();
+    // writer thread only
+    void    write_block(SealedBlock& block);
+    void    write_entry(SegmentBlockIndex index, const std::string& raw);
+    bool    write_all(const char* data, size_t len);
+    void    write_index();
+
+private:
+    std::string     m_path;
+    size_t          m_block_size;
+    int             m_fd = -1;
+
+    // guarded by m_mutex
+    std::string     m_dict;                 // dictionary entries the open block needs
+    std::string     m_data;                 // the open block's events
+    SegmentBlockIndex m_index;              // and its index entry so far
+    std::chrono::steady_clock::time_point m_opened_at;  // when its first event came in
+    std::unordered_map<const LogSite*, uint32_t>        m_site_ids;
+    std::unordered_map<const std::string*, uint32_t>    m_logger_ids;
+    std::deque<SealedBlock> m_sealed;       // waiting for the writer
+    std::vector<std::string> m_spare;       // buffers of written blocks, for reuse
+    uint64_t        m_sealed_count = 0;
+    uint64_t        m_written_count = 0;
+    bool            m_stop = false;
+    std::chrono::milliseconds m_flush_interval{1000};
+    std::condition_variable m_cond;         // wakes the writer
+    std::condition_variable m_written_cond; // wakes flush() and full queues
+
+    // writer thread only
+    uint64_t        m_offset = 0;
+    std::vector<SegmentBlockIndex> m_entries;
+    std::string     m_compressed;
+
+    std::atomic<uint64_t> m_blocks{0};      // data blocks written
+    std::thread     m_thread;
+};
+
+/* ------------ SegmentReader ------------ */
+
+// What to read from a segment: events in [from_ns, to_ns), at min_level or
+// above, of the given loggers and their children (all loggers if empty).
+struct SegmentQuery {
+    int64_t                     from_ns = INT64_MIN;
+    int64_t                     to_ns = INT64_MAX;
+    LogLevel                    min_level = LogLevel::DEBUG;
+    std::vector<std::string>    loggers;
+};
+
+// Maps a segment file and reads it back as LogEvents. The index is used in
+// place from the mapping; for a segment without one (still being written,
+// or cut short) it is rebuilt from the block headers. Decoding is const and
+// may run on several threads at once.
+class SegmentReader {
+public:
+    SegmentReader() = default;
+    ~SegmentReader();
+    SegmentReader(const SegmentReader&) = delete;
+    SegmentReader& operator=(const SegmentReader&) = delete;
+
+    bool    open(const std::string& path);
+    // index entries of the data blocks
+    const std::vector<const SegmentBlockIndex*>& get_blocks() const { return m_blocks; }
+    bool    has_index() const   { return m_has_index; }
+    bool    is_corrupt() const  { return m_corrupt; }
+    // Ends in part of a block, as a segment still being written or cut
+    // short by a crash does; the blocks before it are read as usual.
+    bool    is_truncated() const { return m_truncated; }
+
+    // The data blocks (positions in get_blocks()) whose index entry matches query.
+    std::vector<size_t> select(const SegmentQuery& query) const;
+    // Decompresses one data block and appends the events in it that match
+    // query; returns false if the block is corrupt.
+    bool    read_block(size_t block, const SegmentQuery& query, std::vector<LogEvent::ptr>& events) const;
+    // All matching events, in file order.
+    bool    read(const SegmentQuery& query, std::vector<LogEvent::ptr>& events) const;
+    // Formats the matching events and writes them to out in file order,
+    // decoding and formatting blocks on up to threads threads.
+    bool    render(const SegmentQuery& query, const LogFormatter& formatter, unsigned threads,
+                   std::ostream& out) const;
+
+private:
+    struct Filter;
+    Filter  make_filter(const SegmentQuery& query) const;
+    bool    matches(const SegmentBlockIndex& index, const Filter& filter) const;
+    bool    decode(const SegmentBlockIndex& index, const Filter& filter, std::string& raw,
+                   std::vector<LogEvent::ptr>& events) const;
+    bool    load_dict(const SegmentBlockIndex& index);
+    bool    inflate(const SegmentBlockIndex& index, std::string& raw) const;
+
+private:
+    const char*     m_map = nullptr;
+    size_t          m_size = 0;
+    bool            m_has_index = false;
+    bool            m_corrupt = false;
+    bool            m_truncated = false;
+    std::vector<SegmentBlockIndex>          m_scanned;      // index rebuilt from block headers
+    std::vector<const SegmentBlockIndex*>   m_blocks;       // data blocks
+    std::vector<const LogSite*>             m_sites;        // index = site id - 1, interned
+    std::vector<const std::string*>         m_loggers;      // index = logger id - 1, interned
+};
+
+} // namespace gfc
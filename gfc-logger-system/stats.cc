@@ -0,0 +1,144 @@
+#include "stats.hh"
+#include "logger.hh"
+
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+
+namespace gfc {
+
+uint64_t LatencyHistogram::Snapshot::percentile_ns(double p) const {
+    if(count == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * count + 0.5);
+    rank = rank < 1 ? 1 : (rank > count ? count : rank);
+    uint64_t seen = 0;
+    for(size_t i = 0; i < kBuckets; ++i) {
+        seen += buckets[i];
+        if(seen >= rank) {
+            return (uint64_t(1) << (i + 1)) - 1;
+        }
+    }
+    return UINT64_MAX;
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const {
+    Snapshot snap;
+    for(const Shard& shard : m_shards) {
+        snap.count += shard.count.load(std::memory_order_relaxed);
+        snap.sum_ns += shard.sum_ns.load(std::memory_order_relaxed);
+        for(size_t i = 0; i < kBuckets; ++i) {
+            snap.buckets[i] += shard.buckets[i].load(std::memory_order_relaxed);
+        }
+    }
+    return snap;
+}
+
+namespace {
+
+void dump_levels(std::ostream& os, const char* name, const uint64_t (&counts)[6]) {
+    os << ' ' << name << '=';
+    for(size_t i = 1; i < 6; ++i) {
+        os << (i > 1 ? "/" : "") << counts[i];
+    }
+}
+
+void dump_latency(std::ostream& os, const char* name, const LatencyHistogram::Snapshot& snap) {
+    if(snap.count == 0) {
+        return;
+    }
+    os << ' ' << name << "_mean=" << static_cast<uint64_t>(snap.mean_ns()) << "ns"
+       << ' ' << name << "_p50<" << snap.percentile_ns(50) << "ns"
+       << ' ' << name << "_p99<" << snap.percentile_ns(99) << "ns";
+}
+
+// Background thread behind set_stats_dump(), started on first use.
+class StatsDumper {
+public:
+    static StatsDumper& get_instance() {
+        // leaked, like the other background threads
+        static StatsDumper* instance = new StatsDumper();
+        return *instance;
+    }
+
+    void set(const Logger::ptr& logger, std::chrono::milliseconds interval) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_logger = interval.count() > 0 ? logger : nullptr;
+        m_interval = interval;
+        if(m_logger && !m_started) {
+            m_started = true;
+            std::thread(&StatsDumper::run, this).detach();
+        }
+        m_cond.notify_one();
+    }
+
+private:
+    void run() {
+        static const LogSite& site = intern_log_site(__FILE__, __LINE__, __func__, LogLevel::INFO);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for(;;) {
+            if(!m_logger) {
+                m_cond.wait(lock);
+                continue;
+            }
+            if(m_cond.wait_for(lock, m_interval) == std::cv_status::timeout && m_logger) {
+                Logger::ptr logger = m_logger;
+                lock.unlock();
+                auto event = LogEvent::create(site, logger->get_name());
+                event->set_content(dump_stats());
+                logger->log(LogLevel::INFO, event);
+                lock.lock();
+            }
+        }
+    }
+
+private:
+    std::mutex                  m_mutex;
+    std::condition_variable     m_cond;
+    Logger::ptr                 m_logger;
+    std::chrono::milliseconds   m_interval{0};
+    bool                        m_started = false;
+};
+
+} // namespace
+
+std::string dump_stats() {
+    std::ostringstream os;
+    os << "logging stats (levels debug/info/warn/error/fatal)";
+    std::unordered_set<const LogFormatter*> formatters;
+    for(const Logger::ptr& logger : LoggerManager::get_instance().get_loggers()) {
+        LoggerStats stats = logger->get_stats();
+        os << "\nlogger " << logger->get_name();
+        dump_levels(os, "emitted", stats.emitted);
+        dump_levels(os, "filtered", stats.filtered);
+
+        std::vector<LogAppender::ptr> appenders = logger->get_appenders();
+        for(size_t i = 0; i < appenders.size(); ++i) {
+            AppenderStats app = appenders[i]->get_stats();
+            os << "\n  appender " << i << " events=" << app.events << " bytes=" << app.bytes
+               << " writes=" << app.writes << " flushes=" << app.flushes;
+            if(app.dropped || app.queue_depth) {
+                os << " dropped=" << app.dropped << " queue_depth=" << app.queue_depth;
+            }
+            dump_latency(os, "write", app.write_time);
+
+            LogFormatter::ptr formatter = appenders[i]->get_formatter();
+            if(formatter && formatters.insert(formatter.get()).second) {
+                FormatterStats fmt = formatter->get_stats();
+                os << "\n  formatter \"" << formatter->get_pattern() << "\" events=" << fmt.events
+                   << " bytes=" << fmt.bytes;
+                dump_latency(os, "format", fmt.format_time);
+            }
+        }
+    }
+    return os.str();
+}
+
+void set_stats_dump(const std::shared_ptr<Logger>& logger, std::chrono::milliseconds interval) {
+    StatsDumper::get_instance().set(logger, interval);
+}
+
+} // namespace gfc
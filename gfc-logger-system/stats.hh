@@ -0,0 +1,146 @@
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace gfc {
+
+// Self-metrics of the logging pipeline. Loggers, formatters and appenders
+// keep their counters in ShardedCounters and LatencyHistograms: every shard
+// sits on its own cache lines and a thread always updates the same shard,
+// so the hot path does a relaxed add on a line no other thread is likely to
+// write. Reading sums the shards.
+//
+// Counting is always on. Timing (format time, sink write latency) costs two
+// clock reads per measurement and is off until set_stats_timing(true).
+
+static constexpr size_t kStatShards = 8;
+
+// Shard of the calling thread; threads are spread round-robin.
+inline size_t stat_shard() {
+    static std::atomic<size_t> next{0};
+    thread_local size_t shard = next.fetch_add(1, std::memory_order_relaxed) % kStatShards;
+    return shard;
+}
+
+inline std::atomic<bool>& stats_timing_flag() {
+    static std::atomic<bool> enabled{false};
+    return enabled;
+}
+inline bool stats_timing() { return stats_timing_flag().load(std::memory_order_relaxed); }
+inline void set_stats_timing(bool enabled) { stats_timing_flag().store(enabled, std::memory_order_relaxed); }
+
+inline int64_t stats_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* ------------ ShardedCounters ------------ */
+
+// N counters, one set per shard.
+template<size_t N>
+class ShardedCounters {
+public:
+    void add(size_t index, uint64_t n = 1) {
+        m_shards[stat_shard()].values[index].fetch_add(n, std::memory_order_relaxed);
+    }
+    uint64_t get(size_t index) const {
+        uint64_t sum = 0;
+        for(const Shard& shard : m_shards) {
+            sum += shard.values[index].load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+    std::array<uint64_t, N> snapshot() const {
+        std::array<uint64_t, N> sums{};
+        for(const Shard& shard : m_shards) {
+            for(size_t i = 0; i < N; ++i) {
+                sums[i] += shard.values[i].load(std::memory_order_relaxed);
+            }
+        }
+        return sums;
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> values[N] = {};
+    };
+    Shard m_shards[kStatShards];
+};
+
+/* ------------ LatencyHistogram ------------ */
+
+// Durations in power-of-two nanosecond buckets: bucket i holds [2^i, 2^(i+1)),
+// bucket 0 also 0, and the last one everything from about 2 seconds up.
+class LatencyHistogram {
+public:
+    static constexpr size_t kBuckets = 32;
+
+    struct Snapshot {
+        uint64_t    count = 0;
+        uint64_t    sum_ns = 0;
+        uint64_t    buckets[kBuckets] = {};
+
+        double      mean_ns() const { return count ? static_cast<double>(sum_ns) / count : 0; }
+        // upper bound of the bucket holding the p-th percentile (0 < p <= 100)
+        uint64_t    percentile_ns(double p) const;
+    };
+
+    void record(int64_t ns) {
+        uint64_t value = ns > 0 ? static_cast<uint64_t>(ns) : 0;
+        size_t bucket = value ? 63 - __builtin_clzll(value) : 0;
+        Shard& shard = m_shards[stat_shard()];
+        shard.count.fetch_add(1, std::memory_order_relaxed);
+        shard.sum_ns.fetch_add(value, std::memory_order_relaxed);
+        shard.buckets[bucket < kBuckets ? bucket : kBuckets - 1].fetch_add(1, std::memory_order_relaxed);
+    }
+    Snapshot snapshot() const;
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sum_ns{0};
+        std::atomic<uint64_t> buckets[kBuckets] = {};
+    };
+    Shard m_shards[kStatShards];
+};
+
+/* ------------ snapshots ------------ */
+
+// Indexed by LogLevel (UNKNOW .. FATAL).
+struct LoggerStats {
+    uint64_t    emitted[6] = {};    // passed the logger's level and went to the appenders
+    uint64_t    filtered[6] = {};   // reached Logger::log() below the level, or dropped as duplicates
+};
+
+struct FormatterStats {
+    uint64_t    events = 0;
+    uint64_t    bytes = 0;
+    LatencyHistogram::Snapshot format_time;     // empty unless timing is on
+};
+
+struct AppenderStats {
+    uint64_t    events = 0;         // handed to the appender
+    uint64_t    bytes = 0;          // written to the sink
+    uint64_t    writes = 0;         // write calls to the sink
+    uint64_t    flushes = 0;        // flush() calls
+    uint64_t    dropped = 0;        // buffered appenders: events given up on
+    uint64_t    queue_depth = 0;    // buffered appenders: events waiting right now
+    LatencyHistogram::Snapshot write_time;      // per sink write, empty unless timing is on
+};
+
+class Logger;
+
+// Stats of every logger known to LoggerManager, with their appenders and
+// formatters, one object per line.
+std::string dump_stats();
+// Logs dump_stats() to logger at INFO every interval from a background
+// thread; an interval of 0 stops it.
+void set_stats_dump(const std::shared_ptr<Logger>& logger, std::chrono::milliseconds interval);
+
+} // namespace gfc
@@ -0,0 +1,6 @@
+// Must not compile: two {} fields but one argument.
+#include "../../gfc-logger-system/logger.hh"
+
+void f(const gfc::Logger::ptr& logger) {
+    GFC_LOG_INFOF(logger, "user={} latency={}us", 42);
+}
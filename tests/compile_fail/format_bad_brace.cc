@@ -0,0 +1,6 @@
+// Must not compile: format specs are not supported and a lone '}' is invalid.
+#include "../../gfc-logger-system/logger.hh"
+
+void f(const gfc::Logger::ptr& logger) {
+    GFC_LOG_INFOF(logger, "value={:x} }", 42);
+}
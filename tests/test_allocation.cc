@@ -0,0 +1,141 @@
+#include "../gfc-logger-system/logger.hh"
+#include "test_util.hh"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include <vector>
+
+// Counts heap allocations made by the current thread while enabled.
+static thread_local bool    t_counting = false;
+static thread_local size_t  t_allocations = 0;
+
+void* operator new(size_t size) {
+    if(t_counting) {
+        ++t_allocations;
+    }
+    if(void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+class AllocationCounter {
+public:
+    AllocationCounter()  { t_allocations = 0; t_counting = true; }
+    ~AllocationCounter() { t_counting = false; }
+    size_t count() const { return t_allocations; }
+};
+
+// Formats into a reused buffer and discards the result.
+class NullAppender : public gfc::LogAppender {
+public:
+    void log(const gfc::LogEvent::ptr& event) override {
+        m_buf.clear();
+        m_formatter->format(m_buf, *event);
+        m_bytes += m_buf.size();
+    }
+    std::string m_buf;
+    size_t      m_bytes = 0;
+};
+
+static void log_event(const gfc::Logger::ptr& logger, int i) {
+    auto event = gfc::LogEvent::create(gfc::LogLevel::INFO, __FILE__, __LINE__, 0, 0, 0,
+                                       std::chrono::system_clock::now(), logger->get_name());
+    event->set_content(i % 2 ? "a message that does not fit in the small string buffer"
+                             : "short");
+    logger->log(event->get_level(), event);
+}
+
+static void test_pooled_events_do_not_allocate() {
+    auto logger = std::make_shared<gfc::Logger>("alloc");
+    auto appender = std::make_shared<NullAppender>();
+    logger->add_appender(appender);
+    for(int i = 0; i < 100; ++i) {
+        log_event(logger, i);
+    }
+
+    AllocationCounter counter;
+    for(int i = 0; i < 10000; ++i) {
+        log_event(logger, i);
+    }
+    CHECK(counter.count() == 0);
+    CHECK(appender->m_bytes > 0);
+}
+
+static void test_log_statement_does_not_allocate() {
+    auto logger = std::make_shared<gfc::Logger>("alloc");
+    logger->set_formatter(std::make_shared<gfc::LogFormatter>("%d{%H:%M:%S.%ms} [%p] [%c] [%t] [%f:%l] %m%n"));
+    auto appender = std::make_shared<NullAppender>();
+    logger->add_appender(appender);
+    std::string name = "a std::string value";
+    auto run = [&](int i) {
+        GFC_LOG_INFO(logger) << "request " << i << " took " << i * 0.25 << "ms for user " << name
+                             << " at " << static_cast<const void*>(&name) << ' ' << (i % 2 == 0);
+        GFC_LOG_DEBUG(logger) << "short";
+    };
+    for(int i = 0; i < 100; ++i) {
+        run(i);
+    }
+
+    AllocationCounter counter;
+    for(int i = 0; i < 10000; ++i) {
+        run(i);
+    }
+    CHECK(counter.count() == 0);
+}
+
+static void test_events_released_on_another_thread_are_recycled() {
+    auto logger = std::make_shared<gfc::Logger>("alloc");
+    std::vector<gfc::LogEvent::ptr> batch;
+    batch.reserve(64);
+    auto fill = [&]() {
+        for(int i = 0; i < 64; ++i) {
+            batch.push_back(gfc::LogEvent::create(gfc::LogLevel::INFO, __FILE__, __LINE__, 0, 0, 0,
+                                                  std::chrono::system_clock::now(), logger->get_name()));
+        }
+    };
+    auto release_elsewhere = [&]() {
+        std::thread([&]() { batch.clear(); }).join();
+    };
+    fill();
+    release_elsewhere();
+
+    for(int round = 0; round < 10; ++round) {
+        size_t allocations;
+        {
+            AllocationCounter counter;
+            fill();
+            allocations = counter.count();
+        }
+        CHECK(allocations == 0);
+        release_elsewhere();
+    }
+}
+
+static void test_interned_names() {
+    auto a = std::make_shared<gfc::Logger>("same.name");
+    auto b = std::make_shared<gfc::Logger>("same.name");
+    CHECK(&a->get_name() == &b->get_name());
+    auto event = std::make_shared<gfc::LogEvent>(gfc::LogLevel::INFO, "f", 1, 0, 0, 0, time(nullptr), "same.name", "x");
+    CHECK(&event->get_logger_name() == &a->get_name());
+}
+
+static void test_counter_sees_allocations() {
+    AllocationCounter counter;
+    std::string s(100, 'x');
+    CHECK(counter.count() == 1);
+}
+
+int main() {
+    test_counter_sees_allocations();
+    test_pooled_events_do_not_allocate();
+    test_log_statement_does_not_allocate();
+    test_events_released_on_another_thread_are_recycled();
+    test_interned_names();
+    std::cout << "test_allocation passed" << std::endl;
+    return 0;
+}
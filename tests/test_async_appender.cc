@@ -0,0 +1,330 @@
+#include "../gfc-logger-system/async_appender.hh"
+#include "test_util.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Records what it receives; only ever called from the async writer thread.
+class CountingAppender : public gfc::LogAppender {
+public:
+    typedef std::shared_ptr<CountingAppender> ptr;
+    explicit CountingAppender(std::chrono::microseconds delay = std::chrono::microseconds(0)) : m_delay(delay) {}
+    void log(const gfc::LogEvent::ptr& event) override {
+        if(m_delay.count() > 0) {
+            std::this_thread::sleep_for(m_delay);
+        }
+        m_lines.push_back(m_formatter->format(event));
+        m_logged.fetch_add(1, std::memory_order_release);
+    }
+    void flush() override {
+        m_flushes.fetch_add(1, std::memory_order_release);
+    }
+    std::vector<std::string>    m_lines;
+    std::atomic<size_t>         m_logged{0};
+    std::atomic<size_t>         m_flushes{0};
+private:
+    std::chrono::microseconds   m_delay;
+};
+
+// Holds the writer thread inside log() until opened, to make the queue overflow.
+class GatedAppender : public CountingAppender {
+public:
+    void log(const gfc::LogEvent::ptr& event) override {
+        while(!m_open.load(std::memory_order_acquire)) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        CountingAppender::log(event);
+    }
+    std::atomic<bool> m_open{false};
+};
+
+// Records the size of every batch it is handed.
+class BatchAppender : public CountingAppender {
+public:
+    void log_batch(std::span<const gfc::LogEvent::ptr> events) override {
+        m_batches.push_back(events.size());
+        CountingAppender::log_batch(events);
+    }
+    std::vector<size_t> m_batches;
+};
+
+static std::shared_ptr<gfc::Logger> make_logger(gfc::LogAppender::ptr appender) {
+    auto logger = std::make_shared<gfc::Logger>("overflow");
+    logger->set_formatter(std::make_shared<gfc::LogFormatter>("%m"));
+    logger->add_appender(appender);
+    return logger;
+}
+
+static void test_multi_producer_flush() {
+    auto sink = std::make_shared<CountingAppender>();
+    auto async = std::make_shared<gfc::AsyncLogAppender>(sink, 64);
+    auto logger = std::make_shared<gfc::Logger>("async");
+    logger->set_formatter(std::make_shared<gfc::LogFormatter>("%m"));
+    logger->add_appender(async);
+
+    const int kThreads = 4, kPerThread = 2000;
+    std::vector<std::thread> threads;
+    for(int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            for(int i = 0; i < kPerThread; ++i) {
+                GFC_LOG_INFO(logger) << t << ":" << i;
+            }
+        });
+    }
+    for(auto& th : threads) {
+        th.join();
+    }
+    async->flush();
+    CHECK(sink->m_logged.load() == kThreads * kPerThread);
+    CHECK(sink->m_flushes.load() >= 1);
+
+    // per-producer order is preserved
+    std::vector<int> next(kThreads, 0);
+    for(auto& line : sink->m_lines) {
+        int t = std::stoi(line.substr(0, line.find(':')));
+        int i = std::stoi(line.substr(line.find(':') + 1));
+        CHECK(next[t] == i);
+        next[t]++;
+    }
+}
+
+static void test_drain_on_shutdown() {
+    auto sink = std::make_shared<CountingAppender>(std::chrono::microseconds(50));
+    {
+        auto async = std::make_shared<gfc::AsyncLogAppender>(sink, 1024);
+        auto logger = std::make_shared<gfc::Logger>("drain");
+        logger->add_appender(async);
+        for(int i = 0; i < 500; ++i) {
+            GFC_LOG_WARN(logger) << "slow sink " << i;
+        }
+        // the slow sink cannot have kept up; the rest must still be queued
+        CHECK(sink->m_logged.load() < 500);
+    }
+    CHECK(sink->m_logged.load() == 500);
+}
+
+static void test_batches() {
+    auto sink = std::make_shared<BatchAppender>();
+    auto async = std::make_shared<gfc::AsyncLogAppender>(sink, 1024);
+    auto logger = make_logger(async);
+    for(int i = 0; i < 1000; ++i) {
+        GFC_LOG_INFO(logger) << i;
+    }
+    async->flush();
+    CHECK(sink->m_logged.load() == 1000);
+    size_t total = 0, largest = 0;
+    for(size_t n : sink->m_batches) {
+        total += n;
+        largest = std::max(largest, n);
+    }
+    CHECK(total == 1000);
+    CHECK(largest <= 256);
+    // whatever the scheduling, lines come out in order
+    for(int i = 0; i < 1000; ++i) {
+        CHECK(sink->m_lines[i] == std::to_string(i));
+    }
+}
+
+static void test_per_appender_levels() {
+    auto local = std::make_shared<CountingAppender>();
+    // slow sink on its own worker, only interested in WARN and up
+    auto slow = std::make_shared<CountingAppender>(std::chrono::milliseconds(20));
+    auto remote = std::make_shared<gfc::AsyncLogAppender>(slow, 1024);
+    remote->set_level(gfc::LogLevel::WARN);
+    auto logger = make_logger(local);
+    logger->add_appender(remote);
+
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < 50; ++i) {
+        GFC_LOG_DEBUG(logger) << "debug " << i;
+        if(i % 10 == 0) {
+            GFC_LOG_WARN(logger) << "warn " << i;
+        }
+    }
+    // the local sink did not wait for the 5 * 20ms the slow one needs
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(100));
+    CHECK(local->m_logged.load() == 55);
+
+    remote->flush();
+    CHECK(slow->m_logged.load() == 5);
+    CHECK(slow->get_level() == gfc::LogLevel::WARN);
+    CHECK(slow->m_lines[0] == "warn 0");
+    CHECK(slow->m_lines[4] == "warn 40");
+}
+
+static void test_drop_newest() {
+    auto sink = std::make_shared<GatedAppender>();
+    auto async = std::make_shared<gfc::AsyncLogAppender>(sink, 8, gfc::OverflowPolicy::DROP_NEWEST);
+    auto logger = make_logger(async);
+    for(int i = 0; i < 100; ++i) {
+        GFC_LOG_INFO(logger) << i;
+    }
+    CHECK(async->get_dropped_count() > 0);
+    sink->m_open = true;
+    async->flush();
+    CHECK(sink->m_logged.load() + async->get_dropped_count() == 100);
+}
+
+static void test_block_timeout() {
+    auto sink = std::make_shared<GatedAppender>();
+    auto async = std::make_shared<gfc::AsyncLogAppender>(sink, 4, gfc::OverflowPolicy::BLOCK);
+    async->set_block_timeout(std::chrono::milliseconds(5));
+    auto logger = make_logger(async);
+    for(int i = 0; i < 20; ++i) {
+        GFC_LOG_INFO(logger) << i;
+    }
+    CHECK(async->get_dropped_count() > 0);
+    sink->m_open = true;
+    async->flush();
+    CHECK(sink->m_logged.load() + async->get_dropped_count() == 20);
+}
+
+static void test_drop_below_level() {
+    auto sink = std::make_shared<GatedAppender>();
+    auto async = std::make_shared<gfc::AsyncLogAppender>(sink, 8, gfc::OverflowPolicy::DROP_BELOW_LEVEL);
+    async->set_drop_level(gfc::LogLevel::FATAL);    // ERROR must still be kept
+    auto logger = make_logger(async);
+    for(int i = 0; i < 100; ++i) {
+        GFC_LOG_DEBUG(logger) << "debug";
+    }
+    CHECK(async->get_dropped_count() > 0);
+    std::thread opener([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        sink->m_open = true;
+    });
+    for(int i = 0; i < 50; ++i) {
+        GFC_LOG_ERROR(logger) << "error";
+    }
+    opener.join();
+    async->flush();
+    size_t errors = 0;
+    for(auto& line : sink->m_lines) {
+        errors += line == "error";
+    }
+    CHECK(errors == 50);
+    CHECK(sink->m_logged.load() + async->get_dropped_count() == 150);
+}
+
+static void test_spill_to_disk() {
+    auto sink = std::make_shared<GatedAppender>();
+    auto async = std::make_shared<gfc::AsyncLogAppender>(sink, 8, gfc::OverflowPolicy::SPILL);
+    auto logger = make_logger(async);
+    const int kEvents = 1000;
+    for(int i = 0; i < kEvents; ++i) {
+        GFC_LOG_INFO(logger) << i;
+    }
+    CHECK(async->get_spilled_count() > 0);
+    sink->m_open = true;
+    async->flush();
+    CHECK(async->get_dropped_count() == 0);
+    CHECK(async->get_replayed_count() == async->get_spilled_count());
+    CHECK(sink->m_lines.size() == static_cast<size_t>(kEvents));
+    for(int i = 0; i < kEvents; ++i) {
+        CHECK(sink->m_lines[i] == std::to_string(i));
+    }
+}
+
+// kv() fields travel through the spill file with the event
+static void test_spill_keeps_fields() {
+    auto sink = std::make_shared<GatedAppender>();
+    auto async = std::make_shared<gfc::AsyncLogAppender>(sink, 8, gfc::OverflowPolicy::SPILL);
+    auto logger = make_logger(async);
+    async->set_formatter(std::make_shared<gfc::LogFormatter>("%m %K"));
+    const int kEvents = 100;
+    for(int i = 0; i < kEvents; ++i) {
+        GFC_LOG_INFO(logger).kv("i", i).kv("s", std::to_string(i)) << "m";
+    }
+    CHECK(async->get_spilled_count() > 0);
+    sink->m_open = true;
+    async->flush();
+    CHECK(sink->m_lines.size() == static_cast<size_t>(kEvents));
+    for(int i = 0; i < kEvents; ++i) {
+        CHECK(sink->m_lines[i] == "m i=" + std::to_string(i) + " s=" + std::to_string(i));
+    }
+}
+
+// flush() returns once what was spilled before it has been replayed, even
+// while producers keep the spill file busy
+static void test_flush_while_spilling() {
+    auto sink = std::make_shared<CountingAppender>(std::chrono::microseconds(20));
+    auto async = std::make_shared<gfc::AsyncLogAppender>(sink, 8, gfc::OverflowPolicy::SPILL);
+    auto logger = make_logger(async);
+    std::atomic<bool> done{false};
+    std::thread producer([&]() {
+        for(int i = 0; !done.load(std::memory_order_acquire); ++i) {
+            GFC_LOG_INFO(logger) << i;
+        }
+    });
+    while(async->get_spilled_count() < 100) {
+        std::this_thread::yield();
+    }
+    uint64_t spilled = async->get_spilled_count();
+    async->flush();
+    CHECK(async->get_replayed_count() >= spilled);
+    done.store(true, std::memory_order_release);
+    producer.join();
+    async->stop();
+    CHECK(async->get_dropped_count() == 0);
+    CHECK(sink->m_logged.load() == async->get_stats().events);
+}
+
+// Like CountingAppender, but may be called from producers after stop().
+class LockedAppender : public CountingAppender {
+public:
+    void log(const gfc::LogEvent::ptr& event) override {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        CountingAppender::log(event);
+    }
+};
+
+// producers racing stop() fall back to their own thread only after the
+// writer has drained, so nothing is lost or reordered
+static void test_log_during_stop() {
+    auto sink = std::make_shared<LockedAppender>();
+    auto async = std::make_shared<gfc::AsyncLogAppender>(sink, 64);
+    auto logger = make_logger(async);
+    const int kThreads = 4, kPerThread = 2000;
+    std::vector<std::thread> threads;
+    for(int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            for(int i = 0; i < kPerThread; ++i) {
+                GFC_LOG_INFO(logger) << t << ":" << i;
+            }
+        });
+    }
+    while(sink->m_logged.load() < 1000) {
+        std::this_thread::yield();
+    }
+    async->stop();
+    for(auto& th : threads) {
+        th.join();
+    }
+    CHECK(sink->m_lines.size() == kThreads * kPerThread);
+    std::vector<int> next(kThreads, 0);
+    for(auto& line : sink->m_lines) {
+        int t = std::stoi(line.substr(0, line.find(':')));
+        int i = std::stoi(line.substr(line.find(':') + 1));
+        CHECK(next[t] == i);
+        next[t]++;
+    }
+}
+
+int main() {
+    test_multi_producer_flush();
+    test_drain_on_shutdown();
+    test_batches();
+    test_per_appender_levels();
+    test_drop_newest();
+    test_block_timeout();
+    test_drop_below_level();
+    test_spill_to_disk();
+    test_spill_keeps_fields();
+    test_flush_while_spilling();
+    test_log_during_stop();
+    std::cout << "test_async_appender passed" << std::endl;
+    return 0;
+}
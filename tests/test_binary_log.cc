@@ -0,0 +1,189 @@
+#include "../gfc-logger-system/binary_log.hh"
+#include "test_util.hh"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+struct Point {
+    int x;
+    int y;
+};
+
+std::ostream& operator<<(std::ostream& os, const Point& p) {
+    return os << "(" << p.x << "," << p.y << ")";
+}
+
+static std::vector<gfc::LogEvent::ptr> read_all(const std::string& path) {
+    gfc::BinaryLogReader reader;
+    CHECK(reader.open(path));
+    std::vector<gfc::LogEvent::ptr> events;
+    gfc::LogEvent::ptr event;
+    while(reader.next(event)) {
+        events.push_back(event);
+    }
+    CHECK(!reader.is_corrupt());
+    return events;
+}
+
+static void test_round_trip() {
+    std::string path = temp_path("gfc-binlog-test");
+    gfc::BinaryLogger& binlog = gfc::BinaryLogger::get_instance();
+    CHECK(binlog.open(path));
+
+    auto logger = std::make_shared<gfc::Logger>("binary");
+    logger->set_level(gfc::LogLevel::DEBUG);
+    std::string name = "alice";
+    const int line = __LINE__ + 1;
+    GFC_BINLOG_INFO(logger, "user={} id={} ratio={} ok={}", name, 42, 0.25, true);
+    GFC_BINLOG_WARN(logger, "c={} neg={} big={} f={}", 'x', -7L, 18446744073709551615ULL, 1.5f);
+    GFC_BINLOG_ERROR(logger, "{{literal}} p={} null={} point={} sv={}",
+                     Point{1, 2}, static_cast<const void*>(nullptr), Point{3, 4}, std::string_view("view"));
+    GFC_BINLOG_DEBUG(logger, "no arguments");
+    binlog.close();
+
+    std::vector<gfc::LogEvent::ptr> events = read_all(path);
+    CHECK(events.size() == 4);
+    CHECK(events[0]->get_content() == "user=alice id=42 ratio=0.25 ok=1");
+    CHECK(events[0]->get_level() == gfc::LogLevel::INFO);
+    CHECK(events[0]->get_logger_name() == "binary");
+    CHECK(events[0]->get_line_num() == line);
+    CHECK(std::string(events[0]->get_file_name()) == __FILE__);
+    CHECK(std::string(events[0]->get_function_name()) == "test_round_trip");
+    CHECK(events[1]->get_content() == "c=x neg=-7 big=18446744073709551615 f=1.5");
+    CHECK(events[1]->get_level() == gfc::LogLevel::WARN);
+    CHECK(events[2]->get_content() == "{literal} p=(1,2) null=0 point=(3,4) sv=view");
+    CHECK(events[3]->get_content() == "no arguments");
+    CHECK(events[3]->get_level() == gfc::LogLevel::DEBUG);
+
+    // decoded events format like any other
+    gfc::LogFormatter formatter("[%p] [%c] %m");
+    CHECK(formatter.format(events[0]) == "[INFO] [binary] user=alice id=42 ratio=0.25 ok=1");
+    auto now = std::chrono::system_clock::now();
+    CHECK(events[0]->get_time_ns() <= std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count());
+    CHECK(events[0]->get_time_ns() <= events[3]->get_time_ns());
+    unlink(path.c_str());
+}
+
+static void test_level_filter_is_lazy() {
+    std::string path = temp_path("gfc-binlog-test");
+    gfc::BinaryLogger& binlog = gfc::BinaryLogger::get_instance();
+    CHECK(binlog.open(path));
+
+    auto logger = std::make_shared<gfc::Logger>("filtered");
+    logger->set_level(gfc::LogLevel::WARN);
+    int evaluated = 0;
+    auto expensive = [&]() { ++evaluated; return 1; };
+    GFC_BINLOG_INFO(logger, "dropped {}", expensive());
+    GFC_BINLOG_WARN(logger, "kept {}", expensive());
+    binlog.close();
+
+    CHECK(evaluated == 1);
+    std::vector<gfc::LogEvent::ptr> events = read_all(path);
+    CHECK(events.size() == 1);
+    CHECK(events[0]->get_content() == "kept 1");
+    unlink(path.c_str());
+}
+
+// Small per-thread buffers force records to wrap around and producers to
+// wait for the writer; every record must still arrive once and in order.
+static void test_threads_and_wraparound() {
+    std::string path = temp_path("gfc-binlog-test");
+    gfc::BinaryLogger& binlog = gfc::BinaryLogger::get_instance();
+    CHECK(binlog.open(path, 4096));
+
+    auto logger = std::make_shared<gfc::Logger>("worker");
+    logger->set_level(gfc::LogLevel::DEBUG);
+    const int kThreads = 3;
+    const int kEvents = 5000;
+    std::vector<std::thread> threads;
+    for(int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            for(int i = 0; i < kEvents; ++i) {
+                GFC_BINLOG_INFO(logger, "{} {} {}", t, i, std::string(i % 97, 'z'));
+            }
+        });
+    }
+    for(auto& thread : threads) {
+        thread.join();
+    }
+    binlog.flush();
+    GFC_BINLOG_INFO(logger, "after flush");
+    binlog.close();
+    CHECK(binlog.get_dropped_count() == 0);
+
+    std::vector<gfc::LogEvent::ptr> events = read_all(path);
+    CHECK(events.size() == kThreads * kEvents + 1);
+    std::vector<int> next(kThreads, 0);
+    for(size_t n = 0; n + 1 < events.size(); ++n) {
+        const std::string& content = events[n]->get_content();
+        int t = content[0] - '0';
+        CHECK(t >= 0 && t < kThreads);
+        std::string expected = std::to_string(t) + " " + std::to_string(next[t]) + " " +
+                               std::string(next[t] % 97, 'z');
+        CHECK(content == expected);
+        ++next[t];
+    }
+    CHECK(events.back()->get_content() == "after flush");
+    unlink(path.c_str());
+}
+
+static void test_reject_other_files() {
+    std::string path = temp_path("gfc-binlog-test");
+    gfc::BinaryLogReader reader;
+    CHECK(!reader.open(path));
+    unlink(path.c_str());
+}
+
+// a log header followed by one entry with the given tag, length field and body
+static void write_entry(const std::string& path, uint8_t tag, uint32_t len, const std::string& body) {
+    std::string data("GFCBLOG\0", 8);
+    uint32_t fields[2] = {1, 0};
+    data.append(reinterpret_cast<const char*>(fields), sizeof(fields));
+    data.push_back(static_cast<char>(tag));
+    data.append(reinterpret_cast<const char*>(&len), sizeof(len));
+    data += body;
+    std::ofstream(path, std::ios::binary).write(data.data(), data.size());
+}
+
+static void test_reject_corrupt_entries() {
+    std::string path = temp_path("gfc-binlog-test");
+    gfc::LogEvent::ptr event;
+
+    // a length past the end of the file is not allocated
+    write_entry(path, 2, 0xfffffff0u, "");
+    {
+        gfc::BinaryLogReader reader;
+        CHECK(reader.open(path));
+        CHECK(!reader.next(event));
+        CHECK(reader.is_corrupt());
+    }
+
+    // a logger id that skips ahead is not used to size the table
+    uint32_t id = 0x7fffffff;
+    std::string body(reinterpret_cast<const char*>(&id), sizeof(id));
+    uint32_t name_len = 1;
+    body.append(reinterpret_cast<const char*>(&name_len), sizeof(name_len));
+    body += "x";
+    write_entry(path, 2, body.size(), body);
+    {
+        gfc::BinaryLogReader reader;
+        CHECK(reader.open(path));
+        CHECK(!reader.next(event));
+        CHECK(reader.is_corrupt());
+    }
+    unlink(path.c_str());
+}
+
+int main() {
+    test_round_trip();
+    test_level_filter_is_lazy();
+    test_threads_and_wraparound();
+    test_reject_other_files();
+    test_reject_corrupt_entries();
+    std::cout << "test_binary_log passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,106 @@
+// Compiled with INFO and below turned off, as a release build would.
+#define GFC_LOG_ACTIVE_LEVEL 3
+
+#include "../gfc-logger-system/logger.hh"
+#include "test_util.hh"
+
+#include <memory>
+#include <vector>
+
+class CaptureAppender : public gfc::LogAppender {
+public:
+    void log(const gfc::LogEvent::ptr& event) override { m_events.push_back(event); }
+    std::vector<gfc::LogEvent::ptr> m_events;
+};
+
+static int g_evaluated = 0;
+
+static int side_effect() {
+    return ++g_evaluated;
+}
+
+static void test_inactive_levels_compile_out() {
+    auto logger = std::make_shared<gfc::Logger>("site");
+    auto capture = std::make_shared<CaptureAppender>();
+    logger->add_appender(capture);
+    logger->set_level(gfc::LogLevel::DEBUG);
+
+    static_assert(!gfc::is_level_active(gfc::LogLevel::INFO));
+    static_assert(gfc::is_level_active(gfc::LogLevel::WARN));
+    GFC_LOG_DEBUG(logger) << side_effect();
+    GFC_LOG_INFOF(logger, "{}", side_effect());
+    CHECK(g_evaluated == 0);
+    CHECK(capture->m_events.empty());
+
+    GFC_LOG_WARN(logger) << side_effect();
+    CHECK(g_evaluated == 1);
+    CHECK(capture->m_events.size() == 1);
+    CHECK(capture->m_events[0]->get_content() == "1");
+}
+
+static void test_static_site() {
+    auto logger = std::make_shared<gfc::Logger>("site");
+    auto capture = std::make_shared<CaptureAppender>();
+    logger->add_appender(capture);
+
+    const int line = __LINE__ + 2;
+    for(int i = 0; i < 2; ++i) {
+        GFC_LOG_ERROR(logger) << i;
+    }
+    CHECK(capture->m_events.size() == 2);
+    const gfc::LogEvent& event = *capture->m_events[0];
+    CHECK(std::string(event.get_file_name()) == __FILE__);
+    CHECK(event.get_line_num() == line);
+    CHECK(std::string(event.get_function_name()) == "test_static_site");
+    CHECK(event.get_level() == gfc::LogLevel::ERROR);
+    // both events point at the same static call site
+    CHECK(&capture->m_events[0]->get_site() == &capture->m_events[1]->get_site());
+
+    gfc::LogFormatter formatter("%M:%l %m");
+    CHECK(formatter.format(capture->m_events[1]) == "test_static_site:" + std::to_string(line) + " 1");
+}
+
+static void test_dangling_else() {
+    auto logger = std::make_shared<gfc::Logger>("site");
+    auto capture = std::make_shared<CaptureAppender>();
+    logger->add_appender(capture);
+    logger->set_level(gfc::LogLevel::ERROR);
+
+    bool else_taken = false;
+    bool condition = false;
+    if(condition)
+        GFC_LOG_ERROR(logger) << "not logged";
+    else
+        else_taken = true;
+    CHECK(else_taken);
+
+    // a filtered-out statement must not swallow the else either
+    else_taken = false;
+    if(!condition)
+        GFC_LOG_WARN(logger) << "filtered";
+    else
+        else_taken = true;
+    CHECK(!else_taken);
+    CHECK(capture->m_events.empty());
+}
+
+static void test_logger_evaluated_once() {
+    auto logger = std::make_shared<gfc::Logger>("site");
+    auto capture = std::make_shared<CaptureAppender>();
+    logger->add_appender(capture);
+    int lookups = 0;
+    auto get_logger = [&]() { ++lookups; return logger; };
+
+    GFC_LOG_ERROR(get_logger()) << "once";
+    CHECK(lookups == 1);
+    CHECK(capture->m_events.size() == 1);
+}
+
+int main() {
+    test_inactive_levels_compile_out();
+    test_static_site();
+    test_dangling_else();
+    test_logger_evaluated_once();
+    std::cout << "test_call_site passed" << std::endl;
+    return 0;
+}
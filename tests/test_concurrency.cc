@@ -0,0 +1,135 @@
+// Stress tests for concurrent logging and reconfiguration. Build with
+// -DGFC_SANITIZE=thread to run them under ThreadSanitizer.
+
+#include "../gfc-logger-system/logger.hh"
+#include "test_util.hh"
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+class CountingAppender : public gfc::LogAppender {
+public:
+    void log(const gfc::LogEvent::ptr&) override { m_count.fetch_add(1, std::memory_order_relaxed); }
+    std::atomic<size_t> m_count{0};
+};
+
+static const int kThreads = 4;
+static const int kEvents = 20000;
+
+// Appenders come and go and the level flips while other threads log; an
+// appender attached the whole time must see every event, and no thread may
+// touch a freed appender list (ASan/TSan would report it).
+static void test_reconfigure_while_logging() {
+    auto logger = std::make_shared<gfc::Logger>("stress");
+    auto stable = std::make_shared<CountingAppender>();
+    logger->add_appender(stable);
+
+    std::atomic<bool> done{false};
+    std::thread config([&]() {
+        auto churn = std::make_shared<CountingAppender>();
+        auto formatter = std::make_shared<gfc::LogFormatter>("%m");
+        for(int i = 0; !done.load(std::memory_order_relaxed); ++i) {
+            logger->add_appender(churn);
+            churn->set_formatter(formatter);
+            logger->set_level(i % 2 ? gfc::LogLevel::DEBUG : gfc::LogLevel::INFO);
+            logger->set_formatter(formatter);
+            logger->del_appender(churn);
+        }
+    });
+
+    std::vector<std::thread> threads;
+    for(int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&]() {
+            for(int i = 0; i < kEvents; ++i) {
+                GFC_LOG_INFO(logger) << "event " << i;
+            }
+        });
+    }
+    for(auto& thread : threads) {
+        thread.join();
+    }
+    done = true;
+    config.join();
+
+    CHECK(stable->m_count.load() == static_cast<size_t>(kThreads * kEvents));
+    CHECK(logger->get_appenders().size() == 1);
+}
+
+// find_logger() must not insert entries, and lookups must see loggers added
+// concurrently, also when they replace one get_logger() created on demand.
+static void test_manager_lookup() {
+    gfc::LoggerManager& manager = gfc::LoggerManager::get_instance();
+    std::atomic<bool> done{false};
+    std::vector<std::thread> readers;
+    for(int t = 0; t < kThreads; ++t) {
+        readers.emplace_back([&]() {
+            while(!done.load(std::memory_order_relaxed)) {
+                CHECK(manager.find_logger("stress.missing") == nullptr);
+                CHECK(manager.get_root_logger() != nullptr);
+                CHECK(manager.get_logger("stress.0")->get_name() == "stress.0");
+            }
+        });
+    }
+    for(int i = 0; i < 200; ++i) {
+        manager.add_logger("stress." + std::to_string(i), std::make_shared<gfc::Logger>("stress." + std::to_string(i)));
+    }
+    done = true;
+    for(auto& reader : readers) {
+        reader.join();
+    }
+    CHECK(manager.find_logger("stress.199") != nullptr);
+    CHECK(manager.find_logger("stress.199")->get_name() == "stress.199");
+    CHECK(manager.find_logger("stress.199")->get_parent() == manager.find_logger("stress").get());
+    CHECK(manager.find_logger("stress.missing") == nullptr);
+}
+
+// Lines written by several threads to one file must not interleave.
+static void test_file_appender_lines() {
+    char path[] = "/tmp/gfc-concurrency-XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    close(fd);
+
+    auto logger = std::make_shared<gfc::Logger>("file");
+    logger->set_formatter(std::make_shared<gfc::LogFormatter>("%m%n"));
+    auto file = std::make_shared<gfc::FileLogAppender>(path);
+    logger->add_appender(file);
+
+    const int kLines = 5000;
+    const std::string payload(100, 'x');
+    std::vector<std::thread> threads;
+    for(int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            for(int i = 0; i < kLines; ++i) {
+                GFC_LOG_INFO(logger) << t << payload;
+            }
+        });
+    }
+    for(auto& thread : threads) {
+        thread.join();
+    }
+    file->flush();
+
+    std::ifstream in(path);
+    std::string line;
+    int lines = 0;
+    while(std::getline(in, line)) {
+        CHECK(line.size() == payload.size() + 1);
+        CHECK(line.compare(1, std::string::npos, payload) == 0);
+        ++lines;
+    }
+    CHECK(lines == kThreads * kLines);
+    unlink(path);
+}
+
+int main() {
+    test_reconfigure_while_logging();
+    test_manager_lookup();
+    test_file_appender_lines();
+    std::cout << "test_concurrency passed" << std::endl;
+    return 0;
+}
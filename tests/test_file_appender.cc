@@ -0,0 +1,202 @@
+#include "../gfc-logger-system/logger.hh"
+#include "test_util.hh"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+static std::string read_file(const std::string& path) {
+    std::ifstream in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+static gfc::Logger::ptr make_logger(gfc::LogAppender::ptr appender) {
+    auto logger = std::make_shared<gfc::Logger>("file");
+    logger->set_formatter(std::make_shared<gfc::LogFormatter>("%p %m%n"));
+    logger->add_appender(appender);
+    return logger;
+}
+
+static void test_buffered_until_flush() {
+    std::string path = temp_path("gfc-file-appender");
+    auto file = std::make_shared<gfc::FileLogAppender>(path);
+    file->set_flush_interval(std::chrono::milliseconds(60000));
+    auto logger = make_logger(file);
+
+    GFC_LOG_INFO(logger) << "one";
+    GFC_LOG_WARN(logger) << "two";
+    CHECK(read_file(path).empty());
+    CHECK(file->get_write_count() == 0);
+
+    file->flush();
+    CHECK(read_file(path) == "INFO one\nWARN two\n");
+    CHECK(file->get_write_count() == 1);
+    unlink(path.c_str());
+}
+
+static void test_error_writes_through() {
+    std::string path = temp_path("gfc-file-appender");
+    auto file = std::make_shared<gfc::FileLogAppender>(path);
+    file->set_flush_interval(std::chrono::milliseconds(60000));
+    auto logger = make_logger(file);
+
+    GFC_LOG_INFO(logger) << "context";
+    GFC_LOG_ERROR(logger) << "failure";
+    // the error and everything before it are on their way to disk in one write
+    CHECK(read_file(path) == "INFO context\nERROR failure\n");
+    CHECK(file->get_write_count() == 1);
+    unlink(path.c_str());
+}
+
+static void test_size_threshold() {
+    std::string path = temp_path("gfc-file-appender");
+    auto file = std::make_shared<gfc::FileLogAppender>(path, 1024);
+    file->set_flush_interval(std::chrono::milliseconds(60000));
+    auto logger = make_logger(file);
+
+    const std::string payload(94, 'x');     // 100 bytes per line
+    for(int i = 0; i < 25; ++i) {
+        GFC_LOG_INFO(logger) << payload;
+    }
+    // a write whenever 1024 bytes have piled up
+    CHECK(file->get_write_count() == 2);
+    CHECK(read_file(path).size() == 2 * 1100);
+    file->flush();
+    CHECK(read_file(path).size() == 25 * 100);
+    unlink(path.c_str());
+}
+
+static void test_flush_interval() {
+    std::string path = temp_path("gfc-file-appender");
+    auto file = std::make_shared<gfc::FileLogAppender>(path);
+    file->set_flush_interval(std::chrono::milliseconds(20));
+    auto logger = make_logger(file);
+
+    GFC_LOG_INFO(logger) << "eventually";
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while(read_file(path).empty() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    CHECK(read_file(path) == "INFO eventually\n");
+    unlink(path.c_str());
+}
+
+static void test_durability() {
+    std::string path = temp_path("gfc-file-appender");
+    auto file = std::make_shared<gfc::FileLogAppender>(path);
+    file->set_durability(gfc::FileDurability::SYNC_ON_FATAL);
+    auto logger = make_logger(file);
+
+    GFC_LOG_ERROR(logger) << "not synced";
+    CHECK(file->get_sync_count() == 0);
+    GFC_LOG_FATAL(logger) << "synced";
+    CHECK(file->get_sync_count() == 1);
+
+    file->set_durability(gfc::FileDurability::SYNC_INTERVAL, std::chrono::milliseconds(20));
+    GFC_LOG_INFO(logger) << "synced later";
+    file->flush();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while(file->get_sync_count() < 2 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    CHECK(file->get_sync_count() >= 2);
+    unlink(path.c_str());
+}
+
+// reopen() appends, so moving the file away and reopening loses nothing
+static void test_reopen_appends() {
+    std::string path = temp_path("gfc-file-appender");
+    std::string moved = path + ".1";
+    auto file = std::make_shared<gfc::FileLogAppender>(path);
+    auto logger = make_logger(file);
+
+    GFC_LOG_INFO(logger) << "first";
+    file->flush();
+    CHECK(file->reopen());
+    GFC_LOG_INFO(logger) << "second";
+    file->flush();
+    CHECK(read_file(path) == "INFO first\nINFO second\n");
+
+    CHECK(rename(path.c_str(), moved.c_str()) == 0);
+    GFC_LOG_INFO(logger) << "third";
+    CHECK(file->reopen());
+    GFC_LOG_INFO(logger) << "fourth";
+    file->flush();
+    CHECK(read_file(moved) == "INFO first\nINFO second\nINFO third\n");
+    CHECK(read_file(path) == "INFO fourth\n");
+    unlink(path.c_str());
+    unlink(moved.c_str());
+}
+
+static void test_destructor_writes_out() {
+    std::string path = temp_path("gfc-file-appender");
+    {
+        auto file = std::make_shared<gfc::FileLogAppender>(path);
+        file->set_flush_interval(std::chrono::milliseconds(60000));
+        auto logger = make_logger(file);
+        GFC_LOG_INFO(logger) << "last words";
+    }
+    CHECK(read_file(path) == "INFO last words\n");
+    unlink(path.c_str());
+}
+
+static gfc::LogEvent::ptr make_event(gfc::LogLevel level, const std::string& text) {
+    const gfc::LogSite& site = gfc::intern_log_site(__FILE__, __LINE__, __func__, level);
+    auto event = gfc::LogEvent::create(site, 0, 0, 0, std::chrono::system_clock::now(),
+                                       gfc::intern_logger_name("file"));
+    event->set_content(text);
+    return event;
+}
+
+static void test_batch() {
+    std::string path = temp_path("gfc-file-appender");
+    auto file = std::make_shared<gfc::FileLogAppender>(path, 1024);
+    file->set_formatter(std::make_shared<gfc::LogFormatter>("%p %m%n"));
+    file->set_flush_interval(std::chrono::milliseconds(60000));
+
+    // a small batch stays in the buffer like single events do
+    std::vector<gfc::LogEvent::ptr> batch;
+    batch.push_back(make_event(gfc::LogLevel::INFO, "one"));
+    batch.push_back(make_event(gfc::LogLevel::INFO, "two"));
+    file->log_batch(batch);
+    CHECK(file->get_write_count() == 0);
+
+    // one larger than the buffer goes out in a single writev
+    batch.clear();
+    const std::string payload(94, 'x');     // 100 bytes per line
+    for(int i = 0; i < 25; ++i) {
+        batch.push_back(make_event(gfc::LogLevel::INFO, payload));
+    }
+    file->log_batch(batch);
+    CHECK(file->get_write_count() == 1);
+    CHECK(read_file(path).size() == 2 * 9 + 25 * 100);
+
+    // an error anywhere in the batch writes the whole batch through
+    batch.clear();
+    batch.push_back(make_event(gfc::LogLevel::ERROR, "failure"));
+    batch.push_back(make_event(gfc::LogLevel::INFO, "after"));
+    file->log_batch(batch);
+    CHECK(file->get_write_count() == 2);
+    std::string content = read_file(path);
+    CHECK(content.compare(0, 18, "INFO one\nINFO two\n") == 0);
+    CHECK(content.compare(content.size() - 25, 25, "ERROR failure\nINFO after\n") == 0);
+    unlink(path.c_str());
+}
+
+int main() {
+    test_buffered_until_flush();
+    test_error_writes_through();
+    test_size_threshold();
+    test_flush_interval();
+    test_durability();
+    test_reopen_appends();
+    test_destructor_writes_out();
+    test_batch();
+    std::cout << "test_file_appender passed" << std::endl;
+    return 0;
+}
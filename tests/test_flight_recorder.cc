@@ -0,0 +1,257 @@
+#include "../gfc-logger-system/flight_recorder.hh"
+#include "test_util.hh"
+
+#include <csignal>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Keeps the messages Logger::log() hands it.
+class CaptureAppender : public gfc::LogAppender {
+public:
+    void log(const gfc::LogEvent::ptr& event) override { m_lines.push_back(event->get_content()); }
+    std::vector<std::string> m_lines;
+};
+
+static std::string scratch_path(const char* name) {
+    return "/tmp/gfc-flight-" + std::to_string(getpid()) + "-" + name;
+}
+
+// A scratch file to dump into; read() returns what was written so far.
+class DumpFile {
+public:
+    DumpFile() {
+        char path[] = "/tmp/gfc-flight-dump-XXXXXX";
+        m_fd = mkstemp(path);
+        unlink(path);
+    }
+    ~DumpFile() { close(m_fd); }
+    int fd() const { return m_fd; }
+    std::string read() const {
+        std::string text;
+        char buf[4096];
+        ssize_t n;
+        off_t offset = 0;
+        while((n = pread(m_fd, buf, sizeof(buf), offset)) > 0) {
+            text.append(buf, n);
+            offset += n;
+        }
+        return text;
+    }
+private:
+    int m_fd;
+};
+
+static size_t count_lines(const std::string& text) {
+    size_t lines = 0;
+    for(char c : text) {
+        lines += c == '\n';
+    }
+    return lines;
+}
+
+static void test_records_below_logger_level() {
+    std::string path = scratch_path("levels");
+    auto recorder = std::make_shared<gfc::FlightRecorder>(path, 16);
+    CHECK(recorder->is_open());
+    recorder->set_formatter(std::make_shared<gfc::LogFormatter>("%p %m%n"));
+    recorder->set_dump_target(-1);
+    gfc::FlightRecorder::install(recorder);
+
+    auto logger = std::make_shared<gfc::Logger>("flight");
+    logger->set_level(gfc::LogLevel::WARN);
+    auto capture = std::make_shared<CaptureAppender>();
+    logger->add_appender(capture);
+    GFC_LOG_DEBUG(logger) << "debug context";
+    GFC_LOG_INFO(logger) << "info context";
+    GFC_LOG_WARN(logger) << "warning";
+
+    // the appender still only sees WARN, the recorder sees everything
+    CHECK(capture->m_lines.size() == 1);
+    CHECK(capture->m_lines[0] == "warning");
+    CHECK(recorder->get_record_count() == 3);
+    DumpFile out;
+    CHECK(recorder->dump(out.fd()) == 3);
+    CHECK(out.read() == "--- flight recorder: events 0-3 ---\n"
+                        "DEBUG debug context\nINFO info context\nWARN warning\n");
+
+    // raising the recorder's level lets the macros skip DEBUG again
+    recorder->set_level(gfc::LogLevel::INFO);
+    int evaluated = 0;
+    GFC_LOG_DEBUG(logger) << ++evaluated;
+    CHECK(evaluated == 0);
+
+    gfc::FlightRecorder::install(nullptr);
+    GFC_LOG_INFO(logger) << ++evaluated;
+    CHECK(evaluated == 0);
+    CHECK(recorder->get_record_count() == 3);
+    unlink(path.c_str());
+}
+
+static void test_ring_wraps() {
+    std::string path = scratch_path("wrap");
+    // 5 slots round up to 8; slots of 32 bytes keep 16 bytes of text
+    gfc::FlightRecorder recorder(path, 5, 32);
+    CHECK(recorder.get_slot_count() == 8);
+    recorder.set_formatter(std::make_shared<gfc::LogFormatter>("%m%n"));
+    for(int i = 0; i < 20; ++i) {
+        auto event = std::make_shared<gfc::LogEvent>(gfc::LogLevel::INFO, "a.cc", 1, 0, 0, 0, 0, "root",
+                                                     "event " + std::to_string(i));
+        recorder.log(event);
+    }
+    DumpFile all;
+    CHECK(recorder.dump(all.fd()) == 8);
+    std::string text = all.read();
+    CHECK(text.find("--- flight recorder: events 12-20 ---\nevent 12\n") == 0);
+    CHECK(text.find("event 11\n") == std::string::npos);
+    CHECK(text.find("event 19\n") != std::string::npos);
+
+    DumpFile last;
+    CHECK(recorder.dump(last.fd(), 2) == 2);
+    CHECK(last.read() == "--- flight recorder: events 18-20 ---\nevent 18\nevent 19\n");
+
+    // cut off at the slot size, and still one event per line
+    auto event = std::make_shared<gfc::LogEvent>(gfc::LogLevel::INFO, "a.cc", 1, 0, 0, 0, 0, "root",
+                                                 std::string(100, 'x'));
+    recorder.log(event);
+    DumpFile cut;
+    recorder.dump(cut.fd(), 1);
+    CHECK(cut.read().substr(cut.read().find('\n') + 1) == std::string(16, 'x') + "\n");
+    unlink(path.c_str());
+}
+
+static void test_dump_on_fatal() {
+    std::string path = scratch_path("fatal");
+    auto recorder = std::make_shared<gfc::FlightRecorder>(path, 64);
+    recorder->set_formatter(std::make_shared<gfc::LogFormatter>("%p %m%n"));
+    DumpFile out;
+    recorder->set_dump_target(out.fd(), 2);
+    gfc::FlightRecorder::install(recorder);
+
+    auto logger = std::make_shared<gfc::Logger>("flight.fatal");
+    logger->set_level(gfc::LogLevel::ERROR);
+    GFC_LOG_DEBUG(logger) << "one";
+    GFC_LOG_DEBUG(logger) << "two";
+    CHECK(out.read().empty());
+    GFC_LOG_FATAL(logger) << "boom";
+    CHECK(out.read() == "--- flight recorder: events 1-3 ---\nDEBUG two\nFATAL boom\n");
+
+    gfc::FlightRecorder::install(nullptr);
+    unlink(path.c_str());
+}
+
+// A child process crashes; its dump goes to stderr (redirected) and the
+// ring stays readable in the file afterwards.
+static void test_dump_on_signal() {
+    std::string path = scratch_path("signal");
+    DumpFile out;
+    pid_t pid = fork();
+    if(pid == 0) {
+        dup2(out.fd(), STDERR_FILENO);
+        auto recorder = std::make_shared<gfc::FlightRecorder>(path, 64);
+        recorder->set_formatter(std::make_shared<gfc::LogFormatter>("%m%n"));
+        gfc::FlightRecorder::install(recorder);
+        gfc::FlightRecorder::install_signal_handlers();
+        auto logger = std::make_shared<gfc::Logger>("flight.signal");
+        logger->set_level(gfc::LogLevel::FATAL);
+        for(int i = 0; i < 5; ++i) {
+            GFC_LOG_DEBUG(logger) << "step " << i;
+        }
+        std::abort();
+    }
+    int status = 0;
+    CHECK(waitpid(pid, &status, 0) == pid);
+    CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+    std::string text = out.read();
+    CHECK(text.find("--- flight recorder: signal " + std::to_string(SIGABRT) + " ---\n") != std::string::npos);
+    CHECK(text.find("step 0\nstep 1\nstep 2\nstep 3\nstep 4\n") != std::string::npos);
+
+    DumpFile post_mortem;
+    CHECK(gfc::FlightRecorder::dump_file(path, post_mortem.fd()) == 5);
+    CHECK(post_mortem.read() == "--- flight recorder: events 0-5 ---\nstep 0\nstep 1\nstep 2\nstep 3\nstep 4\n");
+
+    // a new recorder keeps the old file aside
+    {
+        gfc::FlightRecorder again(path, 8);
+    }
+    DumpFile previous;
+    CHECK(gfc::FlightRecorder::dump_file(path + ".prev", previous.fd()) == 5);
+    DumpFile empty;
+    CHECK(gfc::FlightRecorder::dump_file(path, empty.fd()) == 0);
+    unlink(path.c_str());
+    unlink((path + ".prev").c_str());
+}
+
+static int recurse(int depth) {
+    volatile char frame[1024];
+    frame[0] = static_cast<char>(depth);
+    return depth < 0 ? 0 : recurse(depth + 1) + frame[0];
+}
+
+// the handler still runs once the thread's own stack is used up
+static void test_dump_on_stack_overflow() {
+    std::string path = scratch_path("overflow");
+    DumpFile out;
+    pid_t pid = fork();
+    if(pid == 0) {
+        dup2(out.fd(), STDERR_FILENO);
+        auto recorder = std::make_shared<gfc::FlightRecorder>(path, 64);
+        recorder->set_formatter(std::make_shared<gfc::LogFormatter>("%m%n"));
+        gfc::FlightRecorder::install(recorder);
+        gfc::FlightRecorder::install_signal_handlers();
+        auto logger = std::make_shared<gfc::Logger>("flight.overflow");
+        logger->set_level(gfc::LogLevel::FATAL);
+        GFC_LOG_DEBUG(logger) << "about to recurse";
+        std::_Exit(recurse(0));
+    }
+    int status = 0;
+    CHECK(waitpid(pid, &status, 0) == pid);
+    // the previous disposition may be a sanitizer's, which exits instead
+    CHECK(WIFSIGNALED(status) ? WTERMSIG(status) == SIGSEGV : WEXITSTATUS(status) != 0);
+    std::string text = out.read();
+    CHECK(text.find("--- flight recorder: signal " + std::to_string(SIGSEGV) + " ---\n") != std::string::npos);
+    CHECK(text.find("about to recurse\n") != std::string::npos);
+    unlink(path.c_str());
+}
+
+static void test_concurrent_writers() {
+    std::string path = scratch_path("threads");
+    gfc::FlightRecorder recorder(path, 256);
+    recorder.set_formatter(std::make_shared<gfc::LogFormatter>("%t %m%n"));
+    const int kThreads = 4, kPerThread = 5000;
+    std::vector<std::thread> threads;
+    for(int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            for(int i = 0; i < kPerThread; ++i) {
+                auto event = gfc::LogEvent::create(gfc::LogLevel::DEBUG, "a.cc", 1, t, 0, 0,
+                                                   std::chrono::system_clock::now(), gfc::intern_logger_name("root"));
+                event->set_content("message " + std::to_string(i));
+                recorder.log(event);
+            }
+        });
+    }
+    for(auto& th : threads) {
+        th.join();
+    }
+    CHECK(recorder.get_record_count() == kThreads * kPerThread);
+    DumpFile out;
+    CHECK(recorder.dump(out.fd()) == 256);
+    CHECK(count_lines(out.read()) == 257);
+    unlink(path.c_str());
+}
+
+int main() {
+    test_records_below_logger_level();
+    test_ring_wraps();
+    test_dump_on_fatal();
+    test_dump_on_signal();
+    test_dump_on_stack_overflow();
+    test_concurrent_writers();
+    std::cout << "test_flight_recorder passed" << std::endl;
+    return 0;
+}
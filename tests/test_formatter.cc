@@ -0,0 +1,215 @@
+#include "../gfc-logger-system/logger.hh"
+#include "test_util.hh"
+
+#include <chrono>
+#include <ctime>
+#include <memory>
+#include <sstream>
+
+static std::string strftime_str(time_t time, const char* fmt) {
+    struct tm tm;
+    localtime_r(&time, &tm);
+    char buf[64];
+    size_t n = strftime(buf, sizeof(buf), fmt, &tm);
+    return std::string(buf, n);
+}
+
+static gfc::LogEvent::ptr make_event() {
+    return std::make_shared<gfc::LogEvent>(
+        gfc::LogLevel::WARN, "src/db/pool.cc", 42, 1234, 7, 99, 1700000000, "db.pool", "connection lost");
+}
+
+static void test_default_pattern() {
+    auto event = make_event();
+    gfc::LogFormatter formatter;
+    std::stringstream expected;
+    expected << strftime_str(event->get_time(), "%Y-%m-%d %H:%M:%S")
+             << " [WARN] [db.pool] [1234] [src/db/pool.cc:42] connection lost" << std::endl;
+    CHECK(!formatter.is_error());
+    CHECK(formatter.format(event) == expected.str());
+}
+
+static void test_all_items() {
+    auto event = make_event();
+    gfc::LogFormatter formatter("%p|%r|%c|%t|%f|%l|%m|%T|%%|%d{%H:%M}|%d|tail");
+    std::string expected = "WARN|99|db.pool|1234|src/db/pool.cc|42|connection lost|\t|%|"
+        + strftime_str(event->get_time(), "%H:%M") + "|"
+        + strftime_str(event->get_time(), "%Y-%m-%d %H:%M:%S") + "|tail";
+    CHECK(formatter.format(event) == expected);
+}
+
+static void test_append_to_buffer() {
+    auto event = make_event();
+    gfc::LogFormatter formatter("[%p] %m%n");
+    std::string buf = "prefix ";
+    formatter.format(buf, *event);
+    formatter.format(buf, *event);
+    CHECK(buf == "prefix [WARN] connection lost\n[WARN] connection lost\n");
+}
+
+static gfc::LogEvent::ptr make_event_ns(int64_t time_ns) {
+    auto tp = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+        std::chrono::nanoseconds(time_ns)));
+    return std::make_shared<gfc::LogEvent>(gfc::LogLevel::INFO, "a.cc", 1, 0, 0, 0, tp, "root", "m");
+}
+
+static void test_subsecond_fields() {
+    const int64_t sec = 1700000000;
+    auto event = make_event_ns(sec * 1000000000 + 123456789);
+    CHECK(event->get_time() == sec);
+    std::string hms = strftime_str(sec, "%H:%M:%S");
+    CHECK(gfc::LogFormatter("%d{%H:%M:%S.%ms}").format(event) == hms + ".123");
+    CHECK(gfc::LogFormatter("%d{%H:%M:%S.%us}").format(event) == hms + ".123456");
+    CHECK(gfc::LogFormatter("%d{%S.%ns|%Y}").format(event) ==
+          strftime_str(sec, "%S") + ".123456789|" + strftime_str(sec, "%Y"));
+    CHECK(gfc::LogFormatter("%d{%%ms %ms}").format(event) == "%ms 123");
+
+    auto early = make_event_ns(sec * 1000000000 + 5000000);
+    CHECK(gfc::LogFormatter("%d{%ms}").format(early) == "005");
+}
+
+static void test_date_cache() {
+    // the cached second must be re-rendered when the second changes, and
+    // distinct formatters must not see each other's cached text
+    gfc::LogFormatter a("%d{%Y-%m-%d %H:%M:%S.%ms}");
+    gfc::LogFormatter b("%d{%H:%M:%S}");
+    int64_t base = 1700000000;
+    for(int64_t i = 0; i < 50; ++i) {
+        int64_t t = base + i / 3;
+        auto event = make_event_ns(t * 1000000000 + i * 1000000);
+        CHECK(a.format(event) == strftime_str(t, "%Y-%m-%d %H:%M:%S") + "." +
+              std::string(i < 10 ? "00" : "0") + std::to_string(i));
+        CHECK(b.format(event) == strftime_str(t, "%H:%M:%S"));
+    }
+    for(int i = 0; i < 20; ++i) {
+        gfc::LogFormatter f("%d{" + std::to_string(i) + " %S}");
+        CHECK(f.format(make_event_ns(base * 1000000000)) == std::to_string(i) + " " + strftime_str(base, "%S"));
+    }
+}
+
+struct Point {
+    int x, y;
+};
+static std::ostream& operator<<(std::ostream& os, const Point& p) {
+    return os << "(" << p.x << ", " << p.y << ")";
+}
+
+// LogStream must render exactly what the std::stringstream it replaced did
+static void test_log_stream_matches_ostream() {
+    std::string buf;
+    gfc::LogStream stream(buf);
+    std::stringstream expected;
+    int i = -42;
+    const void* p = &i;
+    char text[] = "mutable";
+#define BOTH(v) stream << v; expected << v
+    BOTH(i); BOTH(' '); BOTH(42u); BOTH(-7L); BOTH(123456789012345LL); BOTH(18446744073709551615ULL);
+    BOTH(3.14159265); BOTH(0.1f); BOTH(1e20); BOTH(100.0); BOTH(-0.0); BOTH(2.5L);
+    BOTH(true); BOTH(false); BOTH('c'); BOTH("literal"); BOTH(text); BOTH(std::string("string"));
+    BOTH(std::string_view("view")); BOTH(p); BOTH(static_cast<const void*>(nullptr));
+    BOTH((Point{1, 2})); BOTH(std::endl); BOTH(static_cast<short>(-3)); BOTH(static_cast<unsigned char>('u'));
+#undef BOTH
+    CHECK(buf == expected.str());
+
+    // stream state manipulators must not leak into later fallback values
+    buf.clear();
+    stream << std::hex << Point{10, 11};
+    CHECK(buf == "(10, 11)");
+}
+
+static void test_format_api() {
+    std::string buf;
+    gfc::LogStream stream(buf);
+    stream.format("user={} latency={}us ok={}", 42, 1.5, true);
+    CHECK(buf == "user=42 latency=1.5us ok=1");
+
+    buf.clear();
+    stream.format("{{literal}} {} {{{}}}", "x", std::string("y"));
+    CHECK(buf == "{literal} x {y}");
+
+    buf.clear();
+    stream.format("no fields");
+    CHECK(buf == "no fields");
+
+    buf.clear();
+    stream.format("{}{}", (Point{1, 2}), 'c');
+    CHECK(buf == "(1, 2)c");
+
+    // through the macros, into the event content
+    class Capture : public gfc::LogAppender {
+    public:
+        void log(const gfc::LogEvent::ptr& event) override { m_last = event->get_content(); }
+        std::string m_last;
+    };
+    auto capture = std::make_shared<Capture>();
+    auto logger = std::make_shared<gfc::Logger>("fmt");
+    logger->add_appender(capture);
+    GFC_LOG_INFOF(logger, "user={} latency={}us", 7, 250);
+    CHECK(capture->m_last == "user=7 latency=250us");
+    GFC_LOG_ERRORF(logger, "plain");
+    CHECK(capture->m_last == "plain");
+
+    int evaluated = 0;
+    logger->set_level(gfc::LogLevel::ERROR);
+    GFC_LOG_DEBUGF(logger, "{}", ++evaluated);
+    CHECK(evaluated == 0);
+}
+
+static void test_bad_patterns() {
+    CHECK(gfc::LogFormatter("%d{%H:%M").is_error());
+    CHECK(gfc::LogFormatter("%x").is_error());
+    CHECK(!gfc::LogFormatter("%d").is_error());
+}
+
+// Keeps the text Logger::log() hands it and how many formats it took.
+class FormattedAppender : public gfc::LogAppender {
+public:
+    void log(const gfc::LogEvent::ptr& event) override {
+        m_text = m_formatter->format(event);
+    }
+    void log_formatted(gfc::FormattedEvent& formatted) override {
+        m_text = formatted.format(m_formatter);
+        m_formats = formatted.get_format_count();
+    }
+    std::string m_text;
+    size_t      m_formats = 0;
+};
+
+static void test_format_once_fan_out() {
+    auto logger = std::make_shared<gfc::Logger>("fan_out");
+    logger->set_formatter(std::make_shared<gfc::LogFormatter>("%p %m"));
+    auto a = std::make_shared<FormattedAppender>();
+    auto b = std::make_shared<FormattedAppender>();
+    auto c = std::make_shared<FormattedAppender>();
+    logger->add_appender(a);
+    logger->add_appender(b);
+    logger->add_appender(c);
+    c->set_formatter(std::make_shared<gfc::LogFormatter>("[%m]"));
+
+    GFC_LOG_WARN(logger) << "shared";
+    CHECK(a->m_text == "WARN shared");
+    CHECK(b->m_text == "WARN shared");
+    CHECK(c->m_text == "[shared]");
+    // a formats, b reuses a's text, c needs its own
+    CHECK(a->m_formats == 1);
+    CHECK(b->m_formats == 1);
+    CHECK(c->m_formats == 2);
+
+    GFC_LOG_INFO(logger) << "next";
+    CHECK(b->m_text == "INFO next");
+    CHECK(c->m_formats == 2);
+}
+
+int main() {
+    test_default_pattern();
+    test_all_items();
+    test_append_to_buffer();
+    test_subsecond_fields();
+    test_date_cache();
+    test_log_stream_matches_ostream();
+    test_format_api();
+    test_bad_patterns();
+    test_format_once_fan_out();
+    std::cout << "test_formatter passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include "../gfc-logger-system/json_formatter.hh"
+#include "test_util.hh"
+
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <limits>
+#include <memory>
+#include <string>
+
+// Keeps the text Logger::log() hands it.
+class CaptureAppender : public gfc::LogAppender {
+public:
+    void log(const gfc::LogEvent::ptr& event) override {
+        m_text += m_formatter->format(event);
+    }
+    std::string m_text;
+};
+
+struct Point {
+    int x, y;
+};
+static std::ostream& operator<<(std::ostream& os, const Point& p) {
+    return os << "(" << p.x << ", " << p.y << ")";
+}
+
+static std::string escaped(std::string_view text) {
+    std::string out;
+    gfc::JsonLogFormatter::append_escaped(out, text);
+    return out;
+}
+
+static void test_escape() {
+    CHECK(escaped("") == "");
+    CHECK(escaped("plain text") == "plain text");
+    CHECK(escaped("a\"b\\c") == "a\\\"b\\\\c");
+    CHECK(escaped("\n\r\t\b\f") == "\\n\\r\\t\\b\\f");
+    CHECK(escaped(std::string("\x01\x1f\x00", 3)) == "\\u0001\\u001f\\u0000");
+    CHECK(escaped("\x7f \xc3\xa9") == "\x7f \xc3\xa9");
+
+    // every position inside and across the 16/32-byte blocks
+    for(size_t len = 1; len < 100; ++len) {
+        for(size_t pos = 0; pos < len; ++pos) {
+            std::string text(len, 'x');
+            text[pos] = '"';
+            std::string expected(len + 1, 'x');
+            expected[pos] = '\\';
+            expected[pos + 1] = '"';
+            CHECK(escaped(text) == expected);
+        }
+    }
+}
+
+static void test_fields() {
+    auto logger = std::make_shared<gfc::Logger>("kv");
+    auto capture = std::make_shared<CaptureAppender>();
+    logger->add_appender(capture);
+    capture->set_formatter(std::make_shared<gfc::LogFormatter>("%m|%K"));
+
+    int id = -7;
+    unsigned long bytes = 18446744073709551615UL;
+    std::string name = "ann";
+    GFC_LOG_INFO(logger).kv("user", id).kv("bytes", bytes).kv("ms", 1.5).kv("ok", true)
+        .kv("name", name).kv("lit", "x y").kv("c", 'c').kv("p", Point{1, 2}) << "done";
+    CHECK(capture->m_text == "done|user=-7 bytes=18446744073709551615 ms=1.5 ok=true name=ann lit=x y c=c p=(1, 2)");
+
+    // pooled events must not carry fields over
+    capture->m_text.clear();
+    GFC_LOG_INFO(logger) << "bare";
+    CHECK(capture->m_text == "bare|");
+
+    // fmt-style statements take fields too
+    capture->m_text.clear();
+    GFC_LOG_INFOF(logger, "took {}ms", 3).kv("rows", 10);
+    CHECK(capture->m_text == "took 3ms|rows=10");
+
+    // a stream without an event renders the pair as text
+    std::string buf;
+    gfc::LogStream stream(buf);
+    stream << "msg";
+    stream.kv("a", 1).kv("b", "two");
+    CHECK(buf == "msg a=1 b=two");
+}
+
+static void test_typed_fields() {
+    auto logger = std::make_shared<gfc::Logger>("kv.types");
+    class Keep : public gfc::LogAppender {
+    public:
+        void log(const gfc::LogEvent::ptr& event) override { m_event = event; }
+        gfc::LogEvent::ptr m_event;
+    };
+    auto keep = std::make_shared<Keep>();
+    logger->add_appender(keep);
+    GFC_LOG_WARN(logger).kv("i", static_cast<short>(-3)).kv("u", 4u).kv("d", 0.25f).kv("b", false).kv("s", "str");
+    auto fields = keep->m_event->get_fields();
+    CHECK(fields.size() == 5);
+    CHECK(fields[0].type == gfc::LogField::Type::INT && fields[0].i == -3);
+    CHECK(fields[1].type == gfc::LogField::Type::UINT && fields[1].u == 4);
+    CHECK(fields[2].type == gfc::LogField::Type::DOUBLE && fields[2].d == 0.25);
+    CHECK(fields[3].type == gfc::LogField::Type::BOOL && !fields[3].b);
+    CHECK(fields[4].type == gfc::LogField::Type::STRING);
+    CHECK(keep->m_event->get_field_key(fields[4]) == "s");
+    CHECK(keep->m_event->get_field_string(fields[4]) == "str");
+}
+
+static void test_json_output() {
+    const time_t sec = 1700000000;
+    auto tp = std::chrono::system_clock::time_point(std::chrono::seconds(sec) + std::chrono::milliseconds(42));
+    auto event = std::make_shared<gfc::LogEvent>(
+        gfc::LogLevel::ERROR, "src/db/\"pool\".cc", 42, 1234, 0, 0, tp, "db.pool", "line1\nsaid \"hi\"");
+    gfc::LogStream stream(*event);
+    stream.kv("user", 7).kv("ms", 2.5).kv("ok", true).kv("tag", "a\\b").kv("nan", std::nan(""))
+          .kv("big", 18446744073709551615ULL);
+
+    struct tm tm;
+    localtime_r(&sec, &tm);
+    char time[64];
+    strftime(time, sizeof(time), "%Y-%m-%dT%H:%M:%S", &tm);
+
+    gfc::JsonLogFormatter formatter;
+    CHECK(!formatter.is_error());
+    std::string expected = std::string("{\"time\":\"") + time + ".042" + [&]() {
+            char zone[16];
+            strftime(zone, sizeof(zone), "%z", &tm);
+            return std::string(zone);
+        }() +
+        "\",\"level\":\"ERROR\",\"logger\":\"db.pool\",\"thread\":1234,"
+        "\"file\":\"src/db/\\\"pool\\\".cc\",\"line\":42,\"msg\":\"line1\\nsaid \\\"hi\\\"\","
+        "\"user\":7,\"ms\":2.5,\"ok\":true,\"tag\":\"a\\\\b\",\"nan\":null,\"big\":18446744073709551615}\n";
+    CHECK(formatter.format(event) == expected);
+
+    // a time format with characters that need escaping
+    gfc::JsonLogFormatter quoted("\"%Y\"");
+    std::string prefix = "{\"time\":\"\\\"" + std::to_string(tm.tm_year + 1900) + "\\\"\",";
+    CHECK(quoted.format(event).compare(0, prefix.size(), prefix) == 0);
+}
+
+int main() {
+    test_escape();
+    test_fields();
+    test_typed_fields();
+    test_json_output();
+    std::cout << "test_json_formatter passed" << std::endl;
+    return 0;
+}
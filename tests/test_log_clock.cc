@@ -0,0 +1,114 @@
+#include "../gfc-logger-system/logger.hh"
+#include "test_util.hh"
+
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static int64_t system_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static uint32_t gettid_now() {
+    return static_cast<uint32_t>(syscall(SYS_gettid));
+}
+
+// Keeps the last event Logger::log() hands it.
+class CaptureAppender : public gfc::LogAppender {
+public:
+    void log(const gfc::LogEvent::ptr& event) override { m_last = event; }
+    gfc::LogEvent::ptr m_last;
+};
+
+static void test_thread_ids() {
+    CHECK(gfc::current_thread_id() == gettid_now());
+    CHECK(gfc::current_thread_id() == static_cast<uint32_t>(getpid()));
+    uint32_t other = 0;
+    std::thread([&]() { other = gfc::current_thread_id(); CHECK(other == gettid_now()); }).join();
+    CHECK(other != 0 && other != gfc::current_thread_id());
+
+    // the child's main thread is a new thread, with its own id
+    pid_t pid = fork();
+    if(pid == 0) {
+        std::_Exit(gfc::current_thread_id() == gettid_now() ? 0 : 1);
+    }
+    int status = 0;
+    CHECK(waitpid(pid, &status, 0) == pid);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+static void test_clock() {
+    CHECK(gfc::LogClock::get_source() != gfc::LogClock::Source::NONE);
+    // leaves room for a slow CI machine between the readings
+    const int64_t slack_ns = 20000000;
+    int64_t before = system_ns();
+    int64_t ticks = gfc::LogClock::now();
+    int64_t after = system_ns();
+    int64_t ns = gfc::LogClock::to_ns(ticks);
+    CHECK(ns >= before - slack_ns && ns <= after + slack_ns);
+
+    // stays monotonic across recalibrations
+    int64_t last_ticks = gfc::LogClock::now();
+    int64_t last_ns = gfc::LogClock::to_ns(last_ticks);
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(2200);
+    while(std::chrono::steady_clock::now() < end) {
+        int64_t t = gfc::LogClock::now();
+        CHECK(t >= last_ticks);
+        int64_t n = gfc::LogClock::to_ns(t);
+        CHECK(n >= last_ns);
+        last_ticks = t;
+        last_ns = n;
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    CHECK(std::llabs(gfc::LogClock::to_ns(gfc::LogClock::now()) - system_ns()) < slack_ns);
+    // converting the same ticks again, after recalibrating, moves them little
+    CHECK(std::llabs(gfc::LogClock::to_ns(ticks) - ns) < slack_ns);
+}
+
+static void test_event_stamps() {
+    auto logger = std::make_shared<gfc::Logger>("clock");
+    auto capture = std::make_shared<CaptureAppender>();
+    logger->add_appender(capture);
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+
+    uint32_t elapsed_before = gfc::LogClock::elapsed_ms(gfc::LogClock::now());
+    int64_t before = system_ns();
+    GFC_LOG_INFO(logger) << "stamped";
+    int64_t after = system_ns();
+    const gfc::LogEvent::ptr& event = capture->m_last;
+    CHECK(event);
+    CHECK(event->get_thread_id() == gettid_now());
+    CHECK(event->get_time_ns() >= before - 20000000 && event->get_time_ns() <= after + 20000000);
+    CHECK(event->get_elapse() >= 30 && event->get_elapse() >= elapsed_before);
+    CHECK(gfc::LogFormatter("%t").format(event) == std::to_string(gettid_now()));
+    CHECK(gfc::LogFormatter("%r").format(event) == std::to_string(event->get_elapse()));
+
+    // from another thread, its own id
+    uint32_t other = 0;
+    std::thread([&]() {
+        GFC_LOG_INFO(logger) << "other";
+        other = gettid_now();
+    }).join();
+    CHECK(capture->m_last->get_thread_id() == other);
+
+    // events built with an explicit time keep it
+    auto explicit_time = std::make_shared<gfc::LogEvent>(gfc::LogLevel::INFO, "a.cc", 1, 7, 0, 5, 1700000000,
+                                                         "root", "m");
+    CHECK(explicit_time->get_time_ns() == 1700000000LL * 1000000000);
+    CHECK(explicit_time->get_thread_id() == 7);
+    CHECK(explicit_time->get_elapse() == 5);
+}
+
+int main() {
+    test_thread_ids();
+    test_event_stamps();
+    test_clock();
+    std::cout << "test_log_clock passed" << std::endl;
+    return 0;
+}
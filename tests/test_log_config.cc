@@ -0,0 +1,283 @@
+#include "../gfc-logger-system/log_config.hh"
+#include "test_util.hh"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+static std::string scratch_path(const char* name) {
+    return "/tmp/gfc-config-" + std::to_string(getpid()) + "-" + name;
+}
+
+// Replaces path the way deploy tools do: write a new file, rename it over.
+static void write_file(const std::string& path, const std::string& text) {
+    std::string tmp = path + ".tmp";
+    std::ofstream(tmp) << text;
+    std::rename(tmp.c_str(), path.c_str());
+}
+
+static std::string read_file(const std::string& path) {
+    std::ifstream in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+// Polls cond for up to three seconds.
+template<typename Cond>
+static bool eventually(Cond cond) {
+    auto end = std::chrono::steady_clock::now() + std::chrono::seconds(3);
+    while(!cond()) {
+        if(std::chrono::steady_clock::now() > end) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return true;
+}
+
+static void test_parse_errors() {
+    std::string error;
+    auto expect_error = [&](const std::string& text, const std::string& message) {
+        error.clear();
+        CHECK(gfc::LogConfig::parse(text, 0, error) == nullptr);
+        CHECK(error == message);
+    };
+    expect_error("[logger root]\nlevel = LOUD\n", "line 2: bad level LOUD");
+    expect_error("[appender a]\npath = /tmp/x\n", "line 1: appender a has no type");
+    expect_error("[appender a]\ntype = file\n", "line 1: appender a has no path");
+    expect_error("[appender a]\ntype = stdout\ncolour = red\n", "line 3: unknown appender key colour");
+    expect_error("[appender n]\ntype = network\n", "line 1: appender n has no address");
+    expect_error("[appender n]\ntype = network\naddress = x:1\ntransport = sctp\n",
+                 "line 1: appender n: unknown transport sctp");
+    expect_error("[appender a]\ntype = stdout\npattern = %d{%H\n", "line 1: appender a: bad pattern %d{%H");
+    expect_error("\n[logger root]\nappenders = missing\n", "line 2: logger root: unknown appender missing");
+    expect_error("[logger db]\nlevel_for = 5m\n", "line 1: logger db: level_for without a level");
+    expect_error("level = INFO\n", "line 1: key outside a section");
+    expect_error("[route x]\n", "line 1: unknown section route");
+
+    auto config = gfc::LogConfig::parse("# comment\n; another\n[appender a]\ntype = rolling\npath = /tmp/x\n"
+                                        "max_size = 64M\ninterval = daily\n\n[logger db.pool]\nlevel = DEBUG\n"
+                                        "level_for = 2m\nadditive = false\nappenders = a, a\n", 1000, error);
+    CHECK(config);
+    CHECK(config->get_appenders().size() == 1);
+    CHECK(config->get_appenders()[0].settings.at("max_size") == "64M");
+    const auto& logger = config->get_loggers().at(0);
+    CHECK(logger.name == "db.pool");
+    CHECK(logger.level == gfc::LogLevel::DEBUG);
+    CHECK(logger.level_until_ns == 1000 + 120LL * 1000000000);
+    CHECK(!logger.additive);
+    CHECK(logger.appenders.size() == 1);
+}
+
+static void test_load_config() {
+    gfc::LoggerManager& manager = gfc::LoggerManager::get_instance();
+    std::string config = scratch_path("load.ini");
+    std::string out = scratch_path("load.log");
+    write_file(config, "[appender file]\ntype = file\npath = " + out + "\npattern = %p %c %m%n\n"
+                       "[logger cfg]\nlevel = WARN\nappenders = file\n"
+                       "[logger cfg.quiet]\nadditive = false\n");
+    CHECK(manager.load_config(config));
+    auto cfg = manager.get_logger("cfg");
+    auto quiet = manager.get_logger("cfg.quiet");
+    CHECK(cfg->get_level() == gfc::LogLevel::WARN);
+    CHECK(quiet->get_level() == gfc::LogLevel::WARN);
+    CHECK(cfg->get_appenders().size() == 1);
+    GFC_LOG_INFO(cfg) << "dropped";
+    GFC_LOG_ERROR(cfg) << "kept";
+    GFC_LOG_ERROR(manager.get_logger("cfg.child")) << "inherited";
+    GFC_LOG_ERROR(quiet) << "not additive";
+    cfg->get_appenders()[0]->flush();
+    CHECK(read_file(out) == "ERROR cfg kept\nERROR cfg.child inherited\n");
+
+    // a broken file leaves the configuration alone
+    write_file(config, "[logger cfg]\nlevel = NOISY\n");
+    CHECK(!manager.load_config(config));
+    CHECK(cfg->get_level() == gfc::LogLevel::WARN);
+    CHECK(!manager.load_config(scratch_path("missing.ini")));
+
+    // loggers left out go back to inheriting, with no appenders
+    write_file(config, "[logger other]\nlevel = ERROR\n");
+    CHECK(manager.load_config(config));
+    CHECK(cfg->get_own_level() == gfc::LogLevel::UNKNOW);
+    CHECK(cfg->get_appenders().empty());
+    CHECK(quiet->is_additive());
+    write_file(config, "");
+    CHECK(manager.load_config(config));
+    unlink(config.c_str());
+    unlink(out.c_str());
+}
+
+static void test_watch_and_level_for() {
+    gfc::LoggerManager& manager = gfc::LoggerManager::get_instance();
+    std::string config = scratch_path("watch.ini");
+    std::string sink = "[appender sink]\ntype = file\npath = /dev/null\nlevel = INFO\n";
+    write_file(config, sink + "[logger watched]\nlevel = INFO\nappenders = sink\n");
+    CHECK(manager.watch_config(config));
+    auto watched = manager.get_logger("watched");
+    CHECK(watched->get_level() == gfc::LogLevel::INFO);
+    gfc::LogAppender::ptr appender = watched->get_appenders().at(0);
+
+    // raised to DEBUG for a second, then back to INFO on its own
+    write_file(config, sink + "[logger watched]\nlevel = DEBUG\nlevel_for = 1s\nappenders = sink\n");
+    CHECK(eventually([&]() { return watched->get_level() == gfc::LogLevel::DEBUG; }));
+    // the unchanged appender was kept
+    CHECK(watched->get_appenders().at(0) == appender);
+    CHECK(eventually([&]() { return watched->get_own_level() == gfc::LogLevel::UNKNOW; }));
+    CHECK(watched->get_level() == manager.get_root_logger()->get_level());
+
+    // a changed level on the appender keeps it too, other changes replace it
+    write_file(config, "[appender sink]\ntype = file\npath = /dev/null\nlevel = WARN\n"
+                       "[logger watched]\nappenders = sink\n");
+    CHECK(eventually([&]() { return watched->get_appenders().at(0)->get_level() == gfc::LogLevel::WARN; }));
+    CHECK(watched->get_appenders().at(0) == appender);
+    write_file(config, "[appender sink]\ntype = file\npath = /dev/null\npattern = %m%n\n"
+                       "[logger watched]\nappenders = sink\n");
+    CHECK(eventually([&]() { return watched->get_appenders().at(0) != appender; }));
+
+    CHECK(manager.watch_config(""));
+    write_file(config, "[logger watched]\nlevel = FATAL\n");
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    CHECK(watched->get_level() != gfc::LogLevel::FATAL);
+    CHECK(manager.load_config(config));
+    CHECK(watched->get_level() == gfc::LogLevel::FATAL);
+    write_file(config, "");
+    CHECK(manager.load_config(config));
+    unlink(config.c_str());
+}
+
+// Logging threads run while the sink moves between a parent and its child
+// logger; a half-applied reload would deliver an event twice or not at all.
+static void test_reload_is_atomic() {
+    gfc::LoggerManager& manager = gfc::LoggerManager::get_instance();
+    std::string on_parent = scratch_path("parent.ini");
+    std::string on_child = scratch_path("child.ini");
+    std::string sink = "[appender sink]\ntype = file\npath = /dev/null\n";
+    write_file(on_parent, sink + "[logger swap]\nappenders = sink\n[logger swap.child]\n");
+    write_file(on_child, sink + "[logger swap]\n[logger swap.child]\nappenders = sink\nadditive = false\n");
+    CHECK(manager.load_config(on_parent));
+    auto child = manager.get_logger("swap.child");
+    gfc::LogAppender::ptr appender = manager.get_logger("swap")->get_appenders().at(0);
+    uint64_t before = appender->get_stats().events;
+
+    const int kThreads = 4, kPerThread = 20000;
+    std::atomic<int> running{kThreads};
+    std::vector<std::thread> threads;
+    for(int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&]() {
+            for(int i = 0; i < kPerThread; ++i) {
+                GFC_LOG_INFO(child) << "event " << i;
+            }
+            running.fetch_sub(1);
+        });
+    }
+    int reloads = 0;
+    while(running.load() > 0) {
+        CHECK(manager.load_config(reloads++ % 2 ? on_parent : on_child));
+    }
+    for(auto& th : threads) {
+        th.join();
+    }
+    // every config kept the same appender
+    CHECK(manager.get_logger("swap")->get_appenders().size() + child->get_appenders().size() == 1);
+    CHECK(reloads > 1);
+    CHECK(appender->get_stats().events - before == static_cast<uint64_t>(kThreads * kPerThread));
+
+    write_file(on_parent, "");
+    CHECK(manager.load_config(on_parent));
+    unlink(on_parent.c_str());
+    unlink(on_child.c_str());
+}
+
+// Two configs that send the same events to different places, so an event
+// that met the level of one and the appenders (or appender levels) of the
+// other shows up where neither puts it:
+//   quiet: logger at WARN, a at DEBUG: WARN to a, DEBUG nowhere
+//   loud:  logger at DEBUG, a at ERROR, b at DEBUG: WARN and DEBUG to b
+// Appender a is kept across reloads, only its level changes.
+static void test_reload_levels_are_atomic() {
+    gfc::LoggerManager& manager = gfc::LoggerManager::get_instance();
+    std::string quiet = scratch_path("quiet.ini");
+    std::string loud = scratch_path("loud.ini");
+    std::string a_path = scratch_path("a.log");
+    std::string b_path = scratch_path("b.log");
+    unlink(a_path.c_str());
+    unlink(b_path.c_str());
+    auto sections = [&](const char* a_level) {
+        return "[appender a]\ntype = file\npath = " + a_path + "\npattern = %p %m%n\nlevel = " + a_level +
+               "\n[appender b]\ntype = file\npath = " + b_path + "\npattern = %p %m%n\n";
+    };
+    write_file(quiet, sections("DEBUG") + "[logger levels]\nlevel = WARN\nappenders = a\n");
+    write_file(loud, sections("ERROR") + "[logger levels]\nlevel = DEBUG\nappenders = a, b\n");
+    CHECK(manager.load_config(loud));
+    auto logger = manager.get_logger("levels");
+    std::vector<gfc::LogAppender::ptr> appenders = logger->get_appenders();
+    CHECK(appenders.size() == 2);
+
+    const int kThreads = 4, kPerThread = 20000;
+    std::atomic<int> running{kThreads};
+    std::vector<std::thread> threads;
+    for(int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            for(int i = 0; i < kPerThread; ++i) {
+                GFC_LOG_DEBUG(logger) << t << "." << i;
+                GFC_LOG_WARN(logger) << t << "." << i;
+            }
+            running.fetch_sub(1);
+        });
+    }
+    int reloads = 0;
+    while(running.load() > 0) {
+        CHECK(manager.load_config(reloads++ % 2 ? loud : quiet));
+    }
+    for(auto& th : threads) {
+        th.join();
+    }
+    CHECK(reloads > 1);
+    for(auto& appender : appenders) {
+        appender->flush();
+    }
+
+    std::set<std::string> warned;
+    std::istringstream a(read_file(a_path));
+    for(std::string line; std::getline(a, line); ) {
+        CHECK(line.compare(0, 5, "WARN ") == 0);
+        CHECK(warned.insert(line.substr(5)).second);
+    }
+    std::set<std::string> debugged;
+    std::istringstream b(read_file(b_path));
+    for(std::string line; std::getline(b, line); ) {
+        if(line.compare(0, 5, "WARN ") == 0) {
+            CHECK(warned.insert(line.substr(5)).second);
+        } else {
+            CHECK(line.compare(0, 6, "DEBUG ") == 0);
+            CHECK(debugged.insert(line.substr(6)).second);
+        }
+    }
+    // every WARN went to exactly one of them
+    CHECK(warned.size() == static_cast<size_t>(kThreads * kPerThread));
+
+    write_file(quiet, "");
+    CHECK(manager.load_config(quiet));
+    unlink(quiet.c_str());
+    unlink(loud.c_str());
+    unlink(a_path.c_str());
+    unlink(b_path.c_str());
+}
+
+int main() {
+    test_parse_errors();
+    test_load_config();
+    test_watch_and_level_for();
+    test_reload_is_atomic();
+    test_reload_levels_are_atomic();
+    std::cout << "test_log_config passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,165 @@
+#include "../gfc-logger-system/log_limit.hh"
+#include "test_util.hh"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+class CaptureAppender : public gfc::LogAppender {
+public:
+    void log(const gfc::LogEvent::ptr& event) override {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_lines.push_back(m_formatter->format(event));
+    }
+    std::vector<std::string> take() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return std::move(m_lines);
+    }
+private:
+    std::vector<std::string> m_lines;
+};
+
+static std::shared_ptr<CaptureAppender> capture(const gfc::Logger::ptr& logger) {
+    auto appender = std::make_shared<CaptureAppender>();
+    logger->set_formatter(std::make_shared<gfc::LogFormatter>("%p %m"));
+    logger->add_appender(appender);
+    return appender;
+}
+
+static void test_every_n() {
+    auto logger = std::make_shared<gfc::Logger>("every_n");
+    auto out = capture(logger);
+    for(int i = 0; i < 10; ++i) {
+        GFC_LOG_ERROR_EVERY_N(logger, 3) << "attempt " << i;
+    }
+    CHECK(out->take() == std::vector<std::string>({"ERROR attempt 0", "ERROR attempt 3",
+                                                   "ERROR attempt 6", "ERROR attempt 9"}));
+}
+
+static void test_first_n() {
+    auto logger = std::make_shared<gfc::Logger>("first_n");
+    auto out = capture(logger);
+    for(int i = 0; i < 10; ++i) {
+        GFC_LOG_INFO_FIRST_N(logger, 2) << "deprecated " << i;
+    }
+    CHECK(out->take() == std::vector<std::string>({"INFO deprecated 0", "INFO deprecated 1"}));
+}
+
+static void test_rate() {
+    auto logger = std::make_shared<gfc::Logger>("rate");
+    auto out = capture(logger);
+    // a burst of per_sec gets through, then one every 1/per_sec
+    for(int i = 0; i < 1000; ++i) {
+        GFC_LOG_WARN_RATE(logger, 2) << "queue full";
+    }
+    CHECK(out->take().size() == 2);
+}
+
+static void test_below_level_not_counted() {
+    auto logger = std::make_shared<gfc::Logger>("below");
+    auto out = capture(logger);
+    auto emit = [&]() { GFC_LOG_DEBUG_FIRST_N(logger, 1) << "first enabled"; };
+    logger->set_level(gfc::LogLevel::INFO);
+    emit();
+    emit();
+    logger->set_level(gfc::LogLevel::DEBUG);
+    emit();
+    CHECK(out->take() == std::vector<std::string>({"DEBUG first enabled"}));
+}
+
+static void test_report_suppressed() {
+    auto logger = std::make_shared<gfc::Logger>("report");
+    auto out = capture(logger);
+    gfc::report_suppressed(logger);     // clear what the tests above held back
+    out->take();
+
+    for(int i = 0; i < 5; ++i) {
+        GFC_LOG_WARN_FIRST_N(logger, 1) << "disk almost full";
+    }
+    gfc::report_suppressed(logger);
+    CHECK(out->take() == std::vector<std::string>({"WARN disk almost full", "WARN suppressed 4 messages"}));
+    gfc::report_suppressed(logger);     // nothing new
+    CHECK(out->take().empty());
+
+    // a site the logger does not log keeps its count until it does
+    for(int i = 0; i < 3; ++i) {
+        GFC_LOG_WARN_FIRST_N(logger, 1) << "cache cold";
+    }
+    logger->set_level(gfc::LogLevel::ERROR);
+    gfc::report_suppressed(logger);
+    logger->set_level(gfc::LogLevel::DEBUG);
+    gfc::report_suppressed(logger);
+    CHECK(out->take() == std::vector<std::string>({"WARN cache cold", "WARN suppressed 2 messages"}));
+
+    gfc::set_suppression_report(logger, std::chrono::milliseconds(10));
+    for(int i = 0; i < 2; ++i) {
+        GFC_LOG_ERROR_EVERY_N(logger, 100) << "timeout";
+    }
+    std::vector<std::string> lines;
+    for(int i = 0; i < 500 && lines.size() < 2; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        for(auto& line : out->take()) {
+            lines.push_back(line);
+        }
+    }
+    gfc::set_suppression_report(logger, std::chrono::milliseconds(0));
+    CHECK(lines == std::vector<std::string>({"ERROR timeout", "ERROR suppressed 1 messages"}));
+}
+
+static void test_dedup() {
+    auto logger = std::make_shared<gfc::Logger>("dedup");
+    auto out = capture(logger);
+    logger->set_dedup(true, std::chrono::hours(1));
+    for(int i = 0; i < 5; ++i) {
+        GFC_LOG_ERROR(logger) << "connection refused";
+    }
+    GFC_LOG_INFO(logger) << "reconnected";
+    GFC_LOG_INFO(logger) << "reconnected";
+    GFC_LOG_INFO(logger) << "serving";
+    CHECK(out->take() == std::vector<std::string>({"ERROR connection refused",
+                                                   "ERROR last message repeated 4 times",
+                                                   "INFO reconnected",
+                                                   "INFO last message repeated 1 times",
+                                                   "INFO serving"}));
+
+    // with no interval, a long run is reported as it goes
+    logger->set_dedup(true, std::chrono::milliseconds(0));
+    for(int i = 0; i < 3; ++i) {
+        GFC_LOG_WARN(logger) << "retrying";
+    }
+    CHECK(out->take() == std::vector<std::string>({"WARN retrying",
+                                                   "WARN last message repeated 1 times",
+                                                   "WARN last message repeated 1 times"}));
+
+    // a run that ends in silence is still reported, once the interval is up
+    logger->set_dedup(true, std::chrono::milliseconds(50));
+    for(int i = 0; i < 4; ++i) {
+        GFC_LOG_ERROR(logger) << "upstream down";
+    }
+    std::vector<std::string> lines = out->take();
+    for(int i = 0; i < 300 && lines.size() < 2; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        for(auto& line : out->take()) {
+            lines.push_back(line);
+        }
+    }
+    CHECK(lines == std::vector<std::string>({"ERROR upstream down", "ERROR last message repeated 3 times"}));
+
+    logger->set_dedup(false);
+    GFC_LOG_WARN(logger) << "retrying";
+    GFC_LOG_WARN(logger) << "retrying";
+    CHECK(out->take().size() == 2);
+}
+
+int main() {
+    test_every_n();
+    test_first_n();
+    test_rate();
+    test_below_level_not_counted();
+    test_report_suppressed();
+    test_dedup();
+    std::cout << "test_log_limit passed" << std::endl;
+    return 0;
+}
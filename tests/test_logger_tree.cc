@@ -0,0 +1,131 @@
+#include "../gfc-logger-system/logger.hh"
+#include "test_util.hh"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+class CountingAppender : public gfc::LogAppender {
+public:
+    void log(const gfc::LogEvent::ptr&) override { m_count.fetch_add(1, std::memory_order_relaxed); }
+    std::atomic<size_t> m_count{0};
+};
+
+static void test_tree_shape() {
+    gfc::LoggerManager& manager = gfc::LoggerManager::get_instance();
+    CHECK(manager.find_logger("db.pool") == nullptr);
+
+    auto conn = manager.get_logger("db.pool.conn");
+    auto pool = manager.find_logger("db.pool");
+    auto db = manager.find_logger("db");
+    CHECK(pool != nullptr && db != nullptr);
+    CHECK(conn->get_parent() == pool.get());
+    CHECK(pool->get_parent() == db.get());
+    CHECK(db->get_parent() == manager.get_root_logger().get());
+    CHECK(manager.get_logger("db.pool.conn") == conn);
+    CHECK(manager.find_logger("db.missing") == nullptr);
+}
+
+static void test_level_inheritance() {
+    gfc::LoggerManager& manager = gfc::LoggerManager::get_instance();
+    auto conn = manager.get_logger("cache.shard.conn");
+    auto shard = manager.get_logger("cache.shard");
+    auto cache = manager.get_logger("cache");
+    CHECK(conn->get_own_level() == gfc::LogLevel::UNKNOW);
+    CHECK(conn->get_level() == manager.get_root_logger()->get_level());
+
+    cache->set_level(gfc::LogLevel::WARN);
+    CHECK(shard->get_level() == gfc::LogLevel::WARN);
+    CHECK(conn->get_level() == gfc::LogLevel::WARN);
+
+    shard->set_level(gfc::LogLevel::INFO);
+    CHECK(conn->get_level() == gfc::LogLevel::INFO);
+    cache->set_level(gfc::LogLevel::ERROR);
+    CHECK(conn->get_level() == gfc::LogLevel::INFO);    // the nearer level wins
+
+    shard->reset_level();
+    CHECK(shard->get_own_level() == gfc::LogLevel::UNKNOW);
+    CHECK(conn->get_level() == gfc::LogLevel::ERROR);
+
+    // a child created later starts out with the inherited level
+    CHECK(manager.get_logger("cache.shard.conn.retry")->get_level() == gfc::LogLevel::ERROR);
+}
+
+static void test_appender_inheritance() {
+    gfc::LoggerManager& manager = gfc::LoggerManager::get_instance();
+    auto app = manager.get_logger("app");
+    auto http = manager.get_logger("app.http");
+    auto top = std::make_shared<CountingAppender>();
+    auto own = std::make_shared<CountingAppender>();
+    app->add_appender(top);
+    http->add_appender(own);
+
+    GFC_LOG_INFO(http) << "to both";
+    CHECK(own->m_count.load() == 1);
+    CHECK(top->m_count.load() == 1);
+    GFC_LOG_INFO(app) << "to the parent only";
+    CHECK(own->m_count.load() == 1);
+    CHECK(top->m_count.load() == 2);
+
+    http->set_additive(false);
+    GFC_LOG_INFO(http) << "kept to itself";
+    CHECK(own->m_count.load() == 2);
+    CHECK(top->m_count.load() == 2);
+    http->set_additive(true);
+
+    // the child's level decides, whatever the parent's
+    app->set_level(gfc::LogLevel::ERROR);
+    http->set_level(gfc::LogLevel::DEBUG);
+    GFC_LOG_DEBUG(http) << "debug";
+    CHECK(top->m_count.load() == 3);
+}
+
+static void test_add_logger_adopts_children() {
+    gfc::LoggerManager& manager = gfc::LoggerManager::get_instance();
+    auto worker = manager.get_logger("svc.worker");
+    auto placeholder = manager.find_logger("svc");
+
+    auto svc = std::make_shared<gfc::Logger>("svc");
+    svc->set_level(gfc::LogLevel::ERROR);
+    auto counter = std::make_shared<CountingAppender>();
+    svc->add_appender(counter);
+    manager.add_logger("svc", svc);
+
+    CHECK(manager.find_logger("svc") == svc);
+    CHECK(worker->get_parent() == svc.get());
+    CHECK(placeholder->get_parent() == nullptr);
+    CHECK(worker->get_level() == gfc::LogLevel::ERROR);
+    GFC_LOG_ERROR(worker) << "reaches svc";
+    CHECK(counter->m_count.load() == 1);
+}
+
+static const gfc::Logger::ptr& cached_handle() {
+    return GFC_LOGGER("handles.cached");
+}
+
+static void test_cached_handle() {
+    const gfc::Logger::ptr& first = cached_handle();
+    CHECK(&first == &cached_handle());  // the same static, no second lookup
+    CHECK(first == gfc::LoggerManager::get_instance().find_logger("handles.cached"));
+
+    // the way call sites use it: looked up on the first pass only
+    auto counter = std::make_shared<CountingAppender>();
+    first->add_appender(counter);
+    first->set_level(gfc::LogLevel::INFO);
+    for(int i = 0; i < 3; ++i) {
+        GFC_LOG_INFO(GFC_LOGGER("handles.cached")) << "via the macro " << i;
+        GFC_LOG_DEBUG(GFC_LOGGER("handles.cached")) << "below the level";
+    }
+    CHECK(counter->m_count.load() == 3);
+}
+
+int main() {
+    test_tree_shape();
+    test_level_inheritance();
+    test_appender_inheritance();
+    test_add_logger_adopts_children();
+    test_cached_handle();
+    std::cout << "test_logger_tree passed" << std::endl;
+    return 0;
+}
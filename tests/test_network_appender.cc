@@ -0,0 +1,395 @@
+#include "../gfc-logger-system/network_appender.hh"
+#include "test_util.hh"
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sstream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using gfc::NetworkTransport;
+
+// Stand-in for the collector agent on loopback: keeps every message it
+// receives, unframing octet-counted streams.
+class Collector {
+public:
+    // port 0 picks a free one
+    Collector(NetworkTransport transport, int port = 0, const std::string& path = "")
+        : m_transport(transport), m_path(path) {
+        if(transport == NetworkTransport::UNIX) {
+            m_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+            unlink(path.c_str());
+            CHECK(bind(m_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+        } else {
+            m_fd = socket(AF_INET, transport == NetworkTransport::UDP ? SOCK_DGRAM : SOCK_STREAM, 0);
+            int one = 1;
+            setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            int rcvbuf = 8 * 1024 * 1024;
+            if(setsockopt(m_fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) != 0) {
+                setsockopt(m_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+            }
+            sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port = htons(port);
+            CHECK(bind(m_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+            socklen_t len = sizeof(addr);
+            getsockname(m_fd, reinterpret_cast<sockaddr*>(&addr), &len);
+            m_port = ntohs(addr.sin_port);
+        }
+        if(transport != NetworkTransport::UDP) {
+            CHECK(listen(m_fd, 16) == 0);
+        }
+        m_thread = std::thread(&Collector::run, this);
+    }
+    ~Collector() { stop(); }
+
+    std::string get_address() const {
+        return m_transport == NetworkTransport::UNIX ? m_path : "127.0.0.1:" + std::to_string(m_port);
+    }
+    int get_port() const { return m_port; }
+
+    std::vector<std::string> get_messages() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_messages;
+    }
+    size_t count() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_messages.size();
+    }
+    bool wait_for(size_t n, std::chrono::milliseconds timeout = std::chrono::milliseconds(5000)) {
+        auto end = std::chrono::steady_clock::now() + timeout;
+        while(count() < n) {
+            if(std::chrono::steady_clock::now() > end) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        return true;
+    }
+
+    // closes the listening socket and every connection
+    void stop() {
+        if(!m_thread.joinable()) {
+            return;
+        }
+        m_stop.store(true);
+        m_thread.join();
+        close(m_fd);
+        if(m_transport == NetworkTransport::UNIX) {
+            unlink(m_path.c_str());
+        }
+    }
+
+private:
+    struct Connection {
+        int         fd;
+        std::string buf;
+    };
+
+    void run() {
+        std::vector<Connection> conns;
+        std::vector<char> buf(70000);
+        while(!m_stop.load()) {
+            std::vector<pollfd> fds = {{m_fd, POLLIN, 0}};
+            for(auto& conn : conns) {
+                fds.push_back({conn.fd, POLLIN, 0});
+            }
+            if(poll(fds.data(), fds.size(), 20) <= 0) {
+                continue;
+            }
+            if(fds[0].revents & POLLIN) {
+                if(m_transport == NetworkTransport::UDP) {
+                    ssize_t n;
+                    while((n = recv(m_fd, buf.data(), buf.size(), MSG_DONTWAIT)) > 0) {
+                        add(std::string(buf.data(), n));
+                    }
+                } else {
+                    int fd = accept(m_fd, nullptr, nullptr);
+                    if(fd >= 0) {
+                        conns.push_back({fd, ""});
+                    }
+                }
+            }
+            for(size_t i = 1; i < fds.size(); ++i) {
+                if(!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                    continue;
+                }
+                Connection& conn = conns[i - 1];
+                ssize_t n = recv(conn.fd, buf.data(), buf.size(), 0);
+                if(n <= 0) {
+                    close(conn.fd);
+                    conn.fd = -1;
+                    continue;
+                }
+                conn.buf.append(buf.data(), n);
+                unframe(conn.buf);
+            }
+            std::erase_if(conns, [](const Connection& conn) { return conn.fd < 0; });
+        }
+        for(auto& conn : conns) {
+            close(conn.fd);
+        }
+    }
+
+    // "<length> <message>" frames
+    void unframe(std::string& data) {
+        size_t pos = 0;
+        for(;;) {
+            size_t space = data.find(' ', pos);
+            if(space == std::string::npos) {
+                break;
+            }
+            size_t len = std::stoul(data.substr(pos, space - pos));
+            if(data.size() - space - 1 < len) {
+                break;
+            }
+            add(data.substr(space + 1, len));
+            pos = space + 1 + len;
+        }
+        data.erase(0, pos);
+    }
+
+    void add(std::string message) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_messages.push_back(std::move(message));
+    }
+
+private:
+    NetworkTransport            m_transport;
+    std::string                 m_path;
+    int                         m_fd = -1;
+    int                         m_port = 0;
+    std::atomic<bool>           m_stop{false};
+    std::mutex                  m_mutex;
+    std::vector<std::string>    m_messages;
+    std::thread                 m_thread;
+};
+
+static std::vector<std::string> split(const std::string& text, size_t max_parts) {
+    std::vector<std::string> parts;
+    size_t pos = 0;
+    while(parts.size() + 1 < max_parts) {
+        size_t space = text.find(' ', pos);
+        if(space == std::string::npos) {
+            break;
+        }
+        parts.push_back(text.substr(pos, space - pos));
+        pos = space + 1;
+    }
+    parts.push_back(text.substr(pos));
+    return parts;
+}
+
+static gfc::Logger::ptr make_logger(const std::string& name, const gfc::LogAppender::ptr& appender) {
+    auto logger = std::make_shared<gfc::Logger>(name);
+    logger->add_appender(appender);
+    appender->set_formatter(std::make_shared<gfc::LogFormatter>("%m%n"));
+    return logger;
+}
+
+// A port nothing listens on: where a collector was a moment ago.
+static int dead_port() {
+    Collector collector(NetworkTransport::TCP);
+    return collector.get_port();
+}
+
+static void test_udp() {
+    Collector collector(NetworkTransport::UDP);
+    auto appender = std::make_shared<gfc::NetworkLogAppender>(NetworkTransport::UDP, collector.get_address());
+    auto logger = make_logger("net.udp", appender);
+
+    const int kRounds = 5, kPerRound = 100;
+    for(int round = 0; round < kRounds; ++round) {
+        for(int i = 0; i < kPerRound; ++i) {
+            GFC_LOG_INFO(logger) << "message " << round * kPerRound + i;
+        }
+        appender->flush();
+        CHECK(collector.wait_for((round + 1) * kPerRound));
+    }
+    std::vector<std::string> messages = collector.get_messages();
+    CHECK(messages.size() == kRounds * kPerRound);
+    for(size_t i = 0; i < messages.size(); ++i) {
+        std::vector<std::string> parts = split(messages[i], 8);
+        CHECK(parts.size() == 8);
+        CHECK(parts[0] == "<14>1");     // user.info
+        CHECK(parts[1].size() == 27 && parts[1][10] == 'T' && parts[1].back() == 'Z');
+        CHECK(parts[3] == "test_network_appender");
+        CHECK(parts[4] == std::to_string(getpid()));
+        CHECK(parts[5] == "net.udp");
+        CHECK(parts[6] == "-");
+        CHECK(parts[7] == "message " + std::to_string(i));
+    }
+    // several datagrams per sendmmsg
+    gfc::AppenderStats stats = appender->get_stats();
+    CHECK(stats.events == kRounds * kPerRound);
+    CHECK(stats.writes <= kRounds * 4);
+    CHECK(stats.dropped == 0 && stats.queue_depth == 0);
+
+    // ERROR goes out at once, long messages are cut
+    appender->set_flush_interval(std::chrono::milliseconds(60000));
+    appender->set_facility(16);
+    appender->set_app_name("my app");
+    appender->set_max_message(100);
+    GFC_LOG_ERROR(logger) << std::string(500, 'x');
+    CHECK(collector.wait_for(kRounds * kPerRound + 1, std::chrono::milliseconds(2000)));
+    std::string last = collector.get_messages().back();
+    CHECK(last.size() == 100);
+    CHECK(last.compare(0, 7, "<131>1 ") == 0);     // local0.err
+    CHECK(split(last, 8)[3] == "my_app");
+}
+
+static void test_tcp_throughput() {
+    Collector collector(NetworkTransport::TCP);
+    auto appender = std::make_shared<gfc::NetworkLogAppender>(NetworkTransport::TCP, collector.get_address());
+    auto logger = make_logger("net.tcp", appender);
+
+    const int kThreads = 2, kPerThread = 20000;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for(int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            for(int i = 0; i < kPerThread; ++i) {
+                GFC_LOG_INFO(logger) << t << " " << i;
+            }
+        });
+    }
+    for(auto& th : threads) {
+        th.join();
+    }
+    appender->flush();
+    CHECK(collector.wait_for(kThreads * kPerThread, std::chrono::milliseconds(10000)));
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "tcp: " << static_cast<int>(kThreads * kPerThread / seconds) << " messages/s" << std::endl;
+
+    // nothing lost, and each thread's messages in order
+    std::vector<int> next(kThreads, 0);
+    for(const std::string& message : collector.get_messages()) {
+        std::vector<std::string> parts = split(message, 9);
+        CHECK(parts.size() == 9);
+        int t = std::stoi(parts[7]);
+        CHECK(std::stoi(parts[8]) == next[t]);
+        ++next[t];
+    }
+    CHECK(next == std::vector<int>(kThreads, kPerThread));
+    gfc::AppenderStats stats = appender->get_stats();
+    CHECK(stats.writes * 20 < stats.events);
+    CHECK(stats.dropped == 0);
+    CHECK(appender->is_connected());
+}
+
+static void test_unix() {
+    std::string path = "/tmp/gfc-net-" + std::to_string(getpid()) + ".sock";
+    Collector collector(NetworkTransport::UNIX, 0, path);
+    auto appender = std::make_shared<gfc::NetworkLogAppender>(NetworkTransport::UNIX, path);
+    auto logger = make_logger("net.unix", appender);
+    for(int i = 0; i < 100; ++i) {
+        GFC_LOG_WARN(logger) << "line\n" << i;
+    }
+    appender->flush();
+    CHECK(collector.wait_for(100));
+    std::vector<std::string> messages = collector.get_messages();
+    CHECK(messages.front().compare(0, 6, "<12>1 ") == 0);  // user.warning
+    CHECK(split(messages.back(), 8)[7] == "line\n99");
+}
+
+// Logging goes on while the collector is away; messages wait and are sent
+// once it is back.
+static void test_outage() {
+    int port = dead_port();
+    auto appender = std::make_shared<gfc::NetworkLogAppender>(NetworkTransport::TCP,
+                                                              "127.0.0.1:" + std::to_string(port));
+    appender->set_reconnect_backoff(std::chrono::milliseconds(10), std::chrono::milliseconds(50));
+    auto logger = make_logger("net.outage", appender);
+
+    auto slowest = std::chrono::nanoseconds(0);
+    for(int i = 0; i < 500; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        GFC_LOG_ERROR(logger) << "early " << i;
+        slowest = std::max(slowest, std::chrono::steady_clock::now() - start);
+    }
+    CHECK(slowest < std::chrono::milliseconds(50));
+    auto start = std::chrono::steady_clock::now();
+    appender->flush();
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(500));
+    CHECK(!appender->is_connected());
+    CHECK(appender->get_stats().queue_depth == 500);
+
+    {
+        Collector collector(NetworkTransport::TCP, port);
+        CHECK(collector.wait_for(500));
+        CHECK(collector.get_messages().back().ends_with(" early 499"));
+    }
+    // the collector went away again, and comes back
+    for(int i = 0; i < 100; ++i) {
+        GFC_LOG_INFO(logger) << "late " << i;
+    }
+    appender->flush();
+    Collector collector(NetworkTransport::TCP, port);
+    CHECK(collector.wait_for(100));
+    CHECK(collector.get_messages().front().ends_with(" late 0"));
+    CHECK(appender->get_reconnect_count() >= 1);
+    CHECK(appender->get_dropped_count() == 0);
+}
+
+// With the collector gone the buffer stays within max_buffer; what did not
+// fit is dropped and counted, the rest is sent once it is back.
+static void test_bounded_buffer() {
+    int port = dead_port();
+    auto appender = std::make_shared<gfc::NetworkLogAppender>(NetworkTransport::TCP,
+                                                              "127.0.0.1:" + std::to_string(port));
+    appender->set_reconnect_backoff(std::chrono::milliseconds(10), std::chrono::milliseconds(50));
+    appender->set_max_buffer(8 * 1024);
+    auto logger = make_logger("net.bounded", appender);
+    for(int i = 0; i < 1000; ++i) {
+        GFC_LOG_INFO(logger) << "event " << i;
+    }
+    gfc::AppenderStats stats = appender->get_stats();
+    CHECK(stats.events == 1000);
+    CHECK(stats.dropped > 800);
+    CHECK(stats.queue_depth == 1000 - stats.dropped);
+
+    Collector collector(NetworkTransport::TCP, port);
+    CHECK(collector.wait_for(1000 - stats.dropped));
+    // the oldest were kept
+    CHECK(collector.get_messages().front().ends_with(" event 0"));
+    collector.stop();
+
+    // stop() gives up after the flush timeout
+    appender->set_flush_timeout(std::chrono::milliseconds(100));
+    for(int i = 0; i < 10; ++i) {
+        GFC_LOG_INFO(logger) << "lost " << i;
+    }
+    uint64_t dropped = appender->get_dropped_count();
+    auto start = std::chrono::steady_clock::now();
+    appender->stop();
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(1000));
+    CHECK(appender->get_dropped_count() == dropped + 10);
+    GFC_LOG_INFO(logger) << "after stop";
+    CHECK(appender->get_dropped_count() == dropped + 11);
+}
+
+int main() {
+    test_udp();
+    test_tcp_throughput();
+    test_unix();
+    test_outage();
+    test_bounded_buffer();
+    std::cout << "test_network_appender passed" << std::endl;
+    return 0;
+}
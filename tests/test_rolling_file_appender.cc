@@ -0,0 +1,188 @@
+#include "../gfc-logger-system/rolling_file_appender.hh"
+#include "test_util.hh"
+
+#include <algorithm>
+#include <dirent.h>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+#ifdef GFC_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+static std::string temp_dir() {
+    char path[] = "/tmp/gfc-rolling-XXXXXX";
+    CHECK(mkdtemp(path) != nullptr);
+    return path;
+}
+
+static std::vector<std::string> list_dir(const std::string& dir) {
+    std::vector<std::string> names;
+    DIR* d = opendir(dir.c_str());
+    CHECK(d != nullptr);
+    while(struct dirent* entry = readdir(d)) {
+        std::string name = entry->d_name;
+        if(name != "." && name != "..") {
+            names.push_back(name);
+        }
+    }
+    closedir(d);
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+static void remove_dir(const std::string& dir) {
+    for(const std::string& name : list_dir(dir)) {
+        unlink((dir + "/" + name).c_str());
+    }
+    rmdir(dir.c_str());
+}
+
+static std::string read_file(const std::string& path) {
+    if(path.size() > 3 && path.compare(path.size() - 3, 3, ".gz") == 0) {
+#ifdef GFC_HAVE_ZLIB
+        gzFile in = gzopen(path.c_str(), "rb");
+        CHECK(in != nullptr);
+        std::string data;
+        char buf[4096];
+        int n;
+        while((n = gzread(in, buf, sizeof(buf))) > 0) {
+            data.append(buf, n);
+        }
+        gzclose(in);
+        return data;
+#else
+        CHECK(!"compressed archive without zlib");
+#endif
+    }
+    std::ifstream in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+static gfc::Logger::ptr make_logger(gfc::LogAppender::ptr appender) {
+    auto logger = std::make_shared<gfc::Logger>("rolling");
+    logger->set_formatter(std::make_shared<gfc::LogFormatter>("%m%n"));
+    logger->add_appender(appender);
+    return logger;
+}
+
+// Every line ends up in exactly one file, in order, and no file grows far
+// past the size limit.
+static void test_size_rotation() {
+    std::string dir = temp_dir();
+    std::string path = dir + "/app.log";
+    auto appender = std::make_shared<gfc::RollingFileLogAppender>(path, 1000);
+    appender->set_max_archives(0);
+    auto logger = make_logger(appender);
+
+    for(int i = 0; i < 35; ++i) {
+        GFC_LOG_INFO(logger) << "line " << (100 + i) << std::string(91, '.');   // 100 bytes
+    }
+    appender->flush();
+    appender->wait_for_archiving();
+    CHECK(appender->get_rotation_count() == 3);
+
+    std::vector<std::string> names = list_dir(dir);
+    CHECK(names.size() == 4);
+    // archives started within the same second only differ in their -N
+    // suffix, so order them by content
+    std::vector<std::string> archives;
+    for(const std::string& name : names) {
+        if(name != "app.log") {
+#ifdef GFC_HAVE_ZLIB
+            CHECK(name.size() > 3 && name.compare(name.size() - 3, 3, ".gz") == 0);
+#endif
+            archives.push_back(read_file(dir + "/" + name));
+            CHECK(archives.back().size() == 1000);
+        }
+    }
+    std::sort(archives.begin(), archives.end());
+    std::string all;
+    for(const std::string& data : archives) {
+        all += data;
+    }
+    all += read_file(path);
+    CHECK(all.size() == 3500);
+    for(int i = 0; i < 35; ++i) {
+        CHECK(all.compare(i * 100, 8, "line " + std::to_string(100 + i)) == 0);
+    }
+    logger.reset();
+    appender.reset();
+    remove_dir(dir);
+}
+
+static void test_retention() {
+    std::string dir = temp_dir();
+    std::string path = dir + "/app.log";
+    auto appender = std::make_shared<gfc::RollingFileLogAppender>(path, 100);
+    appender->set_max_archives(2);
+    appender->set_compress(false);
+    auto logger = make_logger(appender);
+
+    for(int i = 0; i < 6; ++i) {
+        GFC_LOG_INFO(logger) << i << std::string(98, '.');  // one file per line
+    }
+    appender->flush();
+    appender->wait_for_archiving();
+    CHECK(appender->get_rotation_count() == 5);
+
+    // the two newest archives survive, uncompressed
+    std::vector<std::string> names = list_dir(dir);
+    CHECK(names.size() == 3);
+    std::vector<std::string> kept;
+    for(const std::string& name : names) {
+        if(name != "app.log") {
+            kept.push_back(read_file(dir + "/" + name).substr(0, 1));
+        }
+    }
+    std::sort(kept.begin(), kept.end());
+    CHECK(kept == std::vector<std::string>({"3", "4"}));
+    CHECK(read_file(path).substr(0, 1) == "5");
+    logger.reset();
+    appender.reset();
+    remove_dir(dir);
+}
+
+// Events are filed by their own timestamp: the first one past the hour
+// boundary starts a new file.
+static void test_time_rotation() {
+    std::string dir = temp_dir();
+    std::string path = dir + "/app.log";
+    auto appender = std::make_shared<gfc::RollingFileLogAppender>(path, 0, gfc::RollingInterval::HOURLY);
+    appender->set_formatter(std::make_shared<gfc::LogFormatter>("%m%n"));
+    appender->set_compress(false);
+
+    auto now = std::chrono::system_clock::now();
+    const gfc::LogSite& site = gfc::intern_log_site(__FILE__, __LINE__, __func__, gfc::LogLevel::INFO);
+    auto log_at = [&](std::chrono::system_clock::time_point time, const char* text) {
+        auto event = gfc::LogEvent::create(site, 0, 0, 0, time, gfc::intern_logger_name("rolling"));
+        event->set_content(text);
+        appender->log(event);
+    };
+    log_at(now, "this hour");
+    log_at(now + std::chrono::hours(1), "next hour");
+    log_at(now + std::chrono::hours(1) + std::chrono::seconds(1), "still next hour");
+    appender->flush();
+    appender->wait_for_archiving();
+    CHECK(appender->get_rotation_count() == 1);
+
+    std::vector<std::string> names = list_dir(dir);
+    CHECK(names.size() == 2);
+    CHECK(names[0] == "app.log");
+    CHECK(names[1].compare(0, 8, "app.log.") == 0);
+    CHECK(read_file(dir + "/" + names[1]) == "this hour\n");
+    CHECK(read_file(path) == "next hour\nstill next hour\n");
+    appender.reset();
+    remove_dir(dir);
+}
+
+int main() {
+    test_size_rotation();
+    test_retention();
+    test_time_rotation();
+    std::cout << "test_rolling_file_appender passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,292 @@
+#include "../gfc-logger-system/segment_log.hh"
+#include "test_util.hh"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+static const char* kPattern = "%d{%Y-%m-%d %H:%M:%S} %p %c %t %r [%f:%l] %m%K%n";
+
+static size_t file_size(const std::string& path) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    return in.tellg();
+}
+
+// Formats what it is given, to compare with what comes back from a segment.
+class CaptureAppender : public gfc::LogAppender {
+public:
+    typedef std::shared_ptr<CaptureAppender> ptr;
+    void log(const gfc::LogEvent::ptr& event) override {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_formatter->format(text, *event);
+    }
+    std::string text;
+};
+
+static std::string render(const gfc::SegmentReader& reader, const gfc::SegmentQuery& query, unsigned threads) {
+    std::ostringstream out;
+    CHECK(reader.render(query, gfc::LogFormatter(kPattern), threads, out));
+    return out.str();
+}
+
+static void test_round_trip() {
+    std::string path = temp_path("gfc-segment-test");
+    auto segment = std::make_shared<gfc::SegmentLogAppender>(path, 4096);
+    auto capture = std::make_shared<CaptureAppender>();
+    auto logger = std::make_shared<gfc::Logger>("segment.test");
+    logger->set_level(gfc::LogLevel::DEBUG);
+    logger->add_appender(segment);
+    logger->add_appender(capture);
+    capture->set_formatter(std::make_shared<gfc::LogFormatter>(kPattern));
+
+    for(int i = 0; i < 2000; ++i) {
+        GFC_LOG_INFO(logger) << "request " << i << " served";
+        GFC_LOG_DEBUG(logger).kv("user", "alice").kv("id", i).kv("big", uint64_t(1) << 63)
+            .kv("ratio", i * 0.5).kv("ok", i % 2 == 0) << "fields";
+        if(i % 500 == 0) {
+            std::thread([&]() { GFC_LOG_WARN(logger) << "from another thread"; }).join();
+        }
+    }
+    GFC_LOG_ERROR(logger) << std::string(10000, 'x');     // bigger than a block
+    segment->close();
+    CHECK(segment->get_block_count() > 10);
+    GFC_LOG_INFO(logger) << "after close";                // ignored by the segment
+
+    gfc::SegmentReader reader;
+    CHECK(reader.open(path));
+    CHECK(reader.has_index());
+    CHECK(!reader.is_corrupt());
+    CHECK(reader.get_blocks().size() == segment->get_block_count());
+    std::string expected = capture->text.substr(0, capture->text.rfind("after close"));
+    expected = expected.substr(0, expected.rfind('\n') + 1);
+    CHECK(render(reader, gfc::SegmentQuery(), 1) == expected);
+    CHECK(render(reader, gfc::SegmentQuery(), 4) == expected);
+
+    std::vector<gfc::LogEvent::ptr> events;
+    CHECK(reader.read(gfc::SegmentQuery(), events));
+    CHECK(events.size() == 4005);
+    CHECK(events[1]->get_level() == gfc::LogLevel::DEBUG);
+    CHECK(events[1]->get_logger_name() == "segment.test");
+    CHECK(std::string(events[1]->get_file_name()) == __FILE__);
+    CHECK(events[1]->get_fields().size() == 5);
+    CHECK(events.back()->get_content().size() == 10000);
+    unlink(path.c_str());
+}
+
+// 10000 events one second apart, from three loggers at every level
+static const int64_t kStart = 1700000000LL * 1000000000LL;
+static const char* kLoggers[] = {"app", "app.db", "net"};
+
+static std::string write_synthetic(size_t block_size) {
+    std::string path = temp_path("gfc-segment-test");
+    auto segment = std::make_shared<gfc::SegmentLogAppender>(path, block_size);
+    const gfc::LogSite* sites[5];
+    for(int level = 1; level <= 5; ++level) {
+        sites[level - 1] = &gfc::intern_log_site(__FILE__, level, __func__, static_cast<gfc::LogLevel>(level));
+    }
+    for(int i = 0; i < 10000; ++i) {
+        // FATAL seals a block, keep it rare
+        const gfc::LogSite& site = *sites[i % 1000 == 999 ? 4 : i % 4];
+        auto event = gfc::LogEvent::create(site, 1, 0, i, std::chrono::system_clock::time_point(
+            std::chrono::nanoseconds(kStart + i * 1000000000LL)), gfc::intern_logger_name(kLoggers[i % 3]));
+        event->set_content("event " + std::to_string(i));
+        segment->log(event);
+    }
+    segment->close();
+    return path;
+}
+
+static int event_number(const gfc::LogEvent::ptr& event) {
+    return atoi(event->get_content().c_str() + 6);
+}
+
+static void test_queries() {
+    std::string path = write_synthetic(4096);
+    gfc::SegmentReader reader;
+    CHECK(reader.open(path));
+    size_t blocks = reader.get_blocks().size();
+    CHECK(blocks > 20);
+
+    gfc::SegmentQuery range;
+    range.from_ns = kStart + 5000 * 1000000000LL;
+    range.to_ns = kStart + 5300 * 1000000000LL;
+    CHECK(reader.select(range).size() * 10 < blocks);
+    std::vector<gfc::LogEvent::ptr> events;
+    CHECK(reader.read(range, events));
+    CHECK(events.size() == 300);
+    for(size_t i = 0; i < events.size(); ++i) {
+        CHECK(event_number(events[i]) == 5000 + static_cast<int>(i));
+        CHECK(events[i]->get_time_ns() == kStart + (5000 + static_cast<int64_t>(i)) * 1000000000LL);
+        CHECK(events[i]->get_elapse() == 5000 + i);
+    }
+
+    gfc::SegmentQuery errors;
+    errors.min_level = gfc::LogLevel::ERROR;
+    events.clear();
+    CHECK(reader.read(errors, events));
+    size_t fatal = 0;
+    for(const auto& event : events) {
+        int i = event_number(event);
+        CHECK(i % 4 == 3 || i % 1000 == 999);
+        fatal += event->get_level() == gfc::LogLevel::FATAL;
+    }
+    CHECK(events.size() == 2500);               // every i % 1000 == 999 has i % 4 == 3
+    CHECK(fatal == 10);
+
+    gfc::SegmentQuery app;
+    app.loggers.push_back("app");
+    events.clear();
+    CHECK(reader.read(app, events));
+    CHECK(events.size() == 6667);
+    for(const auto& event : events) {
+        CHECK(event->get_logger_name() == "app" || event->get_logger_name() == "app.db");
+    }
+
+    gfc::SegmentQuery combined = range;
+    combined.min_level = gfc::LogLevel::ERROR;
+    combined.loggers.push_back("app.db");
+    combined.loggers.push_back("ap");           // not a parent of app
+    events.clear();
+    CHECK(reader.read(combined, events));
+    for(const auto& event : events) {
+        int i = event_number(event);
+        CHECK(i >= 5000 && i < 5300 && i % 3 == 1 && i % 4 == 3);
+    }
+    CHECK(events.size() == 25);
+
+    gfc::SegmentQuery nothing;
+    nothing.loggers.push_back("missing");
+    CHECK(reader.select(nothing).empty());
+    unlink(path.c_str());
+}
+
+static void test_compression() {
+#ifdef GFC_HAVE_ZLIB
+    std::string path = write_synthetic(256 * 1024);
+    gfc::SegmentReader reader;
+    CHECK(reader.open(path));
+    std::ostringstream text;
+    CHECK(reader.render(gfc::SegmentQuery(), gfc::LogFormatter(), 2, text));
+    CHECK(file_size(path) * 5 < text.str().size());
+    for(const gfc::SegmentBlockIndex* block : reader.get_blocks()) {
+        CHECK(block->codec == gfc::SegmentBlockIndex::ZLIB);
+    }
+    unlink(path.c_str());
+#endif
+}
+
+static void test_without_index() {
+    std::string path = temp_path("gfc-segment-test");
+    auto segment = std::make_shared<gfc::SegmentLogAppender>(path, 1024);
+    auto logger = std::make_shared<gfc::Logger>("unindexed");
+    logger->add_appender(segment);
+    for(int i = 0; i < 300; ++i) {
+        GFC_LOG_INFO(logger) << "line " << i;
+    }
+    segment->flush();
+    {
+        // as after a crash: no index yet
+        gfc::SegmentReader reader;
+        CHECK(reader.open(path));
+        CHECK(!reader.has_index());
+        CHECK(!reader.is_corrupt());
+        std::vector<gfc::LogEvent::ptr> events;
+        CHECK(reader.read(gfc::SegmentQuery(), events));
+        CHECK(events.size() == 300);
+        CHECK(events[299]->get_content() == "line 299");
+    }
+
+    // the open block is written once it has waited for the flush interval
+    segment->set_flush_interval(std::chrono::milliseconds(20));
+    GFC_LOG_INFO(logger) << "late";
+    for(int i = 0; i < 200; ++i) {
+        gfc::SegmentReader reader;
+        CHECK(reader.open(path));
+        std::vector<gfc::LogEvent::ptr> events;
+        reader.read(gfc::SegmentQuery(), events);
+        if(events.size() == 301) {
+            break;
+        }
+        CHECK(i < 199);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    segment->close();
+
+    // cut in the middle of the last block, the one with "late"
+    uint64_t last;
+    {
+        gfc::SegmentReader reader;
+        CHECK(reader.open(path));
+        CHECK(reader.has_index());
+        last = reader.get_blocks().back()->offset;
+    }
+    CHECK(truncate(path.c_str(), last + 70) == 0);
+    gfc::SegmentReader cut;
+    CHECK(cut.open(path));
+    CHECK(!cut.has_index());
+    CHECK(!cut.is_corrupt());
+    CHECK(cut.is_truncated());
+    std::vector<gfc::LogEvent::ptr> events;
+    CHECK(cut.read(gfc::SegmentQuery(), events));
+    CHECK(events.size() == 300);
+
+    // what follows the last block is no block at all
+    CHECK(truncate(path.c_str(), last) == 0);
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::app);
+        out << std::string(200, 'x');
+    }
+    gfc::SegmentReader garbage;
+    CHECK(garbage.open(path));
+    CHECK(garbage.is_corrupt());
+    CHECK(!garbage.is_truncated());
+    events.clear();
+    CHECK(garbage.read(gfc::SegmentQuery(), events));
+    CHECK(events.size() == 300);
+    unlink(path.c_str());
+}
+
+static void test_corrupt_block() {
+    std::string path = write_synthetic(4096);
+    gfc::SegmentReader clean;
+    CHECK(clean.open(path));
+    uint64_t offset = clean.get_blocks()[3]->offset + 100;
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(offset);
+        file.put('\xff');
+    }
+    gfc::SegmentReader reader;
+    CHECK(reader.open(path));
+    std::vector<gfc::LogEvent::ptr> events;
+    CHECK(reader.read_block(2, gfc::SegmentQuery(), events));
+    CHECK(!reader.read_block(3, gfc::SegmentQuery(), events));
+    events.clear();
+    CHECK(!reader.read(gfc::SegmentQuery(), events));
+    CHECK(events.size() > 9000 && events.size() < 10000);   // all but one block
+    unlink(path.c_str());
+}
+
+static void test_reject_other_files() {
+    std::string path = temp_path("gfc-segment-test");
+    {
+        std::ofstream out(path);
+        out << "2026-10-16 22:50:00 [INFO] [root] plain text log\n";
+    }
+    gfc::SegmentReader reader;
+    CHECK(!reader.open(path));
+    unlink(path.c_str());
+}
+
+int main() {
+    test_round_trip();
+    test_queries();
+    test_compression();
+    test_without_index();
+    test_corrupt_block();
+    test_reject_other_files();
+    std::cout << "test_segment_log passed" << std::endl;
+    return 0;
+}
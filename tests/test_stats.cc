@@ -0,0 +1,127 @@
+#include "../gfc-logger-system/async_appender.hh"
+#include "test_util.hh"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static void test_sharded_counters() {
+    gfc::ShardedCounters<2> counters;
+    std::vector<std::thread> threads;
+    for(int t = 0; t < 12; ++t) {
+        threads.emplace_back([&]() {
+            for(int i = 0; i < 10000; ++i) {
+                counters.add(0);
+                counters.add(1, 3);
+            }
+        });
+    }
+    for(auto& thread : threads) {
+        thread.join();
+    }
+    CHECK(counters.get(0) == 120000);
+    CHECK(counters.snapshot()[1] == 360000);
+}
+
+static void test_histogram() {
+    gfc::LatencyHistogram histogram;
+    for(int i = 0; i < 990; ++i) {
+        histogram.record(100);
+    }
+    for(int i = 0; i < 10; ++i) {
+        histogram.record(1000000);
+    }
+    auto snap = histogram.snapshot();
+    CHECK(snap.count == 1000);
+    CHECK(snap.sum_ns == 990 * 100 + 10 * 1000000);
+    CHECK(snap.percentile_ns(50) == 127);
+    CHECK(snap.percentile_ns(99) == 127);
+    CHECK(snap.percentile_ns(99.9) == (1 << 20) - 1);
+}
+
+static void test_logger_and_formatter() {
+    auto logger = gfc::LoggerManager::get_instance().get_logger("stats.pipeline");
+    logger->set_level(gfc::LogLevel::INFO);
+    auto formatter = std::make_shared<gfc::LogFormatter>("%m");
+    logger->set_formatter(formatter);
+
+    char path[] = "/tmp/gfc-stats-XXXXXX";
+    close(mkstemp(path));
+    auto file = std::make_shared<gfc::FileLogAppender>(path);
+    logger->add_appender(file);
+
+    gfc::set_stats_timing(true);
+    for(int i = 0; i < 3; ++i) {
+        GFC_LOG_INFO(logger) << "12345";
+    }
+    GFC_LOG_ERROR(logger) << "failure";
+    // the macros skip disabled levels before an event exists; Logger::log() counts what reaches it
+    auto debug = gfc::LogEvent::create(gfc::intern_log_site(__FILE__, __LINE__, __func__, gfc::LogLevel::DEBUG),
+                                       0, 0, 0, std::chrono::system_clock::now(), logger->get_name());
+    logger->log(gfc::LogLevel::DEBUG, debug);
+    file->flush();
+    gfc::set_stats_timing(false);
+
+    gfc::LoggerStats stats = logger->get_stats();
+    CHECK(stats.emitted[static_cast<int>(gfc::LogLevel::INFO)] == 3);
+    CHECK(stats.emitted[static_cast<int>(gfc::LogLevel::ERROR)] == 1);
+    CHECK(stats.filtered[static_cast<int>(gfc::LogLevel::DEBUG)] == 1);
+
+    gfc::FormatterStats fmt = formatter->get_stats();
+    CHECK(fmt.events == 4);
+    CHECK(fmt.bytes == 3 * 5 + 7);
+    CHECK(fmt.format_time.count == 4);
+
+    gfc::AppenderStats app = file->get_stats();
+    CHECK(app.events == 4);
+    CHECK(app.bytes == 3 * 5 + 7);
+    CHECK(app.writes == 1);     // the error wrote everything through; the flush found nothing left
+    CHECK(app.flushes == 1);
+    CHECK(app.write_time.count == 1);
+
+    std::string dump = gfc::dump_stats();
+    CHECK(dump.find("logger stats.pipeline emitted=0/3/0/1/0 filtered=1/0/0/0/0") != std::string::npos);
+    CHECK(dump.find("formatter \"%m\" events=4 bytes=22") != std::string::npos);
+    unlink(path);
+}
+
+// Holds the writer thread until opened, so that the queue fills up.
+class GatedAppender : public gfc::LogAppender {
+public:
+    void log(const gfc::LogEvent::ptr&) override {
+        while(!m_open.load(std::memory_order_acquire)) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+    std::atomic<bool> m_open{false};
+};
+
+static void test_async_queue() {
+    auto gated = std::make_shared<GatedAppender>();
+    auto async = std::make_shared<gfc::AsyncLogAppender>(gated, 4, gfc::OverflowPolicy::DROP_NEWEST);
+    auto logger = std::make_shared<gfc::Logger>("stats.async");
+    logger->add_appender(async);
+    for(int i = 0; i < 20; ++i) {
+        GFC_LOG_INFO(logger) << i;
+    }
+    gfc::AppenderStats stats = async->get_stats();
+    CHECK(stats.events == 20);
+    CHECK(stats.dropped > 0);
+    CHECK(stats.queue_depth > 0);
+    CHECK(stats.queue_depth + stats.dropped <= 20);
+    gated->m_open = true;
+    async->flush();
+    CHECK(async->get_stats().queue_depth == 0);
+}
+
+int main() {
+    test_sharded_counters();
+    test_histogram();
+    test_logger_and_formatter();
+    test_async_queue();
+    std::cout << "test_stats passed" << std::endl;
+    return 0;
+}
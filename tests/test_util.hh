@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+// Minimal assertion helper shared by the test executables: report the failed
+// expression and exit non-zero so ctest marks the test as failed.
+#define CHECK(cond) \
+    do { \
+        if(!(cond)) { \
+            std::cerr << "[CHECK FAILED] " << __FILE__ << ":" << __LINE__ << ": " #cond << std::endl; \
+            std::exit(1); \
+        } \
+    } while(0)
+
+// Creates an empty file named /tmp/<prefix>-XXXXXX and returns its path.
+inline std::string temp_path(const char* prefix) {
+    std::string path = std::string("/tmp/") + prefix + "-XXXXXX";
+    int fd = mkstemp(&path[0]);
+    CHECK(fd >= 0);
+    close(fd);
+    return path;
+}
@@ -0,0 +1,129 @@
+// gfc-logcat: prints the events of segment files written by
+// gfc::SegmentLogAppender, reading only the blocks a query can match.
+//
+//     gfc-logcat [-p pattern] [--from TIME] [--to TIME] [--level LEVEL]
+//                [--logger NAME]... [-j threads] file...
+//
+// TIME is local time, "2026-10-16 22:50:00" or 2026-10-16T22:50:00 (the
+// seconds, or the whole time of day, may be left out), or @ and seconds
+// since the epoch; --from is inclusive, --to exclusive. --level prints that
+// level and above, --logger that logger and its children, and may be
+// repeated. Blocks are decompressed and formatted on -j threads, by default
+// one per CPU. The pattern uses the LogFormatter syntax and defaults to its
+// default pattern.
+
+#include "../gfc-logger-system/segment_log.hh"
+
+#include <cstring>
+#include <ctime>
+#include <strings.h>
+
+static bool parse_time(const char* s, int64_t& ns) {
+    char* end;
+    if(s[0] == '@') {
+        long long seconds = strtoll(s + 1, &end, 10);
+        if(end == s + 1 || *end) {
+            return false;
+        }
+        ns = seconds * 1000000000LL;
+        return true;
+    }
+    for(const char* format : {"%Y-%m-%d %H:%M:%S", "%Y-%m-%dT%H:%M:%S", "%Y-%m-%d %H:%M", "%Y-%m-%dT%H:%M",
+                               "%Y-%m-%d"}) {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        end = strptime(s, format, &tm);
+        if(end && !*end) {
+            tm.tm_isdst = -1;
+            ns = static_cast<int64_t>(mktime(&tm)) * 1000000000LL;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_level(const char* s, gfc::LogLevel& level) {
+    for(int i = static_cast<int>(gfc::LogLevel::DEBUG); i <= static_cast<int>(gfc::LogLevel::FATAL); ++i) {
+        if(strcasecmp(s, gfc::to_string(static_cast<gfc::LogLevel>(i))) == 0) {
+            level = static_cast<gfc::LogLevel>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+static int usage(const char* program) {
+    std::cerr << "usage: " << program << " [-p pattern] [--from TIME] [--to TIME] [--level LEVEL]"
+              << " [--logger NAME]... [-j threads] file..." << std::endl;
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    std::string pattern;
+    gfc::SegmentQuery query;
+    unsigned threads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<std::string> files;
+    for(int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if(arg[0] != '-') {
+            files.push_back(arg);
+            continue;
+        }
+        if(!value) {
+            return usage(argv[0]);
+        }
+        ++i;
+        if(strcmp(arg, "-p") == 0) {
+            pattern = value;
+        } else if(strcmp(arg, "--from") == 0) {
+            if(!parse_time(value, query.from_ns)) {
+                std::cerr << "gfc-logcat: invalid time " << value << std::endl;
+                return 2;
+            }
+        } else if(strcmp(arg, "--to") == 0) {
+            if(!parse_time(value, query.to_ns)) {
+                std::cerr << "gfc-logcat: invalid time " << value << std::endl;
+                return 2;
+            }
+        } else if(strcmp(arg, "--level") == 0) {
+            if(!parse_level(value, query.min_level)) {
+                std::cerr << "gfc-logcat: invalid level " << value << std::endl;
+                return 2;
+            }
+        } else if(strcmp(arg, "--logger") == 0) {
+            query.loggers.push_back(value);
+        } else if(strcmp(arg, "-j") == 0) {
+            threads = atoi(value);
+            if(threads == 0) {
+                return usage(argv[0]);
+            }
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    if(files.empty()) {
+        return usage(argv[0]);
+    }
+
+    gfc::LogFormatter formatter = pattern.empty() ? gfc::LogFormatter() : gfc::LogFormatter(pattern);
+    if(formatter.is_error()) {
+        std::cerr << "gfc-logcat: invalid pattern " << pattern << std::endl;
+        return 2;
+    }
+
+    int status = 0;
+    for(const std::string& file : files) {
+        gfc::SegmentReader reader;
+        if(!reader.open(file)) {
+            status = 1;
+            continue;
+        }
+        if(!reader.render(query, formatter, threads, std::cout) || reader.is_corrupt()) {
+            std::cerr << "gfc-logcat: " << file << ": skipped a corrupt block" << std::endl;
+            status = 1;
+        }
+    }
+    std::cout.flush();
+    return status;
+}
@@ -0,0 +1,59 @@
+// gfc-logdecode: renders files written by gfc::BinaryLogger as text.
+//
+//     gfc-logdecode [-p pattern] file...
+//
+// The pattern uses the LogFormatter syntax and defaults to its default pattern.
+
+#include "../gfc-logger-system/binary_log.hh"
+
+#include <cstring>
+
+int main(int argc, char** argv) {
+    std::string pattern;
+    std::vector<std::string> files;
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            pattern = argv[++i];
+        } else if(argv[i][0] == '-') {
+            std::cerr << "usage: " << argv[0] << " [-p pattern] file..." << std::endl;
+            return 2;
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if(files.empty()) {
+        std::cerr << "usage: " << argv[0] << " [-p pattern] file..." << std::endl;
+        return 2;
+    }
+
+    gfc::LogFormatter formatter = pattern.empty() ? gfc::LogFormatter() : gfc::LogFormatter(pattern);
+    if(formatter.is_error()) {
+        std::cerr << "gfc-logdecode: invalid pattern " << pattern << std::endl;
+        return 2;
+    }
+
+    int status = 0;
+    std::string out;
+    for(const std::string& file : files) {
+        gfc::BinaryLogReader reader;
+        if(!reader.open(file)) {
+            status = 1;
+            continue;
+        }
+        gfc::LogEvent::ptr event;
+        while(reader.next(event)) {
+            formatter.format(out, *event);
+            if(out.size() >= 64 * 1024) {
+                std::cout.write(out.data(), out.size());
+                out.clear();
+            }
+        }
+        std::cout.write(out.data(), out.size());
+        out.clear();
+        if(reader.is_corrupt()) {
+            std::cerr << "gfc-logdecode: " << file << ": stopped at a corrupt or truncated record" << std::endl;
+            status = 1;
+        }
+    }
+    return status;
+}